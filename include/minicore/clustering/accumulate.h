@@ -0,0 +1,280 @@
+#ifndef MINOCORE_CLUSTERING_ACCUMULATE_H__
+#define MINOCORE_CLUSTERING_ACCUMULATE_H__
+#include "minicore/util/blaze_adaptor.h"
+#include "minicore/util/csc.h"
+#include "minicore/clustering/grouping.h"
+#include <array>
+#include <numeric>
+
+namespace minicore { namespace clustering {
+
+/*
+ * Lock-free centroid accumulation
+ *
+ * accumulate_centroids computes, for each center j,
+ *     sum_{i: asn[i] == j} rowweight(i) * rowscale(i) * x_i
+ * and counts[j] = sum_{i: asn[i] == j} rowweight(i).
+ *
+ * Rows are split into contiguous chunks, and each chunk is accumulated into its own dense k x d
+ * partial without synchronization. Partials are then combined by a pairwise tree reduction,
+ * parallelized over (pair, center). This avoids serializing threads on the locks of large
+ * clusters when assignments are skewed.
+ *
+ * Partials take nchunks * k * d values; the number of chunks is capped so that
+ * this stays under MINOCORE_ACCUMULATE_MAXBYTES.
+ * If the cap would leave fewer chunks than threads (large k * d), rows are instead grouped by center
+ * with AssignmentGrouping and each center is reduced on its own (accumulate_centroids_grouped).
+ * Large clusters are split into slices so that skewed assignments still spread over threads.
+ * This needs O(k * threads) counts and one (center, row, weight) entry per contribution instead of per-thread partials.
+ *
+ * accumulate_soft_centroids does the same for fractional assignments, where each row may contribute to several centers.
+ *
+ * ctrs may be a std::vector of center vectors or a row-major blaze matrix (one center per row).
+ * Centers are overwritten with the sums; divide by counts to get means.
+ * Centers with no assigned weight are left unchanged.
+ */
+
+#ifndef MINOCORE_ACCUMULATE_MAXBYTES
+#define MINOCORE_ACCUMULATE_MAXBYTES (size_t(1) << 31)
+#endif
+
+struct UnitRowWeight {
+    constexpr double operator()(size_t) const {return 1.;}
+};
+
+namespace detail {
+
+template<typename CtrsT>
+INLINE size_t ncenters(const CtrsT &ctrs) {
+    if constexpr(blaze::IsMatrix_v<CtrsT>) return ctrs.rows();
+    else return ctrs.size();
+}
+
+template<typename CtrsT>
+INLINE decltype(auto) center_at(CtrsT &ctrs, size_t i) {
+    if constexpr(blaze::IsMatrix_v<CtrsT>) return row(ctrs, i, blaze::unchecked);
+    else return ctrs[i];
+}
+
+template<typename FT, typename Mat, typename PT>
+INLINE void add_row(PT &&prow, const Mat &mat, size_t i, FT mul) {
+    if constexpr(util::IsCSparseMatrix_v<Mat>) {
+        auto r = row(mat, i, blaze::unchecked);
+        for(size_t n = 0; n < r.n_; ++n)
+            prow[r.indices_[n]] += r.data_[n] * mul;
+    } else {
+        if(mul == FT(1)) blz::serial(prow += row(mat, i, blaze::unchecked));
+        else blz::serial(prow += row(mat, i, blaze::unchecked) * mul);
+    }
+}
+
+} // namespace detail
+
+namespace detail {
+
+/*
+ * Grouped driver: entries are bucketed by center with AssignmentGrouping (stably, in row order),
+ * then each center, or each slice of a large center, is summed into a single row.
+ */
+template<typename FT, typename Mat, typename CtrsT, typename CountsT, typename RowFunc, typename SFunc>
+void accumulate_grouped(const Mat &mat, CtrsT &ctrs, CountsT &counts, const RowFunc &forrow, const SFunc &rowscale)
+{
+    const size_t np = mat.rows(), nd = mat.columns(), k = ncenters(ctrs);
+    const size_t nt = OMP_ELSE(omp_get_max_threads(), 1);
+    // 1. Flatten contributions into (center, row, weight) entries, in row order
+    std::vector<size_t> rowoffsets(np + 1, 0);
+    OMP_PFOR
+    for(size_t i = 0; i < np; ++i)
+        forrow(i, [&](size_t, double) ALWAYS_INLINE {++rowoffsets[i + 1];});
+    std::partial_sum(rowoffsets.begin(), rowoffsets.end(), rowoffsets.begin());
+    const size_t nentries = rowoffsets.back();
+    std::unique_ptr<uint32_t[]> ectrs(new uint32_t[nentries]);
+    std::unique_ptr<uint64_t[]> erows(new uint64_t[nentries]);
+    std::unique_ptr<double[]> eweights(new double[nentries]);
+    OMP_PFOR
+    for(size_t i = 0; i < np; ++i) {
+        size_t pos = rowoffsets[i];
+        forrow(i, [&](size_t a, double w) ALWAYS_INLINE {
+            assert(a < k);
+            ectrs[pos] = a; erows[pos] = i; eweights[pos] = w;
+            ++pos;
+        });
+    }
+    // 2. Group entry ids by center
+    AssignmentGrouping<uint64_t> groups;
+    groups.build(nentries, k, [&](size_t e) {return ectrs[e];}, [](size_t e) {return uint64_t(e);});
+    const auto &offsets = groups.offsets_;
+    const uint64_t *const eids = groups.indices_.data();
+    // 3. Work items: whole centers, or slices of centers with more than slicesize entries
+    struct Item {size_t ctr, beg, end, scratch;};
+    static constexpr size_t NOSCRATCH = size_t(-1);
+    const size_t slicesize = std::max(size_t(1024), (nentries + 4 * nt - 1) / (4 * nt));
+    std::vector<Item> items;
+    std::vector<std::array<size_t, 3>> splits; // center, first scratch row, end scratch row
+    size_t nscratch = 0;
+    for(size_t j = 0; j < k; ++j) {
+        counts[j] = 0.;
+        const size_t b = offsets[j], e = offsets[j + 1];
+        if(b == e) continue;
+        if(e - b <= slicesize) {
+            items.push_back({j, b, e, NOSCRATCH});
+            continue;
+        }
+        const size_t s0 = nscratch;
+        for(size_t sb = b; sb < e; sb += slicesize)
+            items.push_back({j, sb, std::min(e, sb + slicesize), nscratch++});
+        splits.push_back({j, s0, nscratch});
+    }
+    blz::DM<FT> scratch(nscratch, nd);
+    auto group_weight = [&](size_t b, size_t e) ALWAYS_INLINE {
+        double ret = 0.;
+        for(size_t idx = b; idx < e; ++idx) ret += eweights[eids[idx]];
+        return ret;
+    };
+    auto assign_center = [&](size_t j, const auto &sum) ALWAYS_INLINE {
+        auto &&ctr = center_at(ctrs, j);
+        if constexpr(blaze::TransposeFlag_v<std::decay_t<decltype(ctr)>> == blaze::rowVector)
+            ctr = sum;
+        else
+            ctr = trans(sum);
+    };
+    // 4. Reduce items in parallel, then combine the slices of split centers in order
+    OMP_PRAGMA("omp parallel")
+    {
+        blz::DV<FT, blaze::rowVector> buf(nd);
+        OMP_PRAGMA("omp for schedule(dynamic, 1)")
+        for(size_t n = 0; n < items.size(); ++n) {
+            const auto &item = items[n];
+            auto sum_into = [&](auto &&dest) ALWAYS_INLINE {
+                dest = FT(0);
+                for(size_t idx = item.beg; idx < item.end; ++idx) {
+                    const size_t en = eids[idx], i = erows[en];
+                    add_row(dest, mat, i, FT(eweights[en] * rowscale(i)));
+                }
+            };
+            if(item.scratch != NOSCRATCH) {
+                sum_into(row(scratch, item.scratch, blaze::unchecked));
+                continue;
+            }
+            sum_into(buf);
+            counts[item.ctr] = group_weight(item.beg, item.end);
+            assign_center(item.ctr, buf);
+        }
+    }
+    OMP_PFOR
+    for(size_t n = 0; n < splits.size(); ++n) {
+        const auto [j, s0, s1] = splits[n];
+        for(size_t s = s0 + 1; s < s1; ++s)
+            blz::serial(row(scratch, s0, blaze::unchecked) += row(scratch, s, blaze::unchecked));
+        counts[j] = group_weight(offsets[j], offsets[j + 1]);
+        assign_center(j, row(scratch, s0, blaze::unchecked));
+    }
+}
+
+/*
+ * Shared driver: forrow(i, emit) calls emit(center, weight) once per center that row i contributes to.
+ * Row i is added to that center's partial scaled by weight * rowscale(i), and weight is added to its count.
+ */
+template<typename FT, typename Mat, typename CtrsT, typename CountsT, typename RowFunc, typename SFunc>
+void accumulate_impl(const Mat &mat, CtrsT &ctrs, CountsT &counts, const RowFunc &forrow, const SFunc &rowscale, int nchunks)
+{
+    const size_t np = mat.rows(), nd = mat.columns(), k = ncenters(ctrs);
+    if(nchunks <= 0) {
+        nchunks = OMP_ELSE(omp_get_max_threads(), 1);
+        const size_t perchunk = std::max(k * nd * sizeof(FT), size_t(1));
+        const size_t maxchunks = size_t(MINOCORE_ACCUMULATE_MAXBYTES) / perchunk;
+        // Partials would not fit one per thread: group rows by center instead
+        if(maxchunks < size_t(nchunks) && nchunks > 1 && np > 1) {
+            accumulate_grouped<FT>(mat, ctrs, counts, forrow, rowscale);
+            return;
+        }
+        nchunks = std::max(std::min(size_t(nchunks), maxchunks), size_t(1));
+    }
+    nchunks = std::min(size_t(nchunks), std::max(np, size_t(1)));
+    std::vector<blz::DM<FT>> partials(nchunks);
+    std::vector<blz::DV<double>> pcounts(nchunks);
+    const size_t chunksize = (np + nchunks - 1) / nchunks;
+    // 1. Unsynchronized accumulation per chunk
+    OMP_PRAGMA("omp parallel for schedule(static, 1)")
+    for(int c = 0; c < nchunks; ++c) {
+        auto &p = partials[c];
+        auto &pc = pcounts[c];
+        p.resize(k, nd);
+        p = FT(0);
+        pc.resize(k);
+        pc = 0.;
+        const size_t e = std::min(np, (c + 1) * chunksize);
+        for(size_t i = c * chunksize; i < e; ++i) {
+            const double scale = rowscale(i);
+            forrow(i, [&](size_t a, double w) ALWAYS_INLINE {
+                assert(a < k);
+                pc[a] += w;
+                add_row(row(p, a, blaze::unchecked), mat, i, FT(w * scale));
+            });
+        }
+    }
+    // 2. Pairwise tree reduction into partials[0]
+    for(size_t stride = 1; stride < size_t(nchunks); stride <<= 1) {
+        const size_t npairs = (nchunks + 2 * stride - 1) / (2 * stride);
+        OMP_PFOR
+        for(size_t idx = 0; idx < npairs * k; ++idx) {
+            const size_t lhs = (idx / k) * 2 * stride, rhs = lhs + stride, j = idx % k;
+            if(rhs >= size_t(nchunks)) continue;
+            blz::serial(row(partials[lhs], j, blaze::unchecked) += row(partials[rhs], j, blaze::unchecked));
+            pcounts[lhs][j] += pcounts[rhs][j];
+        }
+    }
+    OMP_PFOR
+    for(size_t j = 0; j < k; ++j) {
+        if((counts[j] = pcounts[0][j]) == 0.) continue;
+        auto &&ctr = center_at(ctrs, j);
+        if constexpr(blaze::TransposeFlag_v<std::decay_t<decltype(ctr)>> == blaze::rowVector)
+            ctr = row(partials[0], j, blaze::unchecked);
+        else
+            ctr = trans(row(partials[0], j, blaze::unchecked));
+    }
+}
+
+} // namespace detail
+
+template<typename FT=double, typename Mat, typename AsnT, typename CtrsT, typename CountsT, typename WFunc=UnitRowWeight, typename SFunc=UnitRowWeight>
+void accumulate_centroids(const Mat &mat, const AsnT &asn, CtrsT &ctrs, CountsT &counts,
+                          const WFunc &rowweight=WFunc(), const SFunc &rowscale=SFunc(), int nchunks=-1)
+{
+    detail::accumulate_impl<FT>(mat, ctrs, counts, [&](size_t i, const auto &emit) ALWAYS_INLINE {
+        emit(size_t(asn[i]), rowweight(i));
+    }, rowscale, nchunks);
+}
+
+/*
+ * Grouped accumulation, which accumulate_centroids falls back to when per-thread partials exceed MINOCORE_ACCUMULATE_MAXBYTES.
+ * Results match accumulate_centroids up to floating-point summation order.
+ */
+template<typename FT=double, typename Mat, typename AsnT, typename CtrsT, typename CountsT, typename WFunc=UnitRowWeight, typename SFunc=UnitRowWeight>
+void accumulate_centroids_grouped(const Mat &mat, const AsnT &asn, CtrsT &ctrs, CountsT &counts,
+                                  const WFunc &rowweight=WFunc(), const SFunc &rowscale=SFunc())
+{
+    detail::accumulate_grouped<FT>(mat, ctrs, counts, [&](size_t i, const auto &emit) ALWAYS_INLINE {
+        emit(size_t(asn[i]), rowweight(i));
+    }, rowscale);
+}
+
+/*
+ * Soft variant: row i contributes to every center stored for it in resp (a SparseResponsibilities-like CSR,
+ * exposing offsets_, indices_ and data_), with weight rowweight(i) * resp(i, j).
+ * Work is proportional to nnz(resp) rather than n * k.
+ */
+template<typename FT=double, typename Mat, typename RespT, typename CtrsT, typename CountsT, typename WFunc=UnitRowWeight, typename SFunc=UnitRowWeight>
+void accumulate_soft_centroids(const Mat &mat, const RespT &resp, CtrsT &ctrs, CountsT &counts,
+                               const WFunc &rowweight=WFunc(), const SFunc &rowscale=SFunc(), int nchunks=-1)
+{
+    detail::accumulate_impl<FT>(mat, ctrs, counts, [&](size_t i, const auto &emit) ALWAYS_INLINE {
+        const double w = rowweight(i);
+        for(size_t n = resp.offsets_[i], e = resp.offsets_[i + 1]; n < e; ++n)
+            emit(size_t(resp.indices_[n]), w * double(resp.data_[n]));
+    }, rowscale, nchunks);
+}
+
+} } // namespace minicore::clustering
+
+#endif /* MINOCORE_CLUSTERING_ACCUMULATE_H__ */
@@ -0,0 +1,449 @@
+#ifndef MINOCORE_CLUSTERING_BOUNDS_H__
+#define MINOCORE_CLUSTERING_BOUNDS_H__
+#include "minicore/dist.h"
+#include "minicore/clustering/grouping.h"
+
+namespace minicore { namespace clustering {
+
+/*
+ * AssignStats
+ * Counts point-center dissimilarity evaluations performed and avoided
+ * by the accelerated assignment engines.
+ */
+struct AssignStats {
+    uint64_t nevaluated_ = 0;
+    uint64_t nskipped_   = 0;
+    void clear() {nevaluated_ = nskipped_ = 0;}
+    uint64_t total() const {return nevaluated_ + nskipped_;}
+    double skip_fraction() const {return total() ? double(nskipped_) / total(): 0.;}
+    AssignStats &operator+=(const AssignStats &o) {
+        nevaluated_ += o.nevaluated_; nskipped_ += o.nskipped_;
+        return *this;
+    }
+};
+
+/*
+ * HamerlyAssigner
+ *
+ * Bounds-tracking hard assignment for metric dissimilarity measures.
+ * See Hamerly, "Making k-means even faster" (SDM 2010).
+ *
+ * For each point, we keep a single lower bound on its distance to every center but
+ * its own. Between calls, the lower bound is relaxed by the furthest any other center moved.
+ * A point is only compared against all k centers if its exact cost exceeds
+ * max(lower bound, half the distance from its center to the nearest other center).
+ *
+ * Costs are kept exact (the distance to the current center is always recomputed),
+ * so that the objective and D^2 restarts see the same values as brute force;
+ * stable points cost 1 evaluation instead of k.
+ *
+ * If assignments are modified externally between calls (e.g., by restarting centers),
+ * those points fall back to full scans.
+ *
+ * Only valid when dist::satisfies_metric(measure).
+ */
+template<typename FT=double, typename CtrT=blz::DV<FT, blz::rowVector>>
+class HamerlyAssigner {
+    std::vector<CtrT> prevctrs_;
+    blz::DV<double> prevsums_;
+    blz::DV<double> lower_;    // Lower bound on distance to any center except the assigned one
+    blz::DV<double> halfsep_;  // Half of the distance from each center to its nearest other center
+    blz::DV<double> drift_;    // Distance each center has moved since the last call
+    std::vector<uint32_t> asn_;
+    AssignStats stats_;
+public:
+    const AssignStats &stats() const {return stats_;}
+    void reset() {
+        prevctrs_.clear();
+        asn_.clear();
+        stats_.clear();
+    }
+
+    template<typename Mat, typename PriorT, typename AsnT, typename CostsT, typename SumT, typename RSumT>
+    void assign(const Mat &mat,
+                const dist::DissimilarityMeasure measure,
+                const PriorT &prior,
+                const std::vector<CtrT> &centers,
+                AsnT &asn,
+                CostsT &costs,
+                const SumT &centersums,
+                const RSumT &rowsums)
+    {
+        MINOCORE_REQUIRE(dist::satisfies_metric(measure), "HamerlyAssigner requires a metric");
+        const size_t np = costs.size(), k = centers.size();
+        const FT prior_sum =
+            prior.size() == 0 ? 0.
+                              : prior.size() == 1
+                              ? double(prior[0] * mat.columns())
+                              : double(blz::sum(prior));
+        auto pdist = [&](size_t id, size_t cid) ALWAYS_INLINE {
+            return msr_with_prior<FT>(measure, row(mat, id, blz::unchecked), centers[cid], prior, prior_sum, rowsums[id], centersums[cid]);
+        };
+        auto cdist = [&](const auto &lhs, const auto &rhs, double lsum, double rsum) {
+            return msr_with_prior<FT>(measure, lhs, rhs, prior, prior_sum, lsum, rsum);
+        };
+        const bool initialized = asn_.size() == np && prevctrs_.size() == k && lower_.size() == np;
+        if(!initialized) {
+            lower_.resize(np);
+            asn_.resize(np);
+        }
+        drift_.resize(k);
+        halfsep_.resize(k);
+
+        // 1. Center movement since the last call, and the two largest moves
+        double maxdrift = 0., secdrift = 0.;
+        size_t maxdriftid = k;
+        if(initialized) {
+            OMP_PFOR
+            for(size_t j = 0; j < k; ++j)
+                drift_[j] = cdist(prevctrs_[j], centers[j], prevsums_[j], centersums[j]);
+            for(size_t j = 0; j < k; ++j) {
+                if(drift_[j] > maxdrift) secdrift = maxdrift, maxdrift = drift_[j], maxdriftid = j;
+                else if(drift_[j] > secdrift) secdrift = drift_[j];
+            }
+        }
+
+        // 2. Half-distance from each center to its nearest neighboring center
+        halfsep_ = std::numeric_limits<double>::max();
+        OMP_PFOR_DYN
+        for(size_t j = 0; j < k; ++j) {
+            double mv = std::numeric_limits<double>::max();
+            for(size_t j2 = 0; j2 < k; ++j2) {
+                if(j2 == j) continue;
+                mv = std::min(mv, double(cdist(centers[j], centers[j2], centersums[j], centersums[j2])));
+            }
+            halfsep_[j] = mv * .5;
+        }
+
+        // 3. Assign points, only scanning all centers when bounds fail
+        uint64_t nevals = 0, nskipped = 0;
+        auto fullscan = [&](size_t i) {
+            double best = pdist(i, 0), second = std::numeric_limits<double>::max();
+            uint32_t bestid = 0;
+            for(size_t j = 1; j < k; ++j) {
+                const double c = pdist(i, j);
+                if(c < best) second = best, best = c, bestid = j;
+                else if(c < second) second = c;
+            }
+            costs[i] = best;
+            asn[i] = bestid;
+            asn_[i] = bestid;
+            lower_[i] = second;
+        };
+        OMP_PRAGMA("omp parallel for schedule(dynamic, 256) reduction(+:nevals,nskipped)")
+        for(size_t i = 0; i < np; ++i) {
+            if(!initialized || asn_[i] != uint32_t(asn[i])) {
+                fullscan(i);
+                nevals += k;
+                continue;
+            }
+            const uint32_t a = asn_[i];
+            const double lb = lower_[i] - (a == maxdriftid ? secdrift: maxdrift);
+            const double cost = pdist(i, a);
+            if(cost <= std::max(lb, halfsep_[a])) {
+                costs[i] = cost;
+                lower_[i] = lb;
+                nevals += 1;
+                nskipped += k - 1;
+            } else {
+                fullscan(i);
+                nevals += k + 1;
+            }
+        }
+        stats_.nevaluated_ += nevals;
+        stats_.nskipped_ += nskipped;
+        prevctrs_ = centers;
+        prevsums_.resize(k);
+        for(size_t j = 0; j < k; ++j) prevsums_[j] = centersums[j];
+        DBG_ONLY(std::fprintf(stderr, "[%s] %zu evaluated, %zu skipped\n", __func__, size_t(nevals), size_t(nskipped));)
+    }
+};
+
+/*
+ * BregmanFilterAssigner
+ *
+ * Grouped center filtering (after Yinyang k-means; Ding et al., ICML 2015) for divergences
+ * which are not metrics but are bounded below by a function of one.
+ *
+ * Each divergence D is paired with a proxy metric p and a nondecreasing lower bound f, D(x, c) >= f(p(x, c)):
+ *     JSD:                    p = JSM (sqrt(JSD)),   f(t) = t^2 (exact)
+ *     MKL, REVERSE_MKL:       p = Hellinger,         f(t) = -2 log(1 - t^2) (KL >= Renyi-1/2 divergence)
+ *     BHATTACHARYYA_DISTANCE: p = Hellinger,         f(t) = -log(1 - t^2) (exact)
+ *     ITAKURA_SAITO:          p = ||log x - log c||, f(t) = exp(-t) + t - 1
+ * All of these are computed on the same prior-smoothed distributions as msr_with_prior.
+ * For Itakura-Saito, each term u - log u - 1 (u = x_i / c_i) is at least h(|log u|) with h(s) = exp(-s) + s - 1,
+ * and h(sqrt(v)) is concave in v, so the sum is at least h of the Euclidean norm of the log-ratios.
+ * That norm is evaluated by the assigner from cached log-centers, so it needs a positive scalar prior
+ * (otherwise no centers are skipped).
+ *
+ * Each point is anchored at its current center a, and by the triangle inequality
+ *     D(x, c_j) >= f(max(0, p(c_a, c_j) - p(x, c_a))).
+ * Centers are partitioned into groups; a whole group is skipped when the bound using
+ * the smallest center-center proxy distance to the group exceeds the best cost found so far,
+ * and otherwise each of its centers is tested individually before being re-evaluated exactly.
+ *
+ * Center-center proxy distances (and center groups) are cached across calls and only recomputed
+ * for centers which changed, so reusing one assigner across iterations avoids the O(k^2) pass
+ * once clusters stabilize. Assignments are not carried across calls, so this is safe to use with
+ * any assignments (invalid anchors are replaced by 0); better anchors (e.g., the previous iteration's assignments) prune more.
+ * Results (including tie-breaking by lowest index) are identical to the brute-force scan.
+ */
+
+static constexpr INLINE bool supports_bregman_filtering(dist::DissimilarityMeasure d) {
+    switch(d) {
+        case dist::JSD: case dist::MKL: case dist::REVERSE_MKL: case dist::BHATTACHARYYA_DISTANCE:
+        case dist::ITAKURA_SAITO:
+            return true;
+        default: ;
+    }
+    return false;
+}
+
+#ifndef MINOCORE_FILTER_MIN_CENTERS
+#define MINOCORE_FILTER_MIN_CENTERS 8
+#endif
+
+template<typename FT=double, typename CtrT=blz::DV<FT, blz::rowVector>>
+class BregmanFilterAssigner {
+    blz::DM<double> ccdist_;   // Proxy distances between centers
+    blz::DM<double> gmin_;     // gmin_(a, g): smallest proxy distance from center a to a center of group g (other than a)
+    std::vector<uint32_t> cgroup_;
+    AssignmentGrouping<uint32_t> groups_;
+    AssignStats stats_;
+    // Center set ccdist_ was computed for
+    std::vector<CtrT> prevctrs_;
+    std::vector<blz::DV<double>> logctrs_; // Itakura-Saito only: log of each prior-smoothed center
+    dist::DissimilarityMeasure prevmsr_ = dist::L1;
+    double prevpv_ = -1.;
+    size_t prevnd_ = 0;
+
+    static dist::DissimilarityMeasure proxy(dist::DissimilarityMeasure d) {
+        return d == dist::JSD ? dist::JSM: d == dist::ITAKURA_SAITO ? d: dist::HELLINGER;
+    }
+    static double lower_bound(dist::DissimilarityMeasure d, double t) {
+        if(t <= 0.) return 0.;
+        if(d == dist::JSD) return t * t;
+        if(d == dist::ITAKURA_SAITO) return std::expm1(-t) + t;
+        if(t >= 1.) return std::numeric_limits<double>::max();
+        const double lb = -std::log1p(-t * t);
+        // msr_with_prior rounds Bhattacharyya distances below ~1e-8 down to 0
+        if(d == dist::BHATTACHARYYA_DISTANCE) return lb > 2e-8 ? lb: 0.;
+        return 2. * lb;
+    }
+    void make_groups(size_t k) {
+        // Farthest-first pivots, then each center joins its nearest pivot's group
+        const size_t ng = std::max(size_t(1), std::min(k, size_t(std::sqrt(double(k)) + .5)));
+        std::vector<uint32_t> pivots{0};
+        blz::DV<double> mind = trans(row(ccdist_, 0));
+        while(pivots.size() < ng) {
+            const uint32_t next = std::max_element(mind.begin(), mind.end()) - mind.begin();
+            pivots.push_back(next);
+            mind = min(mind, trans(row(ccdist_, next)));
+        }
+        cgroup_.resize(k);
+        for(size_t j = 0; j < k; ++j) {
+            uint32_t best = 0;
+            for(size_t g = 1; g < ng; ++g)
+                if(ccdist_(pivots[g], j) < ccdist_(pivots[best], j)) best = g;
+            cgroup_[j] = best;
+        }
+        groups_.build(cgroup_, k, ng);
+        gmin_.resize(k, ng);
+        OMP_PFOR
+        for(size_t a = 0; a < k; ++a) {
+            for(size_t g = 0; g < ng; ++g) {
+                double mv = std::numeric_limits<double>::max();
+                for(const auto j: groups_[g])
+                    if(j != a) mv = std::min(mv, ccdist_(a, j));
+                gmin_(a, g) = mv;
+            }
+        }
+    }
+    // Euclidean distance between the logs of prior-smoothed row r and center cid
+    template<typename RowT>
+    double logratio_dist(const RowT &r, double rsum, size_t cid) const {
+        const auto &lc = logctrs_[cid];
+        const size_t nd = lc.size();
+        const double rsi = 1. / (rsum + prevpv_ * nd), lz = std::log(prevpv_ * rsi);
+        double ret = 0.;
+        size_t j = 0;
+        auto visit = [&](size_t idx, double x) ALWAYS_INLINE {
+            for(; j < idx; ++j) ret += (lz - lc[j]) * (lz - lc[j]);
+            const double v = std::log((x + prevpv_) * rsi) - lc[idx];
+            ret += v * v;
+            j = idx + 1;
+        };
+        if constexpr(util::IsCSparseVector_v<RowT>) {
+            for(size_t n = 0; n < r.n_; ++n) visit(r.indices_[n], r.data_[n]);
+        } else if constexpr(blaze::IsSparseVector_v<RowT>) {
+            for(auto it = r.begin(), e = r.end(); it != e; ++it) visit(it->index(), it->value());
+        } else {
+            for(size_t n = 0; n < nd; ++n) visit(n, r[n]);
+        }
+        for(; j < nd; ++j) ret += (lz - lc[j]) * (lz - lc[j]);
+        return std::sqrt(ret);
+    }
+    /*
+     * Recomputes proxy distances for centers which differ from the cached center set.
+     * Returns false if nothing changed, in which case groups are kept as well.
+     */
+    template<typename PriorT, typename SumT>
+    bool update_centers(dist::DissimilarityMeasure measure, const PriorT &prior, FT prior_sum,
+                        const std::vector<CtrT> &centers, const SumT &centersums, size_t nd)
+    {
+        const size_t k = centers.size();
+        const dist::DissimilarityMeasure pmsr = proxy(measure);
+        const double pv = prior.size() ? double(prior[0]): 0.;
+        const bool reuse = prevctrs_.size() == k && prevmsr_ == measure && prevpv_ == pv && prevnd_ == nd;
+        std::vector<uint8_t> changed(k, !reuse);
+        if(reuse) {
+            OMP_PFOR
+            for(size_t j = 0; j < k; ++j)
+                changed[j] = centers[j] != prevctrs_[j];
+        }
+        std::vector<uint32_t> ids;
+        for(size_t j = 0; j < k; ++j) if(changed[j]) ids.push_back(j);
+        if(ids.empty()) return false;
+        if(!reuse) {
+            ccdist_.resize(k, k);
+            prevctrs_ = centers;
+            if(measure == dist::ITAKURA_SAITO) logctrs_.resize(k);
+            else logctrs_.clear();
+            prevmsr_ = measure; prevpv_ = pv; prevnd_ = nd;
+        } else {
+            for(const auto j: ids) prevctrs_[j] = centers[j];
+        }
+        if(measure == dist::ITAKURA_SAITO && pv > 0.) {
+            OMP_PFOR
+            for(size_t n = 0; n < ids.size(); ++n) {
+                const auto j = ids[n];
+                const double rsi = 1. / (centersums[j] + pv * nd);
+                logctrs_[j] = blz::generate(nd, [&](size_t f) {return std::log((double(centers[j][f]) + pv) * rsi);});
+            }
+        }
+        auto ccd = [&](size_t j, size_t j2) {
+            if(measure != dist::ITAKURA_SAITO)
+                return double(msr_with_prior<FT>(pmsr, centers[j], centers[j2], prior, prior_sum, centersums[j], centersums[j2]));
+            return pv > 0. ? double(blz::l2Norm(logctrs_[j] - logctrs_[j2])): 0.;
+        };
+        // Each pair is computed once: by its changed endpoint, or by the lower one if both changed
+        OMP_PFOR_DYN
+        for(size_t n = 0; n < ids.size(); ++n) {
+            const auto j = ids[n];
+            ccdist_(j, j) = 0.;
+            for(size_t j2 = 0; j2 < k; ++j2) {
+                if(j2 == j || (changed[j2] && j2 < j)) continue;
+                ccdist_(j, j2) = ccdist_(j2, j) = ccd(j, j2);
+            }
+        }
+        make_groups(k);
+        return true;
+    }
+public:
+    const AssignStats &stats() const {return stats_;}
+    void reset() {
+        stats_.clear();
+        prevctrs_.clear();
+        logctrs_.clear();
+    }
+
+    template<typename Mat, typename PriorT, typename AsnT, typename CostsT, typename SumT, typename RSumT>
+    void assign(const Mat &mat,
+                const dist::DissimilarityMeasure measure,
+                const PriorT &prior,
+                const std::vector<CtrT> &centers,
+                AsnT &asn,
+                CostsT &costs,
+                const SumT &centersums,
+                const RSumT &rowsums)
+    {
+        const FT prior_sum =
+            prior.size() == 0 ? 0.
+                              : prior.size() == 1
+                              ? double(prior[0] * mat.columns())
+                              : double(blz::sum(prior));
+        assign(mat, measure, prior, centers, asn, costs, centersums, rowsums, [&](auto msr, size_t id, size_t cid) ALWAYS_INLINE {
+            return msr_with_prior<FT>(msr, row(mat, id, blz::unchecked), centers[cid], prior, prior_sum, rowsums[id], centersums[cid]);
+        });
+    }
+    /*
+     * dfunc(msr, id, cid) computes msr (the measure or its proxy) between row id and center cid,
+     * e.g., with a SparsePriorKernel. Center-center proxy distances always use msr_with_prior.
+     */
+    template<typename Mat, typename PriorT, typename AsnT, typename CostsT, typename SumT, typename RSumT, typename DistFunc>
+    void assign(const Mat &mat,
+                const dist::DissimilarityMeasure measure,
+                const PriorT &prior,
+                const std::vector<CtrT> &centers,
+                AsnT &asn,
+                CostsT &costs,
+                const SumT &centersums,
+                const RSumT &rowsums,
+                const DistFunc &dfunc)
+    {
+        MINOCORE_REQUIRE(supports_bregman_filtering(measure), "BregmanFilterAssigner does not support this measure");
+        const size_t np = costs.size(), k = centers.size();
+        const dist::DissimilarityMeasure pmsr = proxy(measure);
+        const FT prior_sum =
+            prior.size() == 0 ? 0.
+                              : prior.size() == 1
+                              ? double(prior[0] * mat.columns())
+                              : double(blz::sum(prior));
+        auto pdist = [&](auto msr, size_t id, size_t cid) ALWAYS_INLINE {
+            return double(dfunc(msr, id, cid));
+        };
+        // 1. Proxy distances between centers, and center groups, for centers which changed since the last call
+        update_centers(measure, prior, prior_sum, centers, centersums, mat.columns());
+        const size_t ng = groups_.ncenters();
+        // The log-ratio proxy assumes msr_with_prior smooths with exactly prior[0]
+        bool bounded = true;
+        if(measure == dist::ITAKURA_SAITO) {
+            const double maxsum = double(blz::max(rowsums)) + double(blz::max(centersums)) + 2. * prevpv_ * mat.columns();
+            bounded = prevpv_ > 0. && prevpv_ >= double(FT(SMALLEST_PRIOR)) * maxsum;
+        }
+        // Guard against rounding in the proxy computations
+        static constexpr double slack = 1e-9;
+        auto lb = [&](double cc, double r) ALWAYS_INLINE {
+            return bounded ? lower_bound(measure, cc - r - slack * (cc + r)): 0.;
+        };
+
+        // 2. Assign points, re-evaluating only centers whose bounds fail
+        uint64_t nevals = 0, nskipped = 0;
+        OMP_PRAGMA("omp parallel for schedule(dynamic, 64) reduction(+:nevals,nskipped)")
+        for(size_t i = 0; i < np; ++i) {
+            const uint32_t a = size_t(asn[i]) < k ? uint32_t(asn[i]): uint32_t(0);
+            double best = pdist(measure, i, a);
+            uint32_t bestid = a;
+            const double r = measure == dist::JSD ? std::sqrt(std::max(best, 0.))
+                           : measure == dist::ITAKURA_SAITO ? (bounded ? logratio_dist(row(mat, i, blz::unchecked), rowsums[i], a): 0.)
+                           : pdist(pmsr, i, a);
+            nevals += 1 + (measure != dist::JSD);
+            for(size_t g = 0; g < ng; ++g) {
+                const auto grp = groups_[g];
+                if(lb(gmin_(a, g), r) > best) {
+                    nskipped += grp.size() - (cgroup_[a] == g);
+                    continue;
+                }
+                for(const auto j: grp) {
+                    if(j == a) continue;
+                    if(lb(ccdist_(a, j), r) > best) {
+                        ++nskipped;
+                        continue;
+                    }
+                    ++nevals;
+                    if(const double c = pdist(measure, i, j); c < best || (c == best && j < bestid))
+                        best = c, bestid = j;
+                }
+            }
+            asn[i] = bestid;
+            costs[i] = best;
+        }
+        stats_.nevaluated_ += nevals;
+        stats_.nskipped_ += nskipped;
+        DBG_ONLY(std::fprintf(stderr, "[%s] %zu evaluated, %zu skipped\n", __func__, size_t(nevals), size_t(nskipped));)
+    }
+};
+
+} } // namespace minicore::clustering
+
+#endif /* MINOCORE_CLUSTERING_BOUNDS_H__ */
@@ -4,6 +4,8 @@
 #include "minicore/util/csc.h"
 #include "minicore/dist.h"
 #include "minicore/optim/kmedian.h"
+#include "minicore/clustering/accumulate.h"
+#include "minicore/clustering/grouping.h"
 
 namespace minicore { namespace clustering {
 
@@ -433,15 +435,11 @@ template<typename FT=double, typename Mat, typename AsnT, typename CostsT, typen
 void set_centroids_l1(const Mat &mat, AsnT &asn, CostsT &costs, CtrsT &ctrs, WeightsT *weights) {
     const unsigned k = ctrs.size();
     using asn_t = std::decay_t<decltype(asn[0])>;
-    std::vector<std::vector<asn_t>> assigned(ctrs.size());
     assert(costs.size() == asn.size());
-    for(size_t i = 0; i < costs.size(); ++i) {
-        assert(asn[i] < assigned.size());
-        blz::push_back(assigned[asn[i]], i);
-    }
+    auto assigned = group_by_assignment<IT>(asn, costs.size(), k);
     blaze::SmallArray<asn_t, 16> sa;
     wy::WyRand<asn_t, 4> rng(costs.size());
-    for(unsigned i = 0; i < k; ++i) if(assigned[i].empty()) blz::push_back(sa, i);
+    for(unsigned i = 0; i < k; ++i) if(assigned.empty(i)) blz::push_back(sa, i);
     while(!sa.empty()) {
         std::vector<uint32_t> idxleft;
         for(unsigned i = 0; i < k; ++i)
@@ -474,16 +472,13 @@ void set_centroids_l1(const Mat &mat, AsnT &asn, CostsT &costs, CtrsT &ctrs, Wei
                 }
             }
         }
-        for(auto &subasn: assigned) subasn.clear();
         // Check for orphans again
         sa.clear();
-        for(size_t i = 0; i < costs.size(); ++i) {
-            blz::push_back(assigned[asn[i]], i);
-        }
-        for(const auto &subasn: assigned) if(subasn.empty()) sa.pushBack(&subasn - assigned.data());
+        assigned.build(asn, costs.size(), k);
+        for(unsigned i = 0; i < k; ++i) if(assigned.empty(i)) sa.pushBack(i);
     }
     for(unsigned i = 0; i < k; ++i) {
-        const auto &asnv = assigned[i];
+        const auto asnv = assigned[i];
         const auto asp = asnv.data();
         const auto nasn = asnv.size();
         MINOCORE_VALIDATE(nasn != 0);
@@ -509,15 +504,11 @@ template<typename FT=double, typename Mat, typename AsnT, typename CostsT, typen
 void set_centroids_tvd(const Mat &mat, AsnT &asn, CostsT &costs, CtrsT &ctrs, WeightsT *weights, const RowSums &rsums) {
     const unsigned k = ctrs.size();
     using asn_t = std::decay_t<decltype(asn[0])>;
-    std::vector<std::vector<asn_t>> assigned(ctrs.size());
     assert(costs.size() == asn.size());
-    for(size_t i = 0; i < costs.size(); ++i) {
-        assert(asn[i] < assigned.size());
-        blz::push_back(assigned[asn[i]], i);
-    }
+    auto assigned = group_by_assignment<IT>(asn, costs.size(), k);
     blaze::SmallArray<asn_t, 16> sa;
     wy::WyRand<asn_t, 4> rng(costs.size());
-    for(unsigned i = 0; i < k; ++i) if(assigned[i].empty()) blz::push_back(sa, i);
+    for(unsigned i = 0; i < k; ++i) if(assigned.empty(i)) blz::push_back(sa, i);
     while(!sa.empty()) {
         std::vector<uint32_t> idxleft;
         for(unsigned i = 0; i < k; ++i)
@@ -551,16 +542,13 @@ void set_centroids_tvd(const Mat &mat, AsnT &asn, CostsT &costs, CtrsT &ctrs, We
                 }
             }
         }
-        for(auto &subasn: assigned) subasn.clear();
         // Check for orphans again
         sa.clear();
-        for(size_t i = 0; i < costs.size(); ++i) {
-            blz::push_back(assigned[asn[i]], i);
-        }
-        for(const auto &subasn: assigned) if(subasn.empty()) sa.pushBack(&subasn - assigned.data());
+        assigned.build(asn, costs.size(), k);
+        for(unsigned i = 0; i < k; ++i) if(assigned.empty(i)) sa.pushBack(i);
     }
     for(unsigned i = 0; i < k; ++i) {
-        const auto &asnv = assigned[i];
+        const auto asnv = assigned[i];
         const auto asp = asnv.data();
         const auto nasn = asnv.size();
         MINOCORE_VALIDATE(nasn != 0);
@@ -581,15 +569,12 @@ void set_centroids_tvd(Args &&...args) {
 template<typename FT=double, typename Mat, typename AsnT, typename CostsT, typename CtrsT, typename WeightsT, typename IT=uint32_t>
 void set_centroids_l2(const Mat &mat, AsnT &asn, CostsT &costs, CtrsT &ctrs, WeightsT *weights, double eps=0.) {
     using asn_t = std::decay_t<decltype(asn[0])>;
-    std::vector<std::vector<asn_t>> assigned(ctrs.size());
     const size_t np = costs.size();
     const unsigned k = ctrs.size();
-    for(size_t i = 0; i < np; ++i) {
-        blz::push_back(assigned[asn[i]], i);
-    }
+    auto assigned = group_by_assignment<IT>(asn, np, k);
     wy::WyRand<asn_t, 4> rng(costs.size());
     blaze::SmallArray<asn_t, 16> sa;
-    for(unsigned i = 0; i < k; ++i) if(assigned[i].empty()) blz::push_back(sa, i);
+    for(unsigned i = 0; i < k; ++i) if(assigned.empty(i)) blz::push_back(sa, i);
     while(!sa.empty()) {
         // Compute partial sum
         std::vector<uint32_t> idxleft;
@@ -624,13 +609,10 @@ void set_centroids_l2(const Mat &mat, AsnT &asn, CostsT &costs, CtrsT &ctrs, Wei
                 }
             }
         }
-        for(auto &subasn: assigned) subasn.clear();
         // Check for orphans again
         sa.clear();
-        for(size_t i = 0; i < np; ++i) {
-            blz::push_back(assigned[asn[i]], i);
-        }
-        for(const auto &subasn: assigned) if(subasn.empty()) sa.pushBack(&subasn - assigned.data());
+        assigned.build(asn, np, k);
+        for(unsigned i = 0; i < k; ++i) if(assigned.empty(i)) sa.pushBack(i);
     }
     for(unsigned i = 0; i < k; ++i) {
         const auto nasn = assigned[i].size();
@@ -661,14 +643,9 @@ bool set_centroids_full_mean(const Mat &mat,
     blaze::SmallArray<size_t, 16> sa;
     wy::WyRand<size_t, 4> rng(costs.size()); // Used for restarting orphaned centers
     const size_t np = costs.size(), k = ctrs.size();
-    auto assigned = std::make_unique<std::vector<size_t>[]>(k);
-    OMP_ONLY(std::unique_ptr<std::mutex[]> locks(new std::mutex[k]);)
-    for(size_t i = 0; i < np; ++i) {
-        OMP_ONLY(std::lock_guard<std::mutex> lock(locks[asn[i]]);)
-        assigned[asn[i]].push_back(i);
-    }
+    auto assigned = group_by_assignment<size_t>(asn, np, k);
     for(unsigned i = 0; i < k; ++i)
-        if(assigned[i].empty())
+        if(assigned.empty(i))
             blz::push_back(sa, i);
 #ifndef NDEBUG
     int nfails = 0;
@@ -691,8 +668,6 @@ bool set_centroids_full_mean(const Mat &mat,
         std::cerr << buf;
         const constexpr RestartMethodPol restartpol = RESTART_D2;
         const FT psum = prior.size() == 1 ? FT(prior[0]) * prior.size(): sum(prior);
-        OMP_PFOR
-        for(size_t i = 0; i < k; ++i) assigned[i].clear();
         std::vector<std::ptrdiff_t> rs;
         for(size_t i = 0; i < ne; ++i) {
             // Instead, use a temporary buffer to store partial sums and randomly select newly-started centers
@@ -733,10 +708,6 @@ bool set_centroids_full_mean(const Mat &mat,
                 }
             }
             asn[i] = bestid;
-            OMP_CRITICAL
-            {
-                assigned[bestid].push_back(i);
-            }
         }
         for(size_t i = 0; i < ne; ++i) {
             auto pid = rs[i];
@@ -744,33 +715,24 @@ bool set_centroids_full_mean(const Mat &mat,
             if(asn[pid] != cid) {
                 asn[pid] = cid;
                 costs[pid] = 0.;
-                assigned[cid].push_back(pid);
             }
         }
+        assigned.build(asn, np, k);
     }
+    // Weighted sums for all centers in one pass, without per-center locks
+    blz::DV<double> wsums(k);
+    accumulate_centroids<FT>(mat, asn, ctrs, wsums,
+                             [weights](size_t i) {return weights ? double((*weights)[i]): 1.;},
+                             [&rowsums,isnorm](size_t i) {return isnorm ? 1. / double(rowsums[i]): 1.;});
     OMP_PFOR
-    for(unsigned i = 0; i < k; ++i) shared::sort(assigned[i].begin(), assigned[i].end());
-
     for(unsigned i = 0; i < k; ++i) {
-        const auto nasn = assigned[i].size();
-        const auto asp = assigned[i].data();
+        if(assigned.empty(i) || wsums[i] == 0.) continue;
         auto &ctr = ctrs[i];
-        if(nasn == 0) continue;
-        else if(nasn == 1) {
-            auto mr = row(mat, *asp);
-            assert(ctr.size() == mr.size());
-            if(isnorm) {
-                set_center(ctr, mr / rowsums[*asp]);
-            } else {
-                set_center(ctr, mr);
-            }
-        } else {
-            set_center(ctr, mat, asp, nasn, weights, isnorm ? &rowsums: static_cast<const SumT *>(nullptr));
-            if(isnan(ctr)) {
-                []() __attribute__((noinline,cold)) {
-                    throw std::runtime_error("Unexpected nan in ctr");
-                }();
-            }
+        ctr *= 1. / wsums[i];
+        if(isnan(ctr)) {
+            []() __attribute__((noinline,cold)) {
+                throw std::runtime_error("Unexpected nan in ctr");
+            }();
         }
     }
     return restarted_any;
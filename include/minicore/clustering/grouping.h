@@ -0,0 +1,96 @@
+#ifndef MINOCORE_CLUSTERING_GROUPING_H__
+#define MINOCORE_CLUSTERING_GROUPING_H__
+#include "minicore/util/blaze_adaptor.h"
+
+namespace minicore { namespace clustering {
+
+/*
+ * AssignmentGrouping
+ *
+ * Groups point indices by assigned center into one CSR-style (offsets, indices) layout:
+ * the points assigned to center j are indices_[offsets_[j]:offsets_[j + 1]].
+ *
+ * Built by a parallel counting sort: each thread histograms a contiguous chunk of points,
+ * an exclusive prefix sum over (center, chunk) gives every chunk its write position
+ * within each center, and each chunk then scatters its points without synchronization.
+ * Because chunks are contiguous and processed in order, each group is sorted
+ * by construction whenever the input ids are increasing.
+ */
+
+template<typename IT=uint32_t>
+struct AssignmentGrouping {
+    struct Group {
+        const IT *b_, *e_;
+        const IT *begin() const {return b_;}
+        const IT *end()   const {return e_;}
+        const IT *data()  const {return b_;}
+        size_t size()     const {return e_ - b_;}
+        bool empty()      const {return b_ == e_;}
+        IT operator[](size_t i) const {return b_[i];}
+    };
+    std::vector<size_t> offsets_;
+    std::vector<IT> indices_;
+
+    size_t ncenters() const {return offsets_.empty() ? size_t(0): offsets_.size() - 1;}
+    size_t size(size_t j) const {return offsets_[j + 1] - offsets_[j];}
+    bool empty(size_t j) const {return offsets_[j + 1] == offsets_[j];}
+    Group operator[](size_t j) const {
+        return Group{indices_.data() + offsets_[j], indices_.data() + offsets_[j + 1]};
+    }
+
+    /*
+     * Groups n items into k groups, where item i belongs to group getasn(i)
+     * and is stored as getid(i).
+     */
+    template<typename AsnFunc, typename IdFunc>
+    void build(size_t n, size_t k, const AsnFunc &getasn, const IdFunc &getid) {
+        const size_t nchunks = std::max(std::min(size_t(OMP_ELSE(omp_get_max_threads(), 1)), n / 1024), size_t(1));
+        const size_t chunksize = (n + nchunks - 1) / nchunks;
+        // 1. Per-chunk histograms
+        std::unique_ptr<size_t[]> hist(new size_t[nchunks * k]());
+        OMP_PRAGMA("omp parallel for schedule(static, 1)")
+        for(size_t c = 0; c < nchunks; ++c) {
+            size_t *const h = &hist[c * k];
+            for(size_t i = c * chunksize, e = std::min(n, (c + 1) * chunksize); i < e; ++i) {
+                assert(size_t(getasn(i)) < k);
+                ++h[getasn(i)];
+            }
+        }
+        // 2. Exclusive prefix sum, center-major, chunk-minor
+        offsets_.resize(k + 1);
+        size_t total = 0;
+        for(size_t j = 0; j < k; ++j) {
+            offsets_[j] = total;
+            for(size_t c = 0; c < nchunks; ++c) {
+                const size_t v = hist[c * k + j];
+                hist[c * k + j] = total;
+                total += v;
+            }
+        }
+        offsets_[k] = total;
+        assert(total == n);
+        // 3. Scatter
+        indices_.resize(n);
+        OMP_PRAGMA("omp parallel for schedule(static, 1)")
+        for(size_t c = 0; c < nchunks; ++c) {
+            size_t *const h = &hist[c * k];
+            for(size_t i = c * chunksize, e = std::min(n, (c + 1) * chunksize); i < e; ++i)
+                indices_[h[getasn(i)]++] = getid(i);
+        }
+    }
+    template<typename AsnT>
+    void build(const AsnT &asn, size_t n, size_t k) {
+        build(n, k, [&asn](size_t i) {return asn[i];}, [](size_t i) {return IT(i);});
+    }
+};
+
+template<typename IT=uint32_t, typename AsnT>
+AssignmentGrouping<IT> group_by_assignment(const AsnT &asn, size_t n, size_t k) {
+    AssignmentGrouping<IT> ret;
+    ret.build(asn, n, k);
+    return ret;
+}
+
+} } // namespace minicore::clustering
+
+#endif /* MINOCORE_CLUSTERING_GROUPING_H__ */
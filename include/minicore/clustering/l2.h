@@ -3,6 +3,8 @@
 #include "mtx2cs.h"
 #include <vector>
 #include "minicore/util/blaze_adaptor.h"
+#include "minicore/dist/pairwise.h"
+#include "minicore/optim/oracle_lsearch.h"
 
 namespace minicore {
 
@@ -103,24 +105,27 @@ l2_sum_core(blz::SM<FT> &mat, std::string out, SumOpts &opts) {
 template<typename FT>
 std::tuple<std::vector<uint32_t>, std::vector<uint32_t>, blz::DV<FT, blz::rowVector>>
 get_jv_centers(blz::SM<FT> &mat, unsigned k, unsigned maxiter, double eps, uint64_t seed) {
+    if(mat.rows() > MINOCORE_MAX_DISTMAT_POINTS) {
+        // Too large for an n x n matrix: search against the distance oracle instead
+        OracleLSearchOpts lsopts;
+        lsopts.eps = eps;
+        lsopts.seed = seed + maxiter;
+        return oracle_kmedian<FT>([&mat](size_t i, size_t j) -> FT {
+            return blz::l2Norm(row(mat, i, blz::unchecked) - row(mat, j, blz::unchecked));
+        }, mat.rows(), k, lsopts);
+    }
     auto start = std::chrono::high_resolution_clock::now();
     diskmat::PolymorphicMat<FT> distmat(mat.rows(), mat.rows());
     auto &dm = ~distmat;
     size_t np = dm.rows();
-    for(size_t i = 0; i < mat.rows(); ++i) {
-        auto r = row(dm, i, blz::unchecked);
-        auto dr = row(mat, i, blz::unchecked);
-        r[i] = 0;
-        OMP_PFOR
-        for(size_t j = i + 1; j < mat.rows(); ++j) {
-            dm(j, i) = r[j] = blz::l2Norm(dr - row(mat, j, blz::unchecked));
-        }
+    PairwiseOpts pwopts;
+    pwopts.zero_diagonal = true;
 #ifndef NDEBUG
-        if(unlikely(i % 16 == 0)) {
-            std::fprintf(stderr, "Computed %zu/%zu rows in %gms\n", i, mat.rows(), util::timediff2ms(start, std::chrono::high_resolution_clock::now()));
-        }
+    pwopts.verbose = true;
 #endif
-    }
+    fill_pairwise_tiled(dm, np, true, [&mat](size_t i, size_t j) -> FT {
+        return FT(blz::l2Norm(row(mat, i, blz::unchecked) - row(mat, j, blz::unchecked)));
+    }, pwopts);
     auto distmattime = std::chrono::high_resolution_clock::now();
     // Run JV
     std::fprintf(stderr, "[get_jv_centers:%s:%d] Time to compute distance matrix: %gms\n", __FILE__, __LINE__, util::timediff2ms(start, distmattime));
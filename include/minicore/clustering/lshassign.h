@@ -0,0 +1,286 @@
+#ifndef MINOCORE_CLUSTERING_LSHASSIGN_H__
+#define MINOCORE_CLUSTERING_LSHASSIGN_H__
+#include "minicore/dist.h"
+#include "minicore/hash/hash.h"
+#include "minicore/clustering/bounds.h"
+
+namespace minicore { namespace clustering {
+
+/*
+ * LSHAssigner
+ *
+ * Approximate hard assignment for very large k (e.g., over-clustering for coresets or bicriteria approximations).
+ * Each call hashes the current centers into an LSHTable of the family matching the measure:
+ *     L1, TVD:          L1LSHasher (Cauchy projections; TVD on normalized rows)
+ *     L2, SQRL2:        L2LSHasher (Gaussian projections)
+ *     JSD, JSM:         S2JSDLSHasher, on normalized rows
+ *     HELLINGER:        HellingerLSHasher, on normalized rows
+ * and each point is only compared (with msr_with_prior) against its most frequent LSH candidates,
+ * found with multi-probe queries, plus its previous center.
+ * Points with no candidates besides their previous center fall back to a full scan.
+ *
+ * Tables are rebuilt (with a new seed) on every call, since centers move between calls.
+ * The bucket width defaults to wscale times the mean distance from a sample of centers to their nearest other center.
+ *
+ * Results are approximate: to quantify this, each call also assigns a sample of points exactly
+ * and accumulates the relative cost gap on that sample.
+ */
+
+static constexpr INLINE bool supports_lsh_assignment(dist::DissimilarityMeasure d) {
+    switch(d) {
+        case dist::L1: case dist::TVD: case dist::L2: case dist::SQRL2:
+        case dist::JSD: case dist::JSM: case dist::HELLINGER:
+            return true;
+        default: ;
+    }
+    return false;
+}
+
+struct LSHAssignOpts {
+    unsigned k = 4;                 // Hashes concatenated per table
+    unsigned l = 8;                 // Number of tables
+    unsigned nprobes = 4;           // Buckets probed per table
+    unsigned max_candidates = 32;   // Most frequent candidates evaluated per point; 0 for all
+    double w = 0.;                  // Bucket width; if 0, estimated from center separation
+    double wscale = 2.;
+    size_t gap_sample = 256;        // Points per call also assigned exactly, to estimate the cost gap
+    size_t chunksize = 4096;        // Points hashed per batch
+    uint64_t seed = 0;
+};
+
+struct LSHAssignStats {
+    uint64_t npoints_ = 0;
+    uint64_t nfallback_ = 0;     // Points assigned by full scans
+    uint64_t nevaluated_ = 0;    // Point-center evaluations, including full scans
+    uint64_t ncompared_ = 0;     // Point-center pairs a full scan would have evaluated
+    double sample_cost_ = 0.;    // Costs of the sampled points under LSH assignment
+    double sample_exact_ = 0.;   // Their costs under exact assignment
+    void clear() {*this = LSHAssignStats();}
+    double fallback_fraction() const {return npoints_ ? double(nfallback_) / npoints_: 0.;}
+    double cost_gap() const {return sample_exact_ > 0. ? sample_cost_ / sample_exact_ - 1.: 0.;}
+    AssignStats to_assign_stats() const {
+        AssignStats ret;
+        ret.nevaluated_ = nevaluated_;
+        ret.nskipped_ = ncompared_ > nevaluated_ ? ncompared_ - nevaluated_: 0;
+        return ret;
+    }
+    void print(std::FILE *fp=stderr, const char *prefix="LSHAssigner") const {
+        std::fprintf(fp, "[%s] %zu points, %zu full-scan fallbacks (%0.4g%%), %zu/%zu evaluations (%0.4g%%), cost gap vs exact on sample: %0.4g%%\n",
+                     prefix, size_t(npoints_), size_t(nfallback_), fallback_fraction() * 100.,
+                     size_t(nevaluated_), size_t(ncompared_), ncompared_ ? 100. * nevaluated_ / ncompared_: 0., cost_gap() * 100.);
+    }
+};
+
+template<typename FT=double, typename CtrT=blz::DV<FT, blz::rowVector>>
+class LSHAssigner {
+    LSHAssignOpts opts_;
+    LSHAssignStats stats_;
+    size_t ncalls_ = 0;
+
+    static bool normalizes(dist::DissimilarityMeasure d) {
+        return d == dist::TVD || d == dist::JSD || d == dist::JSM || d == dist::HELLINGER;
+    }
+    // The metric each hasher family approximates, used to choose the bucket width
+    static dist::DissimilarityMeasure proxy(dist::DissimilarityMeasure d) {
+        switch(d) {
+            case dist::SQRL2: return dist::L2;
+            case dist::JSD: return dist::JSM;
+            default: return d;
+        }
+    }
+    template<typename Func>
+    void with_table(dist::DissimilarityMeasure measure, unsigned dim, double w, uint64_t seed, const Func &func) const {
+        const hash::LSHasherSettings settings(dim, opts_.k, opts_.l);
+        switch(measure) {
+            case dist::L1: case dist::TVD: {
+                hash::LSHTable<hash::L1LSHasher<FT>> table(settings, w, seed); func(table); break;
+            }
+            case dist::L2: case dist::SQRL2: {
+                hash::LSHTable<hash::L2LSHasher<FT>> table(settings, w, seed); func(table); break;
+            }
+            case dist::JSD: case dist::JSM: {
+                hash::LSHTable<hash::S2JSDLSHasher<FT>> table(settings, w, seed); func(table); break;
+            }
+            case dist::HELLINGER: {
+                hash::LSHTable<hash::HellingerLSHasher<FT>> table(settings, w, seed); func(table); break;
+            }
+            default: throw std::invalid_argument(std::string("LSH assignment does not support ") + dist::msr2str(measure));
+        }
+    }
+public:
+    LSHAssigner(const LSHAssignOpts &opts=LSHAssignOpts()): opts_(opts) {}
+    const LSHAssignOpts &opts() const {return opts_;}
+    const LSHAssignStats &stats() const {return stats_;}
+    void reset() {stats_.clear(); ncalls_ = 0;}
+
+    // Assigns all points, using asn as their previous centers
+    template<typename Mat, typename PriorT, typename AsnT, typename CostsT, typename SumT, typename RSumT>
+    void assign(const Mat &mat,
+                const dist::DissimilarityMeasure measure,
+                const PriorT &prior,
+                const std::vector<CtrT> &centers,
+                AsnT &asn,
+                CostsT &costs,
+                const SumT &centersums,
+                const RSumT &rowsums)
+    {
+        const size_t np = costs.size();
+        assign_ids(mat, measure, prior, centers, centersums, rowsums, np,
+                   [](size_t i) {return i;},
+                   [&](size_t i) {return size_t(asn[i]);},
+                   [&](size_t i, uint32_t cid, double cost) {asn[i] = cid; costs[i] = cost;});
+    }
+    /*
+     * Assigns the nids points in ids (e.g., a minibatch), using asn as their previous centers,
+     * and writes their new centers to bestinds[0:nids].
+     */
+    template<typename Mat, typename PriorT, typename AsnT, typename IdT, typename OAsnT, typename SumT, typename RSumT>
+    void assign(const Mat &mat,
+                const dist::DissimilarityMeasure measure,
+                const PriorT &prior,
+                const std::vector<CtrT> &centers,
+                const AsnT &asn,
+                const IdT *ids, size_t nids,
+                OAsnT &bestinds,
+                const SumT &centersums,
+                const RSumT &rowsums)
+    {
+        assign_ids(mat, measure, prior, centers, centersums, rowsums, nids,
+                   [ids](size_t i) {return size_t(ids[i]);},
+                   [&](size_t i) {return size_t(asn[ids[i]]);},
+                   [&](size_t i, uint32_t cid, double) {bestinds[i] = cid;});
+    }
+
+    /*
+     * Assigns nq points: point i is row getid(i), its previous center is getprev(i) (ignored if >= k),
+     * and its result is passed to set(i, center, cost).
+     */
+    template<typename Mat, typename PriorT, typename SumT, typename RSumT, typename GetId, typename GetPrev, typename Set>
+    void assign_ids(const Mat &mat,
+                    const dist::DissimilarityMeasure measure,
+                    const PriorT &prior,
+                    const std::vector<CtrT> &centers,
+                    const SumT &centersums,
+                    const RSumT &rowsums,
+                    size_t nq, const GetId &getid, const GetPrev &getprev, const Set &set)
+    {
+        MINOCORE_REQUIRE(supports_lsh_assignment(measure), "LSHAssigner does not support this measure");
+        if constexpr(!blaze::IsMatrix_v<Mat>) {
+            throw std::invalid_argument("LSH assignment requires a blaze matrix");
+        } else {
+            const size_t k = centers.size(), nc = mat.columns();
+            MINOCORE_REQUIRE(k > 0, "No centers");
+            const FT prior_sum =
+                prior.size() == 0 ? 0.
+                                  : prior.size() == 1
+                                  ? double(prior[0] * nc)
+                                  : double(blz::sum(prior));
+            auto pdist = [&](auto msr, size_t id, size_t cid) ALWAYS_INLINE {
+                return double(msr_with_prior<FT>(msr, row(mat, id, blz::unchecked), centers[cid], prior, prior_sum, rowsums[id], centersums[cid]));
+            };
+            const bool norm = normalizes(measure);
+            // 1. Center matrix, and bucket width from the separation of a sample of centers
+            blz::DM<FT> cmat(k, nc);
+            for(size_t j = 0; j < k; ++j) {
+                row(cmat, j) = centers[j];
+                if(norm && centersums[j] > 0.) row(cmat, j) *= FT(1. / centersums[j]);
+            }
+            double w = opts_.w;
+            if(w <= 0.) {
+                const dist::DissimilarityMeasure pmsr = proxy(measure);
+                const size_t ns = std::min(k, size_t(64)), step = k / ns;
+                double sepsum = 0.;
+                OMP_PRAGMA("omp parallel for reduction(+:sepsum)")
+                for(size_t s = 0; s < ns; ++s) {
+                    const size_t j = s * step;
+                    double mv = std::numeric_limits<double>::max();
+                    for(size_t j2 = 0; j2 < k; ++j2)
+                        if(j2 != j)
+                            mv = std::min(mv, double(msr_with_prior<FT>(pmsr, centers[j], centers[j2], prior, prior_sum, centersums[j], centersums[j2])));
+                    sepsum += k > 1 ? mv: 1.;
+                }
+                w = opts_.wscale * sepsum / ns;
+                if(!(w > 0.) || !std::isfinite(w)) w = 1.;
+            }
+            const uint64_t seed = (opts_.seed ? opts_.seed: uint64_t(13)) + 0x9E3779B97F4A7C15ull * ncalls_++;
+            // 2. Hash centers, query points in chunks, and evaluate candidates
+            uint64_t nfallback = 0, nevals = 0;
+            using QMat = std::conditional_t<blaze::IsSparseMatrix_v<Mat>, blz::SM<FT>, blz::DM<FT>>;
+            const size_t sample_stride = opts_.gap_sample ? std::max(size_t(1), nq / opts_.gap_sample): size_t(0);
+            std::vector<size_t> sampled;
+            std::vector<double> sampled_cost;
+            with_table(measure, nc, w, seed, [&](auto &table) {
+                table.add(cmat);
+                std::vector<size_t> ids;
+                QMat q;
+                for(size_t start = 0; start < nq; start += opts_.chunksize) {
+                    const size_t len = std::min(opts_.chunksize, nq - start);
+                    ids.resize(len);
+                    for(size_t i = 0; i < len; ++i) ids[i] = getid(start + i);
+                    q = rows(mat, ids.data(), len);
+                    if(norm) {
+                        for(size_t i = 0; i < len; ++i)
+                            if(rowsums[ids[i]] > 0.) row(q, i) *= FT(1. / rowsums[ids[i]]);
+                    }
+                    const auto cands = table.topk(q, opts_.max_candidates, opts_.nprobes);
+                    dispatch_measure(measure, [&](auto msr) {
+                        OMP_PRAGMA("omp parallel for schedule(dynamic, 64) reduction(+:nfallback,nevals)")
+                        for(size_t i = 0; i < len; ++i) {
+                            const size_t id = ids[i], prev = getprev(start + i);
+                            double best = std::numeric_limits<double>::max();
+                            uint32_t bestid = 0;
+                            auto consider = [&](size_t j) ALWAYS_INLINE {
+                                if(const double c = pdist(msr, id, j); c < best || (c == best && j < bestid))
+                                    best = c, bestid = j;
+                            };
+                            size_t ncand = 0;
+                            for(const auto &pair: cands[i])
+                                ncand += pair.first != prev;
+                            if(ncand == 0) {
+                                for(size_t j = 0; j < k; ++j) consider(j);
+                                nevals += k;
+                                ++nfallback;
+                            } else {
+                                if(prev < k) consider(prev), ++nevals;
+                                for(const auto &pair: cands[i])
+                                    if(pair.first != prev) consider(pair.first);
+                                nevals += ncand;
+                            }
+                            set(start + i, bestid, best);
+                            if(sample_stride && (start + i) % sample_stride == 0) {
+                                OMP_CRITICAL
+                                {
+                                    sampled.push_back(id);
+                                    sampled_cost.push_back(best);
+                                }
+                            }
+                        }
+                    });
+                }
+            });
+            // 3. Exact assignment of the sample, for the cost gap
+            double sample_cost = 0., sample_exact = 0.;
+            dispatch_measure(measure, [&](auto msr) {
+                OMP_PRAGMA("omp parallel for reduction(+:sample_cost,sample_exact)")
+                for(size_t s = 0; s < sampled.size(); ++s) {
+                    double best = std::numeric_limits<double>::max();
+                    for(size_t j = 0; j < k; ++j)
+                        best = std::min(best, pdist(msr, sampled[s], j));
+                    sample_exact += best;
+                    sample_cost += sampled_cost[s];
+                }
+            });
+            stats_.npoints_ += nq;
+            stats_.nfallback_ += nfallback;
+            stats_.nevaluated_ += nevals;
+            stats_.ncompared_ += nq * k;
+            stats_.sample_cost_ += sample_cost;
+            stats_.sample_exact_ += sample_exact;
+            DBG_ONLY(std::fprintf(stderr, "[%s] w = %g, %zu fallbacks, %zu evaluated of %zu\n", __func__, w, size_t(nfallback), size_t(nevals), nq * k);)
+        }
+    }
+};
+
+} } // namespace minicore::clustering
+
+#endif /* MINOCORE_CLUSTERING_LSHASSIGN_H__ */
@@ -32,6 +32,11 @@ struct SumOpts {
 
     size_t n_local_trials = 1; // How many points to sample at each KMeans++ iteration. Defaults to 1.
 
+    // If set, seeds with kmeans|| instead of sequential D2 sampling
+    bool kmeans_parallel = false;
+    double kmeans_parallel_oversampling = 2.; // Points sampled per round, as a multiple of k
+    size_t kmeans_parallel_rounds = 0;        // If 0, uses ceil(log(n))
+
 
     // If nonzero, performs KMC2 with m kmc2_rounds as chain length
     // Otherwise, performs standard D2 sampling
@@ -51,7 +56,14 @@ struct SumOpts {
             ret += std::to_string(kmc2_rounds);
             ret += ".";
         }
-        return buf;
+        if(kmeans_parallel) {
+            ret += "kmeans||, oversampling: ";
+            ret += std::to_string(kmeans_parallel_oversampling);
+            ret += ", rounds: ";
+            ret += kmeans_parallel_rounds ? std::to_string(kmeans_parallel_rounds): std::string("log(n)");
+            ret += ".";
+        }
+        return ret;
     }
     SumOpts(SumOpts &&) = default;
     SumOpts(const SumOpts &) = delete;
@@ -153,10 +165,14 @@ auto m2d2(blaze::Matrix<MT, SO> &sm, const SumOpts &opts, FT *weights=nullptr)
         pcp = nullptr;
     auto app = jsd::make_probdiv_applicator(*sm, opts.dis, opts.prior, pcp);
     wy::WyRand<uint64_t, 2> rng(opts.seed);
-    auto [centers, asn, costs] = jsd::make_kmeanspp(app, opts.k, opts.seed, weights, opts.use_exponential_skips);
+    auto seed = [&]() {
+        return opts.kmeans_parallel ? jsd::make_kmeans_parallel(app, opts.k, opts.seed, weights, opts.kmeans_parallel_oversampling, opts.kmeans_parallel_rounds)
+                                    : jsd::make_kmeanspp(app, opts.k, opts.seed, weights, opts.use_exponential_skips);
+    };
+    auto [centers, asn, costs] = seed();
     auto csum = blz::sum(costs);
     for(unsigned i = 0; i < opts.extra_sample_tries; ++i) {
-        auto [centers2, asn2, costs2] = jsd::make_kmeanspp(app, opts.k, opts.seed, weights, opts.use_exponential_skips);
+        auto [centers2, asn2, costs2] = seed();
         if(auto csum2 = blz::sum(costs2); csum2 < csum) {
             std::tie(centers, asn, costs, csum) = std::move(std::tie(centers2, asn2, costs2, csum2));
         }
@@ -220,10 +236,19 @@ auto m2d2(const util::CSparseMatrix<VT, IndicesT, IndPtrT> &matrix, const SumOpt
         return cmp::msr_with_prior(opts.dis, row(matrix, y, blz::unchecked), row(matrix, x, blz::unchecked), pc, prior_sum, rsums[y], rsums[x]);
     };
     wy::WyRand<uint64_t, 2> rng(opts.seed);
-    auto [centers, asn, costs] = coresets::kmeanspp(oracle, rng, matrix.rows(), opts.k, weights, opts.use_exponential_skips);
+    auto seed = [&]() {
+        return cmp::dispatch_measure(opts.dis, [&](auto msr) {
+            auto coracle = [&](size_t x, size_t y) ALWAYS_INLINE {
+                return cmp::msr_with_prior(msr, row(matrix, y, blz::unchecked), row(matrix, x, blz::unchecked), pc, prior_sum, rsums[y], rsums[x]);
+            };
+            return opts.kmeans_parallel ? coresets::kmeans_parallel(coracle, rng, matrix.rows(), opts.k, weights, opts.kmeans_parallel_oversampling, opts.kmeans_parallel_rounds)
+                                        : coresets::kmeanspp(coracle, rng, matrix.rows(), opts.k, weights, opts.use_exponential_skips);
+        });
+    };
+    auto [centers, asn, costs] = seed();
     auto csum = blz::sum(costs);
     for(unsigned i = 0; i < opts.extra_sample_tries; ++i) {
-        auto [centers2, asn2, costs2] = coresets::kmeanspp(oracle, rng, matrix.rows(), opts.k, weights, opts.use_exponential_skips);
+        auto [centers2, asn2, costs2] = seed();
         if(auto csum2 = blz::sum(costs2); csum2 < csum) {
             std::tie(centers, asn, costs, csum) = std::move(std::tie(centers2, asn2, costs2, csum2));
         }
@@ -0,0 +1,109 @@
+#ifndef MINOCORE_CLUSTERING_RESPONSIBILITIES_H__
+#define MINOCORE_CLUSTERING_RESPONSIBILITIES_H__
+#include "minicore/util/blaze_adaptor.h"
+#include "minicore/util/exception.h"
+#include <numeric>
+
+namespace minicore { namespace clustering {
+
+/*
+ * SparseResponsibilities
+ *
+ * Truncated soft assignments in CSR layout: for point i, the centers it keeps are
+ * indices_[offsets_[i]:offsets_[i + 1]], in increasing order of cost, with responsibilities in data_
+ * and point-center costs in costs_. The first entry of each row is the point's nearest center.
+ *
+ * build() computes all k costs for one point at a time (O(k) scratch per thread),
+ * keeps at most m centers per point, and drops centers whose posterior under the full softmax
+ * is below threshold (the nearest center is always kept). Kept responsibilities are renormalized to sum to 1.
+ * Memory is O(n * m) rather than the O(n * k) of dense cost and assignment matrices.
+ */
+
+template<typename FT=float, typename IT=uint32_t>
+struct SparseResponsibilities {
+    std::vector<size_t> offsets_;
+    std::vector<IT> indices_;
+    std::vector<FT> data_;
+    std::vector<FT> costs_;
+    size_t ncenters_ = 0;
+
+    size_t rows() const {return offsets_.empty() ? size_t(0): offsets_.size() - 1;}
+    size_t columns() const {return ncenters_;}
+    size_t nnz() const {return indices_.size();}
+    size_t size(size_t i) const {return offsets_[i + 1] - offsets_[i];}
+    IT hard_assignment(size_t i) const {return indices_[offsets_[i]];}
+    FT hard_cost(size_t i) const {return costs_[offsets_[i]];}
+
+    /*
+     * Fills responsibilities for n points and k centers, where costfunc(i, j) is the cost of point i to center j.
+     * Returns the truncated soft cost, sum_i rowweight(i) * sum_j r_ij * cost_ij.
+     */
+    template<typename CostFunc, typename WFunc>
+    double build(size_t n, size_t k, size_t m, double threshold, double temp, const CostFunc &costfunc, const WFunc &rowweight) {
+        MINOCORE_REQUIRE(k > 0, "Need at least one center");
+        m = std::max(std::min(m, k), size_t(1));
+        ncenters_ = k;
+        offsets_.resize(n + 1);
+        // Fixed stride of m per row, compacted below
+        indices_.resize(n * m);
+        data_.resize(n * m);
+        costs_.resize(n * m);
+        double ret = 0.;
+        OMP_PRAGMA("omp parallel reduction(+:ret)")
+        {
+            std::vector<double> c(k);
+            std::vector<IT> order(k);
+            OMP_PRAGMA("omp for schedule(dynamic, 64)")
+            for(size_t i = 0; i < n; ++i) {
+                for(size_t j = 0; j < k; ++j) c[j] = costfunc(i, j);
+                std::iota(order.begin(), order.end(), IT(0));
+                auto cmp = [&c](IT x, IT y) {return std::tie(c[x], x) < std::tie(c[y], y);};
+                if(m < k) std::nth_element(order.begin(), order.begin() + m, order.end(), cmp);
+                std::sort(order.begin(), order.begin() + m, cmp);
+                const double mn = c[order[0]];
+                double z = 0.;
+                for(size_t j = 0; j < k; ++j) z += std::exp(-temp * (c[j] - mn));
+                const double zi = 1. / z;
+                IT *const ip = &indices_[i * m];
+                FT *const dp = &data_[i * m], *const cp = &costs_[i * m];
+                size_t nkept = 0;
+                double psum = 0.;
+                for(; nkept < m; ++nkept) {
+                    const IT j = order[nkept];
+                    const double p = std::exp(-temp * (c[j] - mn)) * zi;
+                    if(nkept && p < threshold) break;
+                    ip[nkept] = j;
+                    dp[nkept] = p;
+                    cp[nkept] = c[j];
+                    psum += p;
+                }
+                const double pinv = 1. / psum;
+                double rcost = 0.;
+                for(size_t t = 0; t < nkept; ++t) {
+                    dp[t] *= pinv;
+                    rcost += dp[t] * cp[t];
+                }
+                offsets_[i + 1] = nkept;
+                ret += rcost * rowweight(i);
+            }
+        }
+        // Compact in place; each row's destination never passes its source
+        offsets_[0] = 0;
+        for(size_t i = 0; i < n; ++i) {
+            const size_t nkept = offsets_[i + 1], dst = offsets_[i], src = i * m;
+            offsets_[i + 1] = dst + nkept;
+            if(dst == src) continue;
+            std::copy(&indices_[src], &indices_[src] + nkept, &indices_[dst]);
+            std::copy(&data_[src], &data_[src] + nkept, &data_[dst]);
+            std::copy(&costs_[src], &costs_[src] + nkept, &costs_[dst]);
+        }
+        indices_.resize(offsets_[n]); indices_.shrink_to_fit();
+        data_.resize(offsets_[n]); data_.shrink_to_fit();
+        costs_.resize(offsets_[n]); costs_.shrink_to_fit();
+        return ret;
+    }
+};
+
+} } // namespace minicore::clustering
+
+#endif /* MINOCORE_CLUSTERING_RESPONSIBILITIES_H__ */
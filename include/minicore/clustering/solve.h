@@ -4,6 +4,9 @@
 
 #include "minicore/dist.h"
 #include "minicore/clustering/centroid.h"
+#include "minicore/clustering/bounds.h"
+#include "minicore/clustering/lshassign.h"
+#include "minicore/clustering/responsibilities.h"
 #include "minicore/coreset/coreset.h"
 
 namespace minicore {
@@ -35,6 +38,63 @@ using util::tvd_median;
 static constexpr double DEFAULT_EPS = MC_DEFAULT_EPS;
 #undef MC_DEFAULT_EPS
 
+/*
+ * Step-size schedules for minibatch soft clustering.
+ * Each minibatch produces an unbiased estimate of the full-data sufficient statistics
+ * (responsibility-weighted sums of rows and responsibility masses per center),
+ * which are blended into running statistics with step size eta_t.
+ *
+ * POWER_STEP:      eta_t = (t + t0)^-kappa, with kappa in (0.5, 1] for convergence (stepwise EM)
+ * CONSTANT_STEP:   eta_t = eta
+ * CUMULATIVE_STEP: running statistics are summed rather than blended,
+ *                  so each center is the average over every minibatch seen so far.
+ *                  This is the soft analogue of per-center learning rates in minibatch k-means.
+ */
+enum SoftStepSchedule {
+    POWER_STEP,
+    CONSTANT_STEP,
+    CUMULATIVE_STEP
+};
+
+static constexpr const char *step2str(SoftStepSchedule s) {
+    switch(s) {
+        case POWER_STEP: return "power";
+        case CONSTANT_STEP: return "constant";
+        case CUMULATIVE_STEP: return "cumulative";
+        default: ;
+    }
+    return "unknown";
+}
+
+static inline SoftStepSchedule str2step(const std::string &s) {
+    for(const auto v: {POWER_STEP, CONSTANT_STEP, CUMULATIVE_STEP})
+        if(s == step2str(v)) return v;
+    throw std::invalid_argument(std::string("Unknown step schedule ") + s + "; expected power, constant, or cumulative");
+}
+
+struct SoftMinibatchOpts {
+    SoftStepSchedule schedule = POWER_STEP;
+    double kappa = .6;  // POWER_STEP exponent
+    double t0 = 2.;     // POWER_STEP offset; t0 >= 1 keeps the first step from discarding the initial centers
+    double eta = .1;    // CONSTANT_STEP step size
+    bool importance_sampling = false; // Sample by sensitivity (via CoresetSampler) rather than uniformly
+    uint64_t seed = 0;
+    size_t eval_size = 0;     // Rows in the fixed sample used to estimate the objective (0: max(4096, 4 * mbsize)); all rows if >= n
+    size_t refresh_every = 0; // Outer iterations between full passes over all rows (0: only to build the importance sampler)
+    double step(size_t t) const {
+        switch(schedule) {
+            case POWER_STEP: return std::pow(t + t0, -kappa);
+            case CONSTANT_STEP: return eta;
+            default: return 1.;
+        }
+    }
+    std::string to_string() const {
+        char buf[256];
+        return std::string(buf, std::snprintf(buf, sizeof(buf), "SoftMinibatchOpts[schedule=%s|kappa=%g|t0=%g|eta=%g|importance_sampling=%d|seed=%zu|eval_size=%zu|refresh_every=%zu]",
+                                              step2str(schedule), kappa, t0, eta, int(importance_sampling), size_t(seed), eval_size, refresh_every));
+    }
+};
+
 
 /*
  * set_centroids_* and assign_points_* functions form the E/M steps
@@ -64,7 +124,8 @@ void assign_points_hard(const Mat &mat,
                         CostsT &costs,
                         const WeightT *,
                         const SumT &centersums,
-                        const SumT &rowsums);
+                        const SumT &rowsums,
+                        BregmanFilterAssigner<FT, CtrT> *filter=static_cast<BregmanFilterAssigner<FT, CtrT> *>(nullptr));
 template<typename FT, typename Mat, typename PriorT, typename CtrT, typename CostsT, typename AsnT, typename WeightT=CtrT, typename SumT>
 bool set_centroids_hard(const Mat &mat,
                         const dist::DissimilarityMeasure measure,
@@ -90,6 +151,34 @@ double set_centroids_soft(const Mat &mat,
                         SumT &centersums,
                         const RSumT &rowsums);
 
+// Running state for minibatch soft clustering, kept across calls to set_centroids_soft_minibatch
+template<typename FT>
+struct SoftMinibatchState {
+    SoftMinibatchOpts opts;
+    blz::DM<FT> stats;    // k x d running responsibility-weighted row sums
+    blz::DV<double> mass; // k running responsibility masses
+    size_t t = 0;         // Number of minibatch steps taken so far
+    size_t calls = 0;     // Number of calls to set_centroids_soft_minibatch so far
+    blz::DV<uint64_t> evalids; // Fixed sample of rows on which the objective is estimated
+    blz::DV<double> evalw;     // Their weights, scaled so that sums over the sample estimate sums over all rows
+    coresets::CoresetSampler<double, uint32_t> sampler; // Sensitivity sampler, built from the last full pass
+    wy::WyRand<uint64_t> rng;
+    SoftMinibatchState(const SoftMinibatchOpts &o): opts(o), rng(o.seed) {}
+};
+template<typename FT, typename Mat, typename PriorT, typename CtrT,
+         typename WeightT,
+         typename SumT, typename RSumT>
+double set_centroids_soft_minibatch(const Mat &mat,
+                        const dist::DissimilarityMeasure measure,
+                        const PriorT &prior,
+                        std::vector<CtrT> &centers,
+                        const WeightT *weights,
+                        const FT temp,
+                        SumT &centersums,
+                        const RSumT &rowsums,
+                        size_t mbsize, size_t mbn,
+                        SoftMinibatchState<FT> &state);
+
 template<typename MT>
 using DefaultFT = std::conditional_t<std::is_floating_point_v<blz::ElementType_t<MT>>,
                                                               blz::ElementType_t<MT>,
@@ -114,7 +203,9 @@ perform_hard_clustering(const MT &mat,
                         const WeightT *weights=static_cast<WeightT *>(nullptr),
                         double eps=DEFAULT_EPS,
                         size_t maxiter=size_t(-1),
-                        RSumsT *rsums=static_cast<RSumsT *>(nullptr))
+                        RSumsT *rsums=static_cast<RSumsT *>(nullptr),
+                        AssignStats *stats=static_cast<AssignStats *>(nullptr),
+                        const LSHAssignOpts *lshopts=static_cast<LSHAssignOpts *>(nullptr))
 {
     auto tstart = std::chrono::high_resolution_clock::now();
     auto compute_cost = [&costs,w=weights]() -> FT {
@@ -128,7 +219,36 @@ perform_hard_clustering(const MT &mat,
         rsums = &rowsums;
     }
     blz::DV<double> ctrsums = blaze::generate(centers.size(), [&](auto x){return sum(centers[x]);});
-    assign_points_hard<FT>(mat, measure, prior, centers, asn, costs, weights, ctrsums, *rsums); // Assign points myself
+    // For metrics, use triangle-inequality bounds to skip most point-center comparisons
+    // unless the batched (GEMM) kernel in assign_points_hard applies.
+    const bool use_bounds = dist::satisfies_metric(measure) && measure != dist::ORACLE_METRIC
+                            && !(dist::supports_batched_clustering(measure) && prior.size() <= 1);
+    HamerlyAssigner<FT, CtrT> bounds;
+    BregmanFilterAssigner<FT, CtrT> filter; // Keeps center-center distances for unchanged centers
+    // For very large k, LSH candidates (plus each point's previous center) replace the full scan
+    std::unique_ptr<LSHAssigner<FT, CtrT>> lsh;
+    if(lshopts) lsh.reset(new LSHAssigner<FT, CtrT>(*lshopts));
+    auto assign = [&](const std::vector<CtrT> &ctrs) {
+        if(lsh)
+            lsh->assign(mat, measure, prior, ctrs, asn, costs, ctrsums, *rsums);
+        else if(use_bounds)
+            bounds.assign(mat, measure, prior, ctrs, asn, costs, ctrsums, *rsums);
+        else
+            assign_points_hard<FT>(mat, measure, prior, ctrs, asn, costs, weights, ctrsums, *rsums, &filter);
+    };
+    auto report_bounds = [&]() {
+        if(lsh) {
+            lsh->stats().print(stderr, "perform_hard_clustering");
+            if(stats) *stats += lsh->stats().to_assign_stats();
+            return;
+        }
+        if(!use_bounds) return;
+        const auto &bs = bounds.stats();
+        std::fprintf(stderr, "[perform_hard_clustering] bounded assignment: %zu evaluated, %zu skipped (%0.4g%%)\n",
+                     size_t(bs.nevaluated_), size_t(bs.nskipped_), bs.skip_fraction() * 100.);
+        if(stats) *stats += bs;
+    };
+    assign(centers); // Assign points myself
     PYBIND11_EXCEPTION_CHECK();
     const auto initcost = compute_cost();
     PYBIND11_EXCEPTION_CHECK();
@@ -136,6 +256,7 @@ perform_hard_clustering(const MT &mat,
     std::fprintf(stderr, "[perform_hard_clustering] initial cost: %0.12g\n", cost);
     if(cost == 0) {
         std::fprintf(stderr, "Cost is 0 (unexpected), but the cost can't decrease. No optimization performed\n");
+        report_bounds();
         return {0., 0., 0};
     }
     size_t iternum = 0;
@@ -149,7 +270,7 @@ perform_hard_clustering(const MT &mat,
         std::fprintf(stderr, "Setting centroids took %gms\n", std::chrono::duration<double, std::milli>(ctrstop - ctrstart).count());
 
         ctrstart = std::chrono::high_resolution_clock::now();
-        assign_points_hard<FT>(mat, measure, prior, centers_cpy, asn, costs, weights, ctrsums, *rsums);
+        assign(centers_cpy);
         ctrstop = std::chrono::high_resolution_clock::now();
         std::fprintf(stderr, "Assigning points took %gms\n", std::chrono::duration<double, std::milli>(ctrstop - ctrstart).count());
         ctrstart = std::chrono::high_resolution_clock::now();
@@ -159,7 +280,7 @@ perform_hard_clustering(const MT &mat,
         DBG_ONLY(std::fprintf(stderr, "Iteration %zu: [%.16g old/%.16g new]\n", iternum, cost, newcost);)
         if(newcost > cost && !res) {
             ctrsums = blaze::generate(centers.size(), [&](auto x) {return sum(centers[x]);});
-            assign_points_hard<FT>(mat, measure, prior, centers, asn, costs, weights, ctrsums, *rsums);
+            assign(centers);
             break;
         }
         centers = centers_cpy;
@@ -169,6 +290,7 @@ perform_hard_clustering(const MT &mat,
         if(oldcost - newcost < eps * std::max(double(newcost), double(oldcost)) || iternum > maxiter)
             break;
     }
+    report_bounds();
     auto tstop = std::chrono::high_resolution_clock::now();
     std::fprintf(stderr, "clustering for %zu rounds, from cost %0.12g->%0.12g, in %gms\n", iternum, initcost, cost, std::chrono::duration<double, std::milli>(tstop - tstart).count());
     return {initcost, cost, iternum};
@@ -240,7 +362,8 @@ void assign_points_hard(const Mat &mat,
                         CostsT &costs,
                         const WeightT *,
                         const SumT &centersums,
-                        const SumT &rowsums)
+                        const SumT &rowsums,
+                        BregmanFilterAssigner<FT, CtrT> *filter)
 {
 
     // Setup helpers
@@ -256,34 +379,119 @@ void assign_points_hard(const Mat &mat,
 #ifndef NDEBUG
     std::fprintf(stderr, "[%s]: %zu-clustering with %s and %zu dimensions\n", __func__, centers.size(), dist::msr2str(measure), centers[0].size());
 #endif
+    if constexpr(blaze::IsMatrix_v<Mat> || util::IsCSparseMatrix_v<Mat>) {
+        // Inner-product measures are assigned by tiled matrix products
+        if(dist::supports_batched_clustering(measure) && prior.size() <= 1) {
+            dist::assign_points_batched<FT>(mat, measure, prior, centers, asn, costs);
+            return;
+        }
+    }
+    // JSD, KL, Bhattacharyya distance and Itakura-Saito use the current assignments as anchors for grouped filtering.
+    // Pass filter to keep its center-center distances across calls.
+    const bool use_filter = supports_bregman_filtering(measure) && centers.size() >= MINOCORE_FILTER_MIN_CENTERS;
+    BregmanFilterAssigner<FT, CtrT> tmpfilter;
+    if(!filter) filter = &tmpfilter;
+    if constexpr(blaze::IsSparseMatrix_v<Mat> || util::IsCSparseMatrix_v<Mat>) {
+        // Sparse rows with a scalar prior only visit their nonzeros, using per-center prior terms
+        if(SparsePriorKernel<FT>::applicable(measure, prior)) {
+            SparsePriorKernel<FT> kernel(measure, prior[0], mat.columns());
+            kernel.set_centers(centers, centersums);
+            std::unique_ptr<SparsePriorKernel<FT>> pkernel; // Hellinger proxy, for filtering
+            if(use_filter && measure != dist::JSD) {
+                pkernel.reset(new SparsePriorKernel<FT>(dist::HELLINGER, prior[0], mat.columns()));
+                pkernel->set_centers(centers, centersums);
+            }
+            auto dfunc = [&](auto msr, size_t id, size_t cid) ALWAYS_INLINE {
+                return (msr == measure ? kernel: *pkernel)(row(mat, id, unchecked), rowsums[id], cid);
+            };
+            if(use_filter) {
+                filter->assign(mat, measure, prior, centers, asn, costs, centersums, rowsums, dfunc);
+                return;
+            }
+            const size_t np = costs.size(), k = centers.size();
+            OMP_PFOR
+            for(size_t i = 0; i < np; ++i) {
+                double best = kernel(row(mat, i, unchecked), rowsums[i], 0);
+                uint32_t bestid = 0;
+                for(size_t j = 1; j < k; ++j)
+                    if(const double c = kernel(row(mat, i, unchecked), rowsums[i], j); c < best)
+                        best = c, bestid = j;
+                costs[i] = best; asn[i] = bestid;
+            }
+            return;
+        }
+    }
+    if(use_filter) {
+        filter->assign(mat, measure, prior, centers, asn, costs, centersums, rowsums);
+        return;
+    }
 
     // Compute distance function
     // Handles similarity measure, caching, and the use of a prior for exponential family models
-#define __compute_cost(id, cid) msr_with_prior<FT>(measure, row(mat, id), centers[cid], prior, prior_sum, rowsums[id], centersums[cid])
+    // The measure is dispatched once, so the loop nest runs with a measure-specialized kernel
+#define __compute_cost(id, cid) msr_with_prior<FT>(msr, row(mat, id), centers[cid], prior, prior_sum, rowsums[id], centersums[cid])
     const size_t e = costs.size(), k = centers.size();
-    auto onerow = [&](auto x) {
-        auto cost = __compute_cost(x, 0);
-        asn_t bestid = 0;
-        for(unsigned j = 1; j < k; ++j)
-            if(auto newcost = __compute_cost(x, j); newcost < cost)
-                bestid = j, cost = newcost;
-        costs[x] = cost; asn[x] = bestid;
-        VERBOSE_ONLY(std::fprintf(stderr, "point %zu is assigned to center %u with cost %0.12g\n", x, bestid, cost);)
-    };
-    if constexpr(0) {
-        for(size_t i = 0; i < e; onerow(i++));
-    } else {
+    dispatch_measure(measure, [&](auto msr) {
+        auto onerow = [&](auto x) {
+            auto cost = __compute_cost(x, 0);
+            asn_t bestid = 0;
+            for(unsigned j = 1; j < k; ++j)
+                if(auto newcost = __compute_cost(x, j); newcost < cost)
+                    bestid = j, cost = newcost;
+            costs[x] = cost; asn[x] = bestid;
+            VERBOSE_ONLY(std::fprintf(stderr, "point %zu is assigned to center %u with cost %0.12g\n", x, bestid, cost);)
+        };
         OMP_PFOR
         for(size_t i = 0; i < e; ++i) {
             onerow(i);
         }
-    }
+    });
 #ifndef NDEBUG
     std::fprintf(stderr, "[%s]: %zu-clustering with %s and %zu dimensions, completed!\n", __func__, centers.size(), dist::msr2str(measure), centers[0].size());
 #endif
 #undef __compute_cost
 }
 
+/*
+ * set_soft_costs fills costs(i, j) with the dissimilarity between row ids[i] and center j,
+ * or between row i and center j if ids is null.
+ * Sparse matrices with a positive scalar prior use SparsePriorKernel.
+ */
+template<typename FT, typename Mat, typename PriorT, typename CtrT, typename CostsT, typename SumT, typename RSumT, typename IdT=uint64_t>
+void set_soft_costs(const Mat &mat,
+                    const dist::DissimilarityMeasure measure,
+                    const PriorT &prior,
+                    const std::vector<CtrT> &centers,
+                    CostsT &costs,
+                    const SumT &centersums,
+                    const RSumT &rowsums,
+                    const IdT *ids=static_cast<IdT *>(nullptr), size_t nids=0)
+{
+    const size_t nr = ids ? nids: mat.rows();
+    auto getid = [ids](size_t i) ALWAYS_INLINE {return ids ? size_t(ids[i]): i;};
+    if constexpr(blaze::IsSparseMatrix_v<Mat> || util::IsCSparseMatrix_v<Mat>) {
+        if(SparsePriorKernel<FT>::applicable(measure, prior)) {
+            SparsePriorKernel<FT> kernel(measure, prior[0], mat.columns());
+            kernel.set_centers(centers, centersums);
+            costs = blaze::generate(nr, centers.size(), [&](auto i, auto cid) ALWAYS_INLINE {
+                const auto id = getid(i);
+                return kernel(row(mat, id, unchecked), rowsums[id], cid);
+            });
+            return;
+        }
+    }
+    const double prior_sum =
+        prior.size() == 0 ? 0.
+                          : prior.size() == 1
+                          ? double(prior[0] * mat.columns())
+                          : double(blz::sum(prior));
+    costs = blaze::generate(nr, centers.size(), [&](auto i, auto cid) ALWAYS_INLINE {
+        assert(cid < centers.size());
+        const auto id = getid(i);
+        return msr_with_prior<FT>(measure, row(mat, id, unchecked), centers[cid], prior, prior_sum, rowsums[id], centersums[cid]);
+    });
+}
+
 template<typename MT, // MatrixType
          typename FT=std::conditional_t<(sizeof(ElementType_t<MT>) <= 4), float, double>,
          typename CtrT=blz::DynamicVector<FT, rowVector>, // Vector Type
@@ -302,7 +510,8 @@ auto perform_soft_clustering(const MT &mat,
                              size_t maxiter=size_t(-1),
                              int64_t mbsize=-1, int64_t mbn=10,
                              const WeightT *weights=static_cast<WeightT *>(nullptr),
-                             double eps=DEFAULT_EPS)
+                             double eps=DEFAULT_EPS,
+                             const SoftMinibatchOpts &mbopts=SoftMinibatchOpts())
 {
     auto centers_cpy(centers);
     blz::DV<double> centersums(centers.size());
@@ -312,12 +521,17 @@ auto perform_soft_clustering(const MT &mat,
     double cost = std::numeric_limits<double>::max();
     double initcost = -1;
     size_t iternum = 0;
+    SoftMinibatchState<FT> mbstate(mbopts);
+    if(mbsize > 0) {
+        if(mbn <= 0) mbn = 10;
+        std::fprintf(stderr, "[%s] minibatch soft clustering with %zu samples per batch and %zu batches per full pass. %s\n", __func__, size_t(mbsize), size_t(mbn), mbopts.to_string().data());
+    }
     for(;;) {
         PYBIND11_EXCEPTION_CHECK();
         double oldcost = cost;
         if(mbsize > 0) {
-            throw std::runtime_error("Not yet completed: minibatch soft clustering");
-            for(int i = 0; i < mbn; ++i); // Perform mbn rounds of minibatch clustering between central
+            // Perform mbn rounds of minibatch clustering between full passes
+            cost = set_centroids_soft_minibatch<FT>(mat, measure, prior, centers_cpy, weights, temperature, centersums, rowsums, mbsize, mbn, mbstate);
         } else {
             cost = set_centroids_soft<FT>(mat, measure, prior, centers_cpy, costs, asns, weights, temperature, centersums, rowsums);
         }
@@ -332,8 +546,21 @@ auto perform_soft_clustering(const MT &mat,
             break;
         }
     }
+    if(mbsize > 0 && costs.rows() == mat.rows()) {
+        // Minibatch rounds never form n x k costs or responsibilities;
+        // fill them once for the final centers, and only if the caller allocated them
+        centersums = blaze::generate(centers.size(), [&](auto x){return blz::sum(centers[x]);});
+        set_soft_costs<FT>(mat, measure, prior, centers, costs, centersums, rowsums);
+        asns = softmax<rowwise>(costs * -temperature);
+        OMP_PFOR
+        for(size_t i = 0; i < costs.rows(); ++i) {
+            auto r = row(asns, i, unchecked);
+            correct_softmax(row(costs, i, unchecked), r);
+        }
+    }
     return std::make_tuple(initcost, cost, iternum);
 }
+
 /*
  *
  * set_centroids_soft assumes that costs of points have been assigned
@@ -360,19 +587,211 @@ double set_centroids_soft(const Mat &mat,
     std::fprintf(stderr, "Policy %d/%s for measure %d/%s\n", (int)pol, cp2str(pol), (int)measure, msr2str(measure));
     double ret = set_centroids_full_mean(mat, measure, prior, costs, asns, centers, weights, temp, centersums, rowsums);
     std::fprintf(stderr, "cost: %g for %d/%s\n", ret, (int)measure, msr2str(measure));
-    const double prior_sum =
-        prior.size() == 0 ? 0.
-                          : prior.size() == 1
-                          ? double(prior[0] * mat.columns())
-                          : double(blz::sum(prior));
-    costs = blaze::generate(mat.rows(), centers.size(), [&](auto id, auto cid) ALWAYS_INLINE {
-        assert(cid < centers.size());
-        return msr_with_prior<FT>(measure, row(mat, id, unchecked), centers[cid], prior, prior_sum, rowsums[id], centersums[cid]);
-    });
+    set_soft_costs<FT>(mat, measure, prior, centers, costs, centersums, rowsums);
     //std::cerr << "Costs: " << costs << '\n';
     return ret;
 }
 
+/*
+ * soft_cost_chunked returns the soft cost sum_i getw(i) * <c_i, softmax(-temp * c_i)> over rows ids[0, nids),
+ * or over all rows if ids is null, where c_i holds row i's costs to the centers.
+ * Costs are computed chunksize rows at a time, so no n x k matrix is formed.
+ * If hardcosts and hardasn are non-null, they receive each row's cost to, and index of, its nearest center.
+ */
+template<typename FT, typename Mat, typename PriorT, typename CtrT, typename SumT, typename RSumT, typename GetW>
+double soft_cost_chunked(const Mat &mat,
+                         const dist::DissimilarityMeasure measure,
+                         const PriorT &prior,
+                         const std::vector<CtrT> &centers,
+                         const FT temp,
+                         const SumT &centersums,
+                         const RSumT &rowsums,
+                         const GetW &getw,
+                         const uint64_t *ids=nullptr, size_t nids=0,
+                         double *hardcosts=nullptr, uint32_t *hardasn=nullptr,
+                         size_t chunksize=4096)
+{
+    const size_t nr = ids ? nids: mat.rows(), k = centers.size();
+    blz::DV<uint64_t> cids;
+    blz::DM<FT> costs, resp;
+    double ret = 0.;
+    for(size_t start = 0; start < nr; start += chunksize) {
+        const size_t len = std::min(chunksize, nr - start);
+        cids.resize(len);
+        for(size_t i = 0; i < len; ++i) cids[i] = ids ? ids[start + i]: start + i;
+        set_soft_costs<FT>(mat, measure, prior, centers, costs, centersums, rowsums, cids.data(), len);
+        resp = softmax<rowwise>(costs * -temp);
+        OMP_PRAGMA("omp parallel for reduction(+:ret)")
+        for(size_t i = 0; i < len; ++i) {
+            auto cr = row(costs, i, unchecked);
+            auto r = row(resp, i, unchecked);
+            correct_softmax(cr, r);
+            ret += dot(cr, r) * getw(start + i);
+            if(hardcosts) {
+                uint32_t bi = 0;
+                for(size_t j = 1; j < k; ++j)
+                    if(cr[j] < cr[bi]) bi = j;
+                hardcosts[cids[i]] = cr[bi];
+                hardasn[cids[i]] = bi;
+            }
+        }
+    }
+    return ret;
+}
+
+/*
+ * set_centroids_soft_minibatch performs mbn steps of stochastic (stepwise) soft EM on mbsize sampled rows each,
+ * and returns an estimate of the soft cost of the updated centers.
+ * It neither reads nor forms n x k costs or responsibilities.
+ *
+ * Each step:
+ * 1. Samples mbsize rows, either uniformly with replacement or by sensitivity through CoresetSampler,
+ *    using the hard costs and assignments from the last full pass.
+ *    Each sampled row is weighted by w_i / (mbsize * p_i), so batch sums are unbiased estimates of sums over all rows.
+ * 2. Computes responsibilities for the batch only, softmax(-temp * costs), as set_centroids_full_mean does.
+ * 3. Accumulates each center's responsibility-weighted row sum and mass, one center per thread.
+ * 4. Blends these into the running statistics by opts.schedule, and sets center j to stats_j / mass_j.
+ *
+ * A step costs O(mbsize * k * nnz) rather than O(n * k * nnz).
+ * Only nonzeros of sparse rows are visited, and sparse rows under a scalar prior use SparsePriorKernel.
+ *
+ * The returned objective is measured on a fixed sample of opts.eval_size rows, drawn on the first call,
+ * so successive calls are comparable; if eval_size >= n, it is exact.
+ * A full pass over all rows (streamed in chunks) runs only every opts.refresh_every calls,
+ * or when the importance sampler has not yet been built. It rebuilds the sampler and logs the exact cost.
+ */
+template<typename FT, typename Mat, typename PriorT, typename CtrT,
+         typename WeightT,
+         typename SumT, typename RSumT>
+double set_centroids_soft_minibatch(const Mat &mat,
+                        const dist::DissimilarityMeasure measure,
+                        const PriorT &prior,
+                        std::vector<CtrT> &centers,
+                        const WeightT *weights,
+                        const FT temp,
+                        SumT &centersums,
+                        const RSumT &rowsums,
+                        size_t mbsize, size_t mbn,
+                        SoftMinibatchState<FT> &state)
+{
+    MINOCORE_VALIDATE(dist::is_valid_measure(measure));
+    MINOCORE_REQUIRE(measure != distance::L1 && measure != distance::L2, "Minibatch soft clustering requires a measure whose centroid is a weighted mean");
+    const size_t np = mat.rows(), nd = mat.columns(), k = centers.size();
+    const bool isnorm = msr_is_normalized(measure);
+    const SoftMinibatchOpts &opts = state.opts;
+    auto &rng = state.rng;
+    auto getw = [weights](size_t i) ALWAYS_INLINE {return weights ? double((*weights)[i]): 1.;};
+    if(state.stats.rows() != k || state.stats.columns() != nd) {
+        // Start from the current centers, each carrying an equal share of the total weight
+        double total = np;
+        if(weights) {
+            total = 0.;
+            for(size_t i = 0; i < np; ++i) total += getw(i);
+        }
+        state.stats.resize(k, nd);
+        state.mass.resize(k);
+        state.mass = total / k;
+        for(size_t j = 0; j < k; ++j) {
+            if constexpr(blaze::TransposeFlag_v<CtrT> == rowVector) row(state.stats, j, unchecked) = centers[j] * state.mass[j];
+            else row(state.stats, j, unchecked) = trans(centers[j]) * state.mass[j];
+        }
+        state.t = 0;
+    }
+    if(state.evalids.size() == 0) {
+        const size_t m = std::min(np, opts.eval_size ? opts.eval_size: std::max(size_t(4096), 4 * mbsize));
+        state.evalids.resize(m);
+        state.evalw.resize(m);
+        if(m == np) {
+            std::iota(state.evalids.begin(), state.evalids.end(), uint64_t(0));
+            for(size_t i = 0; i < np; ++i) state.evalw[i] = getw(i);
+        } else {
+            schism::Schismatic<uint64_t> div(np);
+            for(auto &id: state.evalids) id = div.mod(rng());
+            shared::sort(state.evalids.begin(), state.evalids.end());
+            for(size_t i = 0; i < m; ++i) state.evalw[i] = getw(state.evalids[i]) * (double(np) / m);
+        }
+    }
+    if((opts.importance_sampling && !state.sampler.ready()) || (opts.refresh_every && state.calls % opts.refresh_every == 0)) {
+        // Full pass, streamed in chunks: exact cost, and hard costs/assignments for the sensitivity sampler
+        blz::DV<double> hardcosts(np);
+        blz::DV<uint32_t> hardasn(np);
+        const double full = soft_cost_chunked<FT>(mat, measure, prior, centers, temp, centersums, rowsums, getw,
+                                                  (const uint64_t *)nullptr, 0, hardcosts.data(), hardasn.data());
+        std::fprintf(stderr, "[%s] full pass after %zu minibatch steps: cost %0.12g\n", __func__, state.t, full);
+        if(opts.importance_sampling) {
+            using WT = const std::remove_const_t<std::decay_t<decltype((*weights)[0])>>;
+            const WT *ptr = nullptr;
+            if(weights) ptr = weights->data();
+            state.sampler.make_sampler(np, k, hardcosts.data(), hardasn.data(), ptr, rng(), coresets::LBK, k, (uint64_t *)nullptr, true, msr2alpha(measure));
+        }
+    }
+    typename coresets::CoresetSampler<double, uint32_t>::CoresetType coreset(mbsize);
+    schism::Schismatic<uint64_t> div(np);
+    blz::DV<uint64_t> ids(mbsize);
+    blz::DV<double> bw(mbsize), bmass(k);
+    blz::DM<FT> bcosts(mbsize, k), resp(mbsize, k), bstats(k, nd);
+    for(size_t step = 0; step < mbn; ++step) {
+        PYBIND11_EXCEPTION_CHECK();
+        // 1. Sample rows and their importance weights
+        if(opts.importance_sampling) {
+            state.sampler.sample(coreset, rng());
+            std::copy(coreset.indices_.begin(), coreset.indices_.end(), ids.begin());
+            std::copy(coreset.weights_.begin(), coreset.weights_.end(), bw.begin());
+        } else {
+            for(auto &id: ids) id = div.mod(rng());
+            shared::sort(ids.begin(), ids.end()); // Sorted for locality
+            const double scale = double(np) / mbsize;
+            for(size_t i = 0; i < mbsize; ++i) bw[i] = getw(ids[i]) * scale;
+        }
+        // 2. Batch responsibilities
+        set_soft_costs<FT>(mat, measure, prior, centers, bcosts, centersums, rowsums, ids.data(), mbsize);
+        resp = softmax<rowwise>(bcosts * -temp);
+        OMP_PFOR
+        for(size_t i = 0; i < mbsize; ++i) {
+            auto r = row(resp, i, unchecked);
+            correct_softmax(row(bcosts, i, unchecked), r);
+        }
+        // 3. Batch statistics
+        OMP_PFOR_DYN
+        for(size_t j = 0; j < k; ++j) {
+            auto srow = row(bstats, j, unchecked);
+            srow = FT(0);
+            double m = 0.;
+            for(size_t i = 0; i < mbsize; ++i) {
+                const double w = bw[i] * resp(i, j);
+                if(w == 0.) continue;
+                m += w;
+                const auto id = ids[i];
+                detail::add_row(srow, mat, id, FT(isnorm ? w / rowsums[id]: w));
+            }
+            bmass[j] = m;
+        }
+        // 4. Blend into running statistics and set centers
+        const double eta = opts.step(state.t++);
+        OMP_PFOR
+        for(size_t j = 0; j < k; ++j) {
+            auto srow = row(state.stats, j, unchecked);
+            if(opts.schedule == CUMULATIVE_STEP) {
+                blz::serial(srow += row(bstats, j, unchecked));
+                state.mass[j] += bmass[j];
+            } else {
+                blz::serial(srow *= FT(1. - eta));
+                blz::serial(srow += row(bstats, j, unchecked) * FT(eta));
+                state.mass[j] = state.mass[j] * (1. - eta) + bmass[j] * eta;
+            }
+            if(state.mass[j] <= 0.) continue;
+            const FT inv = 1. / state.mass[j];
+            if constexpr(blaze::TransposeFlag_v<CtrT> == rowVector) set_center(centers[j], srow * inv);
+            else set_center(centers[j], trans(srow) * inv);
+            centersums[j] = sum(centers[j]);
+        }
+    }
+    DBG_ONLY(std::fprintf(stderr, "[%s] %zu minibatch steps taken; last step size %g\n", __func__, state.t, opts.step(state.t - 1));)
+    ++state.calls;
+    return soft_cost_chunked<FT>(mat, measure, prior, centers, temp, centersums, rowsums,
+                                 [&](size_t i) {return state.evalw[i];}, state.evalids.data(), state.evalids.size());
+}
+
 
 template<typename Matrix, // MatrixType
          typename FT=DefaultFT<Matrix>,
@@ -396,7 +815,8 @@ auto perform_hard_minibatch_clustering(const Matrix &mat,
                                        unsigned int reseed_after=1,
                                        bool with_replacement=true,
                                        uint64_t seed=0,
-                                       bool with_importance_sampling=false)
+                                       bool with_importance_sampling=false,
+                                       const LSHAssignOpts *lshopts=static_cast<LSHAssignOpts *>(nullptr))
 {
     auto tstart = std::chrono::high_resolution_clock::now();
     if(seed == 0) seed = (((uint64_t(std::rand())) << 48) ^ ((uint64_t(std::rand())) << 32)) | ((std::rand() << 16) | std::rand());
@@ -407,39 +827,39 @@ auto perform_hard_minibatch_clustering(const Matrix &mat,
     double initcost = std::numeric_limits<double>::max(), cost = initcost, bestcost = cost;
     std::vector<CtrT>  savectrs = centers;
     using IT = uint64_t;
-    auto compute_point_cost = [&](auto id, auto cid) ALWAYS_INLINE {
-        return msr_with_prior<FT>(measure, row(mat, id, unchecked), centers[cid], prior, prior_sum, rowsums[id], centersums[cid]);
+    // msr is either measure or its MeasureConstant, selected once per loop nest by dispatch_measure
+    auto compute_point_cost = [&](auto msr, auto id, auto cid) ALWAYS_INLINE {
+        return msr_with_prior<FT>(msr, row(mat, id, unchecked), centers[cid], prior, prior_sum, rowsums[id], centersums[cid]);
     };
     const size_t np = costs.size(), k = centers.size();
+    std::unique_ptr<LSHAssigner<FT, CtrT>> lsh;
+    if(lshopts) lsh.reset(new LSHAssigner<FT, CtrT>(*lshopts));
     auto perform_assign = [&]() {
-#define __perform_assign_one(i) do {\
-            double mincost = std::numeric_limits<double>::max();\
-            IT minind = -1;\
-            for(size_t j = 0; j < k; ++j)\
-                if(const double nc = compute_point_cost(i, j);nc < mincost)\
-                    mincost = nc, minind = j;\
-            asn[i] = minind;\
-            costs[i] = mincost;\
-        } while(0)
-        if constexpr(0) {
-        //if constexpr(blaze::IsDenseMatrix_v<Matrix>)
-            for(size_t i = 0; i < np; ++i) __perform_assign_one(i);
-        } else {
+        if(lsh) {
+            lsh->assign(mat, measure, prior, centers, asn, costs, centersums, rowsums);
+            PYBIND11_EXCEPTION_CHECK();
+            return;
+        }
+        dispatch_measure(measure, [&](auto msr) {
             OMP_PFOR_DYN
             for(size_t i = 0; i < np; ++i) {
-                __perform_assign_one(i);
+                double mincost = std::numeric_limits<double>::max();
+                IT minind = -1;
+                for(size_t j = 0; j < k; ++j)
+                    if(const double nc = compute_point_cost(msr, i, j);nc < mincost)
+                        mincost = nc, minind = j;
+                asn[i] = minind;
+                costs[i] = mincost;
             }
-        }
-#undef __perform_assign_one
+        });
         PYBIND11_EXCEPTION_CHECK();
     };
     wy::WyRand<std::make_unsigned_t<IT>> rng(seed);
     schism::Schismatic<std::make_unsigned_t<IT>> div((mat).rows());
-    blz::DV<IT> sampled_indices(mbsize);
-    std::vector<std::vector<IT>> assigned(k);
+    blz::DV<IT> sampled_indices(mbsize), bestinds(mbsize);
+    AssignmentGrouping<IT> assigned;
     blz::DV<FT> wc;
     if(weights) wc.resize(np);
-    blz::DV<uint64_t> center_counts(k);
     shared::flat_hash_set<IT> idxs;
     if(!with_importance_sampling && !with_replacement)
         idxs.reserve(mbsize);
@@ -450,17 +870,10 @@ auto perform_hard_minibatch_clustering(const Matrix &mat,
             // Every once in a while, perform exhaustive center-point-comparisons
             // and restart any centers with no assigned points
             perform_assign();
-            center_counts = 0;
-
-            OMP_PFOR
-            for(size_t i = 0; i < np; ++i) {
-                assert(asn[i] < k);
-                OMP_ATOMIC
-                ++center_counts[asn[i]];
-            }
+            assigned.build(asn, np, k);
             blaze::SmallArray<uint32_t, 8> foundindices;
-            for(size_t i = 0; i < center_counts.size(); ++i)
-                if(center_counts[i] <= reseed_after) // If there are few points assigned to a center, restart it
+            for(size_t i = 0; i < k; ++i)
+                if(assigned.size(i) <= reseed_after) // If there are few points assigned to a center, restart it
                     foundindices.pushBack(i);
             if(foundindices.size()) {
                 std::fprintf(stderr, "Found %zu centers with no assigned points; restart them.\n", foundindices.size());
@@ -489,7 +902,7 @@ auto perform_hard_minibatch_clustering(const Matrix &mat,
                 for(size_t i = 0; i < np; ++i) {
                     auto &ccost = costs[i];
                     for(const auto fidx: foundindices)
-                        if(auto newcost = compute_point_cost(i, fidx);newcost < ccost)
+                        if(auto newcost = compute_point_cost(measure, i, fidx);newcost < ccost)
                              ccost = newcost, asn[i] = fidx;
                 }
             }
@@ -529,28 +942,25 @@ auto perform_hard_minibatch_clustering(const Matrix &mat,
             for(idxs.clear();idxs.size() < mbsize; idxs.insert(div.mod(rng())));
             std::copy(idxs.begin(), idxs.end(), sampled_indices.data());
         }
-        for(auto &i: assigned) i.clear();
-        OMP_ONLY(auto locks = std::make_unique<std::mutex[]>(k);)
+        // Sorted samples give sorted groups
+        shared::sort(sampled_indices.begin(), sampled_indices.end());
         // 2. Compute nearest centers + step sizes
-        OMP_PFOR
-        for(size_t i = 0; i < mbsize; ++i) {
-            const auto ind = sampled_indices[i];
-            IT oldasn = asn[ind], bestind = -1;
-            double bv = std::numeric_limits<double>::max();
-            for(size_t j = 0; j < k; ++j)
-                if(auto nv = compute_point_cost(ind, j); nv < bv)
-                    bv = nv, bestind = j;
-            if(bestind == (IT(-1)))
-                bestind = oldasn;
-            {
-                OMP_ONLY(std::lock_guard<std::mutex> lock(locks[bestind]);)
-                assigned[bestind].push_back(ind);
+        if(lsh) lsh->assign(mat, measure, prior, centers, asn, sampled_indices.data(), mbsize, bestinds, centersums, rowsums);
+        else dispatch_measure(measure, [&](auto msr) {
+            OMP_PFOR
+            for(size_t i = 0; i < mbsize; ++i) {
+                const auto ind = sampled_indices[i];
+                IT oldasn = asn[ind], bestind = -1;
+                double bv = std::numeric_limits<double>::max();
+                for(size_t j = 0; j < k; ++j)
+                    if(auto nv = compute_point_cost(msr, ind, j); nv < bv)
+                        bv = nv, bestind = j;
+                if(bestind == (IT(-1)))
+                    bestind = oldasn;
+                bestinds[i] = bestind;
             }
-        }
-        OMP_PFOR
-        for(size_t i= 0; i < assigned.size(); ++i) {
-            shared::sort(assigned[i].begin(), assigned[i].end());
-        }
+        });
+        assigned.build(mbsize, k, [&](size_t i) {return bestinds[i];}, [&](size_t i) {return sampled_indices[i];});
         // 3. Calculate new center
 #define __perform_one(i) do {\
             auto asnptr = assigned[i].data();\
@@ -576,6 +986,7 @@ auto perform_hard_minibatch_clustering(const Matrix &mat,
     }
     centers = savectrs;
     cost = bestcost;
+    if(lsh) lsh->stats().print(stderr, "perform_hard_minibatch_clustering");
     auto tstop = std::chrono::high_resolution_clock::now();
     std::fprintf(stderr, "clustering for %zu rounds, from cost %0.12g->%0.12g, in %gms\n", iternum, initcost, cost, std::chrono::duration<double, std::milli>(tstop - tstart).count());
     return std::make_tuple(initcost, cost, iternum);
@@ -623,10 +1034,9 @@ auto hmb_coreset_clustering(const Matrix &mat,
     const size_t np = costs.size(), k = centers.size();
     wy::WyRand<std::make_unsigned_t<IT>> rng(seed);
     blz::DV<IT> sampled_indices(mbsize);
-    std::vector<std::vector<IT>> assigned(k);
+    AssignmentGrouping<IT> assigned;
     blz::DV<FT> wc;
     if(weights) wc.resize(np);
-    blz::DV<uint64_t> center_counts(k);
     coresets::CoresetSampler sampler;
     const coresets::SensitivityMethod sm = measure == L1 || measure == L2 ? coresets::VX: coresets::LBK;
     constexpr bool is_dense = blaze::IsDenseMatrix_v<Matrix>;
@@ -654,17 +1064,11 @@ auto hmb_coreset_clustering(const Matrix &mat,
             costs[i] = mincost;
         }
         PYBIND11_EXCEPTION_CHECK();
-        center_counts = 0;
-
-        OMP_PFOR
-        for(size_t i = 0; i < np; ++i) {
-            assert(asn[i] < k);
-            OMP_ATOMIC ++center_counts[asn[i]];
-        }
+        assigned.build(asn, np, k);
         PYBIND11_EXCEPTION_CHECK();
         blaze::SmallArray<uint32_t, 8> foundindices;
-        for(size_t i = 0; i < center_counts.size(); ++i)
-            if(center_counts[i] <= reseed_after) // If there are few points assigned to a center, restart it
+        for(size_t i = 0; i < k; ++i)
+            if(assigned.size(i) <= reseed_after) // If there are few points assigned to a center, restart it
                 foundindices.pushBack(i);
         PYBIND11_EXCEPTION_CHECK();
         if(foundindices.size()) {
@@ -789,11 +1193,122 @@ auto hmb_coreset_clustering(const Matrix &mat,
 }
 
 
+/*
+ * Soft clustering with truncated responsibilities
+ *
+ * Like perform_soft_clustering, but responsibilities are stored in a SparseResponsibilities (CSR)
+ * holding at most m centers per point, and only those with posterior >= threshold,
+ * rather than in dense n x k cost and assignment matrices.
+ * The E-step needs O(k) scratch per thread, and the M-step visits only the stored entries,
+ * so memory is O(n * m) and M-step work drops by a factor of about k / m.
+ * With m = k and threshold = 0, this computes the same centers as perform_soft_clustering.
+ *
+ * Only measures whose centroid is a weighted mean are supported (not L1 or L2).
+ * Centers which receive no responsibility are left unchanged.
+ */
+template<typename FT, typename Mat, typename RespT, typename CtrT, typename WeightT, typename SumT, typename RSumT>
+void set_centroids_sparse_soft(const Mat &mat,
+                               const dist::DissimilarityMeasure measure,
+                               const RespT &resp,
+                               std::vector<CtrT> &centers,
+                               const WeightT *weights,
+                               SumT &centersums,
+                               const RSumT &rowsums)
+{
+    MINOCORE_REQUIRE(measure != distance::L1 && measure != distance::L2, "Truncated soft clustering requires a measure whose centroid is a weighted mean");
+    const size_t k = centers.size();
+    const bool isnorm = msr_is_normalized(measure);
+    blz::DV<double> wsums(k);
+    accumulate_soft_centroids<FT>(mat, resp, centers, wsums,
+                                  [weights](size_t i) {return weights ? double((*weights)[i]): 1.;},
+                                  [&rowsums,isnorm](size_t i) {return isnorm ? 1. / double(rowsums[i]): 1.;});
+    OMP_PFOR
+    for(size_t j = 0; j < k; ++j) {
+        if(wsums[j] > 0.) centers[j] *= 1. / wsums[j];
+        centersums[j] = sum(centers[j]);
+    }
+}
+
+template<typename MT, // MatrixType
+         typename FT=std::conditional_t<(sizeof(ElementType_t<MT>) <= 4), float, double>,
+         typename CtrT=blz::DynamicVector<FT, rowVector>, // Vector Type
+         typename RFT=float, typename IT=uint32_t,
+         typename PriorT=blaze::DynamicVector<FT, rowVector>,
+         typename WeightT=blz::DV<FT, rowVector> // Vector Type
+        >
+auto perform_sparse_soft_clustering(const MT &mat,
+                                    const dist::DissimilarityMeasure measure,
+                                    const PriorT &prior,
+                                    std::vector<CtrT> &centers,
+                                    SparseResponsibilities<RFT, IT> &resp,
+                                    size_t m,
+                                    double threshold=0.,
+                                    double temperature=1.,
+                                    size_t maxiter=size_t(-1),
+                                    const WeightT *weights=static_cast<WeightT *>(nullptr),
+                                    double eps=DEFAULT_EPS)
+{
+    MINOCORE_VALIDATE(dist::is_valid_measure(measure));
+    const size_t np = mat.rows(), k = centers.size();
+    auto centers_cpy(centers);
+    blz::DV<double> centersums = blaze::generate(k, [&](auto x){return blz::sum(centers[x]);});
+    const blz::DV<double> rowsums = sum<rowwise>(mat);
+    const double prior_sum =
+        prior.size() == 0 ? 0.
+                          : prior.size() == 1
+                          ? double(prior[0] * mat.columns())
+                          : double(blz::sum(prior));
+    auto getw = [weights](size_t i) {return weights ? double((*weights)[i]): 1.;};
+    std::unique_ptr<SparsePriorKernel<FT>> kernel;
+    if constexpr(blaze::IsSparseMatrix_v<MT> || util::IsCSparseMatrix_v<MT>) {
+        if(SparsePriorKernel<FT>::applicable(measure, prior))
+            kernel.reset(new SparsePriorKernel<FT>(measure, prior[0], mat.columns()));
+    }
+    auto estep = [&](const std::vector<CtrT> &ctrs) {
+        if(kernel) kernel->set_centers(ctrs, centersums);
+        return resp.build(np, k, m, threshold, temperature, [&](size_t i, size_t j) ALWAYS_INLINE {
+            if constexpr(blaze::IsSparseMatrix_v<MT> || util::IsCSparseMatrix_v<MT>)
+                if(kernel) return double((*kernel)(row(mat, i, unchecked), rowsums[i], j));
+            return double(msr_with_prior<FT>(measure, row(mat, i, unchecked), ctrs[j], prior, prior_sum, rowsums[i], centersums[j]));
+        }, getw);
+    };
+    double cost = estep(centers);
+    const double initcost = cost;
+    std::fprintf(stderr, "[%s] initial cost: %0.12g, with %zu/%zu stored responsibilities\n", __func__, cost, resp.nnz(), np * k);
+    size_t iternum = 0;
+    for(;;) {
+        PYBIND11_EXCEPTION_CHECK();
+        set_centroids_sparse_soft<FT>(mat, measure, resp, centers_cpy, weights, centersums, rowsums);
+        const double newcost = estep(centers_cpy);
+        DBG_ONLY(std::fprintf(stderr, "oldcost: %.20g. newcost: %.20g. Difference: %0.20g. nnz: %zu\n", cost, newcost, cost - newcost, resp.nnz());)
+        const bool improved = newcost <= cost;
+        const double delta = cost - newcost;
+        if(improved) {
+            std::copy(centers_cpy.begin(), centers_cpy.end(), centers.begin());
+            cost = newcost;
+        }
+        if(delta <= eps * std::max(cost, newcost) || ++iternum == maxiter) {
+            if(!improved) {
+                // Restore responsibilities for the returned centers
+                centersums = blaze::generate(k, [&](auto x){return blz::sum(centers[x]);});
+                estep(centers);
+            }
+            break;
+        }
+    }
+    return std::make_tuple(initcost, cost, iternum);
+}
+
+
 
 } // namespace clustering
 using clustering::perform_hard_clustering;
 using clustering::perform_hard_minibatch_clustering;
+using clustering::LSHAssignOpts;
+using clustering::LSHAssigner;
 using clustering::perform_soft_clustering;
+using clustering::perform_sparse_soft_clustering;
+using clustering::SparseResponsibilities;
 using clustering::hmb_coreset_clustering;
 
 } // namespace minicore
@@ -1,6 +1,7 @@
 #ifndef SQRL2_DETAIL_H__
 #define SQRL2_DETAIL_H__
 #include "mtx2cs.h"
+#include "minicore/clustering/accumulate.h"
 
 namespace minicore {
 
@@ -31,26 +32,16 @@ kmeans_sum_core(blz::SM<FT> &mat, std::string DBG_ONLY(out), SumOpts &opts) {
         std::fprintf(stderr, "Center %u initialized by index %u and has sum of %g\n", i, indices[i], blz::sum(centers[i]));
 #endif
     }
-    if(opts.stamper_) opts.stamper_->add_event("Setup locks + counts");
+    if(opts.stamper_) opts.stamper_->add_event("Setup counts");
     FT tcost = blz::sum(costs), firstcost = tcost;
     size_t iternum = 0;
-    OMP_ONLY(std::unique_ptr<std::mutex[]> mutexes(new std::mutex[opts.k]);)
     std::unique_ptr<uint32_t[]> counts(new uint32_t[opts.k]);
     if(opts.stamper_) opts.stamper_->add_event("Optimize");
     for(;;) {
         std::fprintf(stderr, "[Iter %zu] Cost: %g\n", iternum, tcost);
         // Set centers
         center_setup:
-        for(auto &c: centers) c = 0.;
-        std::fill_n(counts.get(), opts.k, 0u);
-        OMP_PFOR
-        for(size_t i = 0; i < mat.rows(); ++i) {
-            auto myasn = asn[i];
-            OMP_ONLY(std::lock_guard<std::mutex> lock(mutexes[myasn]);)
-            centers[myasn] += row(mat, i, blaze::unchecked);
-            OMP_ATOMIC
-            ++counts[myasn];
-        }
+        clustering::accumulate_centroids<FT>(mat, asn, centers, counts);
         blz::SmallArray<uint32_t, 16> sa;
         for(unsigned i = 0; i < opts.k; ++i) {
             if(counts[i]) {
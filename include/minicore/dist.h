@@ -2,5 +2,9 @@
 #define FGC_DISTANCE_HEADERS_
 #include <minicore/dist/applicator.h>
 #include <minicore/dist/distance.h>
+#include <minicore/dist/batched.h>
+#include <minicore/dist/priorkernel.h>
 #include <minicore/dist/knngraph.h>
+#include <minicore/dist/pairwise.h>
+#include <minicore/dist/nndescent.h>
 #endif
@@ -7,6 +7,8 @@
 #include "distmat/distmat.h"
 #include "minicore/optim/kmeans.h"
 #include "minicore/util/csc.h"
+#include "minicore/util/cpudispatch.h"
+#include "minicore/dist/pairwise.h"
 #include <set>
 #include <x86intrin.h>
 #include "sleef.h"
@@ -34,6 +36,38 @@ using namespace minicore::distance;
             MACRO(L1) MACRO(L2) MACRO(SQRL2)\
             MACRO(TOTAL_VARIATION_DISTANCE)
 
+/*
+ * Compile-time measure dispatch
+ *
+ * dispatch_measure(msr, f) switches on msr once and calls f(MeasureConstant<msr>{}),
+ * so that f can run a whole loop nest with a measure-specialized kernel.
+ * msr_with_prior and DissimilarityApplicator::operator()(i, j, msr) accept a MeasureConstant
+ * in place of a runtime measure, and their per-pair switches then fold away.
+ * Measures outside DISPATCH_MSR_MACRO are passed through as runtime values.
+ *
+ * Each call site instantiates its loop once per measure. Define MINOCORE_NO_MEASURE_DISPATCH
+ * to pass the runtime measure through instead, trading speed for compile time and binary size.
+ */
+template<DissimilarityMeasure M>
+using MeasureConstant = std::integral_constant<DissimilarityMeasure, M>;
+
+template<typename T> struct is_measure_constant: std::false_type {};
+template<DissimilarityMeasure M> struct is_measure_constant<MeasureConstant<M>>: std::true_type {};
+template<typename T> static constexpr bool is_measure_constant_v = is_measure_constant<std::decay_t<T>>::value;
+
+template<typename F>
+INLINE decltype(auto) dispatch_measure(DissimilarityMeasure msr, F &&f) {
+#ifndef MINOCORE_NO_MEASURE_DISPATCH
+    switch(msr) {
+#define DM_CASE(x) case x: return f(MeasureConstant<x>{});
+        DISPATCH_MSR_MACRO(DM_CASE)
+#undef DM_CASE
+        default: ;
+    }
+#endif
+    return f(msr);
+}
+
 template<typename MatrixType, typename ElementType=blaze::ElementType_t<MatrixType>>
 class DissimilarityApplicator {
     static constexpr bool IS_CSC_VIEW    = is_csc_view_v<MatrixType>;
@@ -91,6 +125,13 @@ public:
         const size_t nr = m.rows();
         assert(nr == m.columns());
         assert(nr == data_.rows());
+        if constexpr(blaze::IsDenseMatrix_v<MatType>) {
+            PairwiseOpts opts;
+            opts.symmetrize = symmetrize;
+            opts.zero_diagonal = true; // As below: the diagonal is never evaluated
+            fill_pairwise_tiled(m, nr, distance::is_symmetric(measure), [this](size_t i, size_t j) {return this->call<measure>(i, j);}, opts);
+            return;
+        }
         static constexpr DissimilarityMeasure actual_measure =
             measure == JSM ? JSD
                 : measure == COSINE_DISTANCE ? COSINE_SIMILARITY
@@ -166,6 +207,17 @@ public:
             default: throw std::invalid_argument(std::string("unknown dissimilarity measure: ") + std::to_string(int(measure)) + dist::prob2str(measure));
         }
     }
+    /*
+     * Tiled all-pairs distances into out, which may be a blaze dense matrix, diskmat::DiskMat or diskmat::PolymorphicMat.
+     * Returns the number of distances computed and the time taken. See dist/pairwise.h.
+     */
+    template<typename OutMat>
+    PairwiseStats pairwise_distances(OutMat &out, DissimilarityMeasure measure, const PairwiseOpts &opts=PairwiseOpts()) const {
+        MINOCORE_REQUIRE(measure != ORACLE_METRIC && measure != ORACLE_PSEUDOMETRIC, "Oracle measures are placeholders and cannot be computed");
+        return dispatch_measure(measure, [&](auto m) {
+            return fill_pairwise_tiled(out, data_.rows(), distance::is_symmetric(measure), [&](size_t i, size_t j) {return this->operator()(i, j, m);}, opts);
+        });
+    }
     template<typename OFT=FT>
     blaze::DynamicMatrix<OFT> make_distance_matrix(bool symmetrize=false) const {
         return make_distance_matrix<OFT>(measure_, symmetrize);
@@ -262,6 +314,38 @@ public:
     }
 
 
+    // Dense row-major data against a contiguous operand: L1/L2/SQRL2 use the multiversioned kernels in util/cpudispatch.h
+    template<typename OT>
+    static constexpr bool MV_DENSE = IS_DENSE_BLAZE && IsRowMajorMatrix_v<MatrixType>
+                                     && std::is_same_v<std::remove_cv_t<blaze::ElementType_t<MatrixType>>, ET>
+                                     && util::mv::is_contiguous_v<OT, ET>;
+    template<DissimilarityMeasure constexpr_measure>
+    FT mv_norm(size_t i, const ET *y) const {
+        const ET *const x = blaze::row(data_, i BLAZE_CHECK_DEBUG).data();
+        if constexpr(constexpr_measure == L1) {
+            return util::mv::l1_scaled_diff(x, row_sums_[i], y, data_.columns());
+        } else {
+            const FT ret = util::mv::sqrl2_scaled_diff(x, row_sums_[i], y, data_.columns());
+            return constexpr_measure == L2 ? std::sqrt(ret): ret;
+        }
+    }
+    template<DissimilarityMeasure constexpr_measure>
+    FT mv_norm(size_t i, size_t j) const {
+        // |x_i s_i - x_j s_j| = s_j |x_i (s_i / s_j) - x_j|; both measures are symmetric, so scale by the nonzero sum
+        if(row_sums_[j] == 0) {
+            if(row_sums_[i] == 0) return FT(0);
+            std::swap(i, j);
+        }
+        const FT sj = row_sums_[j];
+        const ET *const x = blaze::row(data_, i BLAZE_CHECK_DEBUG).data(), *const y = blaze::row(data_, j BLAZE_CHECK_DEBUG).data();
+        if constexpr(constexpr_measure == L1) {
+            return util::mv::l1_scaled_diff(x, ET(row_sums_[i] / sj), y, data_.columns()) * sj;
+        } else {
+            const FT ret = util::mv::sqrl2_scaled_diff(x, ET(row_sums_[i] / sj), y, data_.columns()) * (sj * sj);
+            return constexpr_measure == L2 ? std::sqrt(ret): ret;
+        }
+    }
+
     // Accessors
     decltype(auto) weighted_row(size_t ind) const {
         return blaze::row(data_, ind BLAZE_CHECK_DEBUG) * row_sums_[ind];
@@ -302,6 +386,8 @@ public:
         FT ret;
         if constexpr(constexpr_measure == TOTAL_VARIATION_DISTANCE) {
             ret = tvd(o, i);
+        } else if constexpr((constexpr_measure == L1 || constexpr_measure == L2 || constexpr_measure == SQRL2) && MV_DENSE<OT>) {
+            ret = mv_norm<constexpr_measure>(i, o.data());
         } else if constexpr(constexpr_measure == L1) {
             ret = l1Norm(weighted_row(i) - o);
         } else if constexpr(constexpr_measure == L2) {
@@ -359,6 +445,8 @@ public:
         assert(i < this->data().rows());
         if constexpr(constexpr_measure == TOTAL_VARIATION_DISTANCE) {
             ret = tvd(i, o);
+        } else if constexpr((constexpr_measure == L1 || constexpr_measure == L2 || constexpr_measure == SQRL2) && MV_DENSE<OT>) {
+            ret = mv_norm<constexpr_measure>(i, o.data());
         } else if constexpr(constexpr_measure == L1) {
             ret = l1Norm(weighted_row(i) - o);
         } else if constexpr(constexpr_measure == L2) {
@@ -424,6 +512,8 @@ public:
         FT ret;
         if constexpr(constexpr_measure == TOTAL_VARIATION_DISTANCE) {
             ret = tvd(i, j);
+        } else if constexpr((constexpr_measure == L1 || constexpr_measure == L2 || constexpr_measure == SQRL2) && MV_DENSE<VecT>) {
+            ret = mv_norm<constexpr_measure>(i, j);
         } else if constexpr(constexpr_measure == L1) {
             ret = l1Norm(weighted_row(i) - weighted_row(j));
         } else if constexpr(constexpr_measure == L2) {
@@ -555,6 +645,11 @@ public:
         }
         return ret;
     }
+    template<DissimilarityMeasure M>
+    INLINE FT operator()(size_t i, size_t j, MeasureConstant<M>) const noexcept {
+        assert(i < data_.rows() && j < data_.rows());
+        return call<M>(i, j);
+    }
     INLINE FT operator()(size_t i, size_t j, DissimilarityMeasure measure) const noexcept {
         if(unlikely(i >= data_.rows() || j >= data_.rows())) {
             std::cerr << (std::string("Invalid rows selection: ") + std::to_string(i) + ", " + std::to_string(j) + '\n');
@@ -1595,6 +1690,21 @@ auto make_jsm_applicator(MatrixType &data, Prior prior=NONE, const PriorContaine
     return make_probdiv_applicator(data, JSM, prior, pc);
 }
 
+/*
+ * All-pairs distances under measure, streamed tile by tile into a memory-mapped matrix at path.
+ * RAM use is independent of n; see dist/pairwise.h.
+ */
+template<typename OFT=float, typename MatrixType>
+diskmat::DiskMat<OFT> make_distance_diskmat(const DissimilarityApplicator<MatrixType> &app, std::string path, DissimilarityMeasure measure, const PairwiseOpts &opts=PairwiseOpts()) {
+    diskmat::DiskMat<OFT> ret(app.size(), app.size(), path);
+    app.pairwise_distances(ret, measure, opts);
+    return ret;
+}
+template<typename OFT=float, typename MatrixType>
+diskmat::DiskMat<OFT> make_distance_diskmat(const DissimilarityApplicator<MatrixType> &app, std::string path, const PairwiseOpts &opts=PairwiseOpts()) {
+    return make_distance_diskmat<OFT>(app, path, app.get_measure(), opts);
+}
+
 
 template<typename MatrixType>
 auto make_kmc2(const DissimilarityApplicator<MatrixType> &app, unsigned k, size_t m=2000, uint64_t seed=13) {
@@ -1602,10 +1712,38 @@ auto make_kmc2(const DissimilarityApplicator<MatrixType> &app, unsigned k, size_
     return coresets::kmc2(app, gen, app.size(), k, m);
 }
 
+/*
+ * use_bounds: skip distance computations using the triangle inequality.
+ * This is only applied for metrics and for squared metrics (SQRL2, JSD); the result is unchanged.
+ * stats: if non-null, receives the number of distance computations made and avoided.
+ */
 template<typename MatrixType, typename WFT=blaze::ElementType_t<MatrixType>>
-auto make_kmeanspp(const DissimilarityApplicator<MatrixType> &app, unsigned k, uint64_t seed=13, const WFT *weights=nullptr, bool use_exponential_skips=false, bool parallelize=blaze::IsDenseMatrix_v<MatrixType>) {
+auto make_kmeanspp(const DissimilarityApplicator<MatrixType> &app, unsigned k, uint64_t seed=13, const WFT *weights=nullptr, bool use_exponential_skips=false, bool parallelize=blaze::IsDenseMatrix_v<MatrixType>,
+                   bool use_bounds=false, coresets::SeedingStats *stats=nullptr) {
     wy::WyRand<uint64_t> gen(seed);
-    return coresets::kmeanspp(app, gen, app.size(), k, weights, use_exponential_skips, parallelize);
+    const auto msr = app.get_measure();
+    const coresets::SeedingBounds bounds = !use_bounds ? coresets::NO_BOUNDS
+                                         : satisfies_metric(msr) ? coresets::METRIC_BOUNDS
+                                         : msr == SQRL2 || msr == JSD ? coresets::SQUARED_METRIC_BOUNDS
+                                         : coresets::NO_BOUNDS;
+    return dispatch_measure(msr, [&](auto cmsr) {
+        auto oracle = [&app,cmsr](size_t i, size_t j) ALWAYS_INLINE {return app(i, j, cmsr);};
+        return coresets::kmeanspp(oracle, gen, app.size(), k, weights, /*lspprounds=*/0, use_exponential_skips, parallelize, /*n_local_samples=*/1, bounds, stats);
+    });
+}
+
+/*
+ * kmeans|| seeding: O(log n) parallel oversampling rounds, followed by weighted kmeans++ over the candidates.
+ * See coresets::kmeans_parallel.
+ */
+template<typename MatrixType, typename WFT=blaze::ElementType_t<MatrixType>>
+auto make_kmeans_parallel(const DissimilarityApplicator<MatrixType> &app, unsigned k, uint64_t seed=13, const WFT *weights=nullptr,
+                          double oversampling_factor=2., size_t nrounds=0, bool parallelize=blaze::IsDenseMatrix_v<MatrixType>) {
+    wy::WyRand<uint64_t> gen(seed);
+    return dispatch_measure(app.get_measure(), [&](auto cmsr) {
+        auto oracle = [&app,cmsr](size_t i, size_t j) ALWAYS_INLINE {return app(i, j, cmsr);};
+        return coresets::kmeans_parallel(oracle, gen, app.size(), k, weights, oversampling_factor, nrounds, parallelize);
+    });
 }
 
 template<typename MatrixType, typename WFT=blaze::ElementType_t<MatrixType>>
@@ -1622,16 +1760,20 @@ auto make_d2_coreset_sampler(const DissimilarityApplicator<MatrixType> &app, uns
     return cs;
 }
 
-template<typename FT=float, typename CtrT, typename MatrixRowT, typename PriorT, typename PriorSumT, typename SumT, typename OSumT>
-double msr_with_prior(dist::DissimilarityMeasure msr, const CtrT &ctr, const MatrixRowT &mr, const PriorT &prior, PriorSumT prior_sum, SumT ctrsum, OSumT mrsum)
+/*
+ * msr may be a runtime DissimilarityMeasure or a MeasureConstant (see dispatch_measure),
+ * in which case every branch on the measure is resolved at compile time.
+ */
+template<typename FT=float, typename MsrT, typename CtrT, typename MatrixRowT, typename PriorT, typename PriorSumT, typename SumT, typename OSumT>
+double msr_with_prior(MsrT msr, const CtrT &ctr, const MatrixRowT &mr, const PriorT &prior, PriorSumT prior_sum, SumT ctrsum, OSumT mrsum)
 {
     static_assert(std::is_floating_point_v<FT>, "FT must be floating-point");
+    static_assert(std::is_same_v<MsrT, dist::DissimilarityMeasure> || is_measure_constant_v<MsrT>, "msr must be a DissimilarityMeasure or a MeasureConstant");
     const size_t nd = mr.size();
+    // Scratch buffers are per-thread, so they can be grown without synchronization
     thread_local blz::DV<FT> tmpmulx, tmpmuly;
-    OMP_CRITICAL {
-        if(tmpmulx.capacity() < nd) tmpmulx.resize(nd);
-        if(tmpmuly.capacity() < nd) tmpmuly.resize(nd);
-    }
+    if(tmpmulx.size() < nd) tmpmulx.resize(nd);
+    if(tmpmuly.size() < nd) tmpmuly.resize(nd);
     FT lhsum = mrsum + prior_sum;
     FT rhsum = ctrsum + prior_sum;
 #ifndef SMALLEST_PRIOR
@@ -1730,7 +1872,7 @@ double msr_with_prior(dist::DissimilarityMeasure msr, const CtrT &ctr, const Mat
                 } else if(msr == LLR || msr == UWLLR || msr == SRULRT || msr == SRLRT) {
                     klc = libkl::llr_reduce_aligned(tmpmulx.data(), tmpmuly.data(), nd, lhsum / (lhsum + rhsum), lhinc, rhinc);
                 } else if(msr == ITAKURA_SAITO) {
-                    lkc = msr == ITAKURA_SAITO ? libkl::is_reduce_aligned(tmpmulx.data(), tmpmuly.data(), nd, lhinc, rhinc)
+                    klc = msr == ITAKURA_SAITO ? libkl::is_reduce_aligned(tmpmulx.data(), tmpmuly.data(), nd, lhinc, rhinc)
                                                : libkl::is_reduce_aligned(tmpmuly.data(), tmpmulx.data(), nd, rhinc, lhinc);
                 } else if(msr == SIS || msr == RSIS) {
                     klc = msr == SIS ?
@@ -1905,12 +2047,12 @@ double msr_with_prior(dist::DissimilarityMeasure msr, const CtrT &ctr, const Mat
         return msr_with_prior(msr, cv, mr, prior, prior_sum, ctrsum, mrsum);
     }
 }
-template<typename CtrT, typename MatrixRowT, typename PriorT, typename PriorSumT, typename SumT, typename OSumT>
-static INLINE double dmsr_with_prior(dist::DissimilarityMeasure msr, const CtrT &ctr, const MatrixRowT &mr, const PriorT &prior, PriorSumT prior_sum, SumT ctrsum, OSumT mrsum) {
+template<typename MsrT, typename CtrT, typename MatrixRowT, typename PriorT, typename PriorSumT, typename SumT, typename OSumT>
+static INLINE double dmsr_with_prior(MsrT msr, const CtrT &ctr, const MatrixRowT &mr, const PriorT &prior, PriorSumT prior_sum, SumT ctrsum, OSumT mrsum) {
     return msr_with_prior<double>(msr, ctr, mr, prior, prior_sum, ctrsum, mrsum);
 }
-template<typename CtrT, typename MatrixRowT, typename PriorT, typename PriorSumT, typename SumT, typename OSumT>
-static INLINE double fmsr_with_prior(dist::DissimilarityMeasure msr, const CtrT &ctr, const MatrixRowT &mr, const PriorT &prior, PriorSumT prior_sum, SumT ctrsum, OSumT mrsum) {
+template<typename MsrT, typename CtrT, typename MatrixRowT, typename PriorT, typename PriorSumT, typename SumT, typename OSumT>
+static INLINE double fmsr_with_prior(MsrT msr, const CtrT &ctr, const MatrixRowT &mr, const PriorT &prior, PriorSumT prior_sum, SumT ctrsum, OSumT mrsum) {
     return msr_with_prior<float>(msr, ctr, mr, prior, prior_sum, ctrsum, mrsum);
 }
 
@@ -1923,10 +2065,14 @@ using jsd::DissimilarityApplicator;
 using jsd::make_d2_coreset_sampler;
 using jsd::make_kmc2;
 using jsd::make_kmeanspp;
+using jsd::make_kmeans_parallel;
 using jsd::make_jsm_applicator;
+using jsd::make_distance_diskmat;
 using jsd::make_probdiv_applicator;
 
 using cmp::msr_with_prior;
+using cmp::dispatch_measure;
+using cmp::MeasureConstant;
 using cmp::fmsr_with_prior;
 using cmp::dmsr_with_prior;
 
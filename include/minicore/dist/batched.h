@@ -0,0 +1,198 @@
+#ifndef MINOCORE_DIST_BATCHED_H__
+#define MINOCORE_DIST_BATCHED_H__
+#include "minicore/dist/distance.h"
+#include "minicore/util/csc.h"
+
+namespace minicore {
+
+namespace distance {
+
+/*
+ * Batched (GEMM-based) hard assignment
+ *
+ * For measures which are functions of inner products (SQRL2, L2, cosine distance, dot product),
+ * we expand ||x - c||^2 = ||x||^2 - 2 x.c + ||c||^2 and compute the cross terms
+ * for a tile of rows against all centers with one matrix-matrix product
+ * (dense GEMM, or sparse-times-dense for blaze sparse and util::CSparseMatrix rows),
+ * fusing the argmin (or argmax, for similarities) over each tile.
+ * This moves assignment from per-pair, memory-bound loops to BLAS-3.
+ *
+ * Cosine distances include the Dirichlet prior as in msr_with_prior, by shifting
+ * each point and center by pv; this is handled analytically using row/center sums.
+ * For sparse rows, msr_with_prior only shifts the union of the point's and the center's nonzeros,
+ * so the pv^2 terms of features zero in both are removed, counting overlaps
+ * with a second pass over each row's nonzeros against the centers' support.
+ * Only scalar priors (prior.size() <= 1) are supported.
+ * Probability cosine distance is scale-invariant and is therefore identical.
+ * For DOT_PRODUCT_SIMILARITY, the highest-scoring center is chosen and costs hold similarities;
+ * since it is not minimized, the clustering solvers do not dispatch it here.
+ */
+
+static constexpr INLINE bool supports_batched_assignment(DissimilarityMeasure d) {
+    switch(d) {
+        case L2: case SQRL2:
+        case COSINE_DISTANCE: case PROBABILITY_COSINE_DISTANCE:
+        case DOT_PRODUCT_SIMILARITY:
+            return true;
+        default: ;
+    }
+    return false;
+}
+
+// Measures which the clustering solvers assign in batches (those minimized by hard clustering)
+static constexpr INLINE bool supports_batched_clustering(DissimilarityMeasure d) {
+    return supports_batched_assignment(d) && d != DOT_PRODUCT_SIMILARITY;
+}
+
+#ifndef MINOCORE_BATCHED_TILESIZE
+#define MINOCORE_BATCHED_TILESIZE 256
+#endif
+
+/*
+ * ctrt: centers, transposed (d x k)
+ * cnorms: squared norms of (prior-shifted) centers
+ * csums: center sums, only used for cosine distances with pv > 0
+ * For sparse rows with cosine distances and pv > 0, the support of each center
+ * is taken from the nonzeros of ctrt.
+ */
+template<typename FT, typename Mat, typename AsnT, typename CostsT>
+void batched_assign(const Mat &mat, const DissimilarityMeasure msr,
+                    const blz::DM<FT> &ctrt, const blz::DV<FT> &cnorms, const blz::DV<FT> &csums, const FT pv,
+                    AsnT &asn, CostsT &costs, size_t tilesize=MINOCORE_BATCHED_TILESIZE)
+{
+    static_assert(blaze::IsMatrix_v<Mat> || util::IsCSparseMatrix_v<Mat>, "Mat must be a blaze matrix or a CSparseMatrix");
+    MINOCORE_REQUIRE(supports_batched_assignment(msr), "Measure does not support batched assignment");
+    const size_t np = mat.rows(), nd = mat.columns(), k = ctrt.columns();
+    assert(ctrt.rows() == nd);
+    if(tilesize == 0) tilesize = MINOCORE_BATCHED_TILESIZE;
+    const size_t ntiles = (np + tilesize - 1) / tilesize;
+    const bool is_sqr = msr == L2 || msr == SQRL2, is_cos = msr == COSINE_DISTANCE || msr == PROBABILITY_COSINE_DISTANCE;
+    const FT pvshift = pv * pv * nd;
+    static constexpr bool is_sparse = blaze::IsSparseMatrix_v<Mat> || util::IsCSparseMatrix_v<Mat>;
+    const bool use_support = is_sparse && is_cos && pv != FT(0);
+    blz::DM<FT> csupport;
+    blz::DV<FT> cnnz;
+    if(use_support) {
+        csupport = blz::map(ctrt, [](FT v) {return FT(v != FT(0));});
+        cnnz = trans(blz::sum<blz::columnwise>(csupport));
+    }
+    OMP_PRAGMA("omp parallel")
+    {
+        blz::DM<FT> dots;
+        blz::DV<FT, blz::rowVector> overlap;
+        OMP_PRAGMA("omp for schedule(dynamic)")
+        for(size_t t = 0; t < ntiles; ++t) {
+            const size_t rbeg = t * tilesize, nr = std::min(tilesize, np - rbeg);
+            dots.resize(nr, k, false);
+            if constexpr(blaze::IsMatrix_v<Mat>) {
+                dots = blz::serial(submatrix(mat, rbeg, 0, nr, nd) * ctrt);
+            } else {
+                dots = FT(0);
+                for(size_t i = 0; i < nr; ++i) {
+                    auto r = row(mat, rbeg + i, blz::unchecked);
+                    auto dr = row(dots, i, blz::unchecked);
+                    for(size_t n = 0; n < r.n_; ++n)
+                        dr += blz::serial(FT(r.data_[n]) * row(ctrt, r.indices_[n], blz::unchecked));
+                }
+            }
+            for(size_t i = 0; i < nr; ++i) {
+                const size_t id = rbeg + i;
+                FT xn = 0., xs = 0., xnnz = 0.;
+                if(use_support) overlap.resize(k), overlap = FT(0);
+                if constexpr(blaze::IsMatrix_v<Mat>) {
+                    auto r = row(mat, id, blz::unchecked);
+                    xn = blz::sqrNorm(r);
+                    if(is_cos && pv) xs = blz::sum(r);
+                    if constexpr(blaze::IsSparseMatrix_v<Mat>) {
+                        if(use_support) {
+                            for(const auto &pair: r)
+                                overlap += blz::serial(row(csupport, pair.index(), blz::unchecked));
+                            xnnz = nonZeros(r);
+                        }
+                    }
+                } else {
+                    auto r = row(mat, id, blz::unchecked);
+                    for(size_t n = 0; n < r.n_; ++n) {
+                        const FT v = r.data_[n];
+                        xn += v * v; xs += v;
+                    }
+                    if(use_support) {
+                        for(size_t n = 0; n < r.n_; ++n)
+                            overlap += blz::serial(row(csupport, r.indices_[n], blz::unchecked));
+                        xnnz = r.n_;
+                    }
+                }
+                auto dr = row(dots, i, blz::unchecked);
+                uint32_t bestid = 0;
+                double best;
+                if(is_sqr) {
+                    best = std::numeric_limits<double>::max();
+                    for(size_t j = 0; j < k; ++j)
+                        if(const double v = cnorms[j] - 2. * dr[j]; v < best)
+                            best = v, bestid = j;
+                    best = std::max(best + xn, 0.);
+                    if(msr == L2) best = std::sqrt(best);
+                } else if(is_cos) {
+                    const double xnorm2 = xn + pv * (2. * xs) + pvshift;
+                    best = -std::numeric_limits<double>::max();
+                    for(size_t j = 0; j < k; ++j) {
+                        // Features zero in both the row and the center are not shifted by the prior
+                        const double zshift = use_support ? double(pv) * pv * (nd - xnnz - cnnz[j] + overlap[j]): 0.;
+                        const double denom = std::sqrt(std::max(xnorm2 - zshift, 0.) * std::max(cnorms[j] - zshift, 0.));
+                        const double sim = denom > 0. ? (dr[j] + pv * (xs + csums[j]) + pvshift - zshift) / denom: 0.;
+                        if(sim > best) best = sim, bestid = j;
+                    }
+                    best = std::acos(std::max(std::min(best, 1.), 0.)) * 0.31830988618379067153;
+                } else {
+                    best = -std::numeric_limits<double>::max();
+                    for(size_t j = 0; j < k; ++j)
+                        if(dr[j] > best) best = dr[j], bestid = j;
+                }
+                asn[id] = bestid;
+                costs[id] = best;
+            }
+        }
+    }
+}
+
+template<typename FT, typename Mat, typename PriorT, typename CtrT, typename AsnT, typename CostsT>
+void assign_points_batched(const Mat &mat, const DissimilarityMeasure msr, const PriorT &prior,
+                           const std::vector<CtrT> &centers,
+                           AsnT &asn, CostsT &costs, size_t tilesize=MINOCORE_BATCHED_TILESIZE)
+{
+    const size_t nd = mat.columns(), k = centers.size();
+    const bool is_cos = msr == COSINE_DISTANCE || msr == PROBABILITY_COSINE_DISTANCE;
+    MINOCORE_REQUIRE(!is_cos || prior.size() <= 1, "Batched cosine assignment only supports scalar priors");
+    const FT pv = is_cos && prior.size() ? FT(prior[0]): FT(0);
+    blz::DM<FT> ctrt(nd, k);
+    blz::DV<FT> cnorms(k), csums(k);
+    OMP_PFOR
+    for(size_t j = 0; j < k; ++j) {
+        if constexpr(blz::TransposeFlag_v<CtrT> == blz::rowVector)
+            column(ctrt, j) = trans(centers[j]);
+        else
+            column(ctrt, j) = centers[j];
+        csums[j] = blz::sum(centers[j]);
+        cnorms[j] = blz::sqrNorm(centers[j]) + pv * (2. * csums[j] + pv * nd);
+    }
+    batched_assign(mat, msr, ctrt, cnorms, csums, pv, asn, costs, tilesize);
+}
+
+template<typename Mat, typename CMT, bool CSO, typename AsnT, typename CostsT>
+void assign_points_batched(const Mat &mat, const DissimilarityMeasure msr,
+                           const blaze::Matrix<CMT, CSO> &centers,
+                           AsnT &asn, CostsT &costs, size_t tilesize=MINOCORE_BATCHED_TILESIZE)
+{
+    using CET = blz::ElementType_t<CMT>;
+    using FT = std::conditional_t<std::is_floating_point_v<CET>, CET, double>;
+    MINOCORE_REQUIRE(msr != COSINE_DISTANCE && msr != PROBABILITY_COSINE_DISTANCE, "Use the prior-aware overload for cosine distances");
+    const blz::DM<FT> ctrt = trans(*centers);
+    const blz::DV<FT> cnorms = blz::sum<blz::rowwise>(*centers % *centers), csums;
+    batched_assign(mat, msr, ctrt, cnorms, csums, FT(0), asn, costs, tilesize);
+}
+
+} // namespace distance
+
+} // namespace minicore
+
+#endif /* MINOCORE_DIST_BATCHED_H__ */
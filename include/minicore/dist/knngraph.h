@@ -6,88 +6,175 @@
 
 namespace minicore {
 
+#ifndef MINOCORE_KNN_TILESIZE
+#define MINOCORE_KNN_TILESIZE 256
+#endif
+
+namespace detail {
+/*
+ * Circle-method round robin over m (even) blocks: in each of rounds 0..m-2,
+ * slots 0..m/2-1 pair every block with exactly one other, and every unordered pair occurs in exactly one round.
+ */
+static inline std::pair<size_t, size_t> round_robin_pair(size_t round, size_t slot, size_t m) {
+    if(slot == 0) return {round, m - 1};
+    return {(round + slot) % (m - 1), (round + m - 1 - slot) % (m - 1)};
+}
+} // namespace detail
+
+/*
+ * Exact k-nearest neighbors: k (distance, index) pairs per point, nearest first
+ * (most similar first, for similarity measures). A point is never its own neighbor.
+ *
+ * Points are cut into blocks of tilesize rows. Distances are computed a tile (block x block) at a time into
+ * a thread-local buffer and folded into bounded heaps kept in place in the output; no locks are taken.
+ * Asymmetric measures give each thread whole stripes of query blocks, so only it writes their heaps.
+ * Symmetric measures compute each pair of blocks once and update both blocks' heaps;
+ * block pairs are scheduled in rounds in which no block appears twice, so each heap still has one writer.
+ * For SQRL2 and L2 on dense data, tiles are computed with a matrix product (as in dist/batched.h).
+ */
 template<typename IT=uint32_t, typename MatrixType>
-std::vector<packed::pair<blaze::ElementType_t<MatrixType>, IT>> make_knns(const jsd::DissimilarityApplicator<MatrixType> &app, unsigned k) {
+std::vector<packed::pair<blaze::ElementType_t<MatrixType>, IT>>
+make_knns(const jsd::DissimilarityApplicator<MatrixType> &app, unsigned k, size_t tilesize=MINOCORE_KNN_TILESIZE) {
     using FT = blaze::ElementType_t<MatrixType>;
+    using PT = packed::pair<FT, IT>;
     static_assert(std::is_integral_v<IT>, "Sanity");
     static_assert(std::is_floating_point_v<FT>, "Sanity");
 
     MINOCORE_REQUIRE(std::numeric_limits<IT>::max() > app.size(), "sanity check");
-    if(k > app.size()) {
-        std::fprintf(stderr, "Note: make_knn_graph was provided k (%u) > # points (%zu).\n", k, app.size());
-        k = app.size();
+    const size_t np = app.size(), nd = app.data().columns();
+    if(k >= np) {
+        std::fprintf(stderr, "Note: make_knn_graph was provided k (%u) >= # points (%zu).\n", k, np);
+        k = np - 1;
     }
-    const size_t np = app.size();
+    MINOCORE_REQUIRE(k > 0, "Need at least two points");
     const jsd::DissimilarityMeasure measure = app.get_measure();
-    std::vector<packed::pair<FT, IT>> ret(k * np);
-    std::vector<unsigned> in_set(np);
     const bool measure_is_sym = distance::is_symmetric(measure);
     const bool measure_is_dist = distance::is_dissimilarity(measure);
-    std::unique_ptr<std::mutex[]> locks;
-    OMP_ONLY(locks.reset(new std::mutex[np]);)
+    std::vector<PT> ret(size_t(k) * np);
+    std::vector<unsigned> in_set(np);
 
-    // Helper functions
-    // Update
-    auto update_fwd = [&](FT d, size_t i, size_t j) {
+    // Bounded heap per point: max-heap for distances, min-heap for similarities. Ties break by index.
+    auto update = [&](size_t i, FT d, size_t j) ALWAYS_INLINE {
+        PT *const h = &ret[i * k];
+        const PT c(d, static_cast<IT>(j));
         if(in_set[i] < k) {
-            OMP_ONLY(std::lock_guard<std::mutex> lock(locks[i]);)
-            ret[i * k + in_set[i]] = packed::pair<FT, IT>{d, j};
+            h[in_set[i]] = c;
             if(++in_set[i] == k) {
-                if(measure_is_dist)
-                    std::make_heap(ret.data() + i * k, ret.data() + (i + 1) * k, std::less<void>());
-                else
-                    std::make_heap(ret.data() + i * k, ret.data() + (i + 1) * k, std::greater<void>());
+                if(measure_is_dist) std::make_heap(h, h + k, std::less<void>());
+                else                std::make_heap(h, h + k, std::greater<void>());
             }
-        } else {
-            auto cmp = [&](auto d) {return (ret[i * k].first < d) ^ measure_is_dist;};
-            auto pushpop = [&](auto d) {
-                auto startp = &ret[i * k];
-                auto stopp = startp + k;
-                if(measure_is_dist) std::pop_heap(startp, stopp, std::less<void>());
-                else                std::pop_heap(startp, stopp, std::greater<void>());
-                ret[(i + 1) * k - 1] = packed::pair<FT, IT>{d, j};
-                if(measure_is_dist) std::push_heap(startp, stopp, std::less<void>());
-                else                std::push_heap(startp, stopp, std::greater<void>());
-            };
-            if(cmp(d)) {
-                OMP_ONLY(std::lock_guard<std::mutex> lock(locks[i]);)
-                {
-                    OMP_ONLY(if(cmp(d)))
-                        pushpop(d);
-                }
+        } else if(measure_is_dist ? c < h[0]: c > h[0]) {
+            if(measure_is_dist) {
+                std::pop_heap(h, h + k, std::less<void>());
+                h[k - 1] = c;
+                std::push_heap(h, h + k, std::less<void>());
+            } else {
+                std::pop_heap(h, h + k, std::greater<void>());
+                h[k - 1] = c;
+                std::push_heap(h, h + k, std::greater<void>());
             }
         }
     };
-    auto update_both = [&](auto d, auto i, auto j) ALWAYS_INLINE {
-        update_fwd(d, i, j); update_fwd(d, j, i);
-    };
 
-    // Sort
-    auto perform_sort = [&](auto ptr) {
-        auto end = ptr + k;
-        if(measure_is_dist)
-            shared::sort(ptr, end, std::less<>());
-        else
-            shared::sort(ptr, end, std::greater<>());
-        ptr = end;
-    };
-    auto ptr = ret.data();
-    if(measure_is_sym) {
-        OMP_PFOR
-        for(size_t i = 0; i < np; ++i) {
-            for(size_t j = i + 1; j < np; ++j) {
-                update_both(app(i, j), i, j);
+    int nt = 1;
+    OMP_ONLY(nt = omp_get_max_threads();)
+    if(!tilesize) tilesize = MINOCORE_KNN_TILESIZE;
+    // At least two blocks per thread, so that small inputs still use every thread
+    tilesize = std::max(size_t(16), std::min(tilesize, (np + 2 * nt - 1) / (2 * nt)));
+    const size_t nb = (np + tilesize - 1) / tilesize;
+    auto block = [&](size_t b) {return std::make_pair(b * tilesize, std::min(np, (b + 1) * tilesize));};
+
+    const bool use_gemm = blaze::IsDenseMatrix_v<MatrixType> && (measure == distance::L2 || measure == distance::SQRL2);
+    blz::DV<FT> sqnorms;
+    if(use_gemm)
+        sqnorms = blaze::generate(np, [&](size_t i) {return blz::sqrNorm(app.weighted_row(i));});
+    // Fills buf(i - i0, j - j0) for i in [i0, i1), j in [j0, j1); if diag, only j > i is needed
+    auto fill_tile = [&](auto msr, size_t i0, size_t i1, size_t j0, size_t j1, bool diag, blz::DM<FT> &buf, blz::DM<FT> &xi, blz::DM<FT> &xj) {
+        buf.resize(i1 - i0, j1 - j0, false);
+        if constexpr(blaze::IsDenseMatrix_v<MatrixType>) {
+            if(use_gemm) {
+                auto scaled = [&](blz::DM<FT> &x, size_t b0, size_t b1) {
+                    x = blz::serial(submatrix(app.data(), b0, 0, b1 - b0, nd));
+                    for(size_t r = 0; r < b1 - b0; ++r) row(x, r, blz::unchecked) *= app.rs(b0 + r);
+                };
+                scaled(xi, i0, i1);
+                if(!diag) scaled(xj, j0, j1);
+                buf = blz::serial(xi * trans(diag ? xi: xj));
+                for(size_t i = i0; i < i1; ++i) {
+                    auto br = row(buf, i - i0, blz::unchecked);
+                    for(size_t j = j0; j < j1; ++j) {
+                        const FT v = std::max(sqnorms[i] + sqnorms[j] - FT(2) * br[j - j0], FT(0));
+                        br[j - j0] = measure == distance::L2 ? std::sqrt(v): v;
+                    }
+                }
+                return;
             }
-            perform_sort(ptr);
         }
-    } else {
-        OMP_PFOR
-        for(size_t i = 0; i < np; ++i) {
-            for(size_t j = 0; j < np; ++j) {
-                update_fwd(app(i, j), i, j);
+        for(size_t i = i0; i < i1; ++i) {
+            auto br = row(buf, i - i0, blz::unchecked);
+            for(size_t j = diag ? i + 1: j0; j < j1; ++j)
+                br[j - j0] = app(i, j, msr);
+        }
+    };
+
+    // Select the measure-specialized distance once for the whole loop nest
+    jsd::dispatch_measure(measure, [&](auto msr) {
+        OMP_PRAGMA("omp parallel")
+        {
+            blz::DM<FT> buf, xi, xj;
+            if(measure_is_sym) {
+                OMP_PRAGMA("omp for schedule(dynamic)")
+                for(size_t b = 0; b < nb; ++b) {
+                    const auto [i0, i1] = block(b);
+                    fill_tile(msr, i0, i1, i0, i1, true, buf, xi, xj);
+                    for(size_t i = i0; i < i1; ++i) {
+                        for(size_t j = i + 1; j < i1; ++j) {
+                            const FT d = buf(i - i0, j - i0);
+                            update(i, d, j); update(j, d, i);
+                        }
+                    }
+                }
+                const size_t m = nb + (nb & 1);
+                for(size_t round = 0; round + 1 < m; ++round) {
+                    OMP_PRAGMA("omp for schedule(dynamic)")
+                    for(size_t slot = 0; slot < m / 2; ++slot) {
+                        const auto [bi, bj] = detail::round_robin_pair(round, slot, m);
+                        if(bi >= nb || bj >= nb) continue;
+                        const auto [i0, i1] = block(bi);
+                        const auto [j0, j1] = block(bj);
+                        fill_tile(msr, i0, i1, j0, j1, false, buf, xi, xj);
+                        for(size_t i = i0; i < i1; ++i) {
+                            auto br = row(buf, i - i0, blz::unchecked);
+                            for(size_t j = j0; j < j1; ++j) {
+                                update(i, br[j - j0], j); update(j, br[j - j0], i);
+                            }
+                        }
+                    }
+                }
+            } else {
+                OMP_PRAGMA("omp for schedule(dynamic)")
+                for(size_t bi = 0; bi < nb; ++bi) {
+                    const auto [i0, i1] = block(bi);
+                    for(size_t bj = 0; bj < nb; ++bj) {
+                        const auto [j0, j1] = block(bj);
+                        fill_tile(msr, i0, i1, j0, j1, false, buf, xi, xj);
+                        for(size_t i = i0; i < i1; ++i) {
+                            auto br = row(buf, i - i0, blz::unchecked);
+                            for(size_t j = j0; j < j1; ++j)
+                                if(i != j) update(i, br[j - j0], j);
+                        }
+                    }
+                }
             }
-            perform_sort(ptr);
         }
+    });
+    OMP_PFOR
+    for(size_t i = 0; i < np; ++i) {
+        auto ptr = &ret[i * k];
+        if(measure_is_dist)
+            shared::sort(ptr, ptr + k, std::less<>());
+        else
+            shared::sort(ptr, ptr + k, std::greater<>());
     }
     std::fprintf(stderr, "Created knn graph for k = %u and %zu points\n", k, np);
     return ret;
@@ -95,7 +182,7 @@ std::vector<packed::pair<blaze::ElementType_t<MatrixType>, IT>> make_knns(const
 
 template<typename IT=uint32_t, typename MatrixType, typename Hasher, typename IT2=IT, typename KT>
 std::vector<packed::pair<blaze::ElementType_t<MatrixType>, IT>>
-make_knns_by_lsh(const jsd::DissimilarityApplicator<MatrixType> &app, hash::LSHTable<Hasher, IT2, KT> &table, unsigned k, unsigned maxlshcmp=0)
+make_knns_by_lsh(const jsd::DissimilarityApplicator<MatrixType> &app, hash::LSHTable<Hasher, IT2, KT> &table, unsigned k, unsigned maxlshcmp=0, unsigned nprobes=1)
 {
     if(!maxlshcmp) maxlshcmp = 10 * k;
     using FT = blaze::ElementType_t<MatrixType>;
@@ -152,7 +239,7 @@ make_knns_by_lsh(const jsd::DissimilarityApplicator<MatrixType> &app, hash::LSHT
     MINOCORE_VALIDATE(maxlshcmp <= k);
     OMP_PFOR
     for(size_t i = 0; i < np; ++i) {
-        auto tk = table.topk(row(app.data(), i, blaze::unchecked), maxlshcmp);
+        auto tk = table.topk(row(app.data(), i, blaze::unchecked), maxlshcmp, nprobes);
         for(const auto &pair: tk) {
             if(pair.first != i) {
                 auto d = app(i, pair.first);
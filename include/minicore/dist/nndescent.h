@@ -0,0 +1,218 @@
+#ifndef MINOCORE_DIST_NNDESCENT_H__
+#define MINOCORE_DIST_NNDESCENT_H__
+#include "minicore/dist/knngraph.h"
+#include "aesctr/wy.h"
+
+namespace minicore {
+
+/*
+ * NN-Descent (Dong, Charikar and Li, 2011): approximate kNN graphs for any measure a DissimilarityApplicator supports,
+ * including asymmetric ones (MKL, Itakura-Saito) and LLR.
+ *
+ * Starting from random neighbor lists, each iteration samples up to rho * k "new" (not yet joined) and "old" neighbors
+ * of every point, adds sampled reverse neighbors, and compares all new-new and new-old pairs in each list (the local join).
+ * Each comparison of (a, b) offers b to a's list and a to b's list.
+ * Iteration stops when fewer than delta * n * k list entries change, or after max_iter rounds.
+ *
+ * rho is the recall/time knob: higher rho compares more pairs per round and converges to higher recall.
+ * Local joins run in parallel over chunks of points; their proposed updates are bucketed by target and
+ * applied in a second parallel pass in which each bucket has one writer, so no locks are taken.
+ *
+ * Output has the layout of make_knns: k (distance, index) pairs per point, nearest (or most similar) first.
+ */
+
+struct NNDescentOpts {
+    double rho = .5;         // Fraction of k sampled per list each round; up to 1
+    double delta = .001;     // Stop when fewer than delta * n * k neighbor entries change in a round
+    unsigned max_iter = 20;
+    size_t chunksize = 16384; // Points whose local joins are buffered before updates are applied
+    uint64_t seed = 0;
+    bool verbose = false;
+};
+
+template<typename IT=uint32_t, typename MatrixType>
+std::vector<packed::pair<blaze::ElementType_t<MatrixType>, IT>>
+make_knns_by_nndescent(const jsd::DissimilarityApplicator<MatrixType> &app, unsigned k, const NNDescentOpts &opts=NNDescentOpts()) {
+    using FT = blaze::ElementType_t<MatrixType>;
+    static_assert(std::is_integral_v<IT>, "Sanity");
+    static_assert(std::is_floating_point_v<FT>, "Sanity");
+    MINOCORE_REQUIRE(std::numeric_limits<IT>::max() > app.size(), "sanity check");
+    MINOCORE_REQUIRE(opts.rho > 0. && opts.rho <= 1., "rho must be in (0, 1]");
+    const size_t np = app.size();
+    if(k >= np) {
+        std::fprintf(stderr, "Note: make_knns_by_nndescent was provided k (%u) >= # points (%zu).\n", k, np);
+        k = np - 1;
+    }
+    MINOCORE_REQUIRE(k > 0, "Need at least two points");
+    const jsd::DissimilarityMeasure measure = app.get_measure();
+    const bool measure_is_sym = distance::is_symmetric(measure);
+    const bool measure_is_dist = distance::is_dissimilarity(measure);
+    // Lists are max-heaps on key, which is the distance, or the negated similarity
+    const FT sign = measure_is_dist ? FT(1): FT(-1);
+    struct Nbr {
+        FT key;
+        IT id;
+        bool isnew;
+        bool operator<(const Nbr &o) const {return std::tie(key, id) < std::tie(o.key, o.id);}
+    };
+    struct Update {
+        IT target, id;
+        FT key;
+    };
+    std::vector<Nbr> heaps(size_t(k) * np);
+    const unsigned cap = std::max(unsigned(1), unsigned(std::ceil(opts.rho * k)));
+    const size_t stride = 2 * cap;
+    // Candidate lists, fixed stride: forward samples followed by reverse samples
+    std::vector<IT> newc(np * stride), oldc(np * stride);
+    std::vector<unsigned> nnew(np), nold(np), nrnew(np), nrold(np);
+    int nt = 1;
+    OMP_ONLY(nt = omp_get_max_threads();)
+    const size_t nparts = std::max(size_t(1), std::min(np, size_t(nt) * 8));
+    auto part_of = [np,nparts](size_t i) {return i * nparts / np;};
+    // Offers id to target's list; returns whether the list changed
+    auto offer = [&](size_t target, IT id, FT key) {
+        Nbr *const h = &heaps[target * k];
+        const Nbr c{key, id, true};
+        if(!(c < h[0]) || id == target) return false;
+        for(unsigned i = 0; i < k; ++i) if(h[i].id == id) return false;
+        std::pop_heap(h, h + k);
+        h[k - 1] = c;
+        std::push_heap(h, h + k);
+        return true;
+    };
+    auto rng_for = [&](size_t iter, size_t i) {
+        return wy::WyRand<uint64_t>(opts.seed ^ (uint64_t(iter) << 48) ^ (i * 0x9E3779B97F4A7C15ull));
+    };
+    const auto start = util::hrc::now();
+    size_t ndists = 0, iter = 0;
+    jsd::dispatch_measure(measure, [&](auto msr) {
+        // Random initial lists
+        OMP_PRAGMA("omp parallel for reduction(+:ndists)")
+        for(size_t i = 0; i < np; ++i) {
+            auto rng = rng_for(0, i);
+            Nbr *const h = &heaps[i * k];
+            for(unsigned n = 0; n < k;) {
+                const IT id = rng() % np;
+                if(id == i || std::find_if(h, h + n, [id](const Nbr &x) {return x.id == id;}) != h + n) continue;
+                h[n++] = Nbr{sign * FT(app(i, id, msr)), id, true};
+            }
+            ndists += k;
+            std::make_heap(h, h + k);
+        }
+        std::vector<std::vector<std::vector<Update>>> bufs(nt, std::vector<std::vector<Update>>(nparts));
+        for(iter = 1; iter <= opts.max_iter; ++iter) {
+            // 1. Forward samples: up to cap new entries (which become old), and up to cap old entries
+            OMP_PFOR
+            for(size_t i = 0; i < np; ++i) {
+                auto rng = rng_for(iter, i);
+                Nbr *const h = &heaps[i * k];
+                IT *const np_ = &newc[i * stride], *const op = &oldc[i * stride];
+                unsigned nn = 0, no = 0, seen_new = 0, seen_old = 0;
+                for(unsigned n = 0; n < k; ++n) {
+                    if(h[n].isnew) {
+                        // Reservoir sample positions of new entries, converted to ids below
+                        if(nn < cap) np_[nn++] = n;
+                        else if(const unsigned r = rng() % (seen_new + 1); r < cap) np_[r] = n;
+                        ++seen_new;
+                    } else {
+                        if(no < cap) op[no++] = h[n].id;
+                        else if(const unsigned r = rng() % (seen_old + 1); r < cap) op[r] = h[n].id;
+                        ++seen_old;
+                    }
+                }
+                for(unsigned n = 0; n < nn; ++n) {
+                    Nbr &e = h[np_[n]];
+                    np_[n] = e.id;
+                    e.isnew = false;
+                }
+                nnew[i] = nn; nold[i] = no;
+            }
+            // 2. Reverse samples, capped at cap per point by reservoir sampling
+            std::fill(nrnew.begin(), nrnew.end(), 0u);
+            std::fill(nrold.begin(), nrold.end(), 0u);
+            {
+                std::vector<unsigned> seen_new(np), seen_old(np);
+                auto rng = rng_for(iter, np);
+                auto add_reverse = [&](std::vector<IT> &c, std::vector<unsigned> &nrev, std::vector<unsigned> &seen, size_t target, IT id) {
+                    IT *const p = &c[target * stride + cap];
+                    if(nrev[target] < cap) p[nrev[target]++] = id;
+                    else if(const unsigned r = rng() % (seen[target] + 1); r < cap) p[r] = id;
+                    ++seen[target];
+                };
+                for(size_t i = 0; i < np; ++i) {
+                    for(unsigned n = 0; n < nnew[i]; ++n) add_reverse(newc, nrnew, seen_new, newc[i * stride + n], i);
+                    for(unsigned n = 0; n < nold[i]; ++n) add_reverse(oldc, nrold, seen_old, oldc[i * stride + n], i);
+                }
+            }
+            // 3. Local joins, a chunk of points at a time; then apply updates, one writer per bucket of targets
+            size_t nupdates = 0;
+            for(size_t cstart = 0; cstart < np; cstart += opts.chunksize) {
+                const size_t cend = std::min(np, cstart + opts.chunksize);
+                OMP_PRAGMA("omp parallel reduction(+:ndists)")
+                {
+                    int tid = 0;
+                    OMP_ONLY(tid = omp_get_thread_num();)
+                    auto &mybufs = bufs[tid];
+                    std::vector<IT> nl, ol;
+                    auto propose = [&](IT a, IT b, FT key) {
+                        // Filter by the current worst entry; lists are not modified during this phase
+                        if(key < heaps[size_t(a) * k].key) mybufs[part_of(a)].push_back(Update{a, b, key});
+                    };
+                    OMP_PRAGMA("omp for schedule(dynamic, 64)")
+                    for(size_t v = cstart; v < cend; ++v) {
+                        const IT *const np_ = &newc[v * stride], *const op = &oldc[v * stride];
+                        nl.assign(np_, np_ + nnew[v]);
+                        nl.insert(nl.end(), np_ + cap, np_ + cap + nrnew[v]);
+                        ol.assign(op, op + nold[v]);
+                        ol.insert(ol.end(), op + cap, op + cap + nrold[v]);
+                        std::sort(nl.begin(), nl.end()); nl.erase(std::unique(nl.begin(), nl.end()), nl.end());
+                        std::sort(ol.begin(), ol.end()); ol.erase(std::unique(ol.begin(), ol.end()), ol.end());
+                        auto join = [&](IT a, IT b) {
+                            if(a == b) return;
+                            const FT dab = sign * FT(app(a, b, msr));
+                            const FT dba = measure_is_sym ? dab: sign * FT(app(b, a, msr));
+                            ndists += 1 + !measure_is_sym;
+                            propose(a, b, dab);
+                            propose(b, a, dba);
+                        };
+                        for(size_t x = 0; x < nl.size(); ++x) {
+                            for(size_t y = x + 1; y < nl.size(); ++y) join(nl[x], nl[y]);
+                            for(const IT o: ol) join(nl[x], o);
+                        }
+                    }
+                }
+                OMP_PRAGMA("omp parallel for schedule(dynamic) reduction(+:nupdates)")
+                for(size_t p = 0; p < nparts; ++p) {
+                    for(int t = 0; t < nt; ++t) {
+                        for(const Update &u: bufs[t][p])
+                            nupdates += offer(u.target, u.id, u.key);
+                        bufs[t][p].clear();
+                    }
+                }
+            }
+            if(opts.verbose)
+                std::fprintf(stderr, "[%s] Round %zu: %zu updates, %zu distances so far, %gms\n", __func__, iter, nupdates, ndists, util::timediff2ms(start, util::hrc::now()));
+            if(nupdates < opts.delta * np * k) break;
+        }
+    });
+    std::vector<packed::pair<FT, IT>> ret(size_t(k) * np);
+    OMP_PFOR
+    for(size_t i = 0; i < np; ++i) {
+        Nbr *const h = &heaps[i * k];
+        std::sort_heap(h, h + k);
+        for(unsigned n = 0; n < k; ++n)
+            ret[i * k + n] = packed::pair<FT, IT>(sign * h[n].key, h[n].id);
+    }
+    std::fprintf(stderr, "Created approximate knn graph for k = %u and %zu points with %zu distance computations (%0.4g%% of brute force) in %gms\n",
+                 k, np, ndists, 100. * ndists / (double(np) * (np - 1) / (measure_is_sym ? 2.: 1.)), util::timediff2ms(start, util::hrc::now()));
+    return ret;
+}
+
+template<typename IT=uint32_t, typename MatrixType>
+auto make_approx_knn_graph(const jsd::DissimilarityApplicator<MatrixType> &app, unsigned k, bool mutual=true, const NNDescentOpts &opts=NNDescentOpts()) {
+    return knns2graph(make_knns_by_nndescent<IT>(app, k, opts), app.size(), mutual, dist::is_symmetric(app.get_measure()));
+}
+
+} // namespace minicore
+
+#endif /* MINOCORE_DIST_NNDESCENT_H__ */
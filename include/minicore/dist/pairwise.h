@@ -0,0 +1,115 @@
+#ifndef MINOCORE_DIST_PAIRWISE_H__
+#define MINOCORE_DIST_PAIRWISE_H__
+#include "minicore/util/blaze_adaptor.h"
+#include "minicore/util/exception.h"
+#include "minicore/util/timer.h"
+#include "diskmat/diskmat.h"
+#include <atomic>
+
+namespace minicore {
+
+namespace distance {
+
+/*
+ * Tiled all-pairs distance matrices
+ *
+ * The n x n output is cut into B x B tiles, which threads claim dynamically from a single parallel loop.
+ * A tile is computed into a thread-local buffer, so the B rows of its row block stay in cache while its
+ * B columns stream past, and is then written out as B contiguous segments of B entries.
+ * For symmetric measures, only tiles on or above the diagonal are computed; each is also written
+ * transposed into the lower triangle (again as contiguous segments) when symmetrize is set.
+ * Asymmetric measures compute every tile. The diagonal is always computed.
+ *
+ * Working memory is one tile per thread, so the output may be a memory-mapped
+ * diskmat::DiskMat or diskmat::PolymorphicMat larger than RAM.
+ */
+
+#ifndef MINOCORE_PAIRWISE_TILESIZE
+#define MINOCORE_PAIRWISE_TILESIZE 128
+#endif
+
+struct PairwiseOpts {
+    size_t tilesize = MINOCORE_PAIRWISE_TILESIZE;
+    bool symmetrize = true; // For symmetric measures, fill the lower triangle as well as the upper
+    bool verbose = false;   // Emit progress and throughput to stderr
+    bool zero_diagonal = false; // Set out(i, i) = 0 instead of evaluating func(i, i)
+};
+
+struct PairwiseStats {
+    size_t npairs = 0; // Number of distances evaluated
+    double ms = 0.;
+    double pairs_per_sec() const {return ms > 0. ? npairs / ms * 1e3: 0.;}
+};
+
+/*
+ * Fills out(i, j) = func(i, j) for i, j in [0, n).
+ * If symmetric, func(j, i) is assumed to equal func(i, j) and is not evaluated.
+ * If opts.zero_diagonal, func(i, i) is not evaluated either, and out(i, i) is set to 0.
+ */
+template<typename OutMat, typename Func>
+PairwiseStats fill_pairwise_tiled(OutMat &out, size_t n, bool symmetric, const Func &func, const PairwiseOpts &opts=PairwiseOpts()) {
+    using OFT = blaze::ElementType_t<OutMat>;
+    MINOCORE_REQUIRE(out.rows() == n && out.columns() == n, "Output must be n x n");
+    const size_t tsz = opts.tilesize ? opts.tilesize: size_t(MINOCORE_PAIRWISE_TILESIZE);
+    const size_t nb = (n + tsz - 1) / tsz, ntiles = nb * nb;
+    const size_t nreal = symmetric ? nb * (nb + 1) / 2: ntiles;
+    std::atomic<size_t> tiles_done;
+    tiles_done.store(0);
+    size_t npairs = 0;
+    const auto start = util::hrc::now();
+    OMP_PRAGMA("omp parallel reduction(+:npairs)")
+    {
+        blaze::DynamicMatrix<OFT> buf(tsz, tsz);
+        OMP_PRAGMA("omp for schedule(dynamic)")
+        for(size_t t = 0; t < ntiles; ++t) {
+            const size_t bi = t / nb, bj = t % nb;
+            if(symmetric && bj < bi) continue;
+            const size_t i0 = bi * tsz, i1 = std::min(i0 + tsz, n);
+            const size_t j0 = bj * tsz, j1 = std::min(j0 + tsz, n);
+            const bool diag = symmetric && bi == bj;
+            const bool hasdiag = opts.zero_diagonal && bi == bj;
+            for(size_t i = i0; i < i1; ++i) {
+                auto br = row(buf, i - i0, blaze::unchecked);
+                const size_t jstart = diag ? i: j0;
+                for(size_t j = jstart; j < j1; ++j)
+                    br[j - j0] = hasdiag && j == i ? OFT(0): OFT(func(i, j));
+                npairs += j1 - jstart - hasdiag;
+                for(size_t j = jstart; j < j1; ++j)
+                    out(i, j) = br[j - j0];
+            }
+            if(symmetric && opts.symmetrize) {
+                for(size_t j = j0; j < j1; ++j)
+                    for(size_t i = i0, iend = diag ? j: i1; i < iend; ++i)
+                        out(j, i) = buf(i - i0, j - j0);
+            }
+            const size_t val = ++tiles_done;
+            if(opts.verbose && (val & (val - 1)) == 0)
+                std::fprintf(stderr, "[%s] Completed %zu/%zu tiles in %gms\n", __func__, val, nreal, util::timediff2ms(start, util::hrc::now()));
+        }
+    }
+    PairwiseStats ret;
+    ret.npairs = npairs;
+    ret.ms = util::timediff2ms(start, util::hrc::now());
+    if(opts.verbose)
+        std::fprintf(stderr, "[%s] %zu points, %zu distances in %gms (%g pairs/sec)\n", __func__, n, npairs, ret.ms, ret.pairs_per_sec());
+    return ret;
+}
+
+template<typename FT, typename Func>
+PairwiseStats fill_pairwise_tiled(diskmat::DiskMat<FT> &out, size_t n, bool symmetric, const Func &func, const PairwiseOpts &opts=PairwiseOpts()) {
+    return fill_pairwise_tiled(~out, n, symmetric, func, opts);
+}
+template<typename FT, typename Func>
+PairwiseStats fill_pairwise_tiled(diskmat::PolymorphicMat<FT> &out, size_t n, bool symmetric, const Func &func, const PairwiseOpts &opts=PairwiseOpts()) {
+    return fill_pairwise_tiled(~out, n, symmetric, func, opts);
+}
+
+} // namespace distance
+
+using distance::PairwiseOpts;
+using distance::PairwiseStats;
+using distance::fill_pairwise_tiled;
+
+} // namespace minicore
+
+#endif /* MINOCORE_DIST_PAIRWISE_H__ */
@@ -2,3 +2,4 @@
 #include "minicore/graph/graph.h"
 #include "minicore/graph/parse.h"
 #include "minicore/graph/graphdist.h"
+#include "minicore/graph/shortest_paths.h"
@@ -0,0 +1,73 @@
+#pragma once
+#ifndef MINOCORE_GRAPH_SHORTEST_PATHS_H__
+#define MINOCORE_GRAPH_SHORTEST_PATHS_H__
+#include "minicore/graph/graph.h"
+#include "minicore/util/radix_heap.h"
+#include <limits>
+
+namespace minicore {
+
+namespace graph {
+
+/*
+ * Multi-source Dijkstra: distance from every vertex to its nearest source, seeding the queue with all sources
+ * at distance 0 instead of connecting them to a synthetic vertex.
+ * The graph is only read, so one graph can be shared by threads running independent searches.
+ *
+ * dist must have num_vertices(x) entries. If src is non-null, src[v] receives the source nearest to v
+ * (undefined for unreachable vertices, whose distance is max()).
+ * If reset is false, dist and src are kept from a previous call and only [sbeg, send) are seeded:
+ * this adds sources to an earlier search, visiting only vertices whose distance decreases.
+ * Edge weights must be non-negative. Returns the number of vertices settled.
+ */
+template<typename Graph, typename It, typename DistT>
+size_t multi_source_dijkstra(const Graph &x, It sbeg, It send, DistT *dist,
+                             typename boost::graph_traits<Graph>::vertex_descriptor *src=nullptr, bool reset=true)
+{
+    using Vertex = typename boost::graph_traits<Graph>::vertex_descriptor;
+    static_assert(std::is_floating_point_v<DistT>, "Distances must be floating-point");
+    static constexpr DistT maxd = std::numeric_limits<DistT>::max();
+    const size_t nv = boost::num_vertices(x);
+    if(reset) std::fill(dist, dist + nv, maxd);
+    util::RadixHeap<DistT, Vertex> heap;
+    for(;sbeg != send; ++sbeg) {
+        const Vertex s = *sbeg;
+        assert(size_t(s) < nv);
+        if(dist[s] > DistT(0)) {
+            dist[s] = 0;
+            if(src) src[s] = s;
+            heap.push(0, s);
+        }
+    }
+    const auto wmap = boost::get(boost::edge_weight, x);
+    size_t nsettled = 0;
+    while(!heap.empty()) {
+        const auto [d, v] = heap.pop();
+        if(d > dist[v]) continue; // Superseded entry
+        ++nsettled;
+        for(auto [eb, ee] = boost::out_edges(v, x); eb != ee; ++eb) {
+            const Vertex t = boost::target(*eb, x);
+            const DistT nd = d + DistT(boost::get(wmap, *eb));
+            if(nd < dist[t]) {
+                dist[t] = nd;
+                if(src) src[t] = src[v];
+                heap.push(nd, t);
+            }
+        }
+    }
+    return nsettled;
+}
+
+template<typename Graph, typename Container, typename DistT>
+size_t multi_source_dijkstra(const Graph &x, const Container &sources, DistT *dist,
+                             typename boost::graph_traits<Graph>::vertex_descriptor *src=nullptr, bool reset=true)
+{
+    return multi_source_dijkstra(x, std::begin(sources), std::end(sources), dist, src, reset);
+}
+
+} // namespace graph
+using graph::multi_source_dijkstra;
+
+} // namespace minicore
+
+#endif /* MINOCORE_GRAPH_SHORTEST_PATHS_H__ */
@@ -4,6 +4,8 @@
 #include "minicore/util/blaze_adaptor.h"
 #include "minicore/util/macros.h"
 #include <random>
+#include <climits>
+#include <numeric>
 #include "xxHash/xxh3.h"
 #include "xxHash/xxhash.h"
 #ifdef _OPENMP
@@ -433,11 +435,175 @@ template<typename KT> struct XXHasher:
     static_assert(std::is_integral<KT>::value || sizeof(KT) >= 16, "KT must be integral __{u,}int128 aren't guaranteed to have type_traits defined accordingly");
 };
 
+/*
+ * Compact, immutable buckets for one LSH table, in CSR form:
+ * keys_ holds the distinct keys in sorted order, and the ids in bucket b are ids_[offsets_[b]:offsets_[b + 1]], sorted.
+ * Since keys are hash values, their top bits are close to uniform, so dir_ indexes
+ * the first key for each value of the top dirbits_ bits, and lookups binary search a range of O(1) keys.
+ * This replaces one heap-allocated vector and one hash map slot per bucket with
+ * ~ 1 id per entry plus ~ 2 words per bucket.
+ */
+template<typename IT, typename KT>
+struct CSRBuckets {
+    using UKT = std::make_unsigned_t<KT>;
+    std::vector<UKT> keys_;
+    std::vector<IT> offsets_;
+    std::vector<IT> ids_;
+    std::vector<IT> dir_;
+    unsigned dirbits_ = 0;
+
+    size_t nbuckets() const {return keys_.size();}
+    size_t size() const {return ids_.size();}
+    bool empty() const {return ids_.empty();}
+    size_t bytes() const {
+        return keys_.size() * sizeof(UKT) + (offsets_.size() + ids_.size() + dir_.size()) * sizeof(IT);
+    }
+    size_t dirindex(UKT key) const {return dirbits_ ? size_t(key >> (sizeof(UKT) * CHAR_BIT - dirbits_)): size_t(0);}
+
+    // Returns [begin, end) of the ids hashed to key, which is empty if there are none
+    std::pair<const IT *, const IT *> find(KT key) const {
+        if(keys_.empty()) return {nullptr, nullptr};
+        const UKT k = key;
+        const size_t di = dirindex(k);
+        auto kb = keys_.data() + dir_[di], ke = keys_.data() + dir_[di + 1];
+        auto it = std::lower_bound(kb, ke, k);
+        if(it == ke || *it != k) return {nullptr, nullptr};
+        const size_t b = it - keys_.data();
+        return {ids_.data() + offsets_[b], ids_.data() + offsets_[b + 1]};
+    }
+
+    template<typename Func>
+    void for_each(const Func &func) const {
+        for(size_t b = 0; b < keys_.size(); ++b)
+            for(size_t i = offsets_[b]; i < offsets_[b + 1]; ++i)
+                func(KT(keys_[b]), ids_[i]);
+    }
+
+    // Builds from (key, id) pairs sorted by key
+    template<typename Pair>
+    void build(const Pair *pairs, size_t n) {
+        MINOCORE_REQUIRE(n < size_t(std::numeric_limits<IT>::max()), "Too many entries for IT");
+        keys_.clear(); offsets_.clear();
+        ids_.resize(n);
+        for(size_t i = 0; i < n; ++i) {
+            if(i == 0 || UKT(pairs[i].first) != keys_.back()) {
+                keys_.push_back(pairs[i].first);
+                offsets_.push_back(i);
+            }
+            ids_[i] = pairs[i].second;
+        }
+        offsets_.push_back(n);
+        keys_.shrink_to_fit(); offsets_.shrink_to_fit();
+        dirbits_ = 0;
+        while(dirbits_ < 24 && (size_t(1) << (dirbits_ + 1)) <= keys_.size()) ++dirbits_;
+        dir_.assign((size_t(1) << dirbits_) + 1, IT(0));
+        for(const auto k: keys_) ++dir_[dirindex(k) + 1];
+        std::partial_sum(dir_.begin(), dir_.end(), dir_.begin());
+    }
+};
+
+namespace detail {
+
+// Orders (key, id) pairs by key, then id, for kx::radix_sort; ids are the least significant bytes
+template<typename Pair>
+struct KeyIdRadixTraits {
+    using KT = std::make_unsigned_t<std::decay_t<decltype(std::declval<Pair>().first)>>;
+    using IT = std::make_unsigned_t<std::decay_t<decltype(std::declval<Pair>().second)>>;
+    static const int nBytes = sizeof(KT) + sizeof(IT);
+    int kth_byte(const Pair &x, int k) const {
+        return k < int(sizeof(IT)) ? int((IT(x.second) >> (k * 8)) & 0xFFu)
+                                   : int((KT(x.first) >> ((k - sizeof(IT)) * 8)) & 0xFFu);
+    }
+    bool compare(const Pair &x, const Pair &y) const {
+        return std::make_pair(KT(x.first), IT(x.second)) < std::make_pair(KT(y.first), IT(y.second));
+    }
+};
+
+
+/*
+ * Query-directed probe sequence (Lv et al., 2007) for one table of k hash coordinates.
+ * Perturbing coordinate c by -1 (+1) moves to the bucket whose boundary lies x_c (1 - x_c) away, where x_c is
+ * the query's offset from the lower boundary of its bucket. Perturbation sets are scored by their summed
+ * squared distances and enumerated in increasing order with a heap, via the shift and expand operations.
+ * Sets are bitmasks over the 2k single-coordinate perturbations, sorted by score.
+ */
+template<typename FT>
+struct MultiProbeGenerator {
+    struct Perturbation {
+        double score;
+        unsigned coord;
+        int delta;
+        bool operator<(const Perturbation &o) const {return score < o.score;}
+    };
+    struct Set {
+        double score;
+        uint64_t mask;
+        bool operator<(const Set &o) const {return score > o.score;} // Min-heap
+    };
+    const unsigned k_;
+    std::vector<Perturbation> z_;
+    std::vector<Set> heap_;
+    std::vector<FT> buf_;
+    MultiProbeGenerator(unsigned k): k_(k), z_(2 * k), buf_(k) {}
+
+    // Calls func(perturbed hashes) for the query's own bucket, then for up to nprobes - 1 neighboring buckets
+    template<typename Func>
+    void generate(const FT *h, const FT *p, unsigned nprobes, const Func &func) {
+        std::copy(h, h + k_, buf_.data());
+        func(buf_.data());
+        if(nprobes <= 1) return;
+        for(unsigned c = 0; c < k_; ++c) {
+            // Hashers round down or up; either way the bucket is the unit interval below or above the hash
+            const double lower = h[c] > p[c] ? double(h[c]) - 1.: double(h[c]);
+            const double x = std::clamp(double(p[c]) - lower, 0., 1.);
+            z_[2 * c] = Perturbation{x * x, c, -1};
+            z_[2 * c + 1] = Perturbation{(1. - x) * (1. - x), c, 1};
+        }
+        std::sort(z_.begin(), z_.end());
+        const unsigned nz = z_.size();
+        heap_.clear();
+        heap_.push_back(Set{z_[0].score, uint64_t(1)});
+        for(unsigned emitted = 1; emitted < nprobes && !heap_.empty();) {
+            std::pop_heap(heap_.begin(), heap_.end());
+            const Set s = heap_.back();
+            heap_.pop_back();
+            const unsigned m = 63 - __builtin_clzll(s.mask);
+            if(m + 1 < nz) {
+                const uint64_t next = uint64_t(1) << (m + 1);
+                heap_.push_back(Set{s.score - z_[m].score + z_[m + 1].score, (s.mask ^ (uint64_t(1) << m)) | next});
+                std::push_heap(heap_.begin(), heap_.end());
+                heap_.push_back(Set{s.score + z_[m + 1].score, s.mask | next});
+                std::push_heap(heap_.begin(), heap_.end());
+            }
+            // Sets which move one coordinate both ways are invalid, but still generate valid sets
+            uint64_t coords = 0;
+            bool valid = true;
+            for(uint64_t mask = s.mask; mask; mask &= mask - 1) {
+                const uint64_t cbit = uint64_t(1) << z_[__builtin_ctzll(mask)].coord;
+                if(coords & cbit) {valid = false; break;}
+                coords |= cbit;
+            }
+            if(!valid) continue;
+            std::copy(h, h + k_, buf_.data());
+            for(uint64_t mask = s.mask; mask; mask &= mask - 1) {
+                const Perturbation &pert = z_[__builtin_ctzll(mask)];
+                buf_[pert.coord] += pert.delta;
+            }
+            func(buf_.data());
+            ++emitted;
+        }
+    }
+};
+
+} // namespace detail
+
 template<typename Hasher, typename IT=::std::uint32_t, typename KT=uint64_t>
 struct LSHTable {
     using ElementType = typename Hasher::ElementType;
     const Hasher hasher_;
+    // Entries live in csr_ after bulk adds (add(matrix)), and in tables_ after single-vector adds
     std::unique_ptr<shared::flat_hash_map<KT, std::vector<IT>>[]> tables_;
+    std::unique_ptr<CSRBuckets<IT, KT>[]> csr_;
     const unsigned nh_;
     XXHasher<KT> xxhasher_;
     OMP_ONLY(std::unique_ptr<std::mutex[]> mutexes;)
@@ -455,11 +621,26 @@ private:
             else                  it->second.push_back(id);
         }
     }
+    template<typename HashRow>
+    INLINE KT table_key(const HashRow &hr, unsigned i) const {
+        return xxhasher_(&hr[i * k()], sizeof(ElementType) * k());
+    }
+    // Calls func(id) for every id sharing table i's bucket for key
+    template<typename Func>
+    INLINE void for_each_in_bucket(unsigned i, KT key, const Func &func) const {
+        const auto [b, e] = csr_[i].find(key);
+        for(auto p = b; p != e; ++p) func(*p);
+        if(!tables_[i].empty()) {
+            if(auto it = tables_[i].find(key); it != tables_[i].end())
+                for(const auto v: it->second) func(v);
+        }
+    }
 public:
 
     template<typename...Args>
     LSHTable(Args &&...args): hasher_(std::forward<Args>(args)...),
                               tables_(new shared::flat_hash_map<KT, std::vector<IT>>[hasher_.l()]),
+                              csr_(new CSRBuckets<IT, KT>[hasher_.l()]),
                               nh_(hasher_.nh()),
                               xxhasher_(XXH3_64bits_withSeed(hasher_.matrix().data(), hasher_.matrix().spacing() *
                                   (blaze::IsRowMajorMatrix_v<
@@ -473,14 +654,26 @@ public:
     LSHTable(LSHTable &&)     = default;
 
     void sort() {
+        // CSR buckets are sorted on construction
         OMP_PRAGMA("omp parallel for schedule(dynamic)")
-        for(unsigned i = 0; i < tables_.size(); ++i)
+        for(unsigned i = 0; i < l(); ++i)
             for(auto &pair: tables_[i])
                 shared::sort(pair.second.begin(), pair.second.end());
     }
     const LSHasherSettings &settings() const {return hasher_.settings();}
     auto k()   const {return settings().k_;}
     auto l()   const {return settings().l_;}
+    size_t size() const {return ids_used_;}
+    // Approximate memory used by buckets
+    size_t bytes() const {
+        size_t ret = 0;
+        for(unsigned i = 0; i < l(); ++i) {
+            ret += csr_[i].bytes();
+            for(const auto &pair: tables_[i])
+                ret += sizeof(pair) + pair.second.capacity() * sizeof(IT);
+        }
+        return ret;
+    }
     template<typename Query>
     decltype(auto) hash(const Query &q) const {
         return hasher_.hash(q);
@@ -499,10 +692,14 @@ public:
         }
         ++ids_used_;
     }
+    /*
+     * Bulk add: rows are hashed in parallel into per-table (key, id) arrays, which are radix-sorted
+     * by (key, id) and compacted into CSR buckets. Threads never write to the same slot, so no locks are taken.
+     * Entries from earlier bulk adds are merged in, so each call costs time linear in the table's total size.
+     */
     template<typename MT, bool OSO>
     void add(const blaze::Matrix<MT, OSO> &input, IT idoffset=0) {
         auto hv = blaze::evaluate(hash(input));
-        std::fprintf(stderr, "hv shape: %zu/%zu.\n", hv.rows(), hv.columns());
         if(nh_ != hv.columns()) {
             std::fprintf(stderr, "[%s] nh_: %u. hv.columns: %zu\n", __PRETTY_FUNCTION__, nh_, hv.columns());
             std::exit(1);
@@ -511,85 +708,163 @@ public:
             std::fprintf(stderr, "[%s] nh_: %u. hv.columns: %zu. input rows: %zu\n", __PRETTY_FUNCTION__, nh_, hv.rows(), (*input).rows());
             std::exit(1);
         }
+        using UKT = std::make_unsigned_t<KT>;
+        using Pair = std::pair<UKT, IT>;
         const size_t nr = (*input).rows();
-        const auto _l = l(), _k = k();
+        const unsigned _l = l();
+        std::vector<std::vector<Pair>> pairs(_l);
+        for(unsigned j = 0; j < _l; ++j) {
+            pairs[j].resize(nr + csr_[j].size());
+            size_t n = nr;
+            csr_[j].for_each([&](KT key, IT id) {pairs[j][n++] = Pair(key, id);});
+        }
         OMP_PFOR
-        for(unsigned i = 0; i < nr; ++i) {
+        for(size_t i = 0; i < nr; ++i) {
             auto r = row(hv, i, blaze::unchecked);
+            for(unsigned j = 0; j < _l; ++j)
+                pairs[j][i] = Pair(table_key(r, j), idoffset + i);
+        }
+        // Partition each table by the key's top byte, then sort all _l * 256 partitions in parallel,
+        // so that sorting scales with threads even when l < # threads
+        static constexpr size_t NB = 256;
+        static constexpr int TOPSHIFT = sizeof(UKT) * CHAR_BIT - 8;
+        std::vector<size_t> bounds(size_t(_l) * (NB + 1));
+        OMP_PRAGMA("omp parallel")
+        {
+            std::vector<Pair> tmp;
+            OMP_PRAGMA("omp for schedule(dynamic)")
             for(unsigned j = 0; j < _l; ++j) {
-                insert(j, xxhasher_(&r[j * _k], sizeof(ElementType) * _k), idoffset + i);
+                auto &pv = pairs[j];
+                size_t *const bnd = &bounds[size_t(j) * (NB + 1)];
+                std::fill(bnd, bnd + NB + 1, size_t(0));
+                for(const auto &p: pv) ++bnd[(p.first >> TOPSHIFT) + 1];
+                std::partial_sum(bnd, bnd + NB + 1, bnd);
+                std::vector<size_t> pos(bnd, bnd + NB);
+                tmp.resize(pv.size());
+                for(const auto &p: pv) tmp[pos[p.first >> TOPSHIFT]++] = p;
+                std::swap(tmp, pv);
+            }
+            OMP_PRAGMA("omp for schedule(dynamic)")
+            for(size_t t = 0; t < _l * NB; ++t) {
+                const size_t j = t / NB, b = t % NB;
+                const size_t *const bnd = &bounds[j * (NB + 1)];
+                auto beg = pairs[j].begin();
+                kx::radix_sort(beg + bnd[b], beg + bnd[b + 1], detail::KeyIdRadixTraits<Pair>());
             }
         }
+        OMP_PRAGMA("omp parallel for schedule(dynamic)")
+        for(unsigned j = 0; j < _l; ++j) {
+            csr_[j].build(pairs[j].data(), pairs[j].size());
+            std::vector<Pair>().swap(pairs[j]);
+        }
         ids_used_ += nr;
     }
+    template<typename Query>
+    decltype(auto) project(const Query &q) const {
+        return hasher_.project(q);
+    }
+    /*
+     * Multi-probe queries (Lv et al., 2007): with nprobes > 1, each table is probed at the query's own bucket
+     * and at the nprobes - 1 nearby buckets with the smallest perturbation scores, found by shifting hash
+     * coordinates +/- 1 toward the nearest bucket boundaries of the query's projection.
+     * Probing T buckets per table typically reaches the recall of several times as many tables.
+     * Requires k <= 32 when nprobes > 1.
+     */
     template<typename VT, bool OSO>
-    std::vector<std::pair<IT, unsigned>> topk(const blaze::Vector<VT, OSO> &query, unsigned maxgather=0) const {
-        // TODO: build with a heap
-        if(!maxgather) maxgather = ids_used_;
-        std::vector<std::pair<IT, unsigned>> ret;
-        auto retupdate = [&](auto x) {
-            auto rit = std::find(ret.begin(), ret.end(), x);
-        };
+    std::vector<std::pair<IT, unsigned>> topk(const blaze::Vector<VT, OSO> &query, unsigned maxgather=0, unsigned nprobes=1) const {
         auto hv = evaluate(hash(query));
-        for(unsigned i = 0; i < l(); ++i) {
-            if(auto it = tables_[i].find(xxhasher_(&hv[i * k()], sizeof(ElementType) * k()));
-               it != tables_[i].end())
-            {
-                for(const auto v: it->second) {
-                    auto rit = std::find_if(ret.begin(), ret.end(), [v](auto x) {return x.first == v;});
-                    if(rit == ret.end()) ret.emplace_back({v, 1u});
-                    else                 ++rit->second;
-                }
+        std::decay_t<decltype(hv)> pv;
+        if(nprobes > 1) pv = project(query);
+        shared::flat_hash_map<IT, unsigned> counts;
+        count_candidates(hv, pv, nprobes, counts);
+        return select_topk(counts, maxgather);
+    }
+    // Batched topk: hashes all queries at once and processes them in parallel
+    template<typename MT, bool OSO>
+    std::vector<std::vector<std::pair<IT, unsigned>>>
+    topk(const blaze::Matrix<MT, OSO> &query, unsigned maxgather=0, unsigned nprobes=1) const {
+        auto hv = evaluate(hash(query));
+        if(hv.columns() != nh_) throw std::runtime_error("Wrong number of columns");
+        if(hv.rows() != (*query).rows()) throw std::runtime_error("Wrong number of rows");
+        std::decay_t<decltype(hv)> pv;
+        if(nprobes > 1) pv = project(query);
+        std::vector<std::vector<std::pair<IT, unsigned>>> ret(hv.rows());
+        OMP_PRAGMA("omp parallel")
+        {
+            shared::flat_hash_map<IT, unsigned> counts;
+            OMP_PRAGMA("omp for schedule(dynamic, 16)")
+            for(size_t j = 0; j < hv.rows(); ++j) {
+                counts.clear();
+                if(nprobes > 1) count_candidates(row(hv, j, blaze::unchecked), row(pv, j, blaze::unchecked), nprobes, counts);
+                else            count_candidates(row(hv, j, blaze::unchecked), row(hv, j, blaze::unchecked), nprobes, counts);
+                ret[j] = select_topk(counts, maxgather);
             }
         }
-        shared::sort(ret.begin(), ret.end(), [](auto x, auto y) {return x.second > y.second;});
-        if(maxgather < ret.size()) ret.resize(maxgather);
         return ret;
     }
     template<typename VT, bool OSO>
-    shared::flat_hash_map<IT, unsigned> query(const blaze::Vector<VT, OSO> &query) const {
+    shared::flat_hash_map<IT, unsigned> query(const blaze::Vector<VT, OSO> &query, unsigned nprobes=1) const {
         auto hv = evaluate(hash(query));
+        std::decay_t<decltype(hv)> pv;
+        if(nprobes > 1) pv = project(query);
         shared::flat_hash_map<IT, unsigned> ret;
-        for(unsigned i = 0; i < l(); ++i) {
-            if(auto it = tables_[i].find(xxhasher_(&hv[i * k()], sizeof(ElementType) * k()));
-               it != tables_[i].end())
-            {
-                for(const auto v: it->second) {
-                    auto nit = ret.find(v);
-                    if(nit != ret.end()) ++nit->second;
-                    else  ret.emplace(v, 1);
-                }
-            }
-        }
+        count_candidates(hv, pv, nprobes, ret);
         return ret;
     }
     template<typename MT, bool OSO>
     std::vector<shared::flat_hash_map<IT, unsigned>>
-    query(const blaze::Matrix<MT, OSO> &query) const {
+    query(const blaze::Matrix<MT, OSO> &query, unsigned nprobes=1) const {
         auto hv = evaluate(hash(query));
         //std::fprintf(stderr, "hv rows: %zu. columns: %zu. nh: %u. input num rows: %zu. input col: %zu\n", hv.rows(), hv.columns(), nh_, (*query).rows(), (*query).columns());
         if(hv.columns() != nh_) throw std::runtime_error("Wrong number of columns");
         if(hv.rows() != (*query).rows()) throw std::runtime_error("Wrong number of rows");
+        std::decay_t<decltype(hv)> pv;
+        if(nprobes > 1) pv = project(query);
         std::vector<shared::flat_hash_map<IT, unsigned>> ret(hv.rows());
         assert(hv.rows() == (*query).rows());
         OMP_PFOR
         for(unsigned j = 0; j < hv.rows(); ++j) {
-            auto &map = ret[j];
-            typename shared::flat_hash_map<KT, std::vector<IT>>::const_iterator it;
             auto hr = row(hv, j BLAZE_CHECK_DEBUG);
             assert(hr.size() == nh_);
-            for(unsigned i = 0; i < l(); ++i) {
-                if((it = tables_[i].find(xxhasher_(&hr[i * k()], sizeof(ElementType) * k()))) != tables_[i].cend()) {
-                    for(const auto v: it->second) {
-                        auto nit = map.find(v);
-                        if(nit != map.end()) ++nit->second;
-                        else             map.emplace(v, 1);
-                    }
-                }
-            }
+            if(nprobes > 1) count_candidates(hr, row(pv, j, blaze::unchecked), nprobes, ret[j]);
+            else            count_candidates(hr, hr, nprobes, ret[j]);
+        }
+        return ret;
+    }
+private:
+    // Counts, for each id, the number of probed buckets containing it. pr is only read if nprobes > 1.
+    template<typename HashRow, typename ProjRow>
+    void count_candidates(const HashRow &hr, const ProjRow &pr, unsigned nprobes, shared::flat_hash_map<IT, unsigned> &counts) const {
+        auto increment = [&](const IT v) {
+            auto nit = counts.find(v);
+            if(nit != counts.end()) ++nit->second;
+            else                    counts.emplace(v, 1u);
+        };
+        const unsigned _k = k();
+        if(nprobes <= 1) {
+            for(unsigned i = 0; i < l(); ++i)
+                for_each_in_bucket(i, table_key(hr, i), increment);
+            return;
         }
+        MINOCORE_REQUIRE(_k <= 32, "Multi-probe LSH supports k <= 32");
+        detail::MultiProbeGenerator<ElementType> gen(_k);
+        for(unsigned i = 0; i < l(); ++i) {
+            gen.generate(&hr[i * _k], &pr[i * _k], nprobes, [&](const ElementType *perturbed) {
+                for_each_in_bucket(i, KT(xxhasher_(perturbed, sizeof(ElementType) * _k)), increment);
+            });
+        }
+    }
+    // The maxgather (or all, if 0) most frequent candidates, most frequent first; ties go to the smaller id
+    std::vector<std::pair<IT, unsigned>> select_topk(const shared::flat_hash_map<IT, unsigned> &counts, size_t maxgather) const {
+        std::vector<std::pair<IT, unsigned>> ret(counts.begin(), counts.end());
+        auto cmp = [](const auto &x, const auto &y) {return std::tie(y.second, x.first) < std::tie(x.second, y.first);};
+        if(maxgather && maxgather < ret.size()) {
+            std::partial_sort(ret.begin(), ret.begin() + maxgather, ret.end(), cmp);
+            ret.resize(maxgather);
+        } else shared::sort(ret.begin(), ret.end(), cmp);
         return ret;
     }
+public:
 };
 
 
@@ -615,6 +890,7 @@ using hash::S2JSDLSHasher;     // D_{JSM}(P || Q) = \sqrt{D_{JS}(P || Q)}
 using hash::TVDLSHasher;       // D_{TV}(P || Q)  = \frac{D_{\ell_1}(P || Q)}{2}
 
 using hash::LSHTable;
+using hash::CSRBuckets;
 using hash::LpLSHasher;
 
 }
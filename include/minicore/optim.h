@@ -13,5 +13,6 @@
 #include <minicore/optim/jv.h>
 #include <minicore/optim/lsearch.h>
 #include <minicore/optim/lsearchpp.h>
+#include <minicore/optim/oracle_lsearch.h>
 
 #endif
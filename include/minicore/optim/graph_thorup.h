@@ -3,34 +3,13 @@
 #include <random>
 #include <thread>
 #include "minicore/graph/graph.h"
+#include "minicore/graph/shortest_paths.h"
 #include "minicore/util/blaze_adaptor.h"
 #include <cassert>
 
 
 namespace minicore {
 using namespace shared;
-namespace util {
-template<typename Graph>
-struct ScopedSyntheticVertex {
-    using Vertex = typename boost::graph_traits<Graph>::vertex_descriptor;
-    Graph &ref_;
-    Vertex vtx_;
-    bool cleared_ = false;
-    ScopedSyntheticVertex(Graph &ref): ref_(ref), vtx_(boost::add_vertex(ref_)) {
-    }
-    Vertex get() const {return vtx_;}
-    void clear() {
-        if(!cleared_) {
-            boost:: clear_vertex(vtx_, ref_);
-            boost::remove_vertex(vtx_, ref_);
-            cleared_ = true;
-        }
-    }
-    ~ScopedSyntheticVertex() {
-        clear();
-    }
-};
-} // namespace util
 
 template<typename Graph>
 inline void assert_connected__(const Graph &x, const char *filename, const char *func, int line) {
@@ -50,13 +29,13 @@ using namespace boost;
 
 template<typename Graph, typename BBoxContainer=std::vector<typename boost::graph_traits<Graph>::vertex_descriptor>>
 std::vector<typename boost::graph_traits<Graph>::vertex_descriptor>
-&sample_from_graph(Graph &x, size_t samples_per_round, size_t iterations,
+&sample_from_graph(const Graph &x, size_t samples_per_round, size_t iterations,
                         std::vector<typename boost::graph_traits<Graph>::vertex_descriptor> &container, uint64_t seed,
                         const BBoxContainer *bbox_vertices_ptr=nullptr);
 
 template<typename Graph, typename BBoxContainer=std::vector<typename boost::graph_traits<Graph>::vertex_descriptor>>
 auto
-thorup_sample(Graph &x, unsigned k, uint64_t seed, size_t max_sampled=0, BBoxContainer *bbox_vertices_ptr=nullptr) {
+thorup_sample(const Graph &x, unsigned k, uint64_t seed, size_t max_sampled=0, BBoxContainer *bbox_vertices_ptr=nullptr) {
     using Vertex = typename boost::graph_traits<Graph>::vertex_descriptor;
     if(max_sampled == 0) max_sampled = boost::num_vertices(x);
     // Algorithm E, Thorup p.418
@@ -89,7 +68,7 @@ thorup_sample(Graph &x, unsigned k, uint64_t seed, size_t max_sampled=0, BBoxCon
 template<typename Graph, typename RNG, template<typename...> class BBoxTemplate=std::vector, typename WType=uint32_t, typename...BBoxArgs>
 std::pair<std::vector<typename graph_traits<Graph>::vertex_descriptor>,
           double>
-thorup_d(Graph &x, RNG &rng, size_t nperround, size_t maxnumrounds,
+thorup_d(const Graph &x, RNG &rng, size_t nperround, size_t maxnumrounds,
          const BBoxTemplate<typename boost::graph_traits<Graph>::vertex_descriptor, BBoxArgs...> *bbox_vertices_ptr=nullptr,
          const WType *weights=nullptr)
 {
@@ -107,12 +86,15 @@ thorup_d(Graph &x, RNG &rng, size_t nperround, size_t maxnumrounds,
     }
     std::vector<Vertex> F;
     F.reserve(std::min(nperround * 5, R.size()));
-    util::ScopedSyntheticVertex<Graph> vx(x);
-    auto synthetic_vertex = vx.get();
     const size_t nv = boost::num_vertices(x);
     std::unique_ptr<edge_cost[]> distances(new edge_cost[nv]);
     flat_hash_set<Vertex> vertices;
-    std::unique_ptr<Vertex[]> pmap;
+    // Distances to F are updated incrementally: each round only seeds the vertices it added to F
+    size_t nseeded = 0;
+    auto update_distances = [&]() {
+        multi_source_dijkstra(x, F.begin() + nseeded, F.end(), distances.get(), nullptr, nseeded == 0);
+        nseeded = F.size();
+    };
     size_t i;
     if(weights) {
         if(!bbox_vertices_ptr) throw std::runtime_error("bbox_vertices_ptr must be provided to use weights");
@@ -121,7 +103,6 @@ thorup_d(Graph &x, RNG &rng, size_t nperround, size_t maxnumrounds,
             r2wi[R[i]] = i;
         }
         auto cdf = std::make_unique<WType[]>(R.size());
-        pmap.reset(new Vertex[boost::num_vertices(x)]);
         for(i = 0; R.size() && i < maxnumrounds; ++i) {
             const size_t rsz = R.size();
             std::partial_sum(R.data(), R.data() + rsz,
@@ -139,16 +120,12 @@ thorup_d(Graph &x, RNG &rng, size_t nperround, size_t maxnumrounds,
                     sampled_sum += weights[r2wi[v]];
                 } while(sampled_sum < nperround);
                 F.insert(F.end(), vertices.begin(), vertices.end());
-                for(const auto v: vertices) boost::add_edge(v, synthetic_vertex, 0., x);
                 vertices.clear();
             } else {
                 F.insert(F.end(), R.begin(), R.end());
-                for(const auto r: R)
-                    boost::add_edge(r, synthetic_vertex, 0., x);
                 R.clear();
             }
-            boost::dijkstra_shortest_paths(x, synthetic_vertex,
-                                           distance_map(distances.get()).predecessor_map(pmap.get()));
+            update_distances();
             if(R.empty()) break;
             auto randel = weighted_select();
             auto minv = distances[randel];
@@ -163,17 +140,12 @@ thorup_d(Graph &x, RNG &rng, size_t nperround, size_t maxnumrounds,
             if(R.size() > nperround) {
                 do vertices.insert(R[rng() % R.size()]); while(vertices.size() < nperround);
                 F.insert(F.end(), vertices.begin(), vertices.end());
-                for(const auto v: vertices) boost::add_edge(v, synthetic_vertex, 0., x);
                 vertices.clear();
             } else {
-                for(const auto r: R) {
-                    F.push_back(r);
-                    boost::add_edge(r, synthetic_vertex, 0., x);
-                }
+                F.insert(F.end(), R.begin(), R.end());
                 R.clear();
             }
-            boost::dijkstra_shortest_paths(x, synthetic_vertex,
-                                           distance_map(distances.get()));
+            update_distances();
             if(R.empty()) break;
             auto randel = R[rng() % R.size()];
             auto minv = distances[randel];
@@ -183,7 +155,6 @@ thorup_d(Graph &x, RNG &rng, size_t nperround, size_t maxnumrounds,
             // This failed. Do not use this round.
             return std::make_pair(std::move(F), std::numeric_limits<double>::max());
         }
-        assert(boost::num_vertices(x) == nv);
     }
     double cost = 0.;
     if(bbox_vertices_ptr) {
@@ -204,7 +175,7 @@ thorup_d(Graph &x, RNG &rng, size_t nperround, size_t maxnumrounds,
         }
     } else {
         OMP_PRAGMA("omp parallel for reduction(+:cost)")
-        for(size_t i = 0; i < nv - 1; ++i) {
+        for(size_t i = 0; i < nv; ++i) {
             cost += distances[i];
         }
     }
@@ -213,7 +184,7 @@ thorup_d(Graph &x, RNG &rng, size_t nperround, size_t maxnumrounds,
 
 template<typename Graph, typename BBoxContainer=std::vector<typename boost::graph_traits<Graph>::vertex_descriptor>>
 std::vector<typename boost::graph_traits<Graph>::vertex_descriptor>
-&sample_from_graph(Graph &x, size_t samples_per_round, size_t iterations,
+&sample_from_graph(const Graph &x, size_t samples_per_round, size_t iterations,
                    std::vector<typename boost::graph_traits<Graph>::vertex_descriptor> &container, uint64_t seed,
                    const BBoxContainer *bbox_vertices_ptr)
 {
@@ -236,11 +207,10 @@ std::vector<typename boost::graph_traits<Graph>::vertex_descriptor>
     F.reserve(std::min(R.size(), iterations * samples_per_round));
     wy::WyRand<uint64_t, 2> rng(seed);
     //size_t num_el = R.size();
-    util::ScopedSyntheticVertex<Graph> vx(x);
-    auto synthetic_vertex = vx.get();
     // TODO: consider using hash_set distribution for provide randomness for insertion to F.
     // Maybe replace with hash set? Idk.
     auto distances = std::make_unique<edge_cost[]>(boost::num_vertices(x));
+    size_t nseeded = 0;
     for(size_t iter = 0; iter < iterations && R.size() > 0; ++iter) {
         //size_t last_size = F.size();
         // Sample ``samples_per_round'' samples.
@@ -248,14 +218,10 @@ std::vector<typename boost::graph_traits<Graph>::vertex_descriptor>
             auto &r = R[rng() % R.size()];
             F.emplace_back(r);
         }
-        // Add connections from R to all members of F with cost 0.
-        for(const auto vertex: F)
-            boost::add_edge(synthetic_vertex, vertex, 0., x);
         // Calculate F->R distances
-        // (one Dijkstra call with synthetic node)
-        boost::dijkstra_shortest_paths(x, synthetic_vertex,
-                                       distance_map(distances.get()));
-        boost::clear_vertex(synthetic_vertex, x);
+        // (multi-source Dijkstra, seeding only the members of F added since the last iteration)
+        multi_source_dijkstra(x, F.begin() + nseeded, F.end(), distances.get(), nullptr, iter == 0);
+        nseeded = F.size();
         // Pick random t in R, remove from R all points with dist(x, F) <= dist(t, F)
         auto el = R[rng() % R.size()];
         auto minv = distances[el];
@@ -272,7 +238,6 @@ std::vector<typename boost::graph_traits<Graph>::vertex_descriptor>
         VERBOSE_ONLY(std::fprintf(stderr, "R size after: %zu\n", R.size());)
     }
     VERBOSE_ONLY(std::fprintf(stderr, "num vertices: %zu\n", boost::num_vertices(x));)
-    boost::clear_vertex(synthetic_vertex, x);
     std::fprintf(stderr, "size: %zu\n", container.size());
     return container;
 }
@@ -280,52 +245,32 @@ std::vector<typename boost::graph_traits<Graph>::vertex_descriptor>
 template<typename Graph, typename Container>
 std::pair<blaze::DynamicVector<std::decay_t<decltype(get(boost::edge_weight_t(), std::declval<Graph>(), std::declval<Graph>()))>>,
           std::vector<uint32_t>>
-get_costs(Graph &x, const Container &container) {
+get_costs(const Graph &x, const Container &container) {
     using edge_cost = std::decay_t<decltype(get(boost::edge_weight_t(), x, std::declval<Graph>()))>;
     using Vertex = typename boost::graph_traits<Graph>::vertex_descriptor;
     const size_t nv = boost::num_vertices(x);
 
-    util::ScopedSyntheticVertex<Graph> vx(x);
-    std::vector<uint32_t> assignments(boost::num_vertices(x));
-    blaze::DynamicVector<edge_cost> costs(boost::num_vertices(x));
-    std::vector<Vertex> p(boost::num_vertices(x));
-
-    auto synthetic_vertex = vx.get();
-    for(const auto vtx: container) {
-        boost::add_edge(synthetic_vertex, vtx, 0., x);
-    }
-    boost::dijkstra_shortest_paths(x, synthetic_vertex,
-                                   distance_map(&costs[0]).predecessor_map(&p[0]));
-    typename boost::property_map<Graph, boost::vertex_index_t>::type index = get(boost::vertex_index, x);
-    using v_int_t = decltype(index[p[0]]);
-    flat_hash_map<v_int_t, uint32_t> pid2ind;
+    std::vector<uint32_t> assignments(nv);
+    blaze::DynamicVector<edge_cost> costs(nv);
+    std::vector<Vertex> src(nv);
+    multi_source_dijkstra(x, container.begin(), container.end(), &costs[0], src.data());
+    flat_hash_map<Vertex, uint32_t> pid2ind;
     auto it = container.begin();
     for(size_t i = 0; i < container.size(); ++i)
-        pid2ind[index[*it++]] = i;
-
-    // This could be slow, but whatever.
+        pid2ind[*it++] = i;
+    OMP_PFOR
     for(size_t i = 0; i < nv; ++i) {
-        auto parent = p[i], newparent = p[index[parent]];
-        while(newparent != synthetic_vertex) {
-            parent = newparent;
-            newparent = p[index[parent]];
-        }
-        assert(index[parent] == parent);
-        auto it = pid2ind.find(index[parent]);
-        assert(it != pid2ind.end() || pid2ind.find(i) != pid2ind.end());
-        assignments[i] = it == pid2ind.end() ? pid2ind.at(i): it->second;
+        auto pit = pid2ind.find(src[i]);
+        assert(pit != pid2ind.end());
+        assignments[i] = pit->second;
     }
-    assignments.pop_back();
-    costs.resize(nv);
-    assert(costs.size() == assignments.size());
-    assert(nv == costs.size());
     std::fprintf(stderr, "Total cost of solution: %g\n", blaze::sum(costs));
     return std::make_pair(std::move(costs), assignments);
 }
 
 template<typename Graph, template<typename...> class BBoxTemplate=std::vector, typename WeightType=uint32_t, typename...BBoxArgs>
 auto
-thorup_sample_mincost(Graph &x, unsigned k, uint64_t seed, unsigned num_iter,
+thorup_sample_mincost(const Graph &x, unsigned k, uint64_t seed, unsigned num_iter,
     const BBoxTemplate<typename boost::graph_traits<Graph>::vertex_descriptor, BBoxArgs...> *bbox_vertices_ptr=nullptr,
     const WeightType *weights=nullptr,
     double npermult=21., double nroundmult=3.)
@@ -335,26 +280,23 @@ thorup_sample_mincost(Graph &x, unsigned k, uint64_t seed, unsigned num_iter,
     assert_connected(x);
 
     static constexpr double eps = 0.5;
-    wy::WyRand<uint64_t, 2> rng(seed);
     const size_t n = bbox_vertices_ptr ? bbox_vertices_ptr->size(): boost::num_vertices(x);
     const double logn = std::log2(n);
     const size_t samples_per_round = std::ceil(npermult * logn * k / eps);
-    auto func = [&](Graph &localx) {
-        //auto wworking = wcopy;
-        return thorup_d(localx, rng, samples_per_round, nroundmult * logn, bbox_vertices_ptr, weights);
+    // thorup_d only reads the graph, so every trial shares x; each trial (and retry) has its own generator.
+    auto func = [&](unsigned trial, uint64_t attempt) {
+        wy::WyRand<uint64_t, 2> rng(seed ^ (attempt << 48) ^ (uint64_t(trial) * 0x9E3779B97F4A7C15ull));
+        return thorup_d(x, rng, samples_per_round, nroundmult * logn, bbox_vertices_ptr, weights);
     };
     std::pair<std::vector<typename graph_traits<Graph>::vertex_descriptor>,
               double> bestsol;
     bestsol.second = std::numeric_limits<double>::max();
     OMP_PFOR
     for(unsigned i = 0; i < num_iter; ++i) {
-        OMP_ELSE(Graph, Graph &) cpy(x);
-        auto next = func(cpy);
-        if(next.second == std::numeric_limits<double>::max()) {
-            // This round failed.
-            --i;
-            continue;
-        }
+        auto next = func(i, 0);
+        // If this round failed, try again.
+        for(uint64_t attempt = 1; next.second == std::numeric_limits<double>::max(); ++attempt)
+            next = func(i, attempt);
         if(next.second < bestsol.second) {
             OMP_CRITICAL
             {
@@ -401,7 +343,7 @@ blaze::DynamicVector<IType> histogram_assignments(const Con &c, unsigned ncenter
 
 template<typename Graph, template<typename...> class BBoxTemplate=std::vector, typename WeightType=uint32_t, typename...BBoxArgs>
 auto
-thorup_sample_mincost_with_weights(Graph &x, unsigned k, uint64_t seed,
+thorup_sample_mincost_with_weights(const Graph &x, unsigned k, uint64_t seed,
                                    unsigned num_trials, unsigned num_iter,
     const BBoxTemplate<typename boost::graph_traits<Graph>::vertex_descriptor, BBoxArgs...> *bbox_vertices_ptr=nullptr,
     WeightType *weights=nullptr,
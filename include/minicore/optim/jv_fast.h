@@ -0,0 +1,304 @@
+#ifndef JV_FAST_H__
+#define JV_FAST_H__
+#include "minicore/util/blaze_adaptor.h"
+#include "minicore/util/packed.h"
+#include "minicore/util/radix_heap.h"
+#include <numeric>
+
+namespace minicore {
+
+namespace jv {
+
+namespace fast {
+
+/*
+ * Event-driven Jain-Vazirani primal-dual facility location for uniform facility cost z,
+ * used by JVSolver's performance mode.
+ *
+ * Phase 1 raises all active clients' duals together in time t.
+ * Client j starts paying (t - c_ij) toward facility i at t = c_ij.
+ * Facility i becomes temporarily open once its payments reach z.
+ * An active client is frozen (connected) when a facility it pays toward opens,
+ * or when it reaches a tight edge to an already-open facility.
+ * Frozen clients keep their fixed payment. Per facility, payments are fz + na * t - sa:
+ *  - fz: frozen payments;
+ *  - na: the number of active payers;
+ *  - sa: the sum of the active payers' edge costs.
+ * This gives each facility's opening time in closed form.
+ *
+ * Instead of sorting all n * m edges, each client reads its edges in order from a ClientEdgeStreams prefix
+ * (k-smallest selection, extended on demand). Only one pending edge event per client is queued at a time.
+ * Events sit in a RadixEventQueue, a monotone bucketed queue. Superseded facility events are skipped
+ * by version number instead of being erased.
+ *
+ * Phase 2 selects a maximal independent set of the temporarily open facilities in the conflict graph
+ * (two facilities conflict if some client pays both a positive amount), preferring earlier-opened facilities.
+ * It runs as parallel rounds: an undecided facility is selected if it precedes all of its undecided neighbors,
+ * and neighbors of selected facilities are removed. This yields the same set as the sequential greedy pass.
+ */
+
+// Monotone priority queue (radix heap) over non-negative times: keys popped never decrease.
+template<typename Payload>
+using RadixEventQueue = util::RadixHeap<double, Payload>;
+
+/*
+ * Each client's edges (cost, facility) in ascending order, materialized as a prefix of the smallest edges
+ * by partial selection, and extended on demand. These are independent of facility cost,
+ * so one instance serves every step of a bisection.
+ * The distance matrix has facilities as rows and clients as columns.
+ */
+template<typename FT, typename IT=uint32_t>
+struct ClientEdgeStreams {
+    using edge_type = packed::pair<FT, IT>;
+    size_t nfac_ = 0, ncli_ = 0;
+    std::vector<std::vector<edge_type>> sorted_;
+
+    template<typename MT>
+    void fill(const MT &mat, size_t cid, size_t len) {
+        std::vector<edge_type> &dest = sorted_[cid];
+        std::vector<edge_type> tmp(nfac_);
+        for(size_t f = 0; f < nfac_; ++f) tmp[f] = edge_type(FT(mat(f, cid)), IT(f));
+        if(len < nfac_) std::nth_element(tmp.begin(), tmp.begin() + len, tmp.end());
+        tmp.resize(len);
+        std::sort(tmp.begin(), tmp.end());
+        dest = std::move(tmp);
+    }
+    template<typename MT>
+    void setup(const MT &mat, size_t prefix) {
+        nfac_ = mat.rows(); ncli_ = mat.columns();
+        prefix = std::min(std::max(prefix, size_t(1)), nfac_);
+        sorted_.resize(ncli_);
+        OMP_PRAGMA("omp parallel for schedule(dynamic, 64)")
+        for(size_t j = 0; j < ncli_; ++j)
+            fill(mat, j, prefix);
+    }
+    // Doubles the prefix of each client in cids
+    template<typename MT>
+    void extend(const MT &mat, const std::vector<IT> &cids) {
+        OMP_PRAGMA("omp parallel for schedule(dynamic, 1)")
+        for(size_t i = 0; i < cids.size(); ++i)
+            fill(mat, cids[i], std::min(nfac_, 2 * sorted_[cids[i]].size()));
+    }
+    bool complete(size_t cid) const {return sorted_[cid].size() == nfac_;}
+    size_t bytes() const {
+        size_t ret = 0;
+        for(const auto &v: sorted_) ret += v.size() * sizeof(edge_type);
+        return ret;
+    }
+};
+
+/*
+ * One primal-dual run at a given facility cost. Buffers persist across calls to run(),
+ * so a bisection reuses one instance per concurrent evaluation.
+ */
+template<typename MT, typename FT, typename IT=uint32_t>
+struct FacilityLocationRun {
+    using edge_type = packed::pair<FT, IT>;
+    struct Event {
+        IT id;
+        uint32_t version; // CLIENT_EVENT for a client's next edge, otherwise a facility's opening event
+    };
+    static constexpr uint32_t CLIENT_EVENT = std::numeric_limits<uint32_t>::max();
+    static constexpr double NOT_OPEN = std::numeric_limits<double>::max();
+
+    const MT &mat_;
+    const ClientEdgeStreams<FT, IT> &streams_;
+    size_t nfac_, ncli_;
+    double z_ = 0.;
+
+    // Clients
+    std::vector<double> alpha_;               // Dual value; fixed once frozen
+    std::vector<uint8_t> active_;
+    std::vector<IT> witness_;                 // Facility whose opening (or open state) froze the client
+    std::vector<uint32_t> pos_;               // Next edge in the client's stream
+    std::vector<std::vector<edge_type>> tight_; // (cost, facility) edges which became tight while active
+    shared::flat_hash_map<IT, std::vector<edge_type>> local_; // Full streams for clients past their prefix
+    std::vector<IT> exhausted_;               // Clients which needed more than their prefix
+
+    // Facilities
+    std::vector<double> fz_, sa_, open_time_;
+    std::vector<uint32_t> na_, version_;
+    std::vector<std::vector<IT>> payers_;     // Clients with a tight edge to each facility
+    std::vector<IT> opened_;                  // Temporarily open facilities, in order of opening
+
+    RadixEventQueue<Event> queue_;
+    size_t nactive_ = 0, nevents_ = 0;
+
+    FacilityLocationRun(const MT &mat, const ClientEdgeStreams<FT, IT> &streams):
+        mat_(mat), streams_(streams), nfac_(mat.rows()), ncli_(mat.columns()) {}
+
+    const edge_type *next_edge(IT cid) {
+        const size_t p = pos_[cid];
+        const auto &pre = streams_.sorted_[cid];
+        if(p < pre.size()) return &pre[p];
+        if(streams_.complete(cid)) return nullptr;
+        auto it = local_.find(cid);
+        if(it == local_.end()) {
+            std::vector<edge_type> full(nfac_);
+            for(size_t f = 0; f < nfac_; ++f) full[f] = edge_type(FT(mat_(f, cid)), IT(f));
+            std::sort(full.begin(), full.end());
+            it = local_.emplace(cid, std::move(full)).first;
+            exhausted_.push_back(cid);
+        }
+        return p < it->second.size() ? &it->second[p]: nullptr;
+    }
+    void push_client(IT cid) {
+        if(const edge_type *e = next_edge(cid); e && std::isfinite(e->first))
+            queue_.push(e->first, Event{cid, CLIENT_EVENT});
+    }
+    // Queues facility fid's opening time given its current payers
+    void schedule(IT fid, double now) {
+        const uint32_t v = ++version_[fid];
+        const double paid = fz_[fid] + na_[fid] * now - sa_[fid];
+        double t;
+        if(paid >= z_) t = now;
+        else if(na_[fid]) t = std::max(now, (z_ - fz_[fid] + sa_[fid]) / na_[fid]);
+        else return;
+        queue_.push(t, Event{fid, v});
+    }
+    void freeze(IT cid, double t, IT witness) {
+        active_[cid] = false;
+        alpha_[cid] = t;
+        witness_[cid] = witness;
+        --nactive_;
+        for(const edge_type &e: tight_[cid]) {
+            const IT fid = e.second;
+            if(open_time_[fid] != NOT_OPEN) continue;
+            --na_[fid];
+            sa_[fid] -= e.first;
+            fz_[fid] += t - e.first;
+            schedule(fid, t);
+        }
+    }
+    void open(IT fid, double t) {
+        open_time_[fid] = t;
+        opened_.push_back(fid);
+        for(const IT cid: payers_[fid])
+            if(active_[cid]) freeze(cid, t, fid);
+    }
+
+    void phase1() {
+        alpha_.assign(ncli_, 0.);
+        active_.assign(ncli_, true);
+        witness_.assign(ncli_, IT(-1));
+        pos_.assign(ncli_, 0);
+        tight_.resize(ncli_);
+        for(auto &t: tight_) t.clear();
+        local_.clear();
+        exhausted_.clear();
+        fz_.assign(nfac_, 0.); sa_.assign(nfac_, 0.); open_time_.assign(nfac_, NOT_OPEN);
+        na_.assign(nfac_, 0); version_.assign(nfac_, 0);
+        payers_.resize(nfac_);
+        for(auto &p: payers_) p.clear();
+        opened_.clear();
+        queue_.clear();
+        nactive_ = ncli_;
+        nevents_ = 0;
+        for(size_t f = 0; f < nfac_; ++f) schedule(f, 0.);
+        for(size_t j = 0; j < ncli_; ++j) push_client(j);
+        while(nactive_ && !queue_.empty()) {
+            const auto [t, ev] = queue_.pop();
+            ++nevents_;
+            if(ev.version != CLIENT_EVENT) {
+                if(ev.version == version_[ev.id] && open_time_[ev.id] == NOT_OPEN)
+                    open(ev.id, t);
+                continue;
+            }
+            const IT cid = ev.id;
+            if(!active_[cid]) continue;
+            const edge_type e = *next_edge(cid);
+            ++pos_[cid];
+            const IT fid = e.second;
+            if(open_time_[fid] != NOT_OPEN) {
+                freeze(cid, t, fid);
+                continue;
+            }
+            tight_[cid].push_back(e);
+            payers_[fid].push_back(cid);
+            ++na_[fid];
+            sa_[fid] += e.first;
+            schedule(fid, t);
+            push_client(cid);
+        }
+    }
+
+    // Lexicographically-first maximal independent set of opened_ in the conflict graph, in parallel rounds
+    std::vector<IT> phase2(bool parallel) {
+        const size_t nt = opened_.size();
+        std::vector<uint32_t> prio(nfac_, uint32_t(-1));
+        for(size_t i = 0; i < nt; ++i) prio[opened_[i]] = i;
+        // Open facilities each client pays a positive amount, as CSR
+        std::vector<size_t> offsets(ncli_ + 1);
+        OMP_PRAGMA("omp parallel for if(parallel)")
+        for(size_t j = 0; j < ncli_; ++j) {
+            size_t c = 0;
+            for(const edge_type &e: tight_[j]) c += prio[e.second] != uint32_t(-1) && e.first < alpha_[j];
+            offsets[j + 1] = c;
+        }
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        std::vector<IT> cfac(offsets.back());
+        OMP_PRAGMA("omp parallel for if(parallel)")
+        for(size_t j = 0; j < ncli_; ++j) {
+            IT *p = &cfac[offsets[j]];
+            for(const edge_type &e: tight_[j])
+                if(prio[e.second] != uint32_t(-1) && e.first < alpha_[j]) *p++ = e.second;
+        }
+        enum: uint8_t {UNDECIDED, SELECTED, REMOVED};
+        std::vector<uint8_t> state(nfac_, REMOVED), next(nfac_);
+        for(const IT f: opened_) state[f] = UNDECIDED;
+        std::vector<IT> undecided(opened_), ret;
+        // Calls func(g) for each facility g sharing a positive payer with f
+        auto for_each_neighbor = [&](IT f, const auto &func) {
+            for(const IT cid: payers_[f]) {
+                if(!(mat_(f, cid) < alpha_[cid])) continue;
+                for(size_t i = offsets[cid]; i < offsets[cid + 1]; ++i)
+                    if(cfac[i] != f && !func(cfac[i])) return;
+            }
+        };
+        while(!undecided.empty()) {
+            OMP_PRAGMA("omp parallel for schedule(dynamic, 16) if(parallel)")
+            for(size_t i = 0; i < undecided.size(); ++i) {
+                const IT f = undecided[i];
+                bool localmin = true;
+                for_each_neighbor(f, [&](IT g) {
+                    if(state[g] == UNDECIDED && prio[g] < prio[f]) localmin = false;
+                    return localmin;
+                });
+                next[f] = localmin ? SELECTED: UNDECIDED;
+            }
+            for(const IT f: undecided) if(next[f] == SELECTED) state[f] = SELECTED, ret.push_back(f);
+            OMP_PRAGMA("omp parallel for schedule(dynamic, 16) if(parallel)")
+            for(size_t i = 0; i < undecided.size(); ++i) {
+                const IT f = undecided[i];
+                if(state[f] != UNDECIDED) continue;
+                bool adj = false;
+                for_each_neighbor(f, [&](IT g) {
+                    if(state[g] == SELECTED) adj = true;
+                    return !adj;
+                });
+                next[f] = adj ? REMOVED: UNDECIDED;
+            }
+            undecided.erase(std::remove_if(undecided.begin(), undecided.end(), [&](IT f) {
+                if(state[f] == UNDECIDED && next[f] == REMOVED) state[f] = REMOVED;
+                return state[f] != UNDECIDED;
+            }), undecided.end());
+        }
+        std::sort(ret.begin(), ret.end(), [&](IT x, IT y) {return prio[x] < prio[y];});
+        return ret;
+    }
+
+    // Returns the facilities opened for cost z, in order of temporary opening
+    std::vector<IT> run(double z, bool parallel=true) {
+        z_ = z;
+        phase1();
+        return phase2(parallel);
+    }
+};
+
+} // namespace fast
+
+} // namespace jv
+
+} // namespace minicore
+
+#endif /* JV_FAST_H__ */
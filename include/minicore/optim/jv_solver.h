@@ -7,6 +7,7 @@
 #include <mutex>
 #include <thread>
 #include "include/thirdparty/btree/set.h"
+#include "minicore/optim/jv_fast.h"
 
 namespace minicore {
 
@@ -136,6 +137,9 @@ private:
     size_t nfac_;
 
     bool verbose = false;
+    bool edges_ready_ = false;     // edges_ is built and sorted on first use
+    bool performance_mode_ = false; // See kmedian_fast
+    std::shared_ptr<fast::ClientEdgeStreams<FT, IT>> streams_;
 
 
     // Private code
@@ -408,7 +412,10 @@ public:
         n_open_clients_(o.distmatp_->columns()),
         nedges_(o.nedges_),
         ncities_(o.ncities_),
-        nfac_(o.nfac_)
+        nfac_(o.nfac_),
+        edges_ready_(o.edges_ready_),
+        performance_mode_(o.performance_mode_),
+        streams_(o.streams_)
     {
         client_w_ = FT(0);
         set_fac_cost(cost);
@@ -424,6 +431,10 @@ public:
     void make_verbose() {
         verbose = true;
     }
+    // Enables the accelerated k-median path; see kmedian_fast
+    void set_performance_mode(bool value=true) {
+        performance_mode_ = value;
+    }
 
     template<typename CostType>
     JVSolver(const MatrixType &mat, const CostType &cost): JVSolver() {
@@ -465,11 +476,56 @@ public:
         distmatp_ = &mat;
         set_fac_cost(cost);
 
-        // Initialize W and edge vector
+        // Initialize W; the edge list is built on first use (see prepare_edges)
         client_w_.resize(mat.rows(), mat.columns());
         client_w_ = static_cast<FT>(0);
+        edges_ready_ = false;
+        streams_.reset();
+
+        // Initialize V, T, and S
+        if(ncities_ < mat.columns()) {
+            client_v_.clear();
+            client_v_.resize(mat.columns());
+            clients_cpy_.clear();
+            clients_cpy_.resize(mat.columns());
+        } else {
+            OMP_PFOR
+            for(size_t i = 0; i < mat.columns(); ++i) clients_cpy_[i].clear();
+        }
+        OMP_PRAGMA("omp parallel for schedule(static,256)")
+        for(size_t i = 0; i < mat.columns(); ++i)
+            client_v_[i] = payment_t{PAID_IN_FULL, EMPTY};
+        if(nfac_ < mat.rows()) {
+            working_open_facilities_.reset(new std::vector<IT>[mat.rows()]);
+            nfac_ = mat.rows();
+            contribution_time_.reset(new FT[nfac_]());
+            fac_contributions_.reset(new FT[nfac_]());
+        } else {
+            OMP_PRAGMA("omp parallel for schedule(static,512)")
+            for(size_t i = 0; i < nfac_; ++i)
+                working_open_facilities_[i] = {EMPTY};
+
+            std::memset(contribution_time_.get(), 0, sizeof(contribution_time_[0]) * nfac_);
+            std::memset(fac_contributions_.get(), 0, sizeof(fac_contributions_[0]) * nfac_);
+        }
+        ncities_ = mat.columns();
+        nfac_ = mat.rows();
+        n_open_clients_ = ncities_;
+        pay_schedule_.resize(nfac_);
+        next_paid_.clear();
+        for(size_t i = 0; i < nfac_; ++i) {
+            auto cost = get_fac_cost(i);
+            next_paid_.push({cost, i});
+            pay_schedule_[i] = cost;
+        }
+    }
+
+    // Builds the list of all edges, sorted by cost, which drives open_candidates
+    void prepare_edges() {
+        if(edges_ready_) return;
+        const MatrixType &mat = *distmatp_;
         const size_t edges_to_use = blaze::IsDenseMatrix_v<MatrixType> ? mat.rows() * mat.columns(): blaze::nonZeros(mat);
-        if(nedges_ != edges_to_use) {
+        if(nedges_ != edges_to_use || edges_.use_count() > 1) { // Do not overwrite edges shared with other solvers
             edges_.reset(new edge_type[edges_to_use]);
         }
         nedges_ = edges_to_use;
@@ -522,43 +578,7 @@ public:
             return x.cost() < y.cost();
         });
         if(verbose) std::fprintf(stderr, "Edges sorted\n");
-
-        // Initialize V, T, and S
-        if(ncities_ < mat.columns()) {
-            client_v_.clear();
-            client_v_.resize(mat.columns());
-            clients_cpy_.clear();
-            clients_cpy_.resize(mat.columns());
-        } else {
-            OMP_PFOR
-            for(size_t i = 0; i < mat.columns(); ++i) clients_cpy_[i].clear();
-        }
-        OMP_PRAGMA("omp parallel for schedule(static,256)")
-        for(size_t i = 0; i < mat.columns(); ++i)
-            client_v_[i] = payment_t{PAID_IN_FULL, EMPTY};
-        if(nfac_ < mat.rows()) {
-            working_open_facilities_.reset(new std::vector<IT>[mat.rows()]);
-            nfac_ = mat.rows();
-            contribution_time_.reset(new FT[nfac_]());
-            fac_contributions_.reset(new FT[nfac_]());
-        } else {
-            OMP_PRAGMA("omp parallel for schedule(static,512)")
-            for(size_t i = 0; i < nfac_; ++i)
-                working_open_facilities_[i] = {EMPTY};
-
-            std::memset(contribution_time_.get(), 0, sizeof(contribution_time_[0]) * nfac_);
-            std::memset(fac_contributions_.get(), 0, sizeof(fac_contributions_[0]) * nfac_);
-        }
-        ncities_ = mat.columns();
-        nfac_ = mat.rows();
-        n_open_clients_ = ncities_;
-        pay_schedule_.resize(nfac_);
-        next_paid_.clear();
-        for(size_t i = 0; i < nfac_; ++i) {
-            auto cost = get_fac_cost(i);
-            next_paid_.push({cost, i});
-            pay_schedule_[i] = cost;
-        }
+        edges_ready_ = true;
     }
 
     auto &run(std::atomic<int> *early_terminate=nullptr) {
@@ -570,6 +590,7 @@ public:
     }
 
     FT open_candidates(std::atomic<int> *early_terminate=nullptr) {
+        prepare_edges();
         IT edge_idx = 0;
         FT time = 0.;
         DBG_ONLY(const size_t edge_log_num = nedges_ / 10;)
@@ -718,8 +739,9 @@ public:
     std::pair<std::vector<IT>, std::vector<std::vector<IT>>>
     kmedian_parallel(int num_threads, unsigned k, unsigned maxrounds, double maxcost=0., double mincost=0., uint64_t seed = 0) {
         auto fstart = std::chrono::high_resolution_clock::now();
-        if(num_threads <= 1)
+        if(num_threads <= 1 || performance_mode_)
             return kmedian(k, maxrounds, maxcost, mincost);
+        prepare_edges(); // Shared by the clones below
         std::vector<this_type> solvers;
         auto &dm = *distmatp_;
         if(maxcost == 0.) {
@@ -812,6 +834,9 @@ public:
     std::pair<std::vector<IT>, std::vector<std::vector<IT>>>
     kmedian(unsigned k, unsigned maxrounds=100, double maxcost=0., double mincost=0.)
     {
+        if constexpr(blaze::IsDenseMatrix_v<MatrixType>) {
+            if(performance_mode_) return kmedian_fast(k, maxrounds, maxcost, mincost);
+        }
         auto kmed_start = std::chrono::high_resolution_clock::now();
         auto &dm = *distmatp_;
         if(maxcost == 0.) {
@@ -890,6 +915,104 @@ public:
                      (kmed_stop - kmed_start).count() * 1.e-6);
         return std::make_pair(final_open_facilities_, final_open_facility_assignments_);
     }
+    /*
+     * Performance mode for kmedian, for dense distance matrices.
+     * Each facility cost is solved by jv::fast::FacilityLocationRun; the per-client edge streams are built once
+     * (and extended as needed) and shared by all runs.
+     * P = min(threads, 8) costs spaced geometrically across the current bracket are solved concurrently,
+     * shrinking the bracket by a factor of P + 1 per round, until some cost opens exactly k facilities.
+     * Each concurrent slot keeps its run's buffers across rounds.
+     * If maxrounds pass first, the closest solution is repaired to k facilities greedily, as in kmedian.
+     */
+    std::pair<std::vector<IT>, std::vector<std::vector<IT>>>
+    kmedian_fast(unsigned k, unsigned maxrounds=100, double maxcost=0., double mincost=0.)
+    {
+        const auto kmed_start = std::chrono::high_resolution_clock::now();
+        const MatrixType &dm = *distmatp_;
+        if(k >= nfac_) throw std::invalid_argument("k must be less than the number of facilities");
+        if(maxcost == 0.) {
+            maxcost = 0.;
+            for(auto r: blz::rowiterator(dm))
+                for(auto v: r)
+                    if(std::isfinite(v) && v > maxcost)
+                        maxcost = v;
+            maxcost *= dm.columns();
+        }
+        if(!streams_) {
+            streams_.reset(new fast::ClientEdgeStreams<FT, IT>);
+            // Clients rarely read far beyond their nearest nfac / k facilities before connecting
+            streams_->setup(dm, std::max(size_t(32), 4 * (nfac_ + k - 1) / k));
+        }
+        unsigned nslots = 1;
+        OMP_ONLY(nslots = std::min(8, omp_get_max_threads());)
+        using run_type = fast::FacilityLocationRun<MatrixType, FT, IT>;
+        std::vector<run_type> runs;
+        for(unsigned i = 0; i < nslots; ++i) runs.emplace_back(dm, *streams_);
+        std::vector<double> costs(nslots);
+        std::vector<std::vector<IT>> sols(nslots);
+        std::vector<IT> best;
+        size_t bestdiff = std::numeric_limits<size_t>::max();
+        double lo = mincost, hi = maxcost;
+        size_t roundnum = 0, nevents = 0;
+        for(; roundnum < maxrounds; ++roundnum) {
+            for(unsigned i = 0; i < nslots; ++i) {
+                const double frac = (i + 1.) / (nslots + 1);
+                costs[i] = lo > 0. ? lo * std::pow(hi / lo, frac): hi * std::pow(frac, 4);
+            }
+            if(nslots == 1) {
+                sols[0] = runs[0].run(costs[0], true); // Parallelize phase 2 instead
+            } else {
+                OMP_PRAGMA("omp parallel for schedule(dynamic, 1) num_threads(nslots)")
+                for(unsigned i = 0; i < nslots; ++i)
+                    sols[i] = runs[i].run(costs[i], false);
+            }
+            std::vector<IT> exhausted;
+            for(auto &r: runs) {
+                exhausted.insert(exhausted.end(), r.exhausted_.begin(), r.exhausted_.end());
+                nevents += r.nevents_;
+            }
+            if(exhausted.size()) {
+                std::sort(exhausted.begin(), exhausted.end());
+                exhausted.erase(std::unique(exhausted.begin(), exhausted.end()), exhausted.end());
+                streams_->extend(dm, exhausted);
+            }
+            // Facility count generally falls as cost rises: bracket k between the last cost opening too many
+            // and the next cost opening too few
+            double newlo = lo, newhi = hi;
+            for(unsigned i = 0; i < nslots; ++i) {
+                const size_t nopen = sols[i].size();
+                const size_t diff = nopen > k ? nopen - k: k - nopen;
+                if(diff < bestdiff) bestdiff = diff, best = sols[i];
+                if(nopen > k) newlo = costs[i];
+            }
+            for(unsigned i = 0; i < nslots; ++i)
+                if(costs[i] > newlo && sols[i].size() < k) {newhi = costs[i]; break;}
+            lo = newlo; hi = newhi;
+            if(verbose)
+                std::fprintf(stderr, "[%s] Round %zu: costs %0.12g to %0.12g. Best facility count differs from k by %zu. Cost bracket now [%0.12g, %0.12g]. Edge stream memory: %zu bytes\n",
+                             __func__, roundnum, costs.front(), costs.back(), bestdiff, lo, hi, streams_->bytes());
+            if(bestdiff == 0 || hi - lo <= 1e-12 * hi) break;
+        }
+        final_open_facilities_ = std::move(best);
+        if(final_open_facilities_.size() != k) {
+            std::fprintf(stderr, "Failed to find exact solution using JV in %zu rounds. Now using local search from current solution of %zu points to desired k = %u\n",
+                         roundnum, final_open_facilities_.size(), k);
+            reassign();
+            while(final_open_facilities_.size() < k)
+                final_open_facilities_.push_back(local_best_to_add());
+            while(final_open_facilities_.size() > k) {
+                IT to_rm = local_best_to_rm();
+                auto it = std::find(final_open_facilities_.begin(), final_open_facilities_.end(), to_rm);
+                final_open_facility_assignments_.erase(final_open_facility_assignments_.begin() + (it - final_open_facilities_.begin()));
+                final_open_facilities_.erase(it);
+            }
+        }
+        reassign();
+        auto kmed_stop = std::chrono::high_resolution_clock::now();
+        std::fprintf(stderr, "Solution cost with %zu centers: %g. Time to perform clustering: %g (%zu rounds, %zu events)\n", final_open_facilities_.size(), calculate_cost(false),
+                     (kmed_stop - kmed_start).count() * 1.e-6, roundnum + 1, nevents);
+        return std::make_pair(final_open_facilities_, final_open_facility_assignments_);
+    }
     IT local_best_to_add() const {
         blaze::DynamicVector<FT,blaze::rowVector> current_costs = blaze::min<blaze::columnwise>(blaze::rows(*distmatp_, final_open_facilities_.data(), final_open_facilities_.size()));
         FT max_improvement = -std::numeric_limits<FT>::max();
@@ -904,7 +1027,7 @@ public:
                 if(cost < current_costs[j])
                     improvement += (current_costs[j] - cost);
             }
-            if(improvement > max_improvement) improvement = max_improvement, bestind = i;
+            if(improvement > max_improvement) max_improvement = improvement, bestind = i;
         }
         return bestind;
     }
@@ -1,6 +1,7 @@
 #pragma once
 #ifndef FGC_KMEANS_H__
 #define FGC_KMEANS_H__
+#include <array>
 #include <cassert>
 #include <iostream>
 #include <mutex>
@@ -12,6 +13,8 @@
 #include "minicore/optim/lsearchpp.h"
 #include "minicore/util/blaze_adaptor.h"
 #include "minicore/util/tsg.h"
+#include "minicore/dist/batched.h"
+#include "minicore/clustering/accumulate.h"
 #include "libsimdsampling/simdsampling.h"
 #include "reservoir/include/DOGS/reservoir.h"
 #if USE_TBB
@@ -38,18 +41,55 @@ using blz::sqrL2Norm;
  * The Banerjee paper has a table of relevant information.
  */
 
+/*
+ * Bounded seeding
+ *
+ * When the oracle is a metric (or the square of one), the update after adding center c_new
+ * can skip point i whenever d(c_new, c_a(i)) >= 2 d(i, c_a(i)), where c_a(i) is i's current center:
+ * by the triangle inequality, c_new cannot be closer to i than c_a(i) is.
+ * Points are kept grouped by center, along with each center's radius (its largest distance),
+ * so that a whole cluster is skipped at once when d(c_new, c_j) >= 2 radius(j).
+ * Groups are maintained incrementally: only clusters which were scanned can lose points to c_new,
+ * so only they are compacted (and their radii recomputed), and c_new's group is formed from the points they lost.
+ * The bookkeeping is proportional to the points visited rather than n per center.
+ * Each new center costs one oracle call per existing center, and the selected centers, assignments
+ * and costs are identical to those of the unbounded scan.
+ *
+ * For SQUARED_METRIC_BOUNDS (e.g., SQRL2 or JSD), the factor of 2 becomes 4.
+ * Only supported for n_local_samples <= 1; otherwise, bounds are ignored.
+ */
+
+enum SeedingBounds: int {
+    NO_BOUNDS = 0,
+    METRIC_BOUNDS = 1,
+    SQUARED_METRIC_BOUNDS = 2
+};
+
+struct SeedingStats {
+    size_t nevals = 0;            // oracle calls made while updating distances
+    size_t nsaved = 0;            // oracle calls avoided by bounds
+    size_t nclusters_skipped = 0; // clusters skipped without visiting their points
+};
+
+#ifndef MINOCORE_SEEDING_BLOCKSIZE
+#define MINOCORE_SEEDING_BLOCKSIZE 1024
+#endif
+
 /*
  *
  * oracle: computes distance D(x, y) for i in [0, np)
  * weights: null if equal, used if provided
  * lspprounds: how many localsearch++ rounds to perform. By default, perform none.
+ * bounds: whether (and how) to use the triangle inequality to skip distance computations. See above.
+ * stats: if non-null, the number of oracle calls made and avoided are added to it.
  */
 
 
 template<typename Oracle, typename FT=double,
          typename IT=std::uint32_t, typename RNG, typename WFT=FT>
 auto
-kmeanspp(const Oracle &oracle, RNG &rng, size_t np, size_t k, const WFT *weights=nullptr, size_t lspprounds=0, bool use_exponential_skips=false, bool parallelize_oracle=true, size_t n_local_samples=1)
+kmeanspp(const Oracle &oracle, RNG &rng, size_t np, size_t k, const WFT *weights=nullptr, size_t lspprounds=0, bool use_exponential_skips=false, bool parallelize_oracle=true, size_t n_local_samples=1,
+         SeedingBounds bounds=NO_BOUNDS, SeedingStats *stats=nullptr)
 {
     const bool emit_log = false;
     if(emit_log)
@@ -105,6 +145,21 @@ kmeanspp(const Oracle &oracle, RNG &rng, size_t np, size_t k, const WFT *weights
     blz::DV<double> samplescosts(odists.size());
     std::vector<IT> samplesasn(odists.size()), oasn(odists.size());
     if(odists.size()) odists = distances, oasn = assignments;
+    if(n_local_samples > 1) bounds = NO_BOUNDS;
+    const double boundmul = bounds == SQUARED_METRIC_BOUNDS ? 4.: 2.;
+    std::vector<std::vector<IT>> members; // members[j]: points assigned to center j
+    std::vector<FT> radii, ccdists;
+    std::vector<std::array<size_t, 3>> blocks; // cluster, begin, end
+    std::vector<IT> scanned;
+    std::vector<std::vector<IT>> moved;
+    SeedingStats lstats;
+    if(bounds != NO_BOUNDS) {
+        members.resize(k);
+        members[0].resize(np);
+        std::iota(members[0].begin(), members[0].end(), IT(0));
+        radii.assign(k, FT(0));
+        radii[0] = blaze::max(distances);
+    }
     for(size_t center_idx = 1;center_idx < k;) {
         //std::fprintf(stderr, "Centers size: %zu/%zu. Newest center: %u\r\n", center_idx, size_t(k), centers[center_idx - 1]);
         // At this point, the cdf has been prepared, and we are ready to sample.
@@ -182,6 +237,7 @@ kmeanspp(const Oracle &oracle, RNG &rng, size_t np, size_t k, const WFT *weights
                     if(blaze::isnan(distances)) throw std::runtime_error("NAN distance found");
                 }
             }
+            const IT prevasn = assignments[newc];
             assignments[newc] = center_idx;
             centers[center_idx] = newc;
 #define COMPUTE_X(i) do {\
@@ -191,19 +247,94 @@ kmeanspp(const Oracle &oracle, RNG &rng, size_t np, size_t k, const WFT *weights
             if(auto dist = oracle(newc, i); dist < ldist) assignments[i] = center_idx, ldist = dist;\
         }\
     } while(0)
-            if(parallelize_oracle) {
+            if(bounds != NO_BOUNDS) {
+                ccdists.resize(center_idx);
+                OMP_PRAGMA("omp parallel for schedule(dynamic) if(parallelize_oracle)")
+                for(size_t j = 0; j < center_idx; ++j)
+                    ccdists[j] = oracle(newc, centers[j]);
+                // Skip whole clusters, then split the rest into blocks for load balance
+                size_t nevals = center_idx, nsaved = 0;
+                blocks.clear();
+                scanned.clear();
+                for(size_t j = 0; j < center_idx; ++j) {
+                    const size_t ge = members[j].size();
+                    if(ge == 0) continue;
+                    if(ccdists[j] >= boundmul * radii[j]) {
+                        // Its center has distance 0 and would have been skipped anyway
+                        nsaved += ge - 1;
+                        ++lstats.nclusters_skipped;
+                        if(j == prevasn) scanned.push_back(j); // Still has to give up newc
+                        continue;
+                    }
+                    scanned.push_back(j);
+                    for(size_t b = 0; b < ge; b += MINOCORE_SEEDING_BLOCKSIZE)
+                        blocks.push_back({j, b, std::min(ge, b + MINOCORE_SEEDING_BLOCKSIZE)});
+                }
+                OMP_PRAGMA("omp parallel for schedule(dynamic) reduction(+:nevals,nsaved) if(parallelize_oracle)")
+                for(size_t b = 0; b < blocks.size(); ++b) {
+                    const auto &mem = members[blocks[b][0]];
+                    for(size_t p = blocks[b][1]; p < blocks[b][2]; ++p) {
+                        const auto i = mem[p];
+                        if(i == newc) continue;
+                        auto &ldist = distances[i];
+                        if(ldist <= 0.) continue;
+                        if(ccdists[assignments[i]] >= boundmul * ldist) {
+                            ++nsaved;
+                            continue;
+                        }
+                        ++nevals;
+                        if(auto dist = oracle(newc, i); dist < ldist) assignments[i] = center_idx, ldist = dist;
+                    }
+                }
+                lstats.nevals += nevals;
+                lstats.nsaved += nsaved;
+                // Only scanned clusters lost points: compact them, recompute their radii, and form the new group
+                if(center_idx + 1 < k) {
+                    moved.resize(scanned.size());
+                    OMP_PRAGMA("omp parallel for schedule(dynamic) if(parallelize_oracle)")
+                    for(size_t n = 0; n < scanned.size(); ++n) {
+                        auto &mem = members[scanned[n]];
+                        auto &mv = moved[n];
+                        mv.clear();
+                        FT r = 0.;
+                        size_t keep = 0;
+                        for(const auto i: mem) {
+                            if(assignments[i] == center_idx) mv.push_back(i);
+                            else mem[keep++] = i, r = std::max(r, distances[i]);
+                        }
+                        mem.resize(keep);
+                        radii[scanned[n]] = r;
+                    }
+                    auto &newmem = members[center_idx];
+                    FT r = 0.;
+                    for(const auto &mv: moved) {
+                        newmem.insert(newmem.end(), mv.begin(), mv.end());
+                        for(const auto i: mv) if(i != newc) r = std::max(r, distances[i]);
+                    }
+                    radii[center_idx] = r;
+                }
+            } else if(parallelize_oracle) {
                 OMP_PFOR_DYN
                 for(size_t i = 0; i < np; ++i) {COMPUTE_X(i);}
+                lstats.nevals += np - 1;
             } else {
                 for(size_t i = 0; i < np; ++i) {COMPUTE_X(i);}
+                lstats.nevals += np - 1;
             }
-#undef COMPUTE_LOOP
+#undef COMPUTE_X
         }
         distances[newc] = 0.;
         ++center_idx;
     }
+    if(stats) {
+        stats->nevals += lstats.nevals;
+        stats->nsaved += lstats.nsaved;
+        stats->nclusters_skipped += lstats.nclusters_skipped;
+    }
 
     if(emit_log) std::fprintf(stderr, "Completed kmeans++ with centers of size %zu\n", centers.size());
+    if(emit_log && bounds != NO_BOUNDS)
+        std::fprintf(stderr, "Bounds saved %zu/%zu distance computations, skipping %zu clusters\n", lstats.nsaved, lstats.nsaved + lstats.nevals, lstats.nclusters_skipped);
     if(lspprounds > 0) {
         if(emit_log) std::fprintf(stderr, "Performing %u rounds of ls++\n", int(lspprounds));
         localsearchpp_rounds(oracle, rng, distances, centers, assignments, np, lspprounds, weights, parallelize_oracle);
@@ -215,10 +346,11 @@ kmeanspp(const Oracle &oracle, RNG &rng, size_t np, size_t k, const WFT *weights
 template<typename Iter, typename FT=double,
          typename IT=std::uint32_t, typename RNG, typename Norm=sqrL2Norm, typename WFT=FT>
 auto
-kmeanspp(Iter first, Iter end, RNG &rng, size_t k, const Norm &norm=Norm(), WFT *weights=nullptr, size_t lspprounds=0, bool use_exponential_skips=false, bool parallelize_oracle=true, size_t n_local_trials=1) {
+kmeanspp(Iter first, Iter end, RNG &rng, size_t k, const Norm &norm=Norm(), WFT *weights=nullptr, size_t lspprounds=0, bool use_exponential_skips=false, bool parallelize_oracle=true, size_t n_local_trials=1,
+         SeedingBounds bounds=NO_BOUNDS, SeedingStats *stats=nullptr) {
     auto dm = make_index_dm(first, norm);
     static_assert(std::is_floating_point<FT>::value, "FT must be fp");
-    return kmeanspp<decltype(dm), FT>(dm, rng, end - first, k, weights, lspprounds, use_exponential_skips, parallelize_oracle, n_local_trials);
+    return kmeanspp<decltype(dm), FT>(dm, rng, end - first, k, weights, lspprounds, use_exponential_skips, parallelize_oracle, n_local_trials, bounds, stats);
 }
 
 
@@ -321,17 +453,143 @@ kmc2(Iter first, Iter end, RNG &rng, size_t k, size_t m = 2000, const Norm &norm
     return kmc2(dm, rng, np, k, m);
 }
 
+/*
+ * kmeans|| (Bahmani et al., Scalable K-Means++, https://arxiv.org/abs/1203.6402)
+ *
+ * Starting from one uniformly sampled point, each of nrounds rounds samples every point independently
+ * with probability min(1, l * w_i * d_i / sum_j w_j d_j), where l = oversampling_factor * k,
+ * and then updates each point's distance to the candidate set.
+ * Both steps are parallel over points, so seeding takes O(log n) synchronized rounds instead of k.
+ * Candidates are then weighted by the total weight of the points nearest them and reclustered
+ * to k centers with weighted kmeans++, after which every point is assigned to its nearest center.
+ *
+ * Sampling uses a counter-based generator per point, so results do not depend on the number of threads.
+ *
+ * oracle: computes distance D(x, y) for i in [0, np)
+ * weights: null if equal, used if provided
+ * nrounds: number of oversampling rounds. If 0, uses ceil(log(np)).
+ * Returns (centers, assignments, costs), as kmeanspp does.
+ */
+template<typename Oracle, typename FT=double,
+         typename IT=std::uint32_t, typename RNG, typename WFT=FT>
+auto
+kmeans_parallel(const Oracle &oracle, RNG &rng, size_t np, size_t k, const WFT *weights=nullptr,
+                double oversampling_factor=2., size_t nrounds=0, bool parallelize_oracle=true)
+{
+    const bool emit_log = false;
+    if(np < k) {
+        std::fprintf(stderr, "Warning: np (%zu) < k (%zu). Returning exactly %zu\n", np, k, np);
+        k = np;
+    }
+    if(nrounds == 0) nrounds = std::max(size_t(std::ceil(std::log(double(np)))), size_t(1));
+    const double ell = oversampling_factor * k;
+    const double max64inv = 1. / std::numeric_limits<uint64_t>::max();
+    auto getw = [weights](size_t i) -> double {return weights ? double(weights[i]): 1.;};
+    std::vector<IT> candidates{IT(rng() % np)}, cassign(np, IT(0)), newcands;
+    blz::DV<FT> distances(np);
+    {
+        const IT fc = candidates[0];
+        OMP_PRAGMA("omp parallel for schedule(dynamic) if(parallelize_oracle)")
+        for(size_t i = 0; i < np; ++i)
+            distances[i] = i == fc ? FT(0): FT(oracle(fc, i));
+    }
+    std::unique_ptr<uint8_t[]> selected(new uint8_t[np]);
+    for(size_t r = 0; r < nrounds; ++r) {
+        double cost = 0.;
+        OMP_PRAGMA("omp parallel for reduction(+:cost)")
+        for(size_t i = 0; i < np; ++i)
+            cost += getw(i) * distances[i];
+        if(cost <= 0.) break;
+        const double mul = ell / cost;
+        const uint64_t baseseed = rng();
+        // 1. Oversample
+        OMP_PFOR
+        for(size_t i = 0; i < np; ++i) {
+            uint64_t local_seed = baseseed + i;
+            wy::wyhash64_stateless(&local_seed);
+            selected[i] = distances[i] > 0. && local_seed * max64inv < mul * getw(i) * distances[i];
+        }
+        newcands.clear();
+        for(size_t i = 0; i < np; ++i)
+            if(selected[i]) newcands.push_back(i);
+        if(newcands.empty()) continue;
+        const size_t cbase = candidates.size();
+        candidates.insert(candidates.end(), newcands.begin(), newcands.end());
+        // 2. Update distances to the candidate set
+        OMP_PRAGMA("omp parallel for schedule(dynamic) if(parallelize_oracle)")
+        for(size_t i = 0; i < np; ++i) {
+            auto &ld = distances[i];
+            if(ld <= 0.) continue;
+            for(size_t j = 0; j < newcands.size(); ++j) {
+                if(newcands[j] == i) {
+                    ld = 0., cassign[i] = cbase + j;
+                    break;
+                }
+                if(const FT d = oracle(newcands[j], i); d < ld)
+                    ld = d, cassign[i] = cbase + j;
+            }
+        }
+        if(emit_log) std::fprintf(stderr, "Round %zu/%zu: cost %g, %zu new candidates, %zu total\n", r + 1, nrounds, cost, newcands.size(), candidates.size());
+    }
+    const size_t nc = candidates.size();
+    if(nc <= k) {
+        // Too few distinct points were sampled (e.g., most points are duplicates); use D2 sampling directly.
+        if(emit_log) std::fprintf(stderr, "Only %zu candidates for %zu centers; falling back to kmeans++\n", nc, k);
+        return kmeanspp<Oracle, FT, IT>(oracle, rng, np, k, weights, 0, false, parallelize_oracle);
+    }
+    // 3. Weight candidates by the points nearest them, and recluster them with weighted kmeans++
+    std::vector<double> cweights(nc);
+    for(size_t i = 0; i < np; ++i)
+        cweights[cassign[i]] += getw(i);
+    auto coracle = [&](size_t x, size_t y) {return oracle(candidates[x], candidates[y]);};
+    auto [csel, casn, ccosts] = kmeanspp<decltype(coracle), FT, IT>(coracle, rng, nc, k, cweights.data(), 0, false, parallelize_oracle);
+    std::vector<IT> centers(csel.size());
+    for(size_t j = 0; j < centers.size(); ++j)
+        centers[j] = candidates[csel[j]];
+    // 4. Assign every point to its nearest center
+    std::vector<IT> assignments(np);
+    std::vector<FT> costs(np);
+    OMP_PRAGMA("omp parallel for schedule(dynamic) if(parallelize_oracle)")
+    for(size_t i = 0; i < np; ++i) {
+        FT best = std::numeric_limits<FT>::max();
+        IT bestid = 0;
+        for(size_t j = 0; j < centers.size(); ++j) {
+            if(centers[j] == i) {
+                best = 0., bestid = j;
+                break;
+            }
+            if(const FT d = oracle(centers[j], i); d < best)
+                best = d, bestid = j;
+        }
+        assignments[i] = bestid;
+        costs[i] = best;
+    }
+    if(emit_log) std::fprintf(stderr, "Completed kmeans|| with %zu candidates and cost %g\n", nc, std::accumulate(costs.begin(), costs.end(), 0.));
+    return std::make_tuple(std::move(centers), std::move(assignments), std::move(costs));
+}
+
+template<typename Iter, typename FT=double,
+         typename IT=std::uint32_t, typename RNG, typename Norm=sqrL2Norm, typename WFT=FT>
+auto
+kmeans_parallel(Iter first, Iter end, RNG &rng, size_t k, const Norm &norm=Norm(), const WFT *weights=nullptr,
+                double oversampling_factor=2., size_t nrounds=0, bool parallelize_oracle=true) {
+    auto dm = make_index_dm(first, norm);
+    static_assert(std::is_floating_point<FT>::value, "FT must be fp");
+    return kmeans_parallel<decltype(dm), FT, IT>(dm, rng, end - first, k, weights, oversampling_factor, nrounds, parallelize_oracle);
+}
+
 
 template<typename MT, bool SO,
          typename IT=std::uint32_t, typename RNG, typename Norm=sqrL2Norm, typename WFT=typename MT::ElementType>
 auto
-kmeanspp(const blaze::Matrix<MT, SO> &mat, RNG &rng, size_t k, const Norm &norm=Norm(), bool rowwise=true, const WFT *weights=nullptr, size_t lspprounds=0, bool use_exponential_skips=false, bool parallelize_oracle=blaze::IsDenseMatrix_v<MT>, size_t n_local_samples=1) {
+kmeanspp(const blaze::Matrix<MT, SO> &mat, RNG &rng, size_t k, const Norm &norm=Norm(), bool rowwise=true, const WFT *weights=nullptr, size_t lspprounds=0, bool use_exponential_skips=false, bool parallelize_oracle=blaze::IsDenseMatrix_v<MT>, size_t n_local_samples=1,
+         SeedingBounds bounds=NO_BOUNDS, SeedingStats *stats=nullptr) {
     if(rowwise) {
         auto rowit = blz::rowiterator(*mat);
-        return kmeanspp(rowit.begin(), rowit.end(), rng, k, norm, weights, lspprounds, use_exponential_skips, parallelize_oracle, n_local_samples);
+        return kmeanspp(rowit.begin(), rowit.end(), rng, k, norm, weights, lspprounds, use_exponential_skips, parallelize_oracle, n_local_samples, bounds, stats);
     } else { // columnwise
         auto columnit = blz::columniterator(*mat);
-        return kmeanspp(columnit.begin(), columnit.end(), rng, k, norm, weights, lspprounds, use_exponential_skips, parallelize_oracle, n_local_samples);
+        return kmeanspp(columnit.begin(), columnit.end(), rng, k, norm, weights, lspprounds, use_exponential_skips, parallelize_oracle, n_local_samples, bounds, stats);
     }
 }
 
@@ -372,7 +630,8 @@ double lloyd_iteration(std::vector<IT> &assignments, std::vector<CFT> &counts,
     auto getw = [weights](size_t ind) {
         return weights ? weights[ind]: WFT(1.);
     };
-    OMP_ONLY(std::unique_ptr<std::mutex[]> mutexes = std::make_unique<std::mutex[]>(centers.rows());)
+    OMP_ONLY(std::unique_ptr<std::mutex[]> mutexes;)
+    OMP_ONLY(if(use_moving_average) mutexes = std::make_unique<std::mutex[]>(centers.rows());)
     centers = static_cast<typename CMatrixType::ElementType>(0.);
     std::fill(counts.data(), counts.data() + counts.size(), WFT(0.));
     assert(blz::sum(centers) == 0.);
@@ -386,23 +645,7 @@ double lloyd_iteration(std::vector<IT> &assignments, std::vector<CFT> &counts,
      * with naive summation.
      */
     if(!use_moving_average) {
-        OMP_PRAGMA("omp parallel for schedule(dynamic)")
-        for(size_t i = 0; i < nr; ++i) {
-            assert(assignments[i] < centers.rows());
-            auto asn = assignments[i];
-            auto dr = row(data, i BLAZE_CHECK_DEBUG);
-            auto cr = row(centers, asn BLAZE_CHECK_DEBUG);
-            const auto w = getw(i);
-            {
-                OMP_ONLY(std::lock_guard<std::mutex> lg(mutexes[asn]);)
-                if(w == 1.) {
-                    blz::serial(cr.operator+=(dr));
-                }
-                else blz::serial(cr.operator+=(dr * w));
-            }
-            OMP_ATOMIC
-            counts[asn] += w;
-        }
+        clustering::accumulate_centroids<typename CMatrixType::ElementType>(data, assignments, centers, counts, getw);
         OMP_PFOR
         for(size_t i = 0; i < centers.rows(); ++i)
             row(centers, i BLAZE_CHECK_DEBUG) *= (1. / counts[i]);
@@ -455,22 +698,31 @@ double lloyd_iteration(std::vector<IT> &assignments, std::vector<CFT> &counts,
         goto get_assignment_counts;
     // 2. Assign centers
     double total_loss = 0.;
-    OMP_PRAGMA("omp parallel for reduction(+:total_loss)")
-    for(size_t i = 0; i < nr; ++i) {
-        auto dr = row(data, i BLAZE_CHECK_DEBUG);
-        auto lhr = row(centers, 0 BLAZE_CHECK_DEBUG);
-        auto dist = blz::serial(func(dr, lhr));
-        unsigned label = 0;
-        double newdist;
-        for(unsigned j = 1;j < centers.rows(); ++j) {
-            if((newdist = blz::serial(func(dr, row(centers, j BLAZE_CHECK_DEBUG)))) < dist) {
-                //std::fprintf(stderr, "newdist: %g. olddist: %g. Replacing label %u with %u\n", newdist, dist, label, j);
-                dist = newdist;
-                label = j;
+    if constexpr(std::is_same_v<Functor, blz::sqrL2Norm> || std::is_same_v<Functor, blz::L2Norm>) {
+        // Tiled matrix products instead of per-pair distances
+        blz::DV<double> dists(nr);
+        dist::assign_points_batched(data, std::is_same_v<Functor, blz::sqrL2Norm> ? dist::SQRL2: dist::L2, centers, assignments, dists);
+        OMP_PRAGMA("omp parallel for reduction(+:total_loss)")
+        for(size_t i = 0; i < nr; ++i)
+            total_loss += getw(i) * dists[i];
+    } else {
+        OMP_PRAGMA("omp parallel for reduction(+:total_loss)")
+        for(size_t i = 0; i < nr; ++i) {
+            auto dr = row(data, i BLAZE_CHECK_DEBUG);
+            auto lhr = row(centers, 0 BLAZE_CHECK_DEBUG);
+            auto dist = blz::serial(func(dr, lhr));
+            unsigned label = 0;
+            double newdist;
+            for(unsigned j = 1;j < centers.rows(); ++j) {
+                if((newdist = blz::serial(func(dr, row(centers, j BLAZE_CHECK_DEBUG)))) < dist) {
+                    //std::fprintf(stderr, "newdist: %g. olddist: %g. Replacing label %u with %u\n", newdist, dist, label, j);
+                    dist = newdist;
+                    label = j;
+                }
             }
+            assignments[i] = label;
+            total_loss += getw(i) * dist;
         }
-        assignments[i] = label;
-        total_loss += getw(i) * dist;
     }
     if(std::isnan(total_loss)) total_loss = std::numeric_limits<decltype(total_loss)>::infinity();
     return total_loss;
@@ -7,6 +7,7 @@
 #include "discreture/include/discreture.hpp"
 #include "libsimdsampling/argminmax.h"
 #include <atomic>
+#include <tuple>
 
 /*
  * In this file, we use the local search heuristic for k-median.
@@ -20,6 +21,41 @@ namespace minicore {
 namespace graph {
 
 
+namespace detail {
+/*
+ * Scores candidates [0, n) of a batch concurrently, each with a single-threaded kernel score(i, scratch),
+ * and returns the lowest index whose gain exceeds thresh (n if none), its gain, and the number of candidates scored.
+ * The lowest improving index found so far is shared atomically, so candidates after it are skipped.
+ * Because the lowest improving index is accepted, the result matches a serial first-improvement scan
+ * for any number of threads or batch size.
+ * score returns -inf for candidates which should not be considered.
+ */
+template<typename Score>
+std::tuple<size_t, double, size_t> first_improvement(size_t n, double thresh, const Score &score) {
+    std::atomic<size_t> first(n);
+    std::vector<double> gains(n);
+    size_t nscored = 0;
+    OMP_PRAGMA("omp parallel reduction(+:nscored)")
+    {
+        std::vector<double> scratch;
+        OMP_PRAGMA("omp for schedule(dynamic, 1)")
+        for(size_t i = 0; i < n; ++i) {
+            if(i > first.load(std::memory_order_relaxed)) continue;
+            const double g = score(i, scratch);
+            gains[i] = g;
+            if(g == -std::numeric_limits<double>::infinity()) continue;
+            ++nscored;
+            if(g > thresh) {
+                size_t cur = first.load(std::memory_order_relaxed);
+                while(i < cur && !first.compare_exchange_weak(cur, i, std::memory_order_relaxed));
+            }
+        }
+    }
+    const size_t pos = first.load();
+    return {pos, pos < n ? gains[pos]: 0., nscored};
+}
+} // namespace detail
+
 template<typename MatType, typename IType=std::uint32_t, size_t N=16>
 struct ExhaustiveSearcher {
     using value_type = typename MatType::ElementType;
@@ -75,6 +111,20 @@ struct LocalKMedSearcher {
     uint32_t max_swap_n_:16;
     // if(max_swap_n_ > 1), after exhaustive single-swap optimization, enables multiswap search.
     // TODO: enable searches for multiswaps.
+    // Opt-in: use the fast-swap engine for single swaps (requires k > 1). This ignores lazy_eval_.
+    // Otherwise (the default), use lazy_eval_ and evaluate_swap.
+    bool fast_swap_;
+    // Candidate swaps scored concurrently per batch (0: 8 per thread). See detail::first_improvement.
+    size_t swap_batch_ = 0;
+    // Candidate swaps scored and swaps applied by the last run()
+    size_t nscored_ = 0, nswaps_ = 0;
+
+    // Fast-swap state; see run_fastswap. assignments_ and current_costs_ hold each client's nearest open facility and cost.
+    std::vector<IType> open_;                 // Open facilities
+    std::vector<IType> slot_;                 // slot_[f]: index of f in open_, or IType(-1) if f is closed
+    blaze::DynamicVector<IType> second_;      // Second-nearest open facility per client
+    blaze::DynamicVector<typename MatType::ElementType, blaze::rowVector> second_costs_;
+    std::vector<double> loss_;                // loss_[s]: cost increase from closing open_[s] alone
 
     // Constructors
 
@@ -94,7 +144,7 @@ struct LocalKMedSearcher {
         current_cost_(std::numeric_limits<value_type>::max()),
         eps_(eps),
         k_(k), nr_(mat.rows()), nc_(mat.columns()),
-        ordering_(mat.rows()), shuffle_(true), lazy_eval_(2), max_swap_n_(1)
+        ordering_(mat.rows()), shuffle_(true), lazy_eval_(2), max_swap_n_(1), fast_swap_(false)
     {
         std::iota(ordering_.begin(), ordering_.end(), 0);
         static_assert(std::is_integral_v<std::decay_t<decltype(wc->operator[](0))>>, "index container must contain integral values");
@@ -332,6 +382,151 @@ struct LocalKMedSearcher {
         return diff;
     }
 
+    /*
+     * Fast swap (Resende and Werneck, "A fast swap-based local search procedure for location problems", 2007)
+     *
+     * With d1(u)/d2(u) the costs of client u's nearest/second-nearest open facilities, opening f and closing r changes the cost by
+     *     profit(f, r) = gain(f) - loss(r) + extra(f, r), where
+     *     gain(f)     = sum_u max(0, d1(u) - d(f, u))
+     *     loss(r)     = sum_{u: nearest(u) = r} d2(u) - d1(u)
+     *     extra(f, r) = sum_{u: nearest(u) = r, d(f, u) < d2(u)} d2(u) - max(d(f, u), d1(u))
+     * so one O(n) pass over f's row scores f against every open facility, accumulating extra per open facility.
+     * After a swap, only clients whose nearest or second-nearest facility closed are rescanned (O(k) each);
+     * the rest are updated in O(1) against the new facility.
+     */
+    void fs_update_client(size_t u) {
+        using FT = typename MatType::ElementType;
+        FT d1 = std::numeric_limits<FT>::max(), d2 = d1;
+        IType f1 = open_[0], f2 = open_[0];
+        for(const IType f: open_) {
+            const FT d = mat_(f, u);
+            if(d < d1) d2 = d1, f2 = f1, d1 = d, f1 = f;
+            else if(d < d2) d2 = d, f2 = f;
+        }
+        assignments_[u] = f1; current_costs_[u] = d1;
+        second_[u] = f2; second_costs_[u] = d2;
+    }
+    void fs_set_loss() {
+        loss_.assign(open_.size(), 0.);
+        for(size_t u = 0; u < nc_; ++u)
+            loss_[slot_[assignments_[u]]] += double(second_costs_[u]) - double(current_costs_[u]);
+    }
+    void fs_init() {
+        open_.assign(sol_.begin(), sol_.end());
+        std::sort(open_.begin(), open_.end());
+        slot_.assign(nr_, IType(-1));
+        for(size_t s = 0; s < open_.size(); ++s) slot_[open_[s]] = s;
+        assignments_.resize(nc_);
+        current_costs_.resize(nc_);
+        second_.resize(nc_);
+        second_costs_.resize(nc_);
+        OMP_PFOR
+        for(size_t u = 0; u < nc_; ++u)
+            fs_update_client(u);
+        fs_set_loss();
+        current_cost_ = blaze::sum(current_costs_);
+    }
+    // Returns the best profit from opening f and the slot in open_ of the facility to close. extra must hold k doubles.
+    std::pair<double, size_t> fs_score(IType f, double *extra) const {
+        std::fill(extra, extra + open_.size(), 0.);
+        double gain = 0.;
+        auto r = row(mat_, f, blaze::unchecked);
+        for(size_t u = 0; u < nc_; ++u) {
+            const double dfu = r[u], d1 = current_costs_[u], d2 = second_costs_[u];
+            if(dfu < d1) {
+                gain += d1 - dfu;
+                extra[slot_[assignments_[u]]] += d2 - d1;
+            } else if(dfu < d2) {
+                extra[slot_[assignments_[u]]] += d2 - dfu;
+            }
+        }
+        size_t bests = 0;
+        double best = extra[0] - loss_[0];
+        for(size_t s = 1; s < open_.size(); ++s)
+            if(const double v = extra[s] - loss_[s]; v > best) best = v, bests = s;
+        return {gain + best, bests};
+    }
+    // Opens f in place of open_[s]
+    void fs_apply(IType f, size_t s) {
+        using FT = typename MatType::ElementType;
+        const IType r = open_[s];
+        sol_.erase(r);
+        sol_.insert(f);
+        open_[s] = f;
+        slot_[r] = IType(-1);
+        slot_[f] = s;
+        OMP_PFOR
+        for(size_t u = 0; u < nc_; ++u) {
+            if(assignments_[u] == r || second_[u] == r) {
+                fs_update_client(u);
+                continue;
+            }
+            const FT dfu = mat_(f, u);
+            if(dfu < current_costs_[u]) {
+                second_[u] = assignments_[u]; second_costs_[u] = current_costs_[u];
+                assignments_[u] = f; current_costs_[u] = dfu;
+            } else if(dfu < second_costs_[u]) {
+                second_[u] = f; second_costs_[u] = dfu;
+            }
+        }
+        fs_set_loss();
+        current_cost_ = blaze::sum(current_costs_);
+    }
+    size_t swap_batch_size() const {
+        if(swap_batch_) return swap_batch_;
+        size_t nt = 1;
+        OMP_ONLY(nt = omp_get_max_threads();)
+        return nt * 8;
+    }
+    /*
+     * First-improvement local search over candidate facilities: each candidate is paired with its best facility to close,
+     * and the swap is applied if it improves the cost by more than diffthresh_.
+     * Candidates are scored in parallel batches in ordering_ order (see detail::first_improvement), so the swap sequence
+     * is the same as a serial scan's.
+     * Terminates once every candidate has been scored without improvement since the last swap.
+     */
+    void run_fastswap() {
+        fs_init();
+        if(shuffle_) {
+            wy::WyRand<uint64_t, 2> rng(nr_);
+            std::shuffle(ordering_.begin(), ordering_.end(), rng);
+        }
+        const size_t batch = swap_batch_size();
+        std::vector<size_t> slots(batch);
+        size_t total = 0, since_swap = 0, pi = 0, nscored = 0;
+        while(since_swap < nr_) {
+            const size_t len = std::min(batch, nr_ - since_swap);
+            const auto [pos, profit, nev] = detail::first_improvement(len, diffthresh_, [&](size_t i, std::vector<double> &extra) {
+                const IType f = ordering_[(pi + i) % nr_];
+                if(slot_[f] != IType(-1)) return -std::numeric_limits<double>::infinity();
+                extra.resize(open_.size());
+                const auto [p, s] = fs_score(f, extra.data());
+                slots[i] = s;
+                return p;
+            });
+            nscored += nev;
+            if(pos == len) {
+                pi = (pi + len) % nr_;
+                since_swap += len;
+                continue;
+            }
+            const IType f = ordering_[(pi + pos) % nr_];
+            const size_t s = slots[pos];
+#ifndef NDEBUG
+            std::fprintf(stderr, "Swapping %zu for %zu. Swap number %zu. Current cost: %g. Improvement: %g. Threshold: %g.\n", size_t(f), size_t(open_[s]), total + 1, current_cost_, profit, diffthresh_);
+#endif
+            fs_apply(f, s);
+            ++total;
+            pi = (pi + pos + 1) % nr_;
+            since_swap = 0;
+            std::fprintf(stderr, "Swap number %zu with cost %0.12g\n", total, current_cost_);
+        }
+        nscored_ += nscored;
+        nswaps_ += total;
+        std::fprintf(stderr, "Fast swap finished in %zu swaps (%zu candidates scored) by exhausting all potential improvements. Final cost: %f\n",
+                     total, nscored, current_cost_);
+    }
+
     // Getters
     auto k() const {
         return k_;
@@ -426,9 +621,18 @@ struct LocalKMedSearcher {
     }
     void run() {
         assign();
+        nscored_ = nswaps_ = 0;
         const double diffthresh = initial_cost_ / k_ * eps_;
         diffthresh_ = diffthresh;
         if(mat_.rows() <= k_) return;
+        if(fast_swap_ && k_ > 1) {
+            run_fastswap();
+            if(max_swap_n_ > 1) {
+                std::fprintf(stderr, "max_swap_n_ %u set. Searching multiswaps\n", max_swap_n_);
+                run_multi(max_swap_n_);
+            }
+            return;
+        }
         if(lazy_eval_) {
             run_lazy();
             if(lazy_eval_ > 1)
@@ -436,33 +640,45 @@ struct LocalKMedSearcher {
         }
         //const double diffthresh = 0.;
         std::fprintf(stderr, "diffthresh: %f\n", diffthresh);
-        size_t total = 0;
-        next:
-        for(const auto oldcenter: sol_) {
+        // (old, new) pairs are enumerated old-major over the sorted solution and scored in parallel batches;
+        // the first improving pair in that order is applied, and enumeration restarts.
+        size_t total = 0, nscored = 0;
+        const size_t batch = swap_batch_size();
+        std::vector<IType> csol;
+        for(bool improved = true; improved;) {
+            improved = false;
+            csol.assign(sol_.begin(), sol_.end());
+            std::sort(csol.begin(), csol.end());
             if(shuffle_) {
                 wy::WyRand<uint64_t, 2> rng(total);
                 std::shuffle(ordering_.begin(), ordering_.end(), rng);
             }
-            std::vector<IType> newindices(sol_.begin(), sol_.end());
-            for(size_t pi = 0; pi < nr_; ++pi) {
-                size_t potential_index = ordering_[pi];
-                if(sol_.find(potential_index) != sol_.end()) continue;
-                if(const auto val = evaluate_swap(potential_index, oldcenter, true);
-                   val > diffthresh) {
+            const size_t npairs = csol.size() * nr_;
+            for(size_t t = 0; t < npairs && !improved; t += batch) {
+                const size_t len = std::min(batch, npairs - t);
+                const auto [pos, val, nev] = detail::first_improvement(len, diffthresh, [&](size_t i, std::vector<double> &) {
+                    const IType oldcenter = csol[(t + i) / nr_], potential_index = ordering_[(t + i) % nr_];
+                    if(sol_.find(potential_index) != sol_.end()) return -std::numeric_limits<double>::infinity();
+                    return evaluate_swap(potential_index, oldcenter, true);
+                });
+                nscored += nev;
+                if(pos == len) continue;
+                const IType oldcenter = csol[(t + pos) / nr_], potential_index = ordering_[(t + pos) % nr_];
 #ifndef NDEBUG
-                     std::fprintf(stderr, "Swapping %zu for %u. Swap number %zu. Current cost: %g. Improvement: %g. Threshold: %g.\n", potential_index, oldcenter, total + 1, current_cost_, val, diffthresh);
+                std::fprintf(stderr, "Swapping %zu for %zu. Swap number %zu. Current cost: %g. Improvement: %g. Threshold: %g.\n", size_t(potential_index), size_t(oldcenter), total + 1, current_cost_, val, diffthresh);
 #endif
-                     sol_.erase(oldcenter);
-                     sol_.insert(potential_index);
-                     ++total;
-                     current_cost_ -= val;
-                     std::fprintf(stderr, "Swap number %zu with cost %0.12g\n", total, current_cost_);
-                     goto next;
-                 }
-             }
+                sol_.erase(oldcenter);
+                sol_.insert(potential_index);
+                ++total;
+                current_cost_ -= val;
+                improved = true;
+                std::fprintf(stderr, "Swap number %zu with cost %0.12g\n", total, current_cost_);
+            }
         }
-        std::fprintf(stderr, "Finished in %zu swaps by exhausting all potential improvements. Final cost: %f\n",
-                     total, current_cost_);
+        nscored_ += nscored;
+        nswaps_ += total;
+        std::fprintf(stderr, "Finished in %zu swaps (%zu candidates scored) by exhausting all potential improvements. Final cost: %f\n",
+                     total, nscored, current_cost_);
         if(max_swap_n_ > 1) {
             std::fprintf(stderr, "max_swap_n_ %u set. Searching multiswaps\n", max_swap_n_);
             run_multi(max_swap_n_);
@@ -0,0 +1,366 @@
+#pragma once
+#ifndef FGC_ORACLE_LOCAL_SEARCH_H__
+#define FGC_ORACLE_LOCAL_SEARCH_H__
+#include "minicore/optim/lsearch.h"
+#include "minicore/util/timer.h"
+
+/*
+ * Solvers which would otherwise materialize an n x n distance matrix use oracle-based local search above this many points.
+ */
+#ifndef MINOCORE_MAX_DISTMAT_POINTS
+#define MINOCORE_MAX_DISTMAT_POINTS 32768
+#endif
+
+namespace minicore {
+
+namespace graph {
+
+/*
+ * Local search for k-median against a distance oracle, without a materialized n x n matrix.
+ * oracle(f, u) is the cost of serving client u from facility f; every point is both a client and a potential facility.
+ * This may wrap a DissimilarityApplicator ([&app](size_t i, size_t j) {return app(i, j);})
+ * or shortest-path distances in a graph.
+ *
+ * State is the n x k matrix of client costs to each open facility and each client's nearest and second-nearest slot,
+ * which is enough to score a candidate against every open facility from the candidate's row alone,
+ * using the fast-swap profit of LocalKMedSearcher::fs_score.
+ * Candidate rows are evaluated on demand and kept in a bounded LRU cache.
+ *
+ * Each pass scores ncandidates closed facilities, sampled with probability proportional to cost^power
+ * under the current solution (D-sampling for power = 1, D^2 for power = 2), in parallel batches with
+ * first-improvement acceptance (see detail::first_improvement).
+ * If ncandidates covers every closed point, the search stops at a single-swap local optimum;
+ * otherwise, it stops after max_fruitless consecutive passes without a swap.
+ *
+ * Memory is O(n (k + cache_rows)); a pass evaluates at most ncandidates * n distances.
+ */
+
+struct OracleLSearchOpts {
+    size_t ncandidates = 0;     // Candidate facilities per pass (0: max(64, 4k))
+    size_t cache_rows = 0;      // Cached candidate rows (0: up to 2^26 entries); at least one batch
+    double power = 1.;          // Candidates are sampled proportional to cost^power
+    double eps = 1e-4;          // Swaps must improve the cost by more than eps * cost / k
+    unsigned max_fruitless = 3; // Stop after this many passes without a swap
+    size_t max_swaps = std::numeric_limits<size_t>::max();
+    size_t batch = 0;           // Candidates scored concurrently (0: 8 per thread)
+    uint64_t seed = 0;
+    bool verbose = false;
+};
+
+template<typename Oracle, typename FT=float, typename IType=std::uint32_t>
+struct OracleKMedSearcher {
+    static_assert(std::is_integral_v<IType>, "IType must be integral");
+    static_assert(std::is_floating_point_v<FT>, "FT must be floating-point");
+
+    const Oracle &oracle_;
+    const size_t np_;
+    const unsigned k_;
+    OracleLSearchOpts opts_;
+
+    std::vector<IType> open_;             // Open facilities; slots index into this
+    std::vector<IType> slot_;             // slot_[f]: index of f in open_, or IType(-1) if f is closed
+    blaze::DynamicMatrix<FT> dist_;       // dist_(u, s): cost of serving u from open_[s]
+    std::vector<IType> s1_, s2_;          // Nearest and second-nearest slots per client
+    blaze::DynamicVector<FT> d1_, d2_;    // Their costs
+    std::vector<double> loss_;            // loss_[s]: cost increase from closing open_[s] alone
+    double current_cost_ = 0.;
+    size_t nswaps_ = 0, nscored_ = 0, ndists_ = 0;
+
+    // Candidate row cache
+    blaze::DynamicMatrix<FT> cache_;      // One row of n costs per cached candidate
+    std::vector<IType> cache_ids_;        // Candidate held in each cache row, or IType(-1)
+    std::vector<uint64_t> cache_used_;    // Last batch which used each row, for LRU eviction
+    shared::flat_hash_map<IType, size_t> cache_index_;
+    uint64_t clock_ = 0;
+    size_t nhits_ = 0, nmisses_ = 0;
+
+    wy::WyRand<uint64_t, 2> rng_;
+
+    OracleKMedSearcher(const Oracle &oracle, size_t np, unsigned k, const OracleLSearchOpts &opts=OracleLSearchOpts()):
+        oracle_(oracle), np_(np), k_(k), opts_(opts), rng_(opts.seed)
+    {
+        MINOCORE_REQUIRE(k > 0, "k must be positive");
+        MINOCORE_REQUIRE(np > k, "Need more points than facilities");
+        MINOCORE_REQUIRE(np < size_t(std::numeric_limits<IType>::max()), "IType too small");
+        if(!opts_.ncandidates) opts_.ncandidates = std::max(size_t(64), size_t(4) * k);
+        opts_.ncandidates = std::min(opts_.ncandidates, np - k);
+        if(!opts_.batch) {
+            size_t nt = 1;
+            OMP_ONLY(nt = omp_get_max_threads();)
+            opts_.batch = nt * 8;
+        }
+        if(!opts_.cache_rows)
+            opts_.cache_rows = std::min(opts_.ncandidates, std::max(size_t(1), (size_t(1) << 26) / np));
+        opts_.cache_rows = std::max(opts_.cache_rows, opts_.batch);
+        cache_.resize(opts_.cache_rows, np);
+        cache_ids_.assign(opts_.cache_rows, IType(-1));
+        cache_used_.assign(opts_.cache_rows, 0);
+        cache_index_.reserve(opts_.cache_rows);
+        slot_.assign(np, IType(-1));
+        dist_.resize(np, k);
+        s1_.resize(np); s2_.resize(np);
+        d1_.resize(np); d2_.resize(np);
+    }
+
+    // Fills column s of dist_ with oracle(f, u) for all u
+    void set_column(size_t s, IType f) {
+        OMP_PFOR
+        for(size_t u = 0; u < np_; ++u)
+            dist_(u, s) = u == f ? FT(0): FT(oracle_(f, u));
+        ndists_ += np_;
+    }
+    void update_client(size_t u) {
+        auto r = row(dist_, u, blaze::unchecked);
+        FT c1 = std::numeric_limits<FT>::max(), c2 = c1;
+        IType b1 = 0, b2 = 0;
+        for(size_t s = 0; s < open_.size(); ++s) {
+            const FT d = r[s];
+            if(d < c1) c2 = c1, b2 = b1, c1 = d, b1 = s;
+            else if(d < c2) c2 = d, b2 = s;
+        }
+        s1_[u] = b1; d1_[u] = c1;
+        s2_[u] = b2; d2_[u] = c2;
+    }
+    void set_loss() {
+        loss_.assign(k_, 0.);
+        if(k_ > 1)
+            for(size_t u = 0; u < np_; ++u)
+                loss_[s1_[u]] += double(d2_[u]) - double(d1_[u]);
+        current_cost_ = blaze::sum(d1_);
+    }
+
+    /*
+     * Opens [start, end), which must hold k distinct facilities, or D-samples k facilities if start == end:
+     * the first uniformly at random, and each subsequent facility proportional to cost^power.
+     */
+    template<typename It>
+    void init(It start, It end) {
+        open_.clear();
+        std::fill(slot_.begin(), slot_.end(), IType(-1));
+        auto open = [&](IType f) {
+            slot_[f] = open_.size();
+            open_.push_back(f);
+            set_column(open_.size() - 1, f);
+        };
+        if(start != end) {
+            MINOCORE_REQUIRE(size_t(std::distance(start, end)) == k_, "Wrong number of initial facilities");
+            for(; start != end; ++start) {
+                MINOCORE_REQUIRE(slot_[*start] == IType(-1), "Duplicate initial facility");
+                open(*start);
+            }
+        } else {
+            open(rng_() % np_);
+            std::vector<double> cdf(np_);
+            OMP_PFOR
+            for(size_t u = 0; u < np_; ++u) d1_[u] = dist_(u, 0);
+            while(open_.size() < k_) {
+                double sum = 0.;
+                for(size_t u = 0; u < np_; ++u)
+                    cdf[u] = sum += slot_[u] == IType(-1) ? std::pow(double(d1_[u]), opts_.power): 0.;
+                IType f = 0;
+                if(sum > 0.) {
+                    f = std::upper_bound(cdf.begin(), cdf.end(), sum * std::uniform_real_distribution<double>()(rng_)) - cdf.begin();
+                    f = std::min(f, IType(np_ - 1));
+                }
+                if(sum <= 0. || slot_[f] != IType(-1))
+                    do f = rng_() % np_; while(slot_[f] != IType(-1));
+                open(f);
+                const size_t s = open_.size() - 1;
+                OMP_PFOR
+                for(size_t u = 0; u < np_; ++u) d1_[u] = std::min(d1_[u], dist_(u, s));
+            }
+        }
+        OMP_PFOR
+        for(size_t u = 0; u < np_; ++u)
+            update_client(u);
+        set_loss();
+    }
+    void init() {
+        const IType *p = nullptr;
+        init(p, p);
+    }
+
+    // Returns pointers to the rows of ids[0, n), evaluating rows missing from the cache. n must not exceed cache_rows.
+    std::vector<const FT *> fetch_rows(const IType *ids, size_t n) {
+        assert(n <= cache_.rows());
+        const uint64_t stamp = ++clock_;
+        std::vector<const FT *> ret(n);
+        std::vector<size_t> missing;
+        for(size_t i = 0; i < n; ++i) {
+            if(auto it = cache_index_.find(ids[i]); it != cache_index_.end()) {
+                cache_used_[it->second] = stamp;
+                ret[i] = cache_.data() + it->second * cache_.spacing();
+                ++nhits_;
+                continue;
+            }
+            // Evict the least recently used row not needed by this batch
+            const size_t victim = std::min_element(cache_used_.begin(), cache_used_.end()) - cache_used_.begin();
+            assert(cache_used_[victim] < stamp);
+            if(cache_ids_[victim] != IType(-1)) cache_index_.erase(cache_ids_[victim]);
+            cache_ids_[victim] = ids[i];
+            cache_used_[victim] = stamp;
+            cache_index_[ids[i]] = victim;
+            ret[i] = cache_.data() + victim * cache_.spacing();
+            missing.push_back(victim);
+            ++nmisses_;
+        }
+        for(const size_t cr: missing) {
+            const IType f = cache_ids_[cr];
+            auto r = row(cache_, cr, blaze::unchecked);
+            OMP_PFOR
+            for(size_t u = 0; u < np_; ++u)
+                r[u] = u == f ? FT(0): FT(oracle_(f, u));
+        }
+        ndists_ += missing.size() * np_;
+        return ret;
+    }
+
+    // Best profit from opening the facility with costs r, and the slot to close. Serial; extra must hold k doubles.
+    std::pair<double, size_t> score(const FT *r, double *extra) const {
+        if(k_ == 1) {
+            double gain = 0.;
+            for(size_t u = 0; u < np_; ++u) gain += double(d1_[u]) - double(r[u]);
+            return {gain, 0};
+        }
+        std::fill(extra, extra + k_, 0.);
+        double gain = 0.;
+        for(size_t u = 0; u < np_; ++u) {
+            const double dfu = r[u], d1 = d1_[u], d2 = d2_[u];
+            if(dfu < d1) {
+                gain += d1 - dfu;
+                extra[s1_[u]] += d2 - d1;
+            } else if(dfu < d2) {
+                extra[s1_[u]] += d2 - dfu;
+            }
+        }
+        size_t bests = 0;
+        double best = extra[0] - loss_[0];
+        for(size_t s = 1; s < k_; ++s)
+            if(const double v = extra[s] - loss_[s]; v > best) best = v, bests = s;
+        return {gain + best, bests};
+    }
+
+    // Opens f, whose costs are r, in place of open_[s]
+    void apply(IType f, size_t s, const FT *r) {
+        slot_[open_[s]] = IType(-1);
+        slot_[f] = s;
+        open_[s] = f;
+        OMP_PFOR
+        for(size_t u = 0; u < np_; ++u) {
+            const FT dfu = r[u];
+            dist_(u, s) = dfu;
+            if(s1_[u] == s || s2_[u] == s) {
+                update_client(u);
+            } else if(dfu < d1_[u]) {
+                s2_[u] = s1_[u]; d2_[u] = d1_[u];
+                s1_[u] = s; d1_[u] = dfu;
+            } else if(dfu < d2_[u]) {
+                s2_[u] = s; d2_[u] = dfu;
+            }
+        }
+        set_loss();
+    }
+
+    // Closed facilities to score in the next pass: all of them, or ncandidates sampled proportional to cost^power
+    std::vector<IType> sample_candidates() {
+        std::vector<IType> ret;
+        if(opts_.ncandidates >= np_ - k_) {
+            for(size_t f = 0; f < np_; ++f)
+                if(slot_[f] == IType(-1)) ret.push_back(f);
+            std::shuffle(ret.begin(), ret.end(), rng_);
+            return ret;
+        }
+        std::vector<double> cdf(np_);
+        double sum = 0.;
+        for(size_t u = 0; u < np_; ++u)
+            cdf[u] = sum += slot_[u] == IType(-1) ? std::pow(double(d1_[u]), opts_.power): 0.;
+        shared::flat_hash_set<IType> seen;
+        std::uniform_real_distribution<double> urd;
+        for(size_t tries = 0; ret.size() < opts_.ncandidates && tries < 4 * opts_.ncandidates; ++tries) {
+            IType f = sum > 0. ? IType(std::min(size_t(std::upper_bound(cdf.begin(), cdf.end(), sum * urd(rng_)) - cdf.begin()), np_ - 1))
+                               : IType(rng_() % np_);
+            if(slot_[f] == IType(-1) && seen.insert(f).second) ret.push_back(f);
+        }
+        return ret;
+    }
+
+    // Scores candidates in batches of opts_.batch and applies first improvements. Returns the number of swaps.
+    size_t pass(const std::vector<IType> &cands) {
+        size_t nswaps = 0;
+        std::vector<size_t> slots(opts_.batch);
+        for(size_t t = 0; t < cands.size() && nswaps_ + nswaps < opts_.max_swaps;) {
+            const size_t len = std::min(opts_.batch, cands.size() - t);
+            const auto crows = fetch_rows(&cands[t], len);
+            const double thresh = opts_.eps * current_cost_ / k_;
+            const auto [pos, profit, nev] = detail::first_improvement(len, thresh, [&](size_t i, std::vector<double> &extra) {
+                if(slot_[cands[t + i]] != IType(-1)) return -std::numeric_limits<double>::infinity();
+                extra.resize(k_);
+                const auto [p, s] = score(crows[i], extra.data());
+                slots[i] = s;
+                return p;
+            });
+            nscored_ += nev;
+            if(pos == len) {
+                t += len;
+                continue;
+            }
+            if(opts_.verbose)
+                std::fprintf(stderr, "[%s] Swapping %zu for %zu. Cost: %0.12g. Improvement: %g. Threshold: %g.\n", __func__,
+                             size_t(cands[t + pos]), size_t(open_[slots[pos]]), current_cost_, profit, thresh);
+            apply(cands[t + pos], slots[pos], crows[pos]);
+            ++nswaps;
+            t += pos + 1;
+        }
+        return nswaps;
+    }
+
+    void run() {
+        if(open_.empty()) init();
+        const auto start = util::hrc::now();
+        const bool exhaustive = opts_.ncandidates >= np_ - k_;
+        for(unsigned fruitless = 0, passnum = 0; fruitless < (exhaustive ? 1u: opts_.max_fruitless) && nswaps_ < opts_.max_swaps; ++passnum) {
+            const size_t nswaps = pass(sample_candidates());
+            nswaps_ += nswaps;
+            fruitless = nswaps ? 0: fruitless + 1;
+            if(opts_.verbose)
+                std::fprintf(stderr, "[%s] Pass %u: %zu swaps, cost %0.12g\n", __func__, passnum, nswaps, current_cost_);
+        }
+        std::fprintf(stderr, "Oracle local search finished in %zu swaps (%zu candidates scored, %zu distances, %zu/%zu row cache hits) in %gms. Final cost: %0.12g\n",
+                     nswaps_, nscored_, ndists_, nhits_, nhits_ + nmisses_, util::timediff2ms(start, util::hrc::now()), current_cost_);
+    }
+
+    // Open facilities; assignments() and costs() refer to positions in this vector
+    const std::vector<IType> &solution() const {return open_;}
+    const std::vector<IType> &assignments() const {return s1_;}
+    const blaze::DynamicVector<FT> &costs() const {return d1_;}
+    unsigned k() const {return k_;}
+};
+
+template<typename Oracle, typename FT=std::decay_t<decltype(std::declval<Oracle>()(0,0))>, typename IType=std::uint32_t>
+auto make_oracle_kmed_lsearcher(const Oracle &oracle, size_t np, unsigned k, const OracleLSearchOpts &opts=OracleLSearchOpts()) {
+    return OracleKMedSearcher<Oracle, FT, IType>(oracle, np, k, opts);
+}
+
+/*
+ * Runs oracle local search from a D-sampled start and returns (facilities, assignments, costs),
+ * where assignments index into facilities; this is the output of get_jv_centers.
+ */
+template<typename FT, typename Oracle>
+std::tuple<std::vector<uint32_t>, std::vector<uint32_t>, blaze::DynamicVector<FT, blaze::rowVector>>
+oracle_kmedian(const Oracle &oracle, size_t np, unsigned k, const OracleLSearchOpts &opts=OracleLSearchOpts()) {
+    auto lsearcher = make_oracle_kmed_lsearcher<Oracle, FT>(oracle, np, k, opts);
+    lsearcher.run();
+    blaze::DynamicVector<FT, blaze::rowVector> costs = trans(lsearcher.costs());
+    return std::make_tuple(lsearcher.solution(), lsearcher.assignments(), std::move(costs));
+}
+
+} // graph
+
+using graph::OracleLSearchOpts;
+using graph::OracleKMedSearcher;
+using graph::make_oracle_kmed_lsearcher;
+using graph::oracle_kmedian;
+
+} // minicore
+
+#endif /* FGC_ORACLE_LOCAL_SEARCH_H__ */
@@ -0,0 +1,116 @@
+#ifndef MINOCORE_UTIL_CPUDISPATCH_H__
+#define MINOCORE_UTIL_CPUDISPATCH_H__
+#include <cstddef>
+#include <cmath>
+#include <type_traits>
+#include "blaze/Math.h"
+#include "minicore/util/macros.h"
+
+/*
+ * Runtime CPU dispatch
+ *
+ * Portable builds (make PORTABLE=1, or MINICORE_PORTABLE=1 for setup.py) compile for a baseline ISA
+ * rather than -march=native. The hot kernels then need their own wide versions:
+ *   1. libkl and libsimdsampling are compiled once per ISA and linked through scripts/multiversion.py,
+ *      which binds each entry point to the widest supported variant once, at load time.
+ *   2. Header-only loops use the kernels below, which the compiler clones per ISA (target_clones)
+ *      and resolves the same way. This covers the L1/L2/SQRL2 distances of dense, row-major data.
+ * Native builds (PORTABLE=0, the default) compile with -march=native and link the single-ISA libkl and libsimdsampling,
+ * so step 1 does not apply. The kernels in step 2 are still cloned unless the host target already has AVX-512
+ * (__AVX512F__), in which case they compile once, for the host.
+ * Cloning also requires x86-64 ELF targets and compiler support for target_clones;
+ * define MINOCORE_NO_MULTIVERSION to disable it.
+ */
+
+#ifndef MINOCORE_MULTIVERSION
+#  if defined(__x86_64__) && defined(__ELF__) && defined(__has_attribute) && !defined(MINOCORE_NO_MULTIVERSION) && !defined(__AVX512F__)
+#    if __has_attribute(target_clones)
+#      define MINOCORE_MULTIVERSION __attribute__((target_clones("arch=skylake-avx512", "arch=haswell", "default")))
+#      define MINOCORE_MULTIVERSION_ENABLED 1
+#    endif
+#  endif
+#  ifndef MINOCORE_MULTIVERSION
+#    define MINOCORE_MULTIVERSION
+#  endif
+#endif
+#ifndef MINOCORE_MULTIVERSION_ENABLED
+#  define MINOCORE_MULTIVERSION_ENABLED 0
+#endif
+
+namespace minicore { namespace util {
+
+enum CPUISA: int {
+    ISA_DEFAULT,
+    ISA_SSE42,
+    ISA_AVX2,
+    ISA_AVX512
+};
+
+/* Widest ISA this host supports among those we build kernels for; computed once. */
+inline CPUISA cpu_isa() {
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    static const CPUISA ret = []() {
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512cd") && __builtin_cpu_supports("avx512bw")
+           && __builtin_cpu_supports("avx512dq") && __builtin_cpu_supports("avx512vl"))
+            return ISA_AVX512;
+        if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("bmi2"))
+            return ISA_AVX2;
+        if(__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt"))
+            return ISA_SSE42;
+        return ISA_DEFAULT;
+    }();
+    return ret;
+#else
+    return ISA_DEFAULT;
+#endif
+}
+
+inline const char *isa2str(CPUISA isa) {
+    switch(isa) {
+        case ISA_AVX512: return "avx512";
+        case ISA_AVX2: return "avx2";
+        case ISA_SSE42: return "sse4.2";
+        default: return "default";
+    }
+}
+
+namespace mv {
+
+/*
+ * sum_i |x_i * xscale - y_i|, sum_i (x_i * xscale - y_i)^2
+ * Static so that each translation unit owns its clones and resolver.
+ */
+#define MINOCORE_MV_KERNELS(FT) \
+MINOCORE_MULTIVERSION __attribute__((unused)) static FT l1_scaled_diff(const FT *x, FT xscale, const FT *y, size_t n) {\
+    FT ret = 0;\
+    OMP_PRAGMA("omp simd reduction(+:ret)")\
+    for(size_t i = 0; i < n; ++i) ret += std::abs(x[i] * xscale - y[i]);\
+    return ret;\
+}\
+MINOCORE_MULTIVERSION __attribute__((unused)) static FT sqrl2_scaled_diff(const FT *x, FT xscale, const FT *y, size_t n) {\
+    FT ret = 0;\
+    OMP_PRAGMA("omp simd reduction(+:ret)")\
+    for(size_t i = 0; i < n; ++i) {\
+        const FT v = x[i] * xscale - y[i];\
+        ret += v * v;\
+    }\
+    return ret;\
+}
+
+MINOCORE_MV_KERNELS(float)
+MINOCORE_MV_KERNELS(double)
+#undef MINOCORE_MV_KERNELS
+
+/* Whether an operand exposes contiguous storage of FT, which the kernels above require. */
+template<typename VT, typename FT>
+static constexpr bool is_contiguous_v =
+    blaze::IsDenseVector_v<std::decay_t<VT>> && blaze::IsContiguous_v<std::decay_t<VT>>
+    && std::is_same_v<std::remove_cv_t<blaze::ElementType_t<std::decay_t<VT>>>, FT>
+    && (std::is_same_v<FT, float> || std::is_same_v<FT, double>);
+
+} // namespace mv
+
+} } // namespace minicore::util
+
+#endif /* MINOCORE_UTIL_CPUDISPATCH_H__ */
@@ -8,6 +8,8 @@
 #include "./exception.h"
 #include "thirdparty/mio.hpp"
 #include <fstream>
+#include <charconv>
+#include <sys/stat.h>
 
 
 namespace minicore {
@@ -823,6 +825,16 @@ struct CSparseMatrix {
     using ElementType = VT;
 };
 
+template<typename T>
+struct IsCSparseMatrix {
+    static constexpr bool value = false;
+};
+template<typename VT, typename IT, typename IPtrT>
+struct IsCSparseMatrix<CSparseMatrix<VT, IT, IPtrT>>: public std::true_type {};
+
+template<typename T>
+static constexpr const bool IsCSparseMatrix_v = IsCSparseMatrix<T>::value;
+
 using blaze::unchecked;
 
 template<typename VT, typename ORVT, typename IT, typename IPtr, bool TF, typename OIT=IT, typename WeightT=blz::DV<VT>, bool rowwise=true>
@@ -1250,6 +1262,127 @@ blz::SM<FT, blaze::rowMajor> csc2sparse(std::string prefix, bool skip_empty=fals
 }
 
 
+/*
+ * MMapCSparseMatrix
+ *
+ * Owning, read-only CSR matrix backed by the indptr/indices/data/shape files read by csc2sparse(prefix).
+ * The CSC layout of (features x samples) on disk is CSR over samples, so rows are samples.
+ * Files stay mapped for the lifetime of the object and values are used in their native types,
+ * so nothing is copied or converted up front. Pages are faulted in on access, which lets
+ * clustering and coreset routines run on matrices much larger than RAM through the page cache.
+ *
+ * This is a CSparseMatrix, so it can be passed to anything that accepts one: mmapcsrtest seeds it with
+ * coresets::kmeanspp over a msr_with_prior oracle, samples a CoresetSampler from that solution, and runs
+ * perform_hard_clustering, perform_hard_minibatch_clustering and hmb_coreset_clustering on it.
+ * Sizes are validated against the template types; use visit_mmap_csparse to pick types from the files.
+ */
+template<typename VT=uint32_t, typename IT=uint64_t, typename IPtrT=uint64_t>
+struct MMapCSparseMatrix: public CSparseMatrix<VT, IT, IPtrT> {
+    using super = CSparseMatrix<VT, IT, IPtrT>;
+    mio::mmap_source data_map_, indices_map_, indptr_map_;
+
+    MMapCSparseMatrix(std::string prefix, int advice=MADV_NORMAL): super(nullptr, nullptr, nullptr, 0, 0, 0) {
+        const auto [nfeat, nsamples] = read_shape(prefix);
+        map(prefix + "data.file", prefix + "indices.file", prefix + "indptr.file", nsamples, nfeat, advice);
+    }
+    MMapCSparseMatrix(std::string datapath, std::string indicespath, std::string indptrpath, size_t nr, size_t nc, int advice=MADV_NORMAL):
+        super(nullptr, nullptr, nullptr, 0, 0, 0)
+    {
+        map(datapath, indicespath, indptrpath, nr, nc, advice);
+    }
+    MMapCSparseMatrix(MMapCSparseMatrix &&) = default;
+    MMapCSparseMatrix &operator=(MMapCSparseMatrix &&) = default;
+
+    const super &view() const {return *this;}
+
+    static std::pair<uint32_t, uint32_t> read_shape(std::string prefix) {
+        const std::string shape = prefix + "shape.file";
+        std::FILE *ifp = std::fopen(shape.data(), "rb");
+        if(!ifp) throw std::runtime_error(std::string("Missing shape: ") + shape);
+        uint32_t dims[2];
+        const bool ok = std::fread(dims, sizeof(uint32_t), 2, ifp) == 2;
+        std::fclose(ifp);
+        if(!ok) throw std::runtime_error("Failed to read dims from file");
+        return {dims[0], dims[1]};
+    }
+private:
+    void map(std::string datapath, std::string indicespath, std::string indptrpath, size_t nr, size_t nc, int advice) {
+        for(const auto &path: {datapath, indicespath, indptrpath})
+            if(!is_file(path)) throw std::runtime_error(std::string("Missing file: ") + path);
+        indptr_map_.map(indptrpath);
+        if(indptr_map_.size() != (nr + 1) * sizeof(IPtrT))
+            throw std::runtime_error(std::string("indptr file has ") + std::to_string(indptr_map_.size()) + " bytes, expected "
+                                     + std::to_string((nr + 1) * sizeof(IPtrT)) + " for " + std::to_string(nr) + " rows");
+        const IPtrT *indptr = reinterpret_cast<const IPtrT *>(indptr_map_.data());
+        const size_t nnz = indptr[nr];
+        if(nnz) {
+            indices_map_.map(indicespath);
+            data_map_.map(datapath);
+        }
+        if(indices_map_.size() != nnz * sizeof(IT) || data_map_.size() != nnz * sizeof(VT))
+            throw std::runtime_error(std::string("indices/data files have ") + std::to_string(indices_map_.size()) + '/' + std::to_string(data_map_.size())
+                                     + " bytes, which does not match nnz = " + std::to_string(nnz) + " for the requested types");
+        for(auto *m: {&indptr_map_, &indices_map_, &data_map_})
+            if(m->size()) ::madvise((void *)m->data(), m->size(), advice);
+        this->indptr_ = const_cast<IPtrT *>(indptr);
+        this->indices_ = nnz ? reinterpret_cast<IT *>(const_cast<char *>(indices_map_.data())): static_cast<IT *>(nullptr);
+        this->data_ = nnz ? reinterpret_cast<VT *>(const_cast<char *>(data_map_.data())): static_cast<VT *>(nullptr);
+        this->nr_ = nr; this->nc_ = nc; this->nnz_ = nnz;
+    }
+};
+
+template<typename VT, typename IT, typename IPtrT>
+struct IsCSparseMatrix<MMapCSparseMatrix<VT, IT, IPtrT>>: public std::true_type {};
+
+/*
+ * visit_mmap_csparse
+ * Maps the matrix at prefix with index, indptr and data types inferred from file sizes
+ * (uint32/uint64 indptr and indices; uint16, uint32/float or double data) and calls func on it.
+ * 4-byte data are read as float if data_is_float, and as uint32 otherwise.
+ */
+template<typename Func>
+void visit_mmap_csparse(std::string prefix, const Func &func, bool data_is_float=false, int advice=MADV_NORMAL) {
+    const auto [nfeat, nsamples] = MMapCSparseMatrix<>::read_shape(prefix);
+    auto fsize = [](std::string path) -> size_t {
+        struct stat st;
+        if(::stat(path.data(), &st)) throw std::runtime_error(std::string("Missing file: ") + path);
+        return st.st_size;
+    };
+    const size_t ipw = fsize(prefix + "indptr.file") / (size_t(nsamples) + 1);
+    size_t nnz;
+    {
+        mio::mmap_source ip(prefix + "indptr.file");
+        nnz = ipw == 4 ? size_t(reinterpret_cast<const uint32_t *>(ip.data())[nsamples])
+                       : size_t(reinterpret_cast<const uint64_t *>(ip.data())[nsamples]);
+    }
+    const size_t iw = nnz ? fsize(prefix + "indices.file") / nnz: 4, dw = nnz ? fsize(prefix + "data.file") / nnz: 4;
+    auto with_data = [&](auto ipt, auto it) {
+        using IPT = decltype(ipt);
+        using IT = decltype(it);
+        switch(dw) {
+            case 2: func(MMapCSparseMatrix<uint16_t, IT, IPT>(prefix, advice)); break;
+            case 4: if(data_is_float) func(MMapCSparseMatrix<float, IT, IPT>(prefix, advice));
+                    else func(MMapCSparseMatrix<uint32_t, IT, IPT>(prefix, advice));
+                    break;
+            case 8: func(MMapCSparseMatrix<double, IT, IPT>(prefix, advice)); break;
+            default: throw std::runtime_error(std::string("Unsupported data width: ") + std::to_string(dw));
+        }
+    };
+    auto with_indices = [&](auto ipt) {
+        switch(iw) {
+            case 4: with_data(ipt, uint32_t()); break;
+            case 8: with_data(ipt, uint64_t()); break;
+            default: throw std::runtime_error(std::string("Unsupported index width: ") + std::to_string(iw));
+        }
+    };
+    switch(ipw) {
+        case 4: with_indices(uint32_t()); break;
+        case 8: with_indices(uint64_t()); break;
+        default: throw std::runtime_error(std::string("Unsupported indptr width: ") + std::to_string(ipw));
+    }
+}
+
+
 template<typename FT, typename IT=size_t, bool SO=blaze::rowMajor>
 struct COOElement {
     IT x, y;
@@ -1264,8 +1397,13 @@ struct COOElement {
 };
 
 
+/*
+ * mtx2sparse_stream
+ * Serial Matrix Market reader: getline + strtoull/atof into COO, sort, then append.
+ * Kept as a reference implementation; mtx2sparse is the parallel loader.
+ */
 template<typename FT=float, bool SO=blaze::rowMajor, typename IT=size_t>
-blz::SM<FT, SO> mtx2sparse(std::string path, bool perform_transpose=false) {
+blz::SM<FT, SO> mtx2sparse_stream(std::string path, bool perform_transpose=false) {
 #ifndef NDEBUG
     TimeStamper ts("Parse mtx metadata");
 #define MNTSA(x) ts.add_event((x))
@@ -1342,6 +1480,222 @@ blz::SM<FT, SO> mtx2sparse(std::string path, bool perform_transpose=false) {
 }
 #undef MNTSA
 
+namespace mtx {
+
+struct MtxHeader {
+    size_t nr_ = 0, nc_ = 0, nnz_ = 0;
+    bool pattern_ = false, symmetric_ = false, skew_ = false;
+};
+
+static INLINE const char *skip_blanks(const char *p, const char *e) {
+    while(p < e && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+    return p;
+}
+static INLINE const char *next_line(const char *p, const char *e) {
+    p = static_cast<const char *>(std::memchr(p, '\n', e - p));
+    return p ? p + 1: e;
+}
+
+template<typename T>
+static INLINE const char *parse_uint(const char *p, const char *e, T &v, bool &ok) {
+    p = skip_blanks(p, e);
+    auto [ptr, ec] = std::from_chars(p, e, v);
+    ok &= ec == std::errc();
+    return ptr;
+}
+
+template<typename FT>
+static INLINE const char *parse_float(const char *p, const char *e, FT &v, bool &ok) {
+    p = skip_blanks(p, e);
+    if(p < e && *p == '+') ++p;
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    auto [ptr, ec] = std::from_chars(p, e, v);
+    ok &= ec == std::errc();
+    return ptr;
+#else
+    // strtod needs a terminator, so copy the token out
+    char buf[64];
+    const char *te = p;
+    while(te < e && te - p < 63 && *te != ' ' && *te != '\t' && *te != '\n' && *te != '\r') ++te;
+    std::memcpy(buf, p, te - p);
+    buf[te - p] = '\0';
+    char *bend;
+    v = std::strtod(buf, &bend);
+    ok &= bend != buf;
+    return te;
+#endif
+}
+
+// Parses banner, comments and the size line; returns a pointer to the first entry
+static inline const char *parse_header(const char *p, const char *e, MtxHeader &h, std::string path) {
+    if(e - p >= 14 && std::memcmp(p, "%%MatrixMarket", 14) == 0) {
+        std::string banner(p, next_line(p, e));
+        std::transform(banner.begin(), banner.end(), banner.begin(), [](auto c) {return std::tolower(c);});
+        if(banner.find("coordinate") == std::string::npos)
+            MN_THROW_RUNTIME(std::string("Only coordinate mtx files are supported: ") + path + '\n');
+        h.pattern_ = banner.find("pattern") != std::string::npos;
+        h.symmetric_ = banner.find("symmetric") != std::string::npos || banner.find("hermitian") != std::string::npos;
+        h.skew_ = banner.find("skew-symmetric") != std::string::npos;
+    }
+    for(const char *q; p < e && (*p == '%' || (q = skip_blanks(p, e)) == e || *q == '\n');)
+        p = next_line(p, e);
+    bool ok = true;
+    p = parse_uint(p, e, h.nr_, ok);
+    p = parse_uint(p, e, h.nc_, ok);
+    p = parse_uint(p, e, h.nnz_, ok);
+    if(!ok) MN_THROW_RUNTIME(std::string("Malformatted size line in mtx file at ") + path + '\n');
+    return next_line(p, e);
+}
+
+/*
+ * Parses the body of a coordinate mtx file in parallel and builds CSR directly.
+ *
+ * 1. The body is split into chunks at newline boundaries. Each chunk is parsed with std::from_chars
+ *    into local triplets, binned by row block (a contiguous range of rows).
+ * 2. Each row block is then built by one thread, without atomics: it counts entries per row over every chunk's bin,
+ *    takes an exclusive prefix sum, and scatters in chunk order, freeing each bin as it goes.
+ *    Each row is stably sorted by column (rows are short, so this is much cheaper than sorting all of COO),
+ *    and duplicate entries are summed in file order, so results do not depend on thread timing.
+ * 3. Blocks are appended to the output in row order, each freed once copied,
+ *    so peak memory stays near one copy of the entries beside the output.
+ * Symmetric (and hermitian) files store one triangle; the mirrored entries are added,
+ * negated for skew-symmetric files. Duplicate entries, including a stored entry and its mirror, are summed.
+ */
+template<typename FT, typename IT>
+blz::SM<FT, blaze::rowMajor> parse_body(const char *p, const char *e, const MtxHeader &h, std::string path) {
+    const size_t nr = h.nr_, nc = h.nc_, bodylen = e - p;
+    const size_t nt = OMP_ELSE(omp_get_max_threads(), 1);
+    const size_t nchunks = std::max(std::min(nt * 8, bodylen >> 16), size_t(1));
+    const size_t nblocks = std::max(std::min(nt * 4, nr), size_t(1));
+    const size_t rows_per_block = (nr + nblocks - 1) / nblocks;
+    std::vector<const char *> bounds(nchunks + 1);
+    bounds[0] = p; bounds[nchunks] = e;
+    for(size_t c = 1; c < nchunks; ++c)
+        bounds[c] = std::max(next_line(p + c * (bodylen / nchunks), e), bounds[c - 1]);
+    struct Triplet {IT x, y; FT z;};
+    // parts[c][b]: triplets from chunk c whose rows are in block b
+    std::vector<std::vector<std::vector<Triplet>>> parts(nchunks, std::vector<std::vector<Triplet>>(nblocks));
+    size_t nlines = 0, nbad = 0;
+    OMP_PRAGMA("omp parallel for schedule(dynamic) reduction(+:nlines,nbad)")
+    for(size_t c = 0; c < nchunks; ++c) {
+        auto &part = parts[c];
+        for(const char *lp = bounds[c], *le = bounds[c + 1]; lp < le; lp = next_line(lp, le)) {
+            lp = skip_blanks(lp, le);
+            if(lp == le || *lp == '\n' || *lp == '%') continue;
+            bool ok = true;
+            IT x, y;
+            FT z = 1;
+            lp = parse_uint(lp, le, x, ok);
+            lp = parse_uint(lp, le, y, ok);
+            if(!h.pattern_) lp = parse_float(lp, le, z, ok);
+            if(unlikely(!ok || x == 0 || y == 0 || size_t(x) > nr || size_t(y) > nc)) {
+                ++nbad;
+                continue;
+            }
+            ++nlines;
+            --x; --y;
+            part[x / rows_per_block].push_back(Triplet{x, y, z});
+            if(h.symmetric_ && x != y)
+                part[y / rows_per_block].push_back(Triplet{y, x, h.skew_ ? FT(-z): z});
+        }
+    }
+    if(nbad || nlines != h.nnz_) {
+        char buf[1024];
+        std::sprintf(buf, "Parsed %zu entries (%zu malformatted) != expected nnz (%zu). malformatted mtxfile at %s?\n", nlines, nbad, h.nnz_, path.data());
+        MN_THROW_RUNTIME(buf);
+    }
+    struct RowBlock {
+        std::vector<size_t> offsets;
+        std::vector<std::pair<IT, FT>> entries;
+    };
+    std::vector<RowBlock> blocks(nblocks);
+    OMP_PFOR_DYN
+    for(size_t b = 0; b < nblocks; ++b) {
+        const size_t r0 = std::min(nr, b * rows_per_block), r1 = std::min(nr, r0 + rows_per_block), nbr = r1 - r0;
+        auto &offsets = blocks[b].offsets;
+        auto &entries = blocks[b].entries;
+        offsets.assign(nbr + 1, 0);
+        for(size_t c = 0; c < nchunks; ++c)
+            for(const auto &t: parts[c][b]) ++offsets[t.x - r0 + 1];
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        std::vector<size_t> cursor(offsets.begin(), offsets.end() - 1);
+        entries.resize(offsets[nbr]);
+        for(size_t c = 0; c < nchunks; ++c) {
+            for(const auto &t: parts[c][b])
+                entries[cursor[t.x - r0]++] = {t.y, t.z};
+            std::vector<Triplet>().swap(parts[c][b]);
+        }
+        // Sort each row by column and sum duplicates in place, compacting the block
+        size_t out = 0;
+        for(size_t r = 0; r < nbr; ++r) {
+            auto rb = entries.begin() + offsets[r], re = entries.begin() + offsets[r + 1];
+            if(!std::is_sorted(rb, re, [](const auto &x, const auto &y) {return x.first < y.first;}))
+                std::stable_sort(rb, re, [](const auto &x, const auto &y) {return x.first < y.first;});
+            offsets[r] = out;
+            while(rb < re) {
+                auto v = *rb;
+                while(++rb < re && rb->first == v.first) v.second += rb->second;
+                entries[out++] = v;
+            }
+        }
+        offsets[nbr] = out;
+        entries.resize(out);
+        entries.shrink_to_fit();
+    }
+    size_t nentries = 0;
+    for(const auto &blk: blocks) nentries += blk.entries.size();
+    blz::SM<FT, blaze::rowMajor> ret(nr, nc);
+    ret.reserve(nentries);
+    for(size_t b = 0, r = 0; b < nblocks; ++b) {
+        auto &blk = blocks[b];
+        for(size_t i = 0; i + 1 < blk.offsets.size(); ++i, ++r) {
+            for(size_t j = blk.offsets[i]; j < blk.offsets[i + 1]; ++j)
+                ret.append(r, blk.entries[j].first, blk.entries[j].second);
+            ret.finalize(r);
+        }
+        std::vector<std::pair<IT, FT>>().swap(blk.entries);
+        std::vector<size_t>().swap(blk.offsets);
+    }
+    return ret;
+}
+
+} // namespace mtx
+
+/*
+ * mtx2sparse
+ * Loads a coordinate Matrix Market file.
+ * Uncompressed regular files are memory-mapped; compressed or streamed inputs
+ * are decompressed into memory first, on one thread (gzip and xz streams are not split into independently
+ * decodable blocks). Either way, parsing is parallel (see mtx::parse_body).
+ */
+template<typename FT=float, bool SO=blaze::rowMajor, typename IT=size_t>
+blz::SM<FT, SO> mtx2sparse(std::string path, bool perform_transpose=false) {
+    VERBOSE_ONLY(util::Timer t("mtx2sparse load time");)
+    const bool compressed = boost::algorithm::ends_with(path, ".gz") || boost::algorithm::ends_with(path, ".xz")
+                         || boost::algorithm::ends_with(path, ".bz2") || boost::algorithm::ends_with(path, ".zst");
+    struct stat st;
+    const bool mappable = !compressed && ::stat(path.data(), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0;
+    mio::mmap_source mapped;
+    std::string buffer;
+    const char *p, *e;
+    if(mappable) {
+        mapped.map(path);
+        ::madvise((void *)mapped.data(), mapped.size(), MADV_SEQUENTIAL);
+        p = mapped.data(); e = p + mapped.size();
+    } else {
+        auto [ifsp, fp] = io::xopen(path);
+        std::unique_ptr<char[]> block(new char[1 << 20]);
+        while(ifsp->read(block.get(), 1 << 20) || ifsp->gcount())
+            buffer.append(block.get(), ifsp->gcount());
+        p = buffer.data(); e = p + buffer.size();
+    }
+    mtx::MtxHeader h;
+    p = mtx::parse_header(p, e, h, path);
+    blz::SM<FT, SO> ret(mtx::parse_body<FT, IT>(p, e, h, path));
+    if(perform_transpose) blz::transpose(ret);
+    return ret;
+}
+
 
 template<typename MT, bool SO>
 std::pair<std::vector<size_t>, std::vector<size_t>>
@@ -1370,6 +1724,8 @@ blz::SM<FT, SO> csc2sparse(const IndPtrType *indptr, const IndicesType *indices,
 
 } // namespace util
 using util::csc2sparse;
+using util::MMapCSparseMatrix;
+using util::visit_mmap_csparse;
 using util::mtx2sparse;
 using util::nonZeros;
 using util::CSCMatrixView;
@@ -0,0 +1,85 @@
+#ifndef MINOCORE_UTIL_RADIX_HEAP_H__
+#define MINOCORE_UTIL_RADIX_HEAP_H__
+#include <array>
+#include <cassert>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace minicore { namespace util {
+
+/*
+ * Monotone priority queue (radix heap) over non-negative floating-point keys: keys popped never decrease.
+ * The bit pattern of a non-negative float or double orders as an unsigned integer,
+ * so entries are bucketed by the highest bit in which they differ from the last popped key.
+ * Each entry moves to a lower bucket at most once per bit, and push is O(1).
+ * Suited to event-driven simulations and to Dijkstra with lazy deletion.
+ */
+template<typename KeyT, typename Payload>
+class RadixHeap {
+    static_assert(std::is_floating_point_v<KeyT>, "Keys must be floating-point");
+    using bits_type = std::conditional_t<sizeof(KeyT) == sizeof(uint32_t), uint32_t, uint64_t>;
+    static_assert(sizeof(bits_type) == sizeof(KeyT), "Keys must be float or double");
+    static constexpr unsigned NBITS = sizeof(bits_type) * CHAR_BIT;
+    struct Entry {
+        bits_type key;
+        Payload payload;
+    };
+    std::array<std::vector<Entry>, NBITS + 1> buckets_;
+    bits_type last_ = 0;
+    size_t size_ = 0;
+    static bits_type to_bits(KeyT t) {
+        bits_type ret;
+        std::memcpy(&ret, &t, sizeof(ret));
+        return ret;
+    }
+    static KeyT from_bits(bits_type b) {
+        KeyT ret;
+        std::memcpy(&ret, &b, sizeof(ret));
+        return ret;
+    }
+    static unsigned bucket_of(bits_type key, bits_type last) {
+        if(key == last) return 0;
+        if constexpr(sizeof(bits_type) == sizeof(unsigned)) return NBITS - __builtin_clz(key ^ last);
+        else return NBITS - __builtin_clzll(key ^ last);
+    }
+public:
+    void clear() {
+        for(auto &b: buckets_) b.clear();
+        last_ = 0;
+        size_ = 0;
+    }
+    bool empty() const {return size_ == 0;}
+    size_t size() const {return size_;}
+    // t must not precede the last popped key; rounding below it is clamped
+    void push(KeyT t, Payload payload) {
+        if(!(t > KeyT(0))) t = KeyT(0);
+        const bits_type key = std::max(to_bits(t), last_);
+        buckets_[bucket_of(key, last_)].push_back(Entry{key, payload});
+        ++size_;
+    }
+    std::pair<KeyT, Payload> pop() {
+        assert(size_);
+        if(buckets_[0].empty()) {
+            unsigned b = 1;
+            while(buckets_[b].empty()) ++b;
+            auto &src = buckets_[b];
+            last_ = std::min_element(src.begin(), src.end(), [](const Entry &x, const Entry &y) {return x.key < y.key;})->key;
+            for(const Entry &e: src)
+                buckets_[bucket_of(e.key, last_)].push_back(e);
+            src.clear();
+        }
+        const Entry e = buckets_[0].back();
+        buckets_[0].pop_back();
+        --size_;
+        return {from_bits(e.key), e.payload};
+    }
+};
+
+}} // namespace minicore::util
+
+#endif /* MINOCORE_UTIL_RADIX_HEAP_H__ */
@@ -4,7 +4,9 @@ void init_clustering_soft(py::module &m) {
     m.def("scluster", [](const SparseMatrixWrapper &smw, py::object centers,
                     py::object measure, double beta, double temp,
                     uint64_t kmeansmaxiter, Py_ssize_t mbsize, Py_ssize_t mbn,
-                    py::object savepref, bool use_float, py::object weights) -> py::object
+                    py::object savepref, bool use_float, py::object weights,
+                    std::string mbschedule, double kappa, double t0, double eta, bool importance_sampling, uint64_t seed,
+                    Py_ssize_t eval_size, Py_ssize_t refresh_every) -> py::object
     {
         void *wptr = nullptr;
         std::string wfmt = "f";
@@ -13,7 +15,16 @@ void init_clustering_soft(py::module &m) {
             wfmt = standardize_dtype(inf.format);
             wptr = inf.ptr;
         }
-        return py_scluster(smw, centers, assure_dm(measure), beta, temp, kmeansmaxiter, mbsize, mbn, static_cast<std::string>(savepref.cast<py::str>()), use_float, wptr);
+        clust::SoftMinibatchOpts mbopts;
+        mbopts.schedule = clust::str2step(mbschedule);
+        mbopts.kappa = kappa;
+        mbopts.t0 = t0;
+        mbopts.eta = eta;
+        mbopts.importance_sampling = importance_sampling;
+        mbopts.seed = seed;
+        mbopts.eval_size = std::max(eval_size, Py_ssize_t(0));
+        mbopts.refresh_every = std::max(refresh_every, Py_ssize_t(0));
+        return py_scluster(smw, centers, assure_dm(measure), beta, temp, kmeansmaxiter, mbsize, mbn, static_cast<std::string>(savepref.cast<py::str>()), use_float, wptr, wfmt, mbopts);
     },
     py::arg("smw"),
     py::arg("centers"),
@@ -25,6 +36,20 @@ void init_clustering_soft(py::module &m) {
     py::arg("mbn") = Py_ssize_t(-1),
     py::arg("savepref") = "",
     py::arg("use_float") = true,
-    py::arg("weights") = py::none()
+    py::arg("weights") = py::none(),
+    py::arg("mbschedule") = "power",
+    py::arg("kappa") = .6,
+    py::arg("t0") = 2.,
+    py::arg("eta") = .1,
+    py::arg("importance_sampling") = false,
+    py::arg("seed") = 0,
+    py::arg("eval_size") = Py_ssize_t(0),
+    py::arg("refresh_every") = Py_ssize_t(0),
+    "Soft clustering. If mbsize > 0, runs minibatch soft EM, mbn batches of mbsize rows per iteration.\n"
+    "mbschedule selects the step size: 'power' ((t + t0)^-kappa), 'constant' (eta), or 'cumulative' (running average).\n"
+    "If importance_sampling, batches are sampled by sensitivity rather than uniformly.\n"
+    "The objective is estimated on a fixed sample of eval_size rows (0: max(4096, 4 * mbsize)),\n"
+    "and a full pass over all rows runs every refresh_every iterations (0: only to build the importance sampler).\n"
+    "costs and asn are computed once, for the final centers."
     );
 } // init_clustering_csr
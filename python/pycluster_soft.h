@@ -27,7 +27,8 @@ py::dict cpp_scluster(const Matrix &mat, int, double beta,
                Py_ssize_t mbsize,
                Py_ssize_t mbn,
                void *weights=static_cast<void *>(nullptr),
-               char wdtype='f')
+               char wdtype='f',
+               const clust::SoftMinibatchOpts &mbopts=clust::SoftMinibatchOpts())
 {
     using FT = double;
     blz::DV<FT> prior{FT(beta)};
@@ -62,7 +63,7 @@ py::dict cpp_scluster(const Matrix &mat, int, double beta,
     }
     // Only one version of perform_soft_clustering compiled (for double weights)
     // This takes extra memory/time to copy the weights, but halves or thirds compile-time.
-    clusterret = minicore::clustering::perform_soft_clustering(mat, measure, prior, ctrs, costs, asn, temp, kmeansmaxiter, mbsize, mbn, wview.get());
+    clusterret = minicore::clustering::perform_soft_clustering(mat, measure, prior, ctrs, costs, asn, temp, kmeansmaxiter, mbsize, mbn, wview.get(), clust::DEFAULT_EPS, mbopts);
     auto &[initcost, finalcost, numiter]  = clusterret;
     auto pyctrs = centers2pylist(ctrs);
     //auto pycosts = vec2fnp<decltype(costs), float> (costs);
@@ -83,7 +84,8 @@ py::dict py_scluster(const Matrix &smw,
                std::string savepref="",
                bool use_float=true,
                void *weights = (void *)nullptr,
-               std::string wfmt="f")
+               std::string wfmt="f",
+               const clust::SoftMinibatchOpts &mbopts=clust::SoftMinibatchOpts())
 {
     use_float = true;
     assert(beta > 0.);
@@ -113,12 +115,12 @@ py::dict py_scluster(const Matrix &smw,
 #endif
     blz::CustomMatrix<float, unaligned, unpadded, rowMajor> cm((float *)cp, smw.rows(), k);
     blz::CustomMatrix<float, unaligned, unpadded, rowMajor> am((float *)ap, smw.rows(), k);
-    smw.perform([&](auto &x) {retdict = cpp_scluster(x, k, beta, measure, dvecs, cm, am, temp, kmeansmaxiter, mbsize, mbn, weights, wfmt[0]);});
+    smw.perform([&](auto &x) {retdict = cpp_scluster(x, k, beta, measure, dvecs, cm, am, temp, kmeansmaxiter, mbsize, mbn, weights, wfmt[0], mbopts);});
 #if 0
     } else {
         blz::CustomMatrix<double, unaligned, unpadded, rowMajor> cm((double *)cp, smw.rows(), k);
         blz::CustomMatrix<double, unaligned, unpadded, rowMajor> am((double *)ap, smw.rows(), k);
-        smw.perform([&](auto &x) {retdict = cpp_scluster(x, k, beta, measure, dvecs, cm, am, temp, kmeansmaxiter, mbsize, mbn, weights, wfmt[0]);});
+        smw.perform([&](auto &x) {retdict = cpp_scluster(x, k, beta, measure, dvecs, cm, am, temp, kmeansmaxiter, mbsize, mbn, weights, wfmt[0], mbopts);});
     }
 #endif
     retdict["costs"] = costs;
@@ -5,8 +5,8 @@
 
 py::object run_kmpp_noso(const PyCSparseMatrix &smw, py::object msr, py::int_ k, double gamma_beta, uint64_t seed, unsigned nkmc, unsigned ntimes,
                          py::ssize_t lspp, bool use_exponential_skips, py::ssize_t n_local_trials,
-                         py::object weights) {
-    return py_kmeanspp_noso(smw, msr, k, gamma_beta, seed, nkmc, ntimes, lspp, use_exponential_skips, n_local_trials, weights);
+                         py::object weights, bool kmeans_parallel, double kmpar_oversampling, py::ssize_t kmpar_rounds) {
+    return py_kmeanspp_noso(smw, msr, k, gamma_beta, seed, nkmc, ntimes, lspp, use_exponential_skips, n_local_trials, weights, kmeans_parallel, kmpar_oversampling, kmpar_rounds);
 }
 #endif
 
@@ -90,7 +90,7 @@ void init_pycsparse(py::module &m) {
 
      m.def("kmeanspp", [](const PyCSparseMatrix &smw, const SumOpts &so, py::object weights) {
         return run_kmpp_noso(smw, py::int_(int(so.dis)), py::int_(int(so.k)),  so.gamma, so.seed, so.kmc2_rounds, std::max(int(so.extra_sample_tries) - 1, 0),
-                       so.lspp, so.use_exponential_skips, so.n_local_trials, weights);
+                       so.lspp, so.use_exponential_skips, so.n_local_trials, weights, so.kmeans_parallel, so.kmeans_parallel_oversampling, so.kmeans_parallel_rounds);
     },
     "Computes a selecion of points from the matrix pointed to by smw, returning indexes for selected centers, along with assignments and costs for each point.",
        py::arg("smw"),
@@ -102,7 +102,7 @@ void init_pycsparse(py::module &m) {
        "\nSet nkmc to -1 to perform streaming kmeans++ (kmc2 over the full dataset), which parallelizes better but may yield a lower-quality result.\n",
        py::arg("smw"), py::arg("msr"), py::arg("k"), py::arg("prior") = 0., py::arg("seed") = 0, py::arg("nkmc") = 0, py::arg("ntimes") = 1,
        py::arg("lspp") = 0, py::arg("expskips") = false, py::arg("n_local_trials") = 1,
-       py::arg("weights") = py::none()
+       py::arg("weights") = py::none(), py::arg("kmeans_parallel") = false, py::arg("oversampling") = 2., py::arg("kmpar_rounds") = 0
     );
     m.def("greedy_select",  [](PyCSparseMatrix &smw, const SumOpts &so) {
         std::vector<uint64_t> centers;
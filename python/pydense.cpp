@@ -36,7 +36,7 @@ void init_pydense(py::module &m) {
         if(arri.ndim != 2) throw std::invalid_argument("Wrong number of dimensions");
         blz::CustomMatrix<float, unaligned, unpadded, rowMajor> cm((float *)arri.ptr, arri.shape[0], arri.shape[1], arri.strides[0] / sizeof(float));
         return py_kmeanspp_noso_dense(cm, py::int_(int(so.dis)), py::int_(int(so.k)),  so.gamma, so.seed, so.kmc2_rounds, std::max(int(so.extra_sample_tries) - 1, 0),
-                             so.lspp, so.use_exponential_skips, so.n_local_trials, weights);
+                             so.lspp, so.use_exponential_skips, so.n_local_trials, weights, so.kmeans_parallel, so.kmeans_parallel_oversampling, so.kmeans_parallel_rounds);
     },
     "Computes a selecion of points from the matrix pointed to by smw, returning indexes for selected centers, along with assignments and costs for each point.",
        py::arg("matrix"),
@@ -48,7 +48,7 @@ void init_pydense(py::module &m) {
         if(arri.ndim != 2) throw std::invalid_argument("Wrong number of dimensions");
         blz::CustomMatrix<double, unaligned, unpadded, rowMajor> cm((double *)arri.ptr, arri.shape[0], arri.shape[1], arri.strides[0] / sizeof(double));
         return py_kmeanspp_noso_dense(cm, py::int_(int(so.dis)), py::int_(int(so.k)),  so.gamma, so.seed, so.kmc2_rounds, std::max(int(so.extra_sample_tries) - 1, 0),
-                             so.lspp, so.use_exponential_skips, so.n_local_trials, weights);
+                             so.lspp, so.use_exponential_skips, so.n_local_trials, weights, so.kmeans_parallel, so.kmeans_parallel_oversampling, so.kmeans_parallel_rounds);
     },
     "Computes a selecion of points from the matrix pointed to by smw, returning indexes for selected centers, along with assignments and costs for each point.",
        py::arg("matrix"),
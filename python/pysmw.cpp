@@ -9,8 +9,8 @@ using smw_t = SparseMatrixWrapper;
 
 py::object run_kmpp_noso(const SparseMatrixWrapper &smw, py::object msr, py::int_ k, double gamma_beta, uint64_t seed, unsigned nkmc, unsigned ntimes,
                          Py_ssize_t lspp, bool use_exponential_skips, py::ssize_t n_local_trials,
-                         py::object weights) {
-    return py_kmeanspp_noso(smw, msr, k, gamma_beta, seed, nkmc, ntimes, lspp, use_exponential_skips, n_local_trials, weights);
+                         py::object weights, bool kmeans_parallel, double kmpar_oversampling, py::ssize_t kmpar_rounds) {
+    return py_kmeanspp_noso(smw, msr, k, gamma_beta, seed, nkmc, ntimes, lspp, use_exponential_skips, n_local_trials, weights, kmeans_parallel, kmpar_oversampling, kmpar_rounds);
 }
 
 dist::DissimilarityMeasure assure_dm(py::object obj) {
@@ -315,6 +315,9 @@ void init_smw(py::module &m) {
     .def_readwrite("outlier_fraction", &SumOpts::outlier_fraction)
     .def_readwrite("discrete_metric_search", &SumOpts::discrete_metric_search)
     .def_readwrite("use_exponential_skips", &SumOpts::use_exponential_skips)
+    .def_readwrite("kmeans_parallel", &SumOpts::kmeans_parallel)
+    .def_readwrite("kmpar_oversampling", &SumOpts::kmeans_parallel_oversampling)
+    .def_readwrite("kmpar_rounds", &SumOpts::kmeans_parallel_rounds)
     .def_property("cs",
             [](SumOpts &obj) -> py::str {
                 return std::string(coresets::sm2str(obj.sm));
@@ -366,17 +369,19 @@ void init_smw(py::module &m) {
     static constexpr const char *kmeans_doc =
         "Computes a selecion of points from the matrix pointed to by smw, returning indexes for selected centers, along with assignments and costs for each point."
        "\nSet nkmc to > 0 to use kmc2 instead of full D2 sampling, which is faster but may yield a slightly lower-quality result.\n"
-        "One can accelerate sampling via SIMD (default) or exponential skips via use_exponential_skips=True\n";
+        "One can accelerate sampling via SIMD (default) or exponential skips via use_exponential_skips=True\n"
+        "Set kmeans_parallel=True to seed with kmeans|| (kmpar_rounds rounds of oversampling, default log(n), followed by weighted kmeans++),"
+        " which parallelizes better than sequential D2 sampling.\n";
     m.def("kmeanspp", run_kmpp_noso
        , kmeans_doc,
        py::arg("smw"), py::arg("msr"), py::arg("k"), py::arg("prior") = 0., py::arg("seed") = 0, py::arg("nkmc") = 0, py::arg("ntimes") = 1,
        py::arg("lspp") = 0, py::arg("expskips") = false, py::arg("n_local_trials") = 1,
-       py::arg("weights") = py::none()
+       py::arg("weights") = py::none(), py::arg("kmeans_parallel") = false, py::arg("oversampling") = 2., py::arg("kmpar_rounds") = 0
     );
 #if 1
     m.def("kmeanspp", [](const SparseMatrixWrapper &smw, const SumOpts &so, py::object weights) {
         return run_kmpp_noso(smw, py::int_(int(so.dis)), py::int_(int(so.k)),  so.gamma, so.seed, so.kmc2_rounds, std::max(int(so.extra_sample_tries) - 1, 0),
-                       so.lspp, so.use_exponential_skips, so.n_local_trials, weights);
+                       so.lspp, so.use_exponential_skips, so.n_local_trials, weights, so.kmeans_parallel, so.kmeans_parallel_oversampling, so.kmeans_parallel_rounds);
     },
         kmeans_doc,
        py::arg("smw"),
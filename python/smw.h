@@ -179,7 +179,7 @@ public:
 template<typename Mat>
 inline py::object py_kmeanspp_noso(Mat &smw, py::object msr, py::int_ k, double gamma_beta, uint64_t seed, unsigned nkmc, unsigned ntimes,
                           py::ssize_t lspp, bool use_exponential_skips, py::ssize_t n_local_trials,
-                          py::object weights)
+                          py::object weights, bool kmeans_parallel=false, double kmpar_oversampling=2., py::ssize_t kmpar_rounds=0)
     {
         if(gamma_beta < 0.) {
             gamma_beta = 1. / smw.columns();
@@ -244,10 +244,14 @@ inline py::object py_kmeanspp_noso(Mat &smw, py::object msr, py::int_ k, double
                 case 'd': case -1: break;
                 default: throw std::runtime_error("Unsupported dtype for weights");
             }
-            auto sol = kmeanspp(cmp, rng, x.rows(), ki, (double *)wptr, lspp, use_exponential_skips, true, n_local_trials);
+            auto seed = [&]() {
+                return kmeans_parallel ? coresets::kmeans_parallel(cmp, rng, x.rows(), ki, (double *)wptr, kmpar_oversampling, kmpar_rounds)
+                                       : kmeanspp(cmp, rng, x.rows(), ki, (double *)wptr, lspp, use_exponential_skips, true, n_local_trials);
+            };
+            auto sol = seed();
             auto solc = sum(std::get<2>(sol));
             for(auto nt = 0u;nt < ntimes; ++nt) {
-                auto sol2 = kmeanspp(cmp, rng, x.rows(), ki, (double *)wptr, lspp, use_exponential_skips, true, n_local_trials);
+                auto sol2 = seed();
                 auto sol2c = sum(std::get<2>(sol));
                 if(sol2c < solc) {
                     std::swap(sol2, sol);
@@ -292,13 +296,13 @@ inline py::object py_kmeanspp_noso(Mat &smw, py::object msr, py::int_ k, double
 template<typename Mat>
 inline py::tuple py_kmeanspp_so(const Mat &smw, const SumOpts &sm, py::object weights) {
     return py_kmeanspp_noso(smw, py::int_((int)sm.dis), sm.k, sm.gamma, sm.seed, sm.kmc2_rounds, std::max(sm.extra_sample_tries - 1, 0u),
-                       sm.lspp, sm.use_exponential_skips, sm.n_local_trials, weights);
+                       sm.lspp, sm.use_exponential_skips, sm.n_local_trials, weights, sm.kmeans_parallel, sm.kmeans_parallel_oversampling, sm.kmeans_parallel_rounds);
 }
 
 template<typename Mat>
 inline py::object py_kmeanspp_noso_dense(Mat &smw, py::object msr, py::int_ k, double gamma_beta, uint64_t seed, unsigned nkmc, unsigned ntimes,
                           Py_ssize_t lspp, bool use_exponential_skips, py::ssize_t n_local_trials,
-                          py::object weights)
+                          py::object weights, bool kmeans_parallel=false, double kmpar_oversampling=2., py::ssize_t kmpar_rounds=0)
     {
         if(gamma_beta < 0.) {
             gamma_beta = 1. / smw.columns();
@@ -361,10 +365,14 @@ inline py::object py_kmeanspp_noso_dense(Mat &smw, py::object msr, py::int_ k, d
             case 'd': case -1: break;
             default: throw std::runtime_error("Unsupported dtype for weights");
         }
-        auto sol = kmeanspp(cmp, rng, smw.rows(), ki, (double *)wptr, lspp, use_exponential_skips, true, n_local_trials);
+        auto seed = [&]() {
+            return kmeans_parallel ? coresets::kmeans_parallel(cmp, rng, smw.rows(), ki, (double *)wptr, kmpar_oversampling, kmpar_rounds)
+                                   : kmeanspp(cmp, rng, smw.rows(), ki, (double *)wptr, lspp, use_exponential_skips, true, n_local_trials);
+        };
+        auto sol = seed();
         auto solc = sum(std::get<2>(sol));
         for(auto nt = 0u;nt < ntimes; ++nt) {
-            auto sol2 = kmeanspp(cmp, rng, smw.rows(), ki, (double *)wptr, lspp, use_exponential_skips, true, n_local_trials);
+            auto sol2 = seed();
             auto sol2c = sum(std::get<2>(sol2));
             if(sol2c < solc) {
                 std::swap(sol2, sol); std::swap(sol2c, solc);
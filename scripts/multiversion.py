@@ -0,0 +1,169 @@
+"""
+Builds a static archive which dispatches between copies of the same objects compiled for different ISAs.
+
+Usage: python3 scripts/multiversion.py -o libkl_mv.a --api libkl/libkl.h sse42:libkl.sse42.o avx2:libkl.avx2.o avx512:libkl.avx512.o
+
+The first variant is the fallback and should be compiled for the baseline ISA.
+Only the exported API is dispatched: strong (T) functions declared in an --api header or named with --allow.
+For every variant, each such function `f` is renamed to `f_mv_<isa>`.
+A generated dispatch object then defines `f` as a GNU indirect function (ifunc) whose resolver
+checks CPUID once, at load time, and binds `f` to the widest variant the host supports.
+Callers are unchanged: they link against `f` as before and pay no per-call dispatch cost.
+Other global functions stay private to their variant, so each variant calls its own copies:
+strong internal helpers are made local, and weak (COMDAT) inline or template instantiations are renamed
+to `f_mv_<isa>` so the linker neither merges them across variants nor with callers' own definitions.
+
+Global data is shared: non-fallback copies are weakened so that every variant binds to the fallback's definition.
+
+Requires ELF and a GNU toolchain (gcc or clang, binutils nm/objcopy/ar).
+"""
+import argparse as agp
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+# Features each variant's compile flags assume, checked with __builtin_cpu_supports
+ISA_FEATURES = {
+    "sse42": ["sse4.2", "popcnt"],
+    "avx2": ["avx", "avx2", "fma", "bmi2"],
+    "avx512": ["avx2", "fma", "avx512f", "avx512cd", "avx512bw", "avx512dq", "avx512vl"],
+}
+
+TEXT_TYPES = "TWi"
+DATA_TYPES = "DBRGSC"
+
+
+def defined_globals(nm, obj):
+    """(symbol, type, name without namespaces or parameters) for each defined global symbol."""
+    def run(*flags):
+        out = subprocess.check_output([nm, "-P", "--defined-only", "-g"] + list(flags) + [obj]).decode()
+        return [line for line in out.splitlines() if len(line.split()) >= 2]
+    raw, demangled = run(), run("-C")
+    if len(raw) != len(demangled):
+        raise SystemExit("Could not demangle the symbols of %s" % obj)
+    ret = []
+    for line, dline in zip(raw, demangled):
+        toks = line.split()
+        # Demangled names contain spaces; the type is the second-to-last of the value/size fields
+        base = dline.rsplit(" " + toks[1] + " ", 1)[0].split("(", 1)[0].split("::")[-1]
+        ret.append((toks[0], toks[1], base))
+    return ret
+
+
+def declared_functions(headers):
+    """Identifiers followed by '(' in the headers, with comments removed: a superset of the declared functions."""
+    ret = set()
+    for h in headers:
+        with open(h) as f:
+            text = re.sub(r"/\*.*?\*/|//[^\n]*", "", f.read(), flags=re.S)
+        ret.update(re.findall(r"\b([A-Za-z_]\w*)\s*\(", text))
+    return ret
+
+
+def has_ctors(objdump, obj):
+    out = subprocess.check_output([objdump, "-h", obj]).decode()
+    return any(s in out for s in (".init_array", ".ctors"))
+
+
+def emit_dispatch(isas, names):
+    lines = ["/* Generated by scripts/multiversion.py. Do not edit. */",
+             "static int mv_isa = -1;",
+             "static int mv_select(void) {",
+             "    if(mv_isa < 0) {",
+             "        int isa = 0;",
+             "        __builtin_cpu_init();"]
+    for idx in range(len(isas) - 1, 0, -1):
+        cond = " && ".join('__builtin_cpu_supports("%s")' % f for f in ISA_FEATURES[isas[idx]])
+        lines.append("        %sif(%s) isa = %d;" % ("" if idx == len(isas) - 1 else "else ", cond, idx))
+    lines += ["        mv_isa = isa;",
+              "    }",
+              "    return mv_isa;",
+              "}"]
+    for name in names:
+        variants = ["%s_mv_%s" % (name, isa) for isa in isas]
+        lines.append("extern void %s;" % ", ".join("%s(void)" % v for v in variants))
+        lines.append("static void *%s_mv_resolve(void) {" % name)
+        lines.append("    static void *const table[] = {%s};" % ", ".join("(void *)&%s" % v for v in variants))
+        lines.append("    return table[mv_select()];")
+        lines.append("}")
+        lines.append("void %s(void) __attribute__((ifunc(\"%s_mv_resolve\")));" % (name, name))
+    return "\n".join(lines) + "\n"
+
+
+def main():
+    ap = agp.ArgumentParser(description="Combine per-ISA builds of objects into one archive with load-time CPUID dispatch.")
+    ap.add_argument("variants", nargs="+", help="isa:object pairs, fallback first. ISAs: " + ", ".join(ISA_FEATURES))
+    ap.add_argument("-o", "--output", required=True, help="Output archive")
+    ap.add_argument("--api", action="append", default=[], help="Header declaring exported functions to dispatch. May be repeated.")
+    ap.add_argument("--allow", action="append", default=[], help="Exported function to dispatch. May be repeated.")
+    ap.add_argument("--cc", default=os.environ.get("CC", "cc"))
+    ap.add_argument("--nm", default=os.environ.get("NM", "nm"))
+    ap.add_argument("--objcopy", default=os.environ.get("OBJCOPY", "objcopy"))
+    ap.add_argument("--objdump", default=os.environ.get("OBJDUMP", "objdump"))
+    ap.add_argument("--ar", default=os.environ.get("AR", "ar"))
+    args = ap.parse_args()
+    if sys.platform == "darwin":
+        raise SystemExit("Multiversioned archives require ELF ifunc support; use a -march build on macOS.")
+    isas, objs = [], []
+    for v in args.variants:
+        isa, _, obj = v.partition(":")
+        if isa not in ISA_FEATURES or not obj:
+            raise SystemExit("Invalid variant %s; expected isa:object with isa in %s" % (v, list(ISA_FEATURES)))
+        isas.append(isa)
+        objs.append(obj)
+    if len(set(isas)) != len(isas):
+        raise SystemExit("Duplicate ISA in %s" % isas)
+    if not args.api and not args.allow:
+        raise SystemExit("Specify the exported functions with --api and/or --allow")
+    api = declared_functions(args.api) | set(args.allow)
+    syms = [defined_globals(args.nm, o) for o in objs]
+    def exported(s):
+        return {n for n, t, base in s if t == "T" and (n in api or base in api)}
+    funcs = sorted(exported(syms[0]))
+    if not funcs:
+        raise SystemExit("%s defines none of the exported functions" % objs[0])
+    for isa, s in zip(isas[1:], syms[1:]):
+        if exported(s) != set(funcs):
+            raise SystemExit("Variant %s does not define the same exported functions as %s" % (isa, isas[0]))
+    for isa, o in zip(isas[1:], objs[1:]):
+        if has_ctors(args.objdump, o):
+            sys.stderr.write("Warning: %s has static constructors, which run regardless of the selected ISA\n" % o)
+    with tempfile.TemporaryDirectory() as tmp:
+        outobjs = []
+        for idx, (isa, obj) in enumerate(zip(isas, objs)):
+            symfile = os.path.join(tmp, "%s.syms" % isa)
+            weak = [n for n, t, _ in syms[idx] if t == "W"]
+            with open(symfile, "w") as f:
+                for n in funcs + weak:
+                    f.write("%s %s_mv_%s\n" % (n, n, isa))
+            cmd = [args.objcopy, "--redefine-syms=" + symfile]
+            internal = [n for n, t, _ in syms[idx] if t in TEXT_TYPES and t != "W" and n not in funcs]
+            if internal:
+                localfile = os.path.join(tmp, "%s.local" % isa)
+                with open(localfile, "w") as f:
+                    f.write("".join(n + "\n" for n in internal))
+                cmd.append("--localize-symbols=" + localfile)
+            data = [n for n, t, _ in syms[idx] if t in DATA_TYPES] if idx else []
+            if data:
+                weakfile = os.path.join(tmp, "%s.weak" % isa)
+                with open(weakfile, "w") as f:
+                    f.write("".join(n + "\n" for n in data))
+                cmd.append("--weaken-symbols=" + weakfile)
+            dst = os.path.join(tmp, "%s.%s" % (isa, os.path.basename(obj)))
+            subprocess.check_call(cmd + [obj, dst])
+            outobjs.append(dst)
+        src = os.path.join(tmp, "mv_dispatch.c")
+        with open(src, "w") as f:
+            f.write(emit_dispatch(isas, funcs))
+        dobj = os.path.join(tmp, "mv_dispatch.o")
+        subprocess.check_call([args.cc, "-c", "-O2", "-fPIC", src, "-o", dobj])
+        if os.path.exists(args.output):
+            os.remove(args.output)
+        subprocess.check_call([args.ar, "rcs", args.output, dobj] + outobjs)
+    sys.stderr.write("Wrote %s: %d functions dispatched over %s\n" % (args.output, len(funcs), ", ".join(isas)))
+
+
+if __name__ == "__main__":
+    main()
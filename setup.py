@@ -9,16 +9,22 @@ from subprocess import check_output, check_call
 SLEEFLIB="libsleef.a"
 sleefdir = environ.get("SLEEF_DIR", "sleef/build")
 
+# MINICORE_PORTABLE=1 builds a wheel for any x86-64 host with SSE4.2,
+# linking per-ISA builds of libkl and libsimdsampling dispatched at load time (see scripts/multiversion.py)
+PORTABLE = environ.get("MINICORE_PORTABLE", "0") not in ("", "0")
+KLLIB = "libkl_mv.a" if PORTABLE else "libkl.a"
+SSLIB = "libsimdsampling_mv.a" if PORTABLE else "libsimdsampling/libsimdsampling.a"
+
 def main():
 
     if not path.isfile(SLEEFLIB):
         print("Making sleef")
         check_call(f"make {SLEEFLIB}", shell=True)
-    if not path.isfile("libkl.a"):
-        check_call(f"make libkl.a", shell=True)
-    if not path.isfile("libsimdsampling/libsimdsampling.a"):
-        print("Making libss.a")
-        check_call(f"make libsimdsampling/libsimdsampling.a", shell=True)
+    if not path.isfile(KLLIB):
+        check_call(f"make {KLLIB} PORTABLE={int(PORTABLE)}", shell=True)
+    if not path.isfile(SSLIB):
+        print(f"Making {SSLIB}")
+        check_call(f"make {SSLIB} PORTABLE={int(PORTABLE)}", shell=True)
     
     # from https://stackoverflow.com/questions/11013851/speeding-up-build-process-with-distutils
     # parallelizes extension compilation
@@ -44,7 +50,7 @@ def main():
     import distutils.ccompiler
     distutils.ccompiler.CCompiler.compile=parallelCCompile
     
-    LIBOBJS = [SLEEFLIB, "libkl.a", "libsimdsampling/libsimdsampling.a"]
+    LIBOBJS = [SLEEFLIB, KLLIB, SSLIB]
     
     
     class get_pybind_include(object):
@@ -63,7 +69,8 @@ def main():
     
     #EXTRAS = environ.get("EXTRA", "")
     
-    extra_compile_args = ['-march=native', '-DNDEBUG',
+    arch_flags = ['-march=x86-64', '-msse4.2', '-mpopcnt', '-mtune=generic'] if PORTABLE else ['-march=native']
+    extra_compile_args = arch_flags + ['-DNDEBUG',
                           '-Wno-char-subscripts', '-Wno-unused-function', '-Wno-ignored-qualifiers',
                           '-Wno-strict-aliasing', '-Wno-ignored-attributes', '-fno-wrapv',
                           '-Wall', '-Wextra', '-Wformat',
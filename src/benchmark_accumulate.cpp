@@ -0,0 +1,94 @@
+#include "minicore/clustering/accumulate.h"
+#include "aesctr/wy.h"
+#include <getopt.h>
+#include <mutex>
+
+using namespace minicore;
+
+int usage() {
+    std::fprintf(stderr, "Usage: benchmark_accumulate <flags>\n"
+                         "Times centroid accumulation with per-center locks vs thread-local partials\n"
+                         "vs grouping rows by center (the fallback for large k * d),\n"
+                         "for 1, 2, 4, ... up to the maximum number of threads, on a skewed assignment.\n"
+                         "Use large -k to reach the grouped fallback in accumulate_centroids.\n"
+                         "Flags:\n"
+                         "-r: Number of rows. Default: 1000000\n"
+                         "-d: Number of dimensions of generated data. Default: 64\n"
+                         "-k: Number of centers. Default: 64\n"
+                         "-s: Skew exponent. Center j has weight proportional to 1 / (j + 1)^s. Default: 2\n"
+                         "-p: Maximum number of threads to use. Default: 64\n"
+                         "-n: Number of repetitions per configuration. Default: 3\n"
+                         "-h: Emit usage and exit.\n");
+    return EXIT_FAILURE;
+}
+
+template<typename F>
+double time_ms(F &&f, int nreps) {
+    double best = std::numeric_limits<double>::max();
+    for(int i = 0; i < nreps; ++i) {
+        auto start = util::hrc::now();
+        f();
+        best = std::min(best, util::timediff2ms(start, util::hrc::now()));
+    }
+    return best;
+}
+
+int main(int argc, char **argv) {
+    size_t nr = 1000000, nd = 64, k = 64;
+    double skew = 2.;
+    int maxthreads = 64, nreps = 3;
+    for(int c;(c = getopt(argc, argv, "r:d:k:s:p:n:h?")) >= 0;) {
+        switch(c) {
+            case 'r': nr = std::strtoull(optarg, nullptr, 10); break;
+            case 'd': nd = std::strtoull(optarg, nullptr, 10); break;
+            case 'k': k = std::strtoull(optarg, nullptr, 10); break;
+            case 's': skew = std::atof(optarg); break;
+            case 'p': maxthreads = std::atoi(optarg); break;
+            case 'n': nreps = std::atoi(optarg); break;
+            case 'h': case '?': default: return usage();
+        }
+    }
+    blz::DM<float> mat = blaze::generate(nr, nd, [](auto r, auto c) {
+        wy::WyRand<uint64_t> rng((uint64_t(r) << 32) | c);
+        return std::uniform_real_distribution<float>()(rng);
+    });
+    // Zipf-like assignment: most rows land in the first few centers
+    std::vector<double> cdf(k);
+    for(size_t j = 0; j < k; ++j) cdf[j] = (j ? cdf[j - 1]: 0.) + std::pow(j + 1., -skew);
+    std::vector<uint32_t> asn(nr);
+    wy::WyRand<uint64_t> rng(13);
+    for(auto &a: asn)
+        a = std::lower_bound(cdf.begin(), cdf.end(), std::uniform_real_distribution<double>()(rng) * cdf.back()) - cdf.begin();
+    std::fprintf(stderr, "%zu rows, %zu dims, %zu centers; largest cluster has %zu rows\n", nr, nd, k,
+                 size_t(std::count(asn.begin(), asn.end(), 0u)));
+    blz::DM<float> ctrs(k, nd), lctrs(k, nd), gctrs(k, nd);
+    std::vector<double> counts(k), lcounts(k), gcounts(k);
+    std::fprintf(stdout, "#threads\tlocked_ms\tpartials_ms\tspeedup\tgrouped_ms\tgrouped_speedup\tpartials_fit\n");
+    for(int nt = 1; nt <= maxthreads; nt <<= 1) {
+        OMP_ONLY(omp_set_num_threads(nt);)
+        const double tl = time_ms([&]() {
+            std::unique_ptr<std::mutex[]> locks(new std::mutex[k]);
+            lctrs = 0.f;
+            std::fill(lcounts.begin(), lcounts.end(), 0.);
+            OMP_PRAGMA("omp parallel for schedule(dynamic)")
+            for(size_t i = 0; i < nr; ++i) {
+                const auto a = asn[i];
+                std::lock_guard<std::mutex> lock(locks[a]);
+                blz::serial(row(lctrs, a) += row(mat, i));
+                lcounts[a] += 1.;
+            }
+        }, nreps);
+        const double tp = time_ms([&]() {
+            clustering::accumulate_centroids<float>(mat, asn, ctrs, counts);
+        }, nreps);
+        const double tg = time_ms([&]() {
+            clustering::accumulate_centroids_grouped<float>(mat, asn, gctrs, gcounts);
+        }, nreps);
+        const double scale = std::max(1.f, blz::max(blz::abs(lctrs)));
+        const double maxdiff = std::max(blz::max(blz::abs(ctrs - lctrs)), blz::max(blz::abs(gctrs - lctrs))) / scale;
+        if(maxdiff > 1e-3) std::fprintf(stderr, "Warning: results differ by a relative %g\n", maxdiff);
+        // Whether accumulate_centroids used one partial per thread or fell back to grouping
+        const bool fits = size_t(nt) * k * nd * sizeof(float) <= size_t(MINOCORE_ACCUMULATE_MAXBYTES);
+        std::fprintf(stdout, "%d\t%g\t%g\t%g\t%g\t%g\t%d\n", nt, tl, tp, tl / tp, tg, tl / tg, fits);
+    }
+}
@@ -4,8 +4,9 @@
 #include "blaze/util/Serialization.h"
 
 void usage(const char *x) {
-    std::fprintf(stderr, "Usage: %s <input.blaze> <input.coreset_sampler> k <optional: subset_indices>\n",
-                 x);
+    std::fprintf(stderr, "Usage: %s <input.blaze> <input.coreset_sampler> k <optional: subset_indices>\n"
+                         "       %s -T <input.blaze> k: report candidate swaps scored per second vs thread count\n",
+                 x, x);
     std::exit(1);
 }
 using namespace minicore;
@@ -72,7 +73,51 @@ thorup_mincost(const Mat &mat, RNG &rng, unsigned k, unsigned ntries) {
     return ret;
 }
 
+// Runs fast-swap and evaluate_swap local search at 1, 2, 4, ... threads from the same seed,
+// reporting candidate swaps scored per second. Every run should end at the same solution.
+template<typename Mat>
+void bench_thread_scaling(const Mat &dm, unsigned k) {
+#ifdef _OPENMP
+    const int maxnt = omp_get_num_procs();
+#else
+    const int maxnt = 1;
+#endif
+    for(const bool fast: {true, false}) {
+        if(!fast && dm.rows() > 2000) {
+            std::fprintf(stderr, "Skipping evaluate_swap scaling for %zu points\n", dm.rows());
+            continue;
+        }
+        double refcost = -1.;
+        for(int nt = 1;; nt = std::min(nt * 2, maxnt)) {
+            OMP_ONLY(omp_set_num_threads(nt);)
+            auto lsearcher = minicore::make_kmed_lsearcher(dm, k, 1e-3, 13);
+            lsearcher.fast_swap_ = fast;
+            lsearcher.lazy_eval_ = 0;
+            auto start = util::hrc::now();
+            lsearcher.run();
+            const double ms = util::timediff2ms(start, util::hrc::now());
+            if(refcost < 0.) refcost = lsearcher.current_cost_;
+            std::printf("%s\t%d threads\t%zu swaps\t%zu scored\t%gms\t%g swaps/sec\tcost %0.12g%s\n",
+                        fast ? "fastswap": "evaluate_swap", nt, lsearcher.nswaps_, lsearcher.nscored_, ms,
+                        lsearcher.nscored_ / ms * 1e3, lsearcher.current_cost_,
+                        std::abs(lsearcher.current_cost_ - refcost) > 1e-6 * refcost ? " (differs from 1 thread)": "");
+            if(nt == maxnt) break;
+        }
+    }
+}
+
 int main(int argc, char **argv) {
+    if(argc == 4 && std::string(argv[1]) == "-T") {
+        blaze::DynamicMatrix<float> dm;
+        {
+            blaze::Archive<std::ifstream> ifs(argv[2]);
+            ifs >> dm;
+        }
+        const int k = std::atoi(argv[3]);
+        if(k <= 0) throw std::runtime_error("k must be > 0");
+        bench_thread_scaling(dm, k);
+        return 0;
+    }
     std::vector<unsigned> coreset_sizes{
         50, 75, 100, 125, 250, 375, 500, 625, 1250, 1875, 2500, 3125, 3750, 5000
     };
@@ -0,0 +1,97 @@
+#include "minicore/dist.h"
+#include "aesctr/wy.h"
+#include <getopt.h>
+
+using namespace minicore;
+
+int usage() {
+    std::fprintf(stderr, "Usage: benchmark_msrdispatch <flags>\n"
+                         "Times point-center distances with a runtime measure (switch per pair)\n"
+                         "vs a measure dispatched once per loop nest, for each measure.\n"
+                         "Flags:\n"
+                         "-r: Number of rows. Default: 20000\n"
+                         "-d: Number of dimensions of generated data. Default: 32\n"
+                         "-k: Number of centers. Default: 32\n"
+                         "-s: Fraction of nonzeros; if < 1, rows and centers are sparse. Default: 1\n"
+                         "-P: Prior. Default: 1\n"
+                         "-n: Number of repetitions per configuration. Default: 3\n"
+                         "-h: Emit usage and exit.\n");
+    return EXIT_FAILURE;
+}
+
+template<typename F>
+double time_ms(F &&f, int nreps) {
+    double best = std::numeric_limits<double>::max();
+    for(int i = 0; i < nreps; ++i) {
+        auto start = util::hrc::now();
+        f();
+        best = std::min(best, util::timediff2ms(start, util::hrc::now()));
+    }
+    return best;
+}
+
+template<typename MT, typename CtrT>
+void run(const MT &mat, const std::vector<CtrT> &ctrs, double pv, int nreps) {
+    const size_t nr = mat.rows(), k = ctrs.size();
+    const blz::DV<double, blz::rowVector> prior{pv};
+    const double psum = pv * mat.columns();
+    const blz::DV<double> rsums = blaze::sum<blaze::rowwise>(mat);
+    const blz::DV<double> csums = blaze::generate(k, [&](auto j) {return blz::sum(ctrs[j]);});
+    const double ndists = double(nr) * k;
+    std::fprintf(stdout, "#measure\truntime_ns_per_dist\tdispatched_ns_per_dist\tspeedup\n");
+    for(const auto msr: {dist::L1, dist::L2, dist::SQRL2, dist::HELLINGER, dist::BHATTACHARYYA_METRIC, dist::BHATTACHARYYA_DISTANCE,
+                         dist::TVD, dist::COSINE_DISTANCE, dist::MKL, dist::REVERSE_MKL, dist::JSD, dist::JSM,
+                         dist::LLR, dist::UWLLR, dist::SRULRT, dist::SRLRT, dist::ITAKURA_SAITO})
+    {
+        double rsum = 0., dsum = 0.;
+        auto loop = [&](auto m) {
+            double s = 0.;
+            for(size_t i = 0; i < nr; ++i)
+                for(size_t j = 0; j < k; ++j)
+                    s += cmp::msr_with_prior<double>(m, row(mat, i, blz::unchecked), ctrs[j], prior, psum, rsums[i], csums[j]);
+            return s;
+        };
+        const double tr = time_ms([&]() {rsum = loop(msr);}, nreps);
+        const double td = time_ms([&]() {dsum = cmp::dispatch_measure(msr, loop);}, nreps);
+        if(std::abs(rsum - dsum) > 1e-6 * std::max(1., std::abs(rsum)))
+            std::fprintf(stderr, "Warning: %s results differ: %0.12g vs %0.12g\n", dist::msr2str(msr), rsum, dsum);
+        std::fprintf(stdout, "%s\t%g\t%g\t%g\n", dist::msr2str(msr), tr * 1e6 / ndists, td * 1e6 / ndists, tr / td);
+    }
+}
+
+int main(int argc, char **argv) {
+    size_t nr = 20000, nd = 32, k = 32;
+    double density = 1., pv = 1.;
+    int nreps = 3;
+    for(int c;(c = getopt(argc, argv, "r:d:k:s:P:n:h?")) >= 0;) {
+        switch(c) {
+            case 'r': nr = std::strtoull(optarg, nullptr, 10); break;
+            case 'd': nd = std::strtoull(optarg, nullptr, 10); break;
+            case 'k': k = std::strtoull(optarg, nullptr, 10); break;
+            case 's': density = std::atof(optarg); break;
+            case 'P': pv = std::atof(optarg); break;
+            case 'n': nreps = std::atoi(optarg); break;
+            case 'h': case '?': default: return usage();
+        }
+    }
+    OMP_ONLY(omp_set_num_threads(1);)
+    blz::DM<double> mat = blaze::generate(nr, nd, [density](auto r, auto c) {
+        wy::WyRand<uint64_t> rng((uint64_t(r) << 32) | c);
+        std::uniform_real_distribution<double> urd;
+        return urd(rng) < density ? urd(rng) * 8.: 0.;
+    });
+    std::fprintf(stderr, "%zu rows, %zu dims, %zu centers, density %g, prior %g\n", nr, nd, k, density, pv);
+    // L1/L2/SQRL2 timings depend on which kernel variant runs on this host
+    std::fprintf(stderr, "Host ISA: %s. Dense L1/L2/SQRL2 kernels: %s\n", util::isa2str(util::cpu_isa()),
+                 MINOCORE_MULTIVERSION_ENABLED ? "multiversioned (widest supported variant)": "compiled for the build target");
+    if(density < 1.) {
+        const blz::CompressedMatrix<double> smat = mat;
+        std::vector<blz::CompressedVector<double, blz::rowVector>> ctrs;
+        for(size_t j = 0; j < k; ++j) ctrs.emplace_back(row(smat, (j * 7919) % nr));
+        run(smat, ctrs, pv, nreps);
+    } else {
+        std::vector<blz::DV<double, blz::rowVector>> ctrs;
+        for(size_t j = 0; j < k; ++j) ctrs.emplace_back(row(mat, (j * 7919) % nr));
+        run(mat, ctrs, pv, nreps);
+    }
+}
@@ -20,20 +20,14 @@ using namespace boost;
 
 
 template<typename Graph, typename ICon, typename FCon, typename IT, typename RetCon, typename CSWT>
-void calculate_distortion_centerset(Graph &x, const ICon &indices, FCon &costbuffer,
+void calculate_distortion_centerset(const Graph &x, const ICon &indices, FCon &costbuffer,
                              const std::vector<coresets::IndexCoreset<IT, CSWT>> &coresets,
                              RetCon &ret, double z)
 {
     assert(ret.size() == coresets.size());
     const size_t nv = boost::num_vertices(x);
     const size_t ncs = coresets.size();
-    {
-        util::ScopedSyntheticVertex<Graph> vx(x);
-        auto synthetic_vertex = vx.get();
-        for(auto idx: indices)
-            boost::add_edge(synthetic_vertex, idx, 0., x);
-        boost::dijkstra_shortest_paths(x, synthetic_vertex, distance_map(&costbuffer[0]));
-    }
+    multi_source_dijkstra(x, indices, &costbuffer[0]);
     if(z != 1.) costbuffer = pow(costbuffer, z);
     double fullcost = 0.;
     OMP_PRAGMA("omp parallel for reduction(+:fullcost)")
@@ -173,7 +173,7 @@ void emit_coreset_optimization_runtime(Samp &sampler, unsigned k, double z, Grap
 
 
 template<typename Graph, typename ICon, typename FCon, typename IT, typename RetCon, typename CSWT>
-void calculate_distortion_centerset(Graph &x, const ICon &indices, FCon &costbuffer,
+void calculate_distortion_centerset(const Graph &x, const ICon &indices, FCon &costbuffer,
                              const std::vector<coresets::IndexCoreset<IT, CSWT>> &coresets,
                              RetCon &ret, double z,
                              const std::vector<typename boost::graph_traits<Graph>::vertex_descriptor> *
@@ -182,14 +182,7 @@ void calculate_distortion_centerset(Graph &x, const ICon &indices, FCon &costbuf
     assert(ret.size() == coresets.size());
     const size_t nv = boost::num_vertices(x);
     const size_t ncs = coresets.size();
-    {
-        util::ScopedSyntheticVertex<Graph> vx(x);
-        auto synthetic_vertex = vx.get();
-        for(auto idx: indices) {
-            boost::add_edge(synthetic_vertex, idx, 0., x);
-        }
-        boost::dijkstra_shortest_paths(x, synthetic_vertex, distance_map(&costbuffer[0]));
-    }
+    multi_source_dijkstra(x, indices, &costbuffer[0]);
     if(z != 1.) costbuffer = pow(costbuffer, z);
     double fullcost = 0.;
     if(bbox_vertices_ptr) {
@@ -771,12 +764,7 @@ int main(int argc, char **argv) {
 #endif
             blaze::DynamicVector<double> distbuffer(boost::num_vertices(g));
             blaze::DynamicVector<double> currentdistortion(coresets.size());
-#ifdef _OPENMP
-            decltype(g) gcopy(g);
-#else
-            auto &gcopy(g);
-#endif
-            calculate_distortion_centerset(gcopy, random_centers, distbuffer, coresets, currentdistortion, z, bbox_vertices_ptr);
+            calculate_distortion_centerset(g, random_centers, distbuffer, coresets, currentdistortion, z, bbox_vertices_ptr);
             OMP_CRITICAL
             {
                 maxdistortion = blaze::serial(max(maxdistortion, currentdistortion));
@@ -844,8 +832,7 @@ int main(int argc, char **argv) {
                 auto random_centers = generate_random_centers(i + seed + coreset_testing_num_iters, k, x_size, bbox_vertices_ptr);
                 blaze::DynamicVector<double> distbuffer(boost::num_vertices(g));
                 blaze::DynamicVector<double> currentdistortion(coresets.size());
-                OMP_ELSE(decltype(g), auto &) gcopy(g);
-                calculate_distortion_centerset(gcopy, random_centers, distbuffer, coresets, currentdistortion, z, bbox_vertices_ptr);
+                calculate_distortion_centerset(g, random_centers, distbuffer, coresets, currentdistortion, z, bbox_vertices_ptr);
                 OMP_CRITICAL
                 {
                     maxdistortion = blaze::serial(max(maxdistortion, currentdistortion));
@@ -0,0 +1,56 @@
+#undef NDEBUG
+#include "include/minicore/clustering/accumulate.h"
+
+using namespace minicore;
+
+// Checks lock-free centroid accumulation against serial sums on a skewed assignment
+int main(int argc, char *argv[]) {
+    const size_t nr = argc > 1 ? std::atoi(argv[1]): 5000, nc = 30, k = 9;
+    blz::DM<double> x = blaze::generate(nr, nc, [](auto r, auto c) {
+        wy::WyRand<uint64_t> mt((uint64_t(r) << 32) | c);
+        return (mt() % 4 == 0) * std::uniform_real_distribution<double>()(mt);
+    });
+    std::vector<uint32_t> asn(nr);
+    for(size_t i = 0; i < nr; ++i) asn[i] = (i % 13 < 10 ? 0: i % (k - 1)); // Center k - 1 is empty
+    auto getw = [](size_t i) {return 1. + (i % 3);};
+    auto gets = [](size_t i) {return 1. / (1. + (i % 5));};
+    blz::DM<double> expected(k, nc, 0.);
+    blz::DV<double> ecounts(k, 0.);
+    for(size_t i = 0; i < nr; ++i) {
+        row(expected, asn[i]) += row(x, i) * (getw(i) * gets(i));
+        ecounts[asn[i]] += getw(i);
+    }
+    auto check = [&](const auto &mat, int nchunks) {
+        blz::DM<double> ctrs(k, nc, -1.);
+        std::vector<blz::DV<double, blz::rowVector>> vctrs(k, blz::DV<double, blz::rowVector>(nc, -1.));
+        blz::DV<double> counts(k);
+        clustering::accumulate_centroids(mat, asn, ctrs, counts, getw, gets, nchunks);
+        assert(blz::max(blz::abs(counts - ecounts)) == 0.);
+        assert(blz::max(blz::abs(submatrix(ctrs, 0, 0, k - 1, nc) - submatrix(expected, 0, 0, k - 1, nc))) < 1e-9);
+        assert(blz::min(row(ctrs, k - 1)) == -1.); // Empty centers are left unchanged
+        clustering::accumulate_centroids(mat, asn, vctrs, counts, getw, gets, nchunks);
+        for(size_t j = 0; j < k - 1; ++j)
+            assert(blz::max(blz::abs(vctrs[j] - row(expected, j))) < 1e-9);
+        // Counting-sort fallback for large k * d; center 0 is large enough to be split into slices
+        blz::DM<double> gctrs(k, nc, -1.);
+        blz::DV<double> gcounts(k, -1.);
+        clustering::accumulate_centroids_grouped(mat, asn, gctrs, gcounts, getw, gets);
+        assert(blz::max(blz::abs(gcounts - ecounts)) < 1e-9);
+        assert(blz::max(blz::abs(submatrix(gctrs, 0, 0, k - 1, nc) - submatrix(expected, 0, 0, k - 1, nc))) < 1e-9);
+        assert(blz::min(row(gctrs, k - 1)) == -1.);
+    };
+    blz::SM<double> sx(x);
+    std::vector<double> data;
+    std::vector<uint32_t> indices;
+    std::vector<uint64_t> indptr{0};
+    for(size_t i = 0; i < nr; ++i) {
+        for(const auto &pair: row(sx, i)) data.push_back(pair.value()), indices.push_back(pair.index());
+        indptr.push_back(data.size());
+    }
+    util::CSparseMatrix<double, uint32_t, uint64_t> cx(data.data(), indices.data(), indptr.data(), nr, nc, data.size());
+    for(const int nchunks: {-1, 1, 3, 7, 64}) {
+        check(x, nchunks);
+        check(sx, nchunks);
+        check(cx, nchunks);
+    }
+}
@@ -0,0 +1,54 @@
+#undef NDEBUG
+#include "include/minicore/dist.h"
+
+using namespace minicore;
+
+// Checks batched (GEMM) assignment against per-pair distances, for dense and sparse data
+template<typename Mat>
+void check(const Mat &x, const std::vector<blz::DV<double, blz::rowVector>> &centers) {
+    const size_t nr = x.rows(), k = centers.size();
+    blz::DV<double> prior{.1};
+    for(const auto msr: {dist::SQRL2, dist::L2, dist::COSINE_DISTANCE, dist::DOT_PRODUCT_SIMILARITY}) {
+        blz::DV<uint32_t> asn(nr);
+        blz::DV<double> costs(nr);
+        dist::assign_points_batched<double>(x, msr, prior, centers, asn, costs);
+        const double psum = prior[0] * x.columns();
+        for(size_t i = 0; i < nr; ++i) {
+            auto r = row(x, i);
+            const double rs = sum(r);
+            if(msr == dist::DOT_PRODUCT_SIMILARITY) {
+                double best = -std::numeric_limits<double>::max();
+                for(size_t j = 0; j < k; ++j) best = std::max(best, double(dot(r, trans(centers[j]))));
+                assert(std::abs(best - costs[i]) <= 1e-8 * std::max(1., std::abs(best)));
+                continue;
+            }
+            double best = std::numeric_limits<double>::max();
+            for(size_t j = 0; j < k; ++j)
+                best = std::min(best, double(cmp::msr_with_prior<double>(msr, r, centers[j], prior, psum, rs, sum(centers[j]))));
+            const double got = cmp::msr_with_prior<double>(msr, r, centers[asn[i]], prior, psum, rs, sum(centers[asn[i]]));
+            assert(std::abs(got - best) <= 1e-6 * std::max(1., best) || !std::fprintf(stderr, "%s: %g vs %g\n", dist::msr2str(msr), got, best));
+            assert(std::abs(costs[i] - best) <= 1e-6 * std::max(1., best));
+        }
+    }
+}
+
+int main(int argc, char *argv[]) {
+    const size_t nr = argc > 1 ? std::atoi(argv[1]): 1000, nc = 40;
+    const unsigned k = argc > 2 ? std::atoi(argv[2]): 13;
+    blz::DM<double> x = blaze::generate(nr, nc, [](auto r, auto c) {
+        wy::WyRand<uint64_t> mt((uint64_t(r) << 32) | c);
+        return (mt() % 3 == 0) * std::uniform_real_distribution<double>()(mt) * (1 + r % 5);
+    });
+    std::vector<blz::DV<double, blz::rowVector>> centers;
+    for(unsigned i = 0; i < k; ++i) centers.emplace_back(row(x, (i * 7919) % nr));
+    check(x, centers);
+    blz::SM<double> sx(x);
+    check(sx, centers);
+    // Tile sizes that don't divide the number of rows
+    blz::DV<uint32_t> a1(nr), a2(nr);
+    blz::DV<double> c1(nr), c2(nr);
+    blz::DV<double> noprior;
+    dist::assign_points_batched<double>(x, dist::SQRL2, noprior, centers, a1, c1, 7);
+    dist::assign_points_batched<double>(sx, dist::SQRL2, noprior, centers, a2, c2, 1000000);
+    assert(blz::max(blz::abs(c1 - c2)) <= 1e-8);
+}
@@ -0,0 +1,37 @@
+#undef NDEBUG
+#include "include/minicore/clustering/solve.h"
+
+namespace clust = minicore::clustering;
+using namespace minicore;
+
+// Checks that bounds-pruned assignment matches brute force over several Lloyd iterations
+int main(int argc, char *argv[]) {
+    const size_t nr = argc > 1 ? std::atoi(argv[1]): 2000, nc = 50;
+    const unsigned k = argc > 2 ? std::atoi(argv[2]): 25;
+    blz::DM<double> x = blaze::generate(nr, nc, [](auto r, auto c) {
+        wy::WyRand<uint64_t> mt((uint64_t(r) << 32) | c);
+        return std::uniform_real_distribution<double>()(mt) + (r % 7) * (c % 3);
+    });
+    blz::DV<double> prior{1.};
+    const blz::DV<double> rowsums = blaze::sum<blaze::rowwise>(x);
+    for(const auto msr: {dist::L1, dist::L2, dist::JSM, dist::HELLINGER, dist::TVD}) {
+        std::vector<blz::DV<double, blz::rowVector>> centers;
+        for(unsigned i = 0; i < k; ++i) centers.emplace_back(row(x, (i * 7919) % nr));
+        blz::DV<double> ctrsums = blaze::generate(k, [&](auto j) {return sum(centers[j]);});
+        blz::DV<uint32_t> asn(nr), basn(nr);
+        blz::DV<double> costs(nr), bcosts(nr);
+        clust::HamerlyAssigner<double, blz::DV<double, blz::rowVector>> bounds;
+        for(int iter = 0; iter < 5; ++iter) {
+            bounds.assign(x, msr, prior, centers, asn, costs, ctrsums, rowsums);
+            clust::assign_points_hard<double>(x, msr, prior, centers, basn, bcosts, static_cast<blz::DV<double> *>(nullptr), ctrsums, rowsums);
+            for(size_t i = 0; i < nr; ++i) {
+                assert(std::abs(costs[i] - bcosts[i]) <= 1e-6 * std::max(1., bcosts[i]));
+                assert(asn[i] == basn[i] || std::abs(costs[i] - bcosts[i]) <= 1e-10);
+            }
+            clust::set_centroids_hard<double>(x, msr, prior, centers, asn, costs, static_cast<blz::DV<double> *>(nullptr), ctrsums, rowsums);
+        }
+        const auto &stats = bounds.stats();
+        std::fprintf(stderr, "%s: %zu evaluated, %zu skipped\n", dist::msr2str(msr), size_t(stats.nevaluated_), size_t(stats.nskipped_));
+        assert(stats.nskipped_ > 0);
+    }
+}
@@ -0,0 +1,68 @@
+#undef NDEBUG
+#include "include/minicore/clustering/solve.h"
+#include "src/tests/solvetestdata.cpp"
+
+namespace clust = minicore::clustering;
+using namespace minicore;
+
+// Checks that grouped Bregman filtering matches brute-force assignment on the solve test fixture
+int main(int argc, char *argv[]) {
+    const unsigned k = argc > 1 ? std::atoi(argv[1]): 25;
+    const blz::DM<double> xd = x;
+    const size_t nr = xd.rows();
+    const blz::DV<double> rowsums = blaze::sum<blaze::rowwise>(xd);
+    for(const double pv: {1., 0.1}) {
+        blz::DV<double> prior{pv};
+        const double prior_sum = pv * xd.columns();
+        for(const auto msr: {dist::JSD, dist::MKL, dist::REVERSE_MKL, dist::BHATTACHARYYA_DISTANCE, dist::ITAKURA_SAITO}) {
+            std::vector<blz::DV<double, blz::rowVector>> centers;
+            for(unsigned i = 0; i < k; ++i) centers.emplace_back(row(xd, (i * 7919) % nr));
+            blz::DV<double> ctrsums = blaze::generate(k, [&](auto j) {return sum(centers[j]);});
+            blz::DV<uint32_t> asn(nr, 0u), basn(nr);
+            blz::DV<double> costs(nr), bcosts(nr);
+            clust::BregmanFilterAssigner<double, blz::DV<double, blz::rowVector>> filter;
+            for(int iter = 0; iter < 3; ++iter) {
+                filter.assign(xd, msr, prior, centers, asn, costs, ctrsums, rowsums);
+                for(size_t i = 0; i < nr; ++i) {
+                    double best = std::numeric_limits<double>::max();
+                    for(unsigned j = 0; j < k; ++j) {
+                        if(const double c = cmp::msr_with_prior<double>(msr, row(xd, i), centers[j], prior, prior_sum, rowsums[i], ctrsums[j]); c < best)
+                            best = c, basn[i] = j;
+                    }
+                    bcosts[i] = best;
+                }
+                assert(asn == basn);
+                assert(costs == bcosts);
+                // Unchanged centers reuse the cached center-center distances
+                blz::DV<uint32_t> rasn(nr, 0u);
+                blz::DV<double> rcosts(nr);
+                filter.assign(xd, msr, prior, centers, rasn, rcosts, ctrsums, rowsums);
+                assert(rasn == basn);
+                assert(rcosts == bcosts);
+                // Move centers to their means so the next call starts from stale anchors
+                for(unsigned j = 0; j < k; ++j) {
+                    blz::DV<double, blz::rowVector> s(xd.columns(), 0.);
+                    size_t n = 0;
+                    for(size_t i = 0; i < nr; ++i) if(asn[i] == j) s += row(xd, i), ++n;
+                    if(n) centers[j] = s / n, ctrsums[j] = sum(centers[j]);
+                }
+            }
+            const auto &st = filter.stats();
+            std::fprintf(stderr, "%s, prior %g: %zu evaluated, %zu skipped (%0.4g%%)\n", dist::msr2str(msr), pv,
+                         size_t(st.nevaluated_), size_t(st.nskipped_), st.skip_fraction() * 100.);
+            // The Itakura-Saito bound is loose, so it is only required to be exact
+            assert(st.nskipped_ > 0 || msr == dist::ITAKURA_SAITO);
+        }
+    }
+    // assign_points_hard dispatches to the filter and must agree with it
+    blz::DV<double> prior{1.};
+    std::vector<blz::DV<double, blz::rowVector>> centers;
+    for(unsigned i = 0; i < k; ++i) centers.emplace_back(row(xd, (i * 7919) % nr));
+    blz::DV<double> ctrsums = blaze::generate(k, [&](auto j) {return sum(centers[j]);});
+    blz::DV<uint32_t> asn(nr, 0u), fasn(nr, 0u);
+    blz::DV<double> costs(nr), fcosts(nr);
+    clust::assign_points_hard<double>(xd, dist::JSD, prior, centers, asn, costs, static_cast<blz::DV<double> *>(nullptr), ctrsums, rowsums);
+    clust::BregmanFilterAssigner<double, blz::DV<double, blz::rowVector>>().assign(xd, dist::JSD, prior, centers, fasn, fcosts, ctrsums, rowsums);
+    assert(asn == fasn);
+    assert(costs == fcosts);
+}
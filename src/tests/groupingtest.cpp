@@ -0,0 +1,31 @@
+#undef NDEBUG
+#include "include/minicore/clustering/grouping.h"
+
+using namespace minicore;
+
+// Checks parallel counting-sort grouping against per-center buckets
+int main(int argc, char *argv[]) {
+    const size_t n = argc > 1 ? std::atoi(argv[1]): 100000, k = argc > 2 ? std::atoi(argv[2]): 37;
+    std::vector<uint32_t> asn(n);
+    wy::WyRand<uint64_t> rng(13);
+    for(auto &a: asn) a = (rng() % 4 ? 0: rng() % (k - 1)); // Skewed, and center k - 1 is empty
+    std::vector<std::vector<uint32_t>> buckets(k);
+    for(size_t i = 0; i < n; ++i) buckets[asn[i]].push_back(i);
+    auto g = clustering::group_by_assignment(asn, n, k);
+    assert(g.ncenters() == k);
+    assert(g.empty(k - 1));
+    for(size_t j = 0; j < k; ++j) {
+        assert(g.size(j) == buckets[j].size());
+        assert(std::equal(g[j].begin(), g[j].end(), buckets[j].begin()));
+    }
+    // Subsets with explicit ids, as used for minibatches
+    std::vector<uint64_t> ids(n / 3);
+    for(size_t i = 0; i < ids.size(); ++i) ids[i] = 3 * i + 1;
+    clustering::AssignmentGrouping<uint64_t> sg;
+    sg.build(ids.size(), k, [&](size_t i) {return asn[ids[i]];}, [&](size_t i) {return ids[i];});
+    for(size_t j = 0; j < k; ++j) {
+        assert(std::is_sorted(sg[j].begin(), sg[j].end()));
+        for(const auto id: sg[j]) assert(asn[id] == j && id % 3 == 1);
+    }
+    assert(sg.offsets_.back() == ids.size());
+}
@@ -0,0 +1,85 @@
+#undef NDEBUG
+#include "minicore/optim/jv_solver.h"
+
+using namespace minicore;
+
+// Checks the event queue, the primal-dual invariants and phase-2 independent set of the accelerated JV run,
+// and that performance-mode kmedian opens exactly k facilities
+int main(int argc, char *argv[]) {
+    const size_t nf = argc > 1 ? std::atoi(argv[1]): 80;
+    const size_t nc = argc > 2 ? std::atoi(argv[2]): 400;
+    const unsigned k = argc > 3 ? std::atoi(argv[3]): 8;
+    wy::WyRand<uint64_t> rng(7);
+    std::uniform_real_distribution<double> urd;
+    {
+        jv::fast::RadixEventQueue<uint32_t> q;
+        double last = 0.;
+        for(uint32_t i = 0; i < 10000; ++i) {
+            q.push(last + urd(rng) * 10., i);
+            if(i % 3 == 2) {
+                for(int j = 0; j < 2; ++j) {
+                    const double t = q.pop().first;
+                    assert(t >= last);
+                    last = t;
+                }
+            }
+        }
+        while(!q.empty()) {
+            const double t = q.pop().first;
+            assert(t >= last);
+            last = t;
+        }
+    }
+    blaze::DynamicMatrix<double> fpts(nf, 2), cpts(nc, 2);
+    for(size_t i = 0; i < nf; ++i) fpts(i, 0) = urd(rng), fpts(i, 1) = urd(rng);
+    for(size_t i = 0; i < nc; ++i) cpts(i, 0) = urd(rng), cpts(i, 1) = urd(rng);
+    blaze::DynamicMatrix<float> dm(nf, nc);
+    for(size_t i = 0; i < nf; ++i)
+        for(size_t j = 0; j < nc; ++j)
+            dm(i, j) = blaze::l2Norm(row(fpts, i) - row(cpts, j));
+    using MT = blaze::DynamicMatrix<float>;
+    jv::fast::ClientEdgeStreams<float> full, short_prefix;
+    full.setup(dm, nf);
+    short_prefix.setup(dm, 1);
+    for(const double z: {0., .05, .5, 3.}) {
+        jv::fast::FacilityLocationRun<MT, float> run(dm, full), lazy(dm, short_prefix);
+        const auto sol = run.run(z);
+        assert(lazy.run(z, false) == sol);
+        assert(run.nactive_ == 0);
+        // Dual feasibility: no facility is paid more than z
+        for(size_t i = 0; i < nf; ++i) {
+            double paid = 0.;
+            for(size_t j = 0; j < nc; ++j) paid += std::max(0., run.alpha_[j] - dm(i, j));
+            assert(paid <= z * (1. + 1e-6) + 1e-6 || !std::fprintf(stderr, "facility %zu paid %g > %g\n", i, paid, z));
+        }
+        // Every client is frozen by a temporarily open facility it can reach
+        for(size_t j = 0; j < nc; ++j) {
+            const auto w = run.witness_[j];
+            assert(run.open_time_[w] != run.NOT_OPEN);
+            assert(run.alpha_[j] >= dm(w, j) - 1e-6);
+        }
+        // Phase 2 matches the sequential greedy independent set in order of opening
+        std::vector<uint32_t> greedy;
+        auto conflict = [&](uint32_t f, uint32_t g) {
+            for(size_t j = 0; j < nc; ++j)
+                if(run.alpha_[j] > dm(f, j) && run.alpha_[j] > dm(g, j)) return true;
+            return false;
+        };
+        for(const auto f: run.opened_)
+            if(std::none_of(greedy.begin(), greedy.end(), [&](auto g) {return conflict(f, g);}))
+                greedy.push_back(f);
+        assert(sol == greedy);
+        std::fprintf(stderr, "z = %g: %zu temporarily open, %zu open, %zu events\n", z, run.opened_.size(), sol.size(), run.nevents_);
+    }
+    jv::JVSolver<MT, float, uint32_t> classic(dm), fastsolver(dm);
+    fastsolver.set_performance_mode();
+    auto [cfac, casn] = classic.kmedian(k, 100);
+    auto [ffac, fasn] = fastsolver.kmedian(k, 100);
+    assert(ffac.size() == k);
+    size_t nassigned = 0;
+    for(const auto &a: fasn) nassigned += a.size();
+    assert(nassigned == nc);
+    const double ccost = classic.calculate_cost(false), fcost = fastsolver.calculate_cost(false);
+    std::fprintf(stderr, "classic cost: %g. performance mode cost: %g\n", ccost, fcost);
+    assert(fcost <= 2. * ccost);
+}
@@ -0,0 +1,39 @@
+#undef NDEBUG
+#include "include/minicore/optim/kmeans.h"
+#include <set>
+
+using namespace minicore;
+
+// Checks kmeans|| seeding: distinct centers, nearest-center assignments, and cost comparable to kmeans++
+int main(int argc, char *argv[]) {
+    const size_t nr = argc > 1 ? std::atoi(argv[1]): 10000, nc = 20;
+    const size_t k = argc > 2 ? std::atoi(argv[2]): 40;
+    blz::DM<double> x = blaze::generate(nr, nc, [](auto r, auto c) {
+        wy::WyRand<uint64_t> mt((uint64_t(r) << 32) | c), cmt(((r % 40) << 16) | c);
+        return std::normal_distribution<double>()(mt) + 100. * std::uniform_real_distribution<double>()(cmt);
+    });
+    auto rowit = blz::rowiterator(x);
+    auto oracle = [&](size_t i, size_t j) {return blz::sqrDist(row(x, i), row(x, j));};
+    wy::WyRand<uint64_t> rng(13);
+    auto [ctrs, asn, costs] = coresets::kmeans_parallel(oracle, rng, nr, k);
+    assert(ctrs.size() == k);
+    assert(std::set<uint32_t>(ctrs.begin(), ctrs.end()).size() == k);
+    for(size_t i = 0; i < nr; ++i) {
+        double best = std::numeric_limits<double>::max();
+        for(const auto c: ctrs) best = std::min(best, oracle(c, i));
+        assert(std::abs(costs[i] - best) <= 1e-10 * std::max(1., best));
+        assert(costs[i] == oracle(ctrs[asn[i]], i) || ctrs[asn[i]] == i);
+    }
+    const double cost = std::accumulate(costs.begin(), costs.end(), 0.);
+    wy::WyRand<uint64_t> krng(13);
+    auto [kctrs, kasn, kcosts] = coresets::kmeanspp(rowit.begin(), rowit.end(), krng, k);
+    const double kcost = std::accumulate(kcosts.begin(), kcosts.end(), 0.);
+    std::fprintf(stderr, "kmeans|| cost: %g. kmeans++ cost: %g\n", cost, kcost);
+    assert(cost <= 4. * kcost);
+    // Weighted, with a fixed number of rounds and a tiny k
+    std::vector<double> w(nr);
+    for(size_t i = 0; i < nr; ++i) w[i] = 1. + (i % 5);
+    auto [wctrs, wasn, wcosts] = coresets::kmeans_parallel(rowit.begin(), rowit.end(), rng, 3, blz::sqrL2Norm(), w.data(), 4., 3);
+    assert(wctrs.size() == 3);
+    assert(wasn.size() == nr && wcosts.size() == nr);
+}
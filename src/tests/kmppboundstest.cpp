@@ -0,0 +1,35 @@
+#undef NDEBUG
+#include "include/minicore/optim/kmeans.h"
+
+using namespace minicore;
+
+// Checks that triangle-inequality bounded kmeans++ selects the same centers as the unbounded scan
+template<typename Norm>
+void check(const blz::DM<double> &x, size_t k, const Norm &norm, coresets::SeedingBounds bounds) {
+    const size_t nr = x.rows();
+    wy::WyRand<uint64_t> rng(13), brng(13);
+    coresets::SeedingStats stats, bstats;
+    auto [ctrs, asn, costs] = coresets::kmeanspp(x, rng, k, norm, true, (double *)nullptr, 0, false, true, 1, coresets::NO_BOUNDS, &stats);
+    auto [bctrs, basn, bcosts] = coresets::kmeanspp(x, brng, k, norm, true, (double *)nullptr, 0, false, true, 1, bounds, &bstats);
+    assert(ctrs == bctrs);
+    for(size_t i = 0; i < nr; ++i) {
+        assert(costs[i] == bcosts[i]);
+        assert(asn[i] == basn[i]);
+    }
+    assert(stats.nsaved == 0);
+    assert(bstats.nsaved > 0);
+    assert(bstats.nevals < stats.nevals);
+    std::fprintf(stderr, "Saved %zu/%zu distance computations, skipping %zu clusters\n", bstats.nsaved, stats.nevals, bstats.nclusters_skipped);
+}
+
+int main(int argc, char *argv[]) {
+    const size_t nr = argc > 1 ? std::atoi(argv[1]): 5000, nc = 20;
+    const size_t k = argc > 2 ? std::atoi(argv[2]): 50;
+    // Well-separated blobs, so that both the per-point and the per-cluster bounds apply
+    blz::DM<double> x = blaze::generate(nr, nc, [](auto r, auto c) {
+        wy::WyRand<uint64_t> mt((uint64_t(r) << 32) | c), cmt(((r % 40) << 16) | c);
+        return std::normal_distribution<double>()(mt) + 100. * std::uniform_real_distribution<double>()(cmt);
+    });
+    check(x, k, blz::L2Norm(), coresets::METRIC_BOUNDS);
+    check(x, k, blz::sqrL2Norm(), coresets::SQUARED_METRIC_BOUNDS);
+}
@@ -1,6 +1,35 @@
+#undef NDEBUG
 #include "include/minicore/dist/knngraph.h"
 using namespace minicore;
 
+// Compares tiled kNN against brute force: same k-th distance, sorted rows, no self-edges or duplicates
+template<typename MT>
+void check_knns(MT &mat, distance::DissimilarityMeasure msr, unsigned k, size_t tilesize) {
+    auto app = minicore::jsd::make_probdiv_applicator(mat, msr, distance::DIRICHLET);
+    const size_t np = app.size();
+    const bool isdist = distance::is_dissimilarity(msr);
+    auto knns = minicore::make_knns(app, k, tilesize);
+    assert(knns.size() == np * k);
+    std::vector<float> dists(np - 1);
+    for(size_t i = 0; i < np; ++i) {
+        dists.clear();
+        for(size_t j = 0; j < np; ++j)
+            if(j != i) dists.push_back(app(i, j));
+        if(isdist) std::nth_element(dists.begin(), dists.begin() + (k - 1), dists.end());
+        else       std::nth_element(dists.begin(), dists.begin() + (k - 1), dists.end(), std::greater<>());
+        const float kth = dists[k - 1];
+        auto p = &knns[i * k];
+        std::set<uint32_t> seen;
+        for(unsigned j = 0; j < k; ++j) {
+            assert(p[j].second != i);
+            assert(seen.insert(p[j].second).second);
+            assert(j == 0 || (isdist ? p[j - 1].first <= p[j].first: p[j - 1].first >= p[j].first));
+        }
+        assert(std::abs(p[k - 1].first - kth) <= 1e-4 * std::max(1.f, std::abs(kth))
+               || !std::fprintf(stderr, "%s, row %zu: k-th neighbor %g vs brute force %g\n", distance::msr2str(msr), i, p[k - 1].first, kth));
+    }
+}
+
 int main() {
     blaze::DynamicMatrix<float> mat = blaze::generate(1000, 50, [](auto x, auto y) {
         return float(std::rand()) / RAND_MAX + (x * y) / 1000. / 50.;
@@ -10,4 +39,15 @@ int main() {
     auto graph = minicore::knns2graph(knns, app.size(), true);
     auto mst = minicore::knng2mst(graph);
     std::fprintf(stderr, "mst size: %zu edges vs %zu nodes\n", mst.size(), app.size());
+    blaze::DynamicMatrix<float> small = submatrix(mat, 0, 0, 301, mat.columns());
+    blaze::CompressedMatrix<float> ssmall = small;
+    for(const auto msr: {distance::L1, distance::L2, distance::SQRL2, distance::JSD, distance::MKL, distance::COSINE_SIMILARITY}) {
+        for(const size_t tilesize: {size_t(16), size_t(37), size_t(1000)}) {
+            blaze::DynamicMatrix<float> dcpy = small;
+            blaze::CompressedMatrix<float> scpy = ssmall;
+            check_knns(dcpy, msr, 7, tilesize);
+            check_knns(scpy, msr, 7, tilesize);
+        }
+        std::fprintf(stderr, "%s matches brute force\n", distance::msr2str(msr));
+    }
 }
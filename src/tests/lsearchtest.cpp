@@ -0,0 +1,73 @@
+#undef NDEBUG
+#include "minicore/optim/lsearch.h"
+#include "minicore/util/timer.h"
+
+using namespace minicore;
+
+// Fast-swap profits match full re-evaluation, and the search ends at a single-swap local optimum.
+// Parallel batched scoring follows the same swap sequence as a serial scan.
+int main(int argc, char *argv[]) {
+    const size_t n = argc > 1 ? std::atoi(argv[1]): 400;
+    const unsigned k = argc > 2 ? std::atoi(argv[2]): 12;
+    wy::WyRand<uint64_t> rng(13);
+    std::uniform_real_distribution<double> urd;
+    blaze::DynamicMatrix<double> pts(n, 2);
+    for(size_t i = 0; i < n; ++i) pts(i, 0) = urd(rng), pts(i, 1) = urd(rng);
+    blaze::DynamicMatrix<float> dm(n, n);
+    for(size_t i = 0; i < n; ++i)
+        for(size_t j = 0; j < n; ++j)
+            dm(i, j) = blaze::l2Norm(row(pts, i) - row(pts, j));
+    auto lsearcher = make_kmed_lsearcher(dm, k, 1e-6, 7);
+    lsearcher.fast_swap_ = true;
+    lsearcher.assign();
+    lsearcher.fs_init();
+    assert(std::abs(lsearcher.current_cost_ - lsearcher.cost_for_sol(lsearcher.sol_)) <= 1e-3);
+    std::vector<double> extra(k);
+    for(size_t f = 0; f < n; f += 7) {
+        if(lsearcher.sol_.find(f) != lsearcher.sol_.end()) continue;
+        const auto [profit, s] = lsearcher.fs_score(f, extra.data());
+        double best = -std::numeric_limits<double>::max();
+        for(const auto r: lsearcher.sol_)
+            best = std::max(best, lsearcher.evaluate_swap(f, r, true));
+        assert(std::abs(profit - best) <= 1e-3 * std::max(1., std::abs(best)));
+        assert(std::abs(lsearcher.evaluate_swap(f, lsearcher.open_[s], true) - best) <= 1e-3 * std::max(1., std::abs(best)));
+    }
+    util::Timer timer("fast swap");
+    lsearcher.run();
+    timer.report();
+    const double final_cost = lsearcher.current_cost_;
+    assert(std::abs(final_cost - lsearcher.cost_for_sol(lsearcher.sol_)) <= 1e-3 * final_cost);
+    for(size_t f = 0; f < n; ++f) {
+        if(lsearcher.sol_.find(f) != lsearcher.sol_.end()) continue;
+        for(const auto r: lsearcher.sol_)
+            assert(lsearcher.evaluate_swap(f, r, true) <= lsearcher.diffthresh_ + 1e-3);
+    }
+    // The evaluate_swap-based search reaches a local optimum of similar quality
+    auto slow = make_kmed_lsearcher(dm, k, 1e-6, 7);
+    slow.fast_swap_ = false;
+    slow.lazy_eval_ = 0;
+    timer.restart("evaluate_swap search");
+    slow.run();
+    timer.report();
+    std::fprintf(stderr, "fast swap cost: %g. evaluate_swap cost: %g\n", final_cost, slow.current_cost_);
+    assert(final_cost <= 1.1 * slow.current_cost_);
+    // Batch size and thread count do not change the result
+    for(const bool fast: {true, false}) {
+        std::vector<uint32_t> refsol;
+        double refcost = 0.;
+        for(const size_t batch: {size_t(1), size_t(5), size_t(0)}) {
+            auto ls = make_kmed_lsearcher(dm, k, 1e-6, 7);
+            ls.fast_swap_ = fast;
+            ls.lazy_eval_ = 0;
+            ls.swap_batch_ = batch;
+            OMP_ONLY(omp_set_num_threads(batch == 1 ? 1: omp_get_num_procs());)
+            ls.run();
+            std::vector<uint32_t> sol(ls.sol_.begin(), ls.sol_.end());
+            std::sort(sol.begin(), sol.end());
+            if(batch == 1) refsol = sol, refcost = ls.current_cost_;
+            assert(sol == refsol);
+            assert(std::abs(ls.current_cost_ - refcost) <= 1e-9 * refcost);
+            std::fprintf(stderr, "%s, batch %zu: %zu swaps, %zu candidates scored\n", fast ? "fast swap": "evaluate_swap", batch, ls.nswaps_, ls.nscored_);
+        }
+    }
+}
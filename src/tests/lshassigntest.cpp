@@ -0,0 +1,59 @@
+#undef NDEBUG
+#include "include/minicore/clustering/solve.h"
+
+namespace clust = minicore::clustering;
+using namespace minicore;
+
+// LSH-candidate assignment never beats exact assignment, stays close to it, and drives both Lloyd variants
+int main(int argc, char *argv[]) {
+    const size_t nr = argc > 1 ? std::atoi(argv[1]): 5000, nc = 40;
+    const unsigned k = argc > 2 ? std::atoi(argv[2]): 200;
+    // Points scattered around 2k well-separated anchors
+    blz::DM<double> x = blaze::generate(nr, nc, [](auto r, auto c) {
+        wy::WyRand<uint64_t> mt((uint64_t(r) << 32) | c), amt(((r % 400) << 32) | c | (1ull << 63));
+        return std::uniform_real_distribution<double>(0., .1)(mt) + std::uniform_real_distribution<double>(0., 2.)(amt);
+    });
+    blz::DV<double> prior{1.};
+    const blz::DV<double> rowsums = blaze::sum<blaze::rowwise>(x);
+    for(const auto msr: {dist::L1, dist::L2, dist::SQRL2, dist::TVD, dist::JSD, dist::HELLINGER}) {
+        std::vector<blz::DV<double, blz::rowVector>> centers;
+        for(unsigned i = 0; i < k; ++i) centers.emplace_back(row(x, (i * 7919) % nr));
+        blz::DV<double> ctrsums = blaze::generate(k, [&](auto j) {return sum(centers[j]);});
+        blz::DV<uint32_t> asn(nr, uint32_t(-1)), basn(nr);
+        blz::DV<double> costs(nr), bcosts(nr);
+        clust::LSHAssignOpts opts;
+        clust::LSHAssigner<double, blz::DV<double, blz::rowVector>> lsh(opts);
+        for(int iter = 0; iter < 3; ++iter) {
+            lsh.assign(x, msr, prior, centers, asn, costs, ctrsums, rowsums);
+            clust::assign_points_hard<double>(x, msr, prior, centers, basn, bcosts, static_cast<blz::DV<double> *>(nullptr), ctrsums, rowsums);
+            for(size_t i = 0; i < nr; ++i) {
+                assert(asn[i] < k);
+                assert(costs[i] >= bcosts[i] - 1e-8 * std::max(1., bcosts[i]));
+            }
+            std::fprintf(stderr, "%s, iter %d: LSH cost %g, exact %g\n", dist::msr2str(msr), iter, sum(costs), sum(bcosts));
+            assert(sum(costs) <= 1.25 * sum(bcosts));
+            clust::set_centroids_hard<double>(x, msr, prior, centers, asn, costs, static_cast<blz::DV<double> *>(nullptr), ctrsums, rowsums);
+        }
+        const auto &stats = lsh.stats();
+        stats.print(stderr, dist::msr2str(msr));
+        assert(stats.npoints_ == 3 * nr);
+        assert(stats.nevaluated_ < stats.ncompared_);
+        assert(stats.cost_gap() >= -1e-10);
+    }
+    // Both Lloyd variants accept the LSH mode
+    clust::LSHAssignOpts opts;
+    std::vector<blz::DV<double, blz::rowVector>> centers, mbcenters;
+    for(unsigned i = 0; i < k; ++i) centers.emplace_back(row(x, (i * 7919) % nr));
+    mbcenters = centers;
+    blz::DV<uint32_t> asn(nr, uint32_t(-1));
+    blz::DV<double> costs(nr);
+    clust::AssignStats stats;
+    auto [initcost, finalcost, niter] = perform_hard_clustering(x, dist::L2, prior, centers, asn, costs, static_cast<blz::DV<double> *>(nullptr),
+                                                                1e-4, 10, static_cast<blz::DV<double> *>(nullptr), &stats, &opts);
+    assert(finalcost <= initcost);
+    assert(stats.nskipped_ > 0);
+    std::fprintf(stderr, "Lloyd with LSH assignment: %g -> %g in %zu iterations\n", initcost, finalcost, niter);
+    auto mbres = perform_hard_minibatch_clustering(x, dist::L2, prior, mbcenters, asn, costs, static_cast<blz::DV<double> *>(nullptr),
+                                                   500, 50, 10, 1, true, 13, false, &opts);
+    assert(std::get<1>(mbres) <= std::get<0>(mbres));
+}
@@ -0,0 +1,55 @@
+#undef NDEBUG
+#include "minicore/hash.h"
+#include "minicore/util/timer.h"
+using namespace minicore;
+
+// Bulk (CSR) construction must answer queries exactly as per-vector insertion does;
+// multi-probe queries must extend single-probe results
+int main() {
+    unsigned dim = 100, k = 3, l = 8, nsamp = 5000;
+    std::mt19937_64 mt(13);
+    std::normal_distribution<float> gen;
+    blz::DM<float> dm = blz::generate(nsamp, dim, [&](auto, auto) {return std::abs(gen(mt));});
+    for(auto r: rowiterator(dm)) r /= blz::sum(r);
+    hash::LSHasherSettings settings{dim, k, l};
+    const double r = .05;
+    LSHTable<S2JSDLSHasher<float>> bulk(settings, r), incremental(settings, r), halves(settings, r);
+    auto t = util::hrc::now();
+    bulk.add(dm);
+    std::fprintf(stderr, "Bulk add: %gms, %zu bytes\n", util::timediff2ms(t, util::hrc::now()), bulk.bytes());
+    t = util::hrc::now();
+    for(size_t i = 0; i < nsamp; ++i)
+        incremental.add(row(dm, i), i);
+    std::fprintf(stderr, "Per-vector add: %gms, %zu bytes\n", util::timediff2ms(t, util::hrc::now()), incremental.bytes());
+    halves.add(submatrix(dm, 0, 0, nsamp / 2, dim));
+    halves.add(submatrix(dm, nsamp / 2, 0, nsamp - nsamp / 2, dim), nsamp / 2);
+    assert(bulk.size() == nsamp && incremental.size() == nsamp && halves.size() == nsamp);
+    assert(bulk.bytes() < incremental.bytes());
+    auto qb = bulk.query(dm), qi = incremental.query(dm), qh = halves.query(dm);
+    for(size_t i = 0; i < nsamp; ++i) {
+        assert(qb[i].size() == qi[i].size() && qb[i].size() == qh[i].size());
+        assert(qb[i].at(i) == l);
+        for(const auto &pair: qi[i]) {
+            assert(qb[i].at(pair.first) == pair.second);
+            assert(qh[i].at(pair.first) == pair.second);
+        }
+    }
+    // Multi-probe: probed buckets include the exact ones, and batched topk matches per-query topk
+    const unsigned nprobes = 8, maxgather = 20;
+    auto mq = bulk.query(dm, nprobes);
+    auto tk = bulk.topk(dm, maxgather, nprobes);
+    size_t nexact = 0, nmulti = 0;
+    for(size_t i = 0; i < nsamp; ++i) {
+        nexact += qb[i].size(); nmulti += mq[i].size();
+        for(const auto &pair: qb[i]) assert(mq[i].at(pair.first) >= pair.second);
+        for(const auto &pair: mq[i]) assert(pair.second <= l);
+        if(i % 97) continue;
+        auto single = bulk.topk(row(dm, i), maxgather, nprobes);
+        assert(single == tk[i]);
+        assert(tk[i].size() == std::min(size_t(maxgather), mq[i].size()));
+        for(size_t j = 1; j < tk[i].size(); ++j) assert(tk[i][j - 1].second >= tk[i][j].second);
+        assert(tk[i][0].second == l && mq[i].at(i) == l);
+    }
+    std::fprintf(stderr, "Mean candidates: %g with 1 probe, %g with %u probes per table\n", double(nexact) / nsamp, double(nmulti) / nsamp, nprobes);
+    assert(nmulti > nexact);
+}
@@ -0,0 +1,95 @@
+#undef NDEBUG
+#include "include/minicore/clustering/solve.h"
+#include "include/minicore/optim/kmeans.h"
+
+using namespace minicore;
+
+template<typename T>
+void write_file(std::string path, const std::vector<T> &v) {
+    std::FILE *fp = std::fopen(path.data(), "wb");
+    assert(fp);
+    assert(std::fwrite(v.data(), sizeof(T), v.size(), fp) == v.size());
+    std::fclose(fp);
+}
+
+// Writes a small matrix in csc2sparse's on-disk layout and checks that the mmapped CSR matches it
+// and can be seeded, sampled and clustered without copying
+template<typename VT, typename IT>
+void run(const std::string &prefix, uint64_t seed) {
+    const uint32_t nfeat = 200, nsamples = 500;
+    std::vector<uint64_t> indptr{0};
+    std::vector<IT> indices;
+    std::vector<VT> data;
+    wy::WyRand<uint64_t> rng(seed);
+    for(uint32_t i = 0; i < nsamples; ++i) {
+        for(uint32_t j = 0; j < nfeat; ++j)
+            if(rng() % 10 == 0) indices.push_back(j), data.push_back(1 + rng() % 100);
+        indptr.push_back(indices.size());
+    }
+    write_file(prefix + "indptr.file", indptr);
+    write_file(prefix + "indices.file", indices);
+    write_file(prefix + "data.file", data);
+    write_file(prefix + "shape.file", std::vector<uint32_t>{nfeat, nsamples});
+    const auto sm = csc2sparse<double, uint64_t, IT, VT>(prefix);
+    util::MMapCSparseMatrix<VT, IT, uint64_t> mm(prefix);
+    assert(mm.rows() == sm.rows() && mm.columns() == sm.columns() && mm.nnz() == nonZeros(sm));
+    const blz::DV<double> rs1 = sum<blz::rowwise>(sm), rs2 = util::sum<blz::rowwise>(mm.view());
+    assert(blz::max(blz::abs(rs1 - rs2)) == 0.);
+    bool visited = false;
+    util::visit_mmap_csparse(prefix, [&](const auto &mat) {
+        static_assert(util::IsCSparseMatrix_v<std::decay_t<decltype(mat)>>, "Must be a CSparseMatrix");
+        assert(mat.nnz() == mm.nnz());
+        using MVT = typename std::decay_t<decltype(mat)>::ElementType;
+        visited = std::is_same_v<MVT, VT>;
+    });
+    assert(visited);
+    // Mismatched type widths are rejected
+    using BadVT = std::conditional_t<sizeof(VT) == sizeof(double), float, double>;
+    bool threw = false;
+    try {
+        util::MMapCSparseMatrix<BadVT, IT, uint64_t> bad(prefix);
+    } catch(const std::runtime_error &) {threw = true;}
+    assert(threw);
+    // kmeans++ seeding through an oracle over mapped rows
+    const unsigned k = 5;
+    const blz::DV<double> prior{1.};
+    const double psum = prior[0] * nfeat;
+    auto oracle = [&](size_t xi, size_t yi) {
+        return cmp::msr_with_prior<double>(dist::MKL, row(mm, yi), row(mm, xi), prior, psum, rs2[yi], rs2[xi]);
+    };
+    auto [ids, kmasn, kmcosts] = coresets::kmeanspp(oracle, rng, nsamples, k, static_cast<const double *>(nullptr));
+    assert(ids.size() == k);
+    assert(kmasn.size() == nsamples && kmcosts.size() == nsamples);
+    for(size_t i = 0; i < nsamples; ++i) assert(kmasn[i] < k);
+    for(const auto id: ids) assert(id < nsamples && kmcosts[id] <= 1e-10);
+    // Coreset sampling from the seeding solution
+    for(const auto sens: {coresets::BFL, coresets::LBK}) {
+        coresets::CoresetSampler<double, uint32_t> cs;
+        cs.make_sampler(nsamples, k, kmcosts.data(), kmasn.data(), static_cast<const double *>(nullptr), seed, sens);
+        assert(cs.ready());
+        coresets::IndexCoreset<uint32_t, double> ics(50);
+        cs.sample(ics, seed);
+        assert(ics.size() == 50);
+        for(size_t i = 0; i < ics.size(); ++i) assert(ics.indices_[i] < nsamples && ics.weights_[i] > 0.);
+    }
+    // Cluster directly from the mapping, starting from the kmeans++ centers
+    std::vector<blz::DV<double, blz::rowVector>> centers;
+    for(const auto id: ids) centers.emplace_back(row(sm, id));
+    auto mbcenters = centers, cscenters = centers;
+    blz::DV<uint32_t> asn(nsamples);
+    blz::DV<double> costs(nsamples);
+    clustering::perform_hard_clustering(mm, dist::MKL, prior, centers, asn, costs, static_cast<blz::DV<double> *>(nullptr), 1e-4, 5);
+    assert(blz::max(asn) < k);
+    clustering::perform_hard_minibatch_clustering(mm, dist::MKL, prior, mbcenters, asn, costs, static_cast<blz::DV<double> *>(nullptr), 100, 20, 5, 5, true, seed);
+    assert(blz::max(asn) < k);
+    clustering::hmb_coreset_clustering(mm, dist::MKL, prior, cscenters, asn, costs, static_cast<blz::DV<double> *>(nullptr), 100, 20, 2, 5, seed);
+    assert(blz::max(asn) < k);
+    for(const auto suf: {"indptr.file", "indices.file", "data.file", "shape.file"})
+        std::remove((prefix + suf).data());
+}
+
+int main(int argc, char *argv[]) {
+    const std::string prefix = argc > 1 ? argv[1]: "mmapcsrtest.";
+    run<uint16_t, uint32_t>(prefix, 13);
+    run<uint32_t, uint32_t>(prefix, 17);
+}
@@ -0,0 +1,58 @@
+#undef NDEBUG
+#include "minicore/graph/shortest_paths.h"
+#include "aesctr/wy.h"
+#include <random>
+
+using namespace minicore;
+
+// Multi-source distances and nearest-source labels match per-source Boost Dijkstra,
+// adding sources incrementally matches a single search, and concurrent searches share one graph.
+int main(int argc, char *argv[]) {
+    const size_t nv = argc > 1 ? std::atoi(argv[1]): 2000;
+    const size_t nsrc = argc > 2 ? std::atoi(argv[2]): 25;
+    using G = minicore::Graph<boost::undirectedS, float>;
+    using Vertex = typename boost::graph_traits<G>::vertex_descriptor;
+    wy::WyRand<uint64_t> rng(11);
+    std::uniform_real_distribution<float> urd;
+    G g(nv);
+    // A path keeps the graph connected; random chords make shortest paths nontrivial
+    for(size_t i = 1; i < nv; ++i) boost::add_edge(i - 1, i, 1.f + urd(rng), g);
+    for(size_t i = 0; i < 4 * nv; ++i) boost::add_edge(rng() % nv, rng() % nv, 10.f * urd(rng), g);
+    std::vector<Vertex> sources;
+    for(size_t i = 0; i < nsrc; ++i) sources.push_back(rng() % nv);
+    std::vector<float> dist(nv), ref(nv, std::numeric_limits<float>::max()), tmp(nv);
+    std::vector<Vertex> src(nv);
+    const G &cg = g;
+    assert(multi_source_dijkstra(cg, sources, dist.data(), src.data()) == nv);
+    for(const auto s: sources) {
+        boost::dijkstra_shortest_paths(g, s, boost::distance_map(tmp.data()));
+        for(size_t i = 0; i < nv; ++i) ref[i] = std::min(ref[i], tmp[i]);
+    }
+    for(size_t i = 0; i < nv; ++i)
+        assert(std::abs(dist[i] - ref[i]) <= 1e-4f * std::max(1.f, ref[i]) || !std::fprintf(stderr, "%zu: %g vs %g\n", i, dist[i], ref[i]));
+    // The label is a source that attains the distance
+    for(const auto s: flat_hash_set<Vertex>(sources.begin(), sources.end())) {
+        boost::dijkstra_shortest_paths(g, s, boost::distance_map(tmp.data()));
+        for(size_t i = 0; i < nv; ++i)
+            if(src[i] == s) assert(std::abs(tmp[i] - dist[i]) <= 1e-4f * std::max(1.f, dist[i]));
+    }
+    // Incremental seeding, as Thorup sampling does round by round
+    std::vector<float> inc(nv);
+    std::vector<Vertex> incsrc(nv);
+    for(size_t start = 0; start < nsrc; start += 7) {
+        const size_t end = std::min(nsrc, start + 7);
+        multi_source_dijkstra(cg, sources.begin() + start, sources.begin() + end, inc.data(), incsrc.data(), start == 0);
+    }
+    for(size_t i = 0; i < nv; ++i) assert(std::abs(inc[i] - dist[i]) <= 1e-4f * std::max(1.f, dist[i]));
+    // Searches from different source sets on one shared graph
+    std::vector<std::vector<float>> pdists(8, std::vector<float>(nv));
+    OMP_PFOR
+    for(size_t t = 0; t < pdists.size(); ++t)
+        multi_source_dijkstra(cg, sources.begin(), sources.begin() + std::min(nsrc, t + 1), pdists[t].data());
+    for(size_t t = 0; t < pdists.size(); ++t) {
+        std::vector<float> serial(nv);
+        multi_source_dijkstra(cg, sources.begin(), sources.begin() + std::min(nsrc, t + 1), serial.data());
+        assert(serial == pdists[t]);
+    }
+    std::fprintf(stderr, "multi-source Dijkstra matches Boost on %zu vertices and %zu sources\n", nv, nsrc);
+}
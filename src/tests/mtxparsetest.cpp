@@ -0,0 +1,47 @@
+#undef NDEBUG
+#include "include/minicore/util/csc.h"
+
+using namespace minicore;
+
+void write_file(std::string path, std::string contents) {
+    std::FILE *fp = std::fopen(path.data(), "w");
+    assert(fp);
+    assert(std::fwrite(contents.data(), 1, contents.size(), fp) == contents.size());
+    std::fclose(fp);
+}
+
+// Checks symmetric expansion and duplicate summation in mtx2sparse
+int main(int argc, char *argv[]) {
+    const std::string path = argc > 1 ? argv[1]: "mtxparsetest.mtx";
+    // General: duplicates are summed, rows are sorted by column
+    write_file(path, "%%MatrixMarket matrix coordinate real general\n% comment\n3 4 5\n"
+                     "1 3 2.5\n1 1 1\n3 4 -1\n1 3 0.5\n2 2 4\n");
+    auto g = mtx2sparse<double>(path);
+    assert(g.rows() == 3 && g.columns() == 4 && nonZeros(g) == 4);
+    assert(g(0, 0) == 1. && g(0, 2) == 3. && g(1, 1) == 4. && g(2, 3) == -1.);
+    // Symmetric: off-diagonal entries are mirrored, the diagonal is not duplicated
+    write_file(path, "%%MatrixMarket matrix coordinate real symmetric\n3 3 4\n"
+                     "1 1 2\n2 1 3\n3 2 5\n3 3 7\n");
+    auto s = mtx2sparse<double>(path);
+    assert(nonZeros(s) == 6);
+    assert(s(0, 0) == 2. && s(2, 2) == 7.);
+    assert(s(1, 0) == 3. && s(0, 1) == 3.);
+    assert(s(2, 1) == 5. && s(1, 2) == 5.);
+    // A duplicate across the triangle is summed with the mirrored entry
+    write_file(path, "%%MatrixMarket matrix coordinate real symmetric\n2 2 2\n2 1 1\n1 2 2\n");
+    auto sd = mtx2sparse<double>(path);
+    assert(nonZeros(sd) == 2 && sd(0, 1) == 3. && sd(1, 0) == 3.);
+    // Skew-symmetric: mirrored entries are negated
+    write_file(path, "%%MatrixMarket matrix coordinate real skew-symmetric\n3 3 2\n2 1 4\n3 1 -2\n");
+    auto k = mtx2sparse<double>(path);
+    assert(nonZeros(k) == 4);
+    assert(k(1, 0) == 4. && k(0, 1) == -4. && k(2, 0) == -2. && k(0, 2) == 2.);
+    // Pattern: entries are ones, and duplicates count
+    write_file(path, "%%MatrixMarket matrix coordinate pattern symmetric\n2 2 3\n1 1\n2 1\n2 1\n");
+    auto p = mtx2sparse<float>(path);
+    assert(nonZeros(p) == 3 && p(0, 0) == 1.f && p(1, 0) == 2.f && p(0, 1) == 2.f);
+    // Transposition
+    auto t = mtx2sparse<double>(path, true);
+    assert(t(0, 1) == 2.f);
+    std::remove(path.data());
+}
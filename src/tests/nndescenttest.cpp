@@ -0,0 +1,45 @@
+#undef NDEBUG
+#include "include/minicore/dist/nndescent.h"
+using namespace minicore;
+
+// Measures NN-Descent recall against exact kNN and checks the output layout matches make_knns
+template<typename MT>
+void check_recall(MT &mat, distance::DissimilarityMeasure msr, unsigned k, double minrecall) {
+    auto app = minicore::jsd::make_probdiv_applicator(mat, msr, distance::DIRICHLET);
+    const size_t np = app.size();
+    const bool isdist = distance::is_dissimilarity(msr);
+    auto exact = minicore::make_knns(app, k);
+    NNDescentOpts opts;
+    opts.seed = 13;
+    auto approx = minicore::make_knns_by_nndescent(app, k, opts);
+    assert(approx.size() == exact.size());
+    size_t hits = 0;
+    for(size_t i = 0; i < np; ++i) {
+        auto p = &approx[i * k], e = &exact[i * k];
+        std::set<uint32_t> truth, seen;
+        for(unsigned j = 0; j < k; ++j) truth.insert(e[j].second);
+        for(unsigned j = 0; j < k; ++j) {
+            assert(p[j].second != i);
+            assert(seen.insert(p[j].second).second);
+            assert(j == 0 || (isdist ? p[j - 1].first <= p[j].first: p[j - 1].first >= p[j].first));
+            hits += truth.count(p[j].second);
+        }
+    }
+    const double recall = double(hits) / (np * k);
+    std::fprintf(stderr, "%s: recall %g\n", distance::msr2str(msr), recall);
+    assert(recall >= minrecall);
+}
+
+int main() {
+    blaze::DynamicMatrix<float> mat = blaze::generate(1000, 50, [](auto x, auto y) {
+        return float(std::rand()) / RAND_MAX + (x * y) / 1000. / 50.;
+    });
+    for(const auto msr: {distance::MKL, distance::LLR, distance::ITAKURA_SAITO, distance::JSD}) {
+        blaze::DynamicMatrix<float> cpy = mat;
+        check_recall(cpy, msr, 10, .9);
+    }
+    auto app = minicore::jsd::make_probdiv_applicator(mat, distance::MKL, distance::DIRICHLET);
+    auto graph = minicore::make_approx_knn_graph(app, 10, false);
+    auto mst = minicore::knng2mst(graph);
+    std::fprintf(stderr, "mst size: %zu edges vs %zu nodes\n", mst.size(), app.size());
+}
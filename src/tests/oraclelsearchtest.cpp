@@ -0,0 +1,89 @@
+#undef NDEBUG
+#include "minicore/optim/oracle_lsearch.h"
+#include "minicore/util/timer.h"
+
+using namespace minicore;
+
+// Oracle local search matches the matrix-based fast swap: exhaustive candidates end at a single-swap local optimum,
+// D-sampled candidates with a small row cache reach similar cost, and the row cache does not change the result.
+int main(int argc, char *argv[]) {
+    const size_t n = argc > 1 ? std::atoi(argv[1]): 500;
+    const unsigned k = argc > 2 ? std::atoi(argv[2]): 10;
+    wy::WyRand<uint64_t> rng(13);
+    std::uniform_real_distribution<double> urd;
+    blaze::DynamicMatrix<double> pts(n, 2);
+    for(size_t i = 0; i < n; ++i) pts(i, 0) = urd(rng), pts(i, 1) = urd(rng);
+    size_t ncalls = 0;
+    auto oracle = [&](size_t i, size_t j) {
+        OMP_ATOMIC
+        ++ncalls;
+        return float(blaze::l2Norm(row(pts, i) - row(pts, j)));
+    };
+    blaze::DynamicMatrix<float> dm(n, n);
+    for(size_t i = 0; i < n; ++i)
+        for(size_t j = 0; j < n; ++j)
+            dm(i, j) = i == j ? 0.f: oracle(i, j);
+    ncalls = 0;
+
+    auto ref = make_kmed_lsearcher(dm, k, 1e-6, 7);
+    ref.fast_swap_ = true;
+    ref.run();
+    std::fprintf(stderr, "Matrix local search cost: %g\n", ref.current_cost_);
+
+    OracleLSearchOpts opts;
+    opts.seed = 7;
+    opts.eps = 1e-6;
+    opts.ncandidates = n;
+    auto full = make_oracle_kmed_lsearcher(oracle, n, k, opts);
+    util::Timer timer("exhaustive oracle search");
+    full.run();
+    timer.report();
+    assert(full.solution().size() == k);
+    assert(std::abs(full.current_cost_ - blaze::sum(blaze::min<blaze::columnwise>(rows(dm, full.solution())))) <= 1e-3 * full.current_cost_);
+    for(size_t u = 0; u < n; ++u)
+        assert(full.costs()[u] == dm(full.solution()[full.assignments()[u]], u));
+    // No single swap improves by more than the threshold
+    const double thresh = opts.eps * full.current_cost_ / k;
+    std::vector<uint32_t> sol = full.solution();
+    for(size_t f = 0; f < n; ++f) {
+        if(std::find(sol.begin(), sol.end(), f) != sol.end()) continue;
+        for(size_t s = 0; s < k; ++s) {
+            auto tmp = sol;
+            tmp[s] = f;
+            const double cost = blaze::sum(blaze::min<blaze::columnwise>(rows(dm, tmp)));
+            assert(full.current_cost_ - cost <= thresh + 1e-3);
+        }
+    }
+    assert(full.current_cost_ <= 1.1 * ref.current_cost_);
+    std::fprintf(stderr, "Exhaustive oracle cost: %g, %zu swaps, %zu distances\n", full.current_cost_, full.nswaps_, ncalls);
+
+    // D-sampled candidates and a cache of one batch
+    for(const double power: {1., 2.}) {
+        ncalls = 0;
+        OracleLSearchOpts sopts;
+        sopts.seed = 7;
+        sopts.eps = 1e-6;
+        sopts.power = power;
+        sopts.ncandidates = 4 * k;
+        sopts.batch = 8;
+        sopts.cache_rows = 8;
+        auto sampled = make_oracle_kmed_lsearcher(oracle, n, k, sopts);
+        sampled.run();
+        assert(std::abs(sampled.current_cost_ - blaze::sum(blaze::min<blaze::columnwise>(rows(dm, sampled.solution())))) <= 1e-3 * sampled.current_cost_);
+        assert(sampled.ndists_ >= ncalls); // Self-distances are not queried
+        std::fprintf(stderr, "D^%g-sampled oracle cost: %g, %zu swaps, %zu distances\n", power, sampled.current_cost_, sampled.nswaps_, ncalls);
+        assert(sampled.current_cost_ <= 1.25 * ref.current_cost_);
+        // A larger cache only saves oracle calls
+        sopts.cache_rows = n;
+        auto cached = make_oracle_kmed_lsearcher(oracle, n, k, sopts);
+        cached.run();
+        assert(cached.solution() == sampled.solution());
+        assert(cached.ndists_ <= sampled.ndists_);
+    }
+    // Starting from given facilities
+    auto warm = make_oracle_kmed_lsearcher(oracle, n, k, opts);
+    warm.init(full.solution().begin(), full.solution().end());
+    warm.run();
+    assert(warm.nswaps_ == 0);
+    assert(warm.solution() == full.solution());
+}
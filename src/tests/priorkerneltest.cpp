@@ -0,0 +1,42 @@
+#undef NDEBUG
+#include "include/minicore/dist.h"
+#include "src/tests/solvetestdata.cpp"
+
+using namespace minicore;
+
+// Checks SparsePriorKernel against msr_with_prior for sparse rows and dense centers
+int main(int argc, char *argv[]) {
+    const unsigned k = argc > 1 ? std::atoi(argv[1]): 10;
+    // Sparsify the fixture so that zero coordinates matter
+    blaze::CompressedMatrix<double> sx = x;
+    for(size_t i = 0; i < sx.rows(); ++i)
+        for(auto it = sx.begin(i); it != sx.end(i); ++it)
+            if(it->value() < 12.) it->value() = 0.;
+    sx.erase([](double v) {return v == 0.;});
+    const size_t nr = std::min(sx.rows(), size_t(1000));
+    const blz::DV<double> rowsums = blaze::sum<blaze::rowwise>(sx);
+    std::vector<blz::DV<double, blz::rowVector>> centers;
+    for(unsigned i = 0; i < k; ++i) centers.emplace_back(row(sx, (i * 7919) % sx.rows()) + row(sx, (i * 104729 + 1) % sx.rows()));
+    blz::DV<double> ctrsums = blaze::generate(k, [&](auto j) {return sum(centers[j]);});
+    for(const double pv: {1., 0.01}) {
+        const blz::DV<double, blz::rowVector> prior{pv};
+        const double prior_sum = pv * sx.columns();
+        for(const auto msr: {dist::MKL, dist::REVERSE_MKL, dist::HELLINGER, dist::BHATTACHARYYA_METRIC, dist::BHATTACHARYYA_DISTANCE,
+                             dist::TVD, dist::JSD, dist::JSM, dist::LLR, dist::UWLLR}) {
+            SparsePriorKernel<double> kernel(msr, pv, sx.columns());
+            kernel.set_centers(centers, ctrsums);
+            double maxerr = 0.;
+            for(size_t i = 0; i < nr; ++i) {
+                for(unsigned j = 0; j < k; ++j) {
+                    const blz::CompressedVector<double, blz::rowVector> sc = centers[j];
+                    const double expected = cmp::msr_with_prior<double>(msr, row(sx, i), sc, prior, prior_sum, rowsums[i], ctrsums[j]);
+                    const double got = kernel(row(sx, i), rowsums[i], j);
+                    const double err = std::abs(got - expected) / std::max(1e-3, std::abs(expected));
+                    maxerr = std::max(maxerr, err);
+                    assert(err < 1e-6 || !std::fprintf(stderr, "%s row %zu center %u: %0.12g vs %0.12g\n", dist::msr2str(msr), i, j, got, expected));
+                }
+            }
+            std::fprintf(stderr, "%s, prior %g: max relative error %g\n", dist::msr2str(msr), pv, maxerr);
+        }
+    }
+}
@@ -0,0 +1,78 @@
+#undef NDEBUG
+#include "include/minicore/clustering/solve.h"
+#include "src/tests/solvetestdata.cpp"
+
+using namespace minicore;
+
+// Checks that minibatch soft clustering reaches a cost comparable to full soft EM,
+// for dense and sparse rows, each step-size schedule, and importance sampling
+template<typename MT>
+double run(const MT &mat, dist::DissimilarityMeasure msr, unsigned k, int64_t mbsize, const clustering::SoftMinibatchOpts &opts, double &initcost, bool dense=true) {
+    const blz::DV<double, blz::rowVector> prior{1.};
+    std::vector<blz::DV<double, blz::rowVector>> centers;
+    for(unsigned i = 0; i < k; ++i) centers.emplace_back(row(mat, (i * 7919) % mat.rows()));
+    const blz::DV<double> rowsums = blaze::sum<blaze::rowwise>(mat);
+    blz::DV<double> ctrsums = blaze::generate(k, [&](auto j) {return sum(centers[j]);});
+    blz::DM<double> costs(mat.rows(), k), asns(mat.rows(), k);
+    clustering::set_soft_costs<double>(mat, msr, prior, centers, costs, ctrsums, rowsums);
+    asns = blaze::softmax<blaze::rowwise>(costs * -1.);
+    initcost = sum(costs % asns);
+    // Without dense outputs, the minibatch path must not form n x k matrices
+    blz::DM<double> nocosts, noasns;
+    auto [ic, fc, niter] = clustering::perform_soft_clustering(mat, msr, prior, centers, dense ? costs: nocosts, dense ? asns: noasns, 1., 10, mbsize, 20,
+                                                               static_cast<blz::DV<double> *>(nullptr), clustering::DEFAULT_EPS, opts);
+    for(const auto &c: centers) assert(!isnan(c));
+    if(!dense) {
+        assert(nocosts.rows() == 0 && noasns.rows() == 0);
+        ctrsums = blaze::generate(k, [&](auto j) {return sum(centers[j]);});
+        clustering::set_soft_costs<double>(mat, msr, prior, centers, costs, ctrsums, rowsums);
+        asns = blaze::softmax<blaze::rowwise>(costs * -1.);
+        fc = sum(costs % asns);
+    }
+    assert(blaze::min(asns) >= 0.);
+    for(size_t i = 0; i < asns.rows(); ++i)
+        assert(std::abs(sum(row(asns, i)) - 1.) < 1e-6);
+    std::fprintf(stderr, "%s, mbsize %zd, %s: %0.12g (first pass %0.12g) -> %0.12g in %zu iterations\n", dist::msr2str(msr), std::ptrdiff_t(mbsize), opts.to_string().data(), initcost, ic, fc, niter);
+    return fc;
+}
+
+int main(int argc, char *argv[]) {
+    const unsigned k = argc > 1 ? std::atoi(argv[1]): 10;
+    const size_t nr = std::min(x.rows(), size_t(2000));
+    blaze::DynamicMatrix<double> dx = submatrix(x, 0, 0, nr, x.columns());
+    blaze::CompressedMatrix<double> sx = dx;
+    for(size_t i = 0; i < sx.rows(); ++i)
+        for(auto it = sx.begin(i); it != sx.end(i); ++it)
+            if(it->value() < 12.) it->value() = 0.;
+    sx.erase([](double v) {return v == 0.;});
+    for(const auto msr: {dist::MKL, dist::JSD, dist::SQRL2}) {
+        double initcost;
+        const double full = run(sx, msr, k, -1, clustering::SoftMinibatchOpts(), initcost);
+        for(const auto sched: {clustering::POWER_STEP, clustering::CONSTANT_STEP, clustering::CUMULATIVE_STEP}) {
+            for(const bool is: {false, true}) {
+                clustering::SoftMinibatchOpts opts;
+                opts.schedule = sched;
+                opts.importance_sampling = is;
+                opts.seed = 13;
+                double mbinit;
+                const double mb = run(sx, msr, k, 200, opts, mbinit);
+                // Minibatch steps should improve on the starting centers and land near the full-batch optimum
+                assert(mb < mbinit || !std::fprintf(stderr, "mb cost %g did not improve on %g\n", mb, mbinit));
+                assert(mb < full * 1.25 || !std::fprintf(stderr, "mb cost %g vs full %g\n", mb, full));
+            }
+        }
+        double dinit;
+        clustering::SoftMinibatchOpts opts;
+        opts.seed = 13;
+        const double dmb = run(dx, msr, k, 200, opts, dinit);
+        assert(dmb < dinit);
+        // Objective estimated on a sample of rows, with occasional full passes
+        opts.eval_size = 400;
+        opts.refresh_every = 3;
+        opts.importance_sampling = true;
+        double sinit;
+        const double smb = run(sx, msr, k, 200, opts, sinit, /*dense=*/false);
+        assert(smb < sinit);
+        assert(smb < full * 1.25 || !std::fprintf(stderr, "sampled-objective mb cost %g vs full %g\n", smb, full));
+    }
+}
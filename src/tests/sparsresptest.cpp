@@ -0,0 +1,66 @@
+#undef NDEBUG
+#include "include/minicore/clustering/solve.h"
+#include "src/tests/solvetestdata.cpp"
+
+using namespace minicore;
+
+// Checks truncated (CSR) responsibilities against dense soft assignments and the dense M-step
+int main(int argc, char *argv[]) {
+    const unsigned k = argc > 1 ? std::atoi(argv[1]): 10;
+    const size_t nr = std::min(x.rows(), size_t(1000));
+    blaze::DynamicMatrix<double> dx = submatrix(x, 0, 0, nr, x.columns());
+    const blz::DV<double, blz::rowVector> prior{1.};
+    const double prior_sum = dx.columns();
+    const blz::DV<double> rowsums = blaze::sum<blaze::rowwise>(dx);
+    std::vector<blz::DV<double, blz::rowVector>> centers;
+    for(unsigned i = 0; i < k; ++i) centers.emplace_back(row(dx, (i * 7919) % nr));
+    blz::DV<double> ctrsums = blaze::generate(k, [&](auto j) {return sum(centers[j]);});
+    const auto msr = dist::MKL;
+    const double temp = 1e-3;
+    blz::DM<double> costs = blaze::generate(nr, k, [&](auto i, auto j) {
+        return cmp::msr_with_prior<double>(msr, row(dx, i), centers[j], prior, prior_sum, rowsums[i], ctrsums[j]);
+    });
+    auto costfunc = [&](size_t i, size_t j) {return costs(i, j);};
+    auto unit = [](size_t) {return 1.;};
+    // 1. m = k keeps everything and matches the dense softmax
+    clustering::SparseResponsibilities<double> resp;
+    resp.build(nr, k, k, 0., temp, costfunc, unit);
+    assert(resp.nnz() == nr * k);
+    blz::DM<double> asns = blaze::softmax<blaze::rowwise>(costs * -temp);
+    for(size_t i = 0; i < nr; ++i) {
+        double rsum = 0.;
+        for(size_t n = resp.offsets_[i]; n < resp.offsets_[i + 1]; ++n) {
+            assert(std::abs(resp.data_[n] - asns(i, resp.indices_[n])) < 1e-10);
+            assert(n == resp.offsets_[i] || resp.costs_[n - 1] <= resp.costs_[n]);
+            rsum += resp.data_[n];
+        }
+        assert(std::abs(rsum - 1.) < 1e-10);
+    }
+    // 2. The sparse M-step matches the dense one
+    auto dctrs = centers, sctrs = centers;
+    blz::DV<double> dsums = ctrsums, ssums = ctrsums;
+    blz::DM<double> dcosts = costs, dasns(nr, k);
+    clustering::set_centroids_full_mean(dx, msr, prior, dcosts, dasns, dctrs, static_cast<blz::DV<double> *>(nullptr), temp, dsums, rowsums);
+    clustering::set_centroids_sparse_soft<double>(dx, msr, resp, sctrs, static_cast<blz::DV<double> *>(nullptr), ssums, rowsums);
+    for(unsigned j = 0; j < k; ++j) {
+        const double err = blz::max(blz::abs(dctrs[j] - sctrs[j])) / std::max(1e-10, blz::max(blz::abs(dctrs[j])));
+        assert(err < 1e-8 || !std::fprintf(stderr, "center %u differs by %g\n", j, err));
+    }
+    // 3. Truncation: at most m per row, nearest center first
+    const size_t m = 3;
+    resp.build(nr, k, m, 1e-4, temp, costfunc, unit);
+    assert(resp.nnz() <= nr * m);
+    for(size_t i = 0; i < nr; ++i) {
+        assert(resp.size(i) >= 1 && resp.size(i) <= m);
+        const auto bi = std::min_element(row(costs, i).begin(), row(costs, i).end()) - row(costs, i).begin();
+        assert(costs(i, resp.hard_assignment(i)) == costs(i, bi));
+    }
+    std::fprintf(stderr, "With m = %zu and threshold 1e-4, kept %zu of %zu responsibilities\n", m, resp.nnz(), nr * k);
+    // 4. Full clustering on sparse rows
+    blaze::CompressedMatrix<double> sx = dx;
+    clustering::SparseResponsibilities<float> fresp;
+    auto [initcost, finalcost, niter] = clustering::perform_sparse_soft_clustering(sx, msr, prior, centers, fresp, m, 0., temp, 20);
+    std::fprintf(stderr, "Truncated soft clustering: %0.12g -> %0.12g in %zu iterations\n", initcost, finalcost, niter);
+    assert(finalcost <= initcost);
+    assert(fresp.rows() == nr);
+}
@@ -0,0 +1,45 @@
+#include "minicore/util/csc.h"
+#include <getopt.h>
+
+void usage() {
+    std::fprintf(stderr, "Usage: mtxloadbench <flags> input.mtx[.gz]\n"
+                         "Times the serial stream loader against the parallel loader and compares their output.\n"
+                         "The parallel loader expands symmetric files and sums duplicate entries, and the stream loader does not,\n"
+                         "so such inputs are reported as differing without failing.\n"
+                         "-d: use doubles, not float.\n-p: number of threads [default: all]\n-s: skip the serial loader\n");
+    std::exit(EXIT_FAILURE);
+}
+
+template<typename FT>
+int run(std::string in, bool skip_serial) {
+    using minicore::util::hrc;
+    using minicore::util::timediff2ms;
+    auto start = hrc::now();
+    auto fast = minicore::util::mtx2sparse<FT>(in);
+    const double tfast = timediff2ms(start, hrc::now());
+    std::fprintf(stdout, "parallel\t%zu\t%zu\t%zu\t%gms\n", fast.rows(), fast.columns(), nonZeros(fast), tfast);
+    if(skip_serial) return 0;
+    start = hrc::now();
+    auto slow = minicore::util::mtx2sparse_stream<FT>(in);
+    const double tslow = timediff2ms(start, hrc::now());
+    std::fprintf(stdout, "serial\t%zu\t%zu\t%zu\t%gms\n", slow.rows(), slow.columns(), nonZeros(slow), tslow);
+    std::fprintf(stdout, "speedup\t%g\n", tslow / tfast);
+    if(fast != slow)
+        std::fprintf(stderr, "Warning: loaded matrices differ (%zu vs %zu nonzeros). Expected for symmetric files or duplicate entries.\n",
+                     nonZeros(fast), nonZeros(slow));
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    bool use_float = true, skip_serial = false;
+    for(int c;(c = getopt(argc, argv, "p:dsh?")) >= 0;) {
+        switch(c) {
+            case 'd': use_float = false; break;
+            case 's': skip_serial = true; break;
+            case 'p': OMP_ONLY(omp_set_num_threads(std::atoi(optarg));) break;
+            default: usage();
+        }
+    }
+    if(optind == argc) usage();
+    return use_float ? run<float>(argv[optind], skip_serial): run<double>(argv[optind], skip_serial);
+}